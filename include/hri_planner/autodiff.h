@@ -0,0 +1,226 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#ifndef HRI_PLANNER_AUTODIFF_H
+#define HRI_PLANNER_AUTODIFF_H
+
+#include <cmath>
+
+namespace hri_planner {
+namespace autodiff {
+
+// calls f(0), ..., f(N-1), unrolled at compile time
+// GCC only unrolls the fixed-size loops at -O3, and the derivative arrays need them unrolled to stay in registers
+template <int N>
+struct Unroll {
+    template <typename F>
+    static inline void apply(const F& f) {
+        Unroll<N-1>::apply(f);
+        f(N-1);
+    }
+};
+
+template <>
+struct Unroll<0> {
+    template <typename F>
+    static inline void apply(const F& f) {}
+};
+
+// forward-mode dual number with N derivative directions
+// nesting (Dual<Dual<double, N1>, N2>) gives second derivatives, all sizes are known at compile time
+template <typename T, int N>
+struct Dual {
+    T v;
+    T d[N];
+
+    Dual() = default;
+
+    // constant
+    template <typename V>
+    explicit Dual(const V& val): v(val) {
+        Unroll<N>::apply([&](int i) { d[i] = T(0.0); });
+    }
+
+    // variable i
+    template <typename V>
+    Dual(const V& val, int i): Dual(val) {
+        d[i] = T(1.0);
+    }
+};
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> operator-(const Dual<T, N>& a)
+{
+    Dual<T, N> r;
+    r.v = -a.v;
+    Unroll<N>::apply([&](int i) { r.d[i] = -a.d[i]; });
+    return r;
+}
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> operator+(const Dual<T, N>& a, const Dual<T, N>& b)
+{
+    Dual<T, N> r;
+    r.v = a.v + b.v;
+    Unroll<N>::apply([&](int i) { r.d[i] = a.d[i] + b.d[i]; });
+    return r;
+}
+
+template <typename T, int N>
+inline Dual<T, N> operator+(const Dual<T, N>& a, double b)
+{
+    Dual<T, N> r = a;
+    r.v = a.v + b;
+    return r;
+}
+
+template <typename T, int N>
+inline Dual<T, N> operator+(double a, const Dual<T, N>& b)
+{
+    return b + a;
+}
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> operator-(const Dual<T, N>& a, const Dual<T, N>& b)
+{
+    Dual<T, N> r;
+    r.v = a.v - b.v;
+    Unroll<N>::apply([&](int i) { r.d[i] = a.d[i] - b.d[i]; });
+    return r;
+}
+
+template <typename T, int N>
+inline Dual<T, N> operator-(const Dual<T, N>& a, double b)
+{
+    Dual<T, N> r = a;
+    r.v = a.v - b;
+    return r;
+}
+
+template <typename T, int N>
+inline Dual<T, N> operator-(double a, const Dual<T, N>& b)
+{
+    return -b + a;
+}
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> operator*(const Dual<T, N>& a, const Dual<T, N>& b)
+{
+    Dual<T, N> r;
+    r.v = a.v * b.v;
+    Unroll<N>::apply([&](int i) { r.d[i] = a.d[i] * b.v + a.v * b.d[i]; });
+    return r;
+}
+
+template <typename T, int N>
+inline Dual<T, N> operator*(const Dual<T, N>& a, double b)
+{
+    Dual<T, N> r;
+    r.v = a.v * b;
+    Unroll<N>::apply([&](int i) { r.d[i] = a.d[i] * b; });
+    return r;
+}
+
+template <typename T, int N>
+inline Dual<T, N> operator*(double a, const Dual<T, N>& b)
+{
+    return b * a;
+}
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> operator/(const Dual<T, N>& a, const Dual<T, N>& b)
+{
+    // (a / b)' = (a' - (a / b) * b') / b
+    Dual<T, N> r;
+    T b_inv = 1.0 / b.v;
+    r.v = a.v * b_inv;
+    Unroll<N>::apply([&](int i) { r.d[i] = (a.d[i] - r.v * b.d[i]) * b_inv; });
+    return r;
+}
+
+template <typename T, int N>
+inline Dual<T, N> operator/(const Dual<T, N>& a, double b)
+{
+    return a * (1.0 / b);
+}
+
+template <typename T, int N>
+inline Dual<T, N> operator/(double a, const Dual<T, N>& b)
+{
+    Dual<T, N> r;
+    T b_inv = 1.0 / b.v;
+    r.v = a * b_inv;
+    Unroll<N>::apply([&](int i) { r.d[i] = -r.v * b.d[i] * b_inv; });
+    return r;
+}
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> exp(const Dual<T, N>& a)
+{
+    using std::exp;
+
+    Dual<T, N> r;
+    r.v = exp(a.v);
+    Unroll<N>::apply([&](int i) { r.d[i] = a.d[i] * r.v; });
+    return r;
+}
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> sqrt(const Dual<T, N>& a)
+{
+    using std::sqrt;
+
+    Dual<T, N> r;
+    r.v = sqrt(a.v);
+    T den_inv = 0.5 / r.v;
+    Unroll<N>::apply([&](int i) { r.d[i] = a.d[i] * den_inv; });
+    return r;
+}
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> sin(const Dual<T, N>& a)
+{
+    using std::sin;
+    using std::cos;
+
+    Dual<T, N> r;
+    r.v = sin(a.v);
+    T c = cos(a.v);
+    Unroll<N>::apply([&](int i) { r.d[i] = a.d[i] * c; });
+    return r;
+}
+
+//----------------------------------------------------------------------------------
+template <typename T, int N>
+inline Dual<T, N> cos(const Dual<T, N>& a)
+{
+    using std::sin;
+    using std::cos;
+
+    Dual<T, N> r;
+    r.v = cos(a.v);
+    T s = -sin(a.v);
+    Unroll<N>::apply([&](int i) { r.d[i] = a.d[i] * s; });
+    return r;
+}
+
+} // namespace autodiff
+} // namespace
+
+#endif //HRI_PLANNER_AUTODIFF_H
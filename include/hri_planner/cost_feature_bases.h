@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/7/2018
-// Last revision: 3/31/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -15,6 +15,7 @@
 #include <Eigen/Dense>
 
 #include "hri_planner/trajectory.h"
+#include "hri_planner/workspace.h"
 
 namespace hri_planner {
 
@@ -37,6 +38,12 @@ public:
     virtual void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) = 0;
     virtual void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) = 0;
 
+    // gradients w.r.t. the states and the direct gradients w.r.t. the controls, for the adjoint pass
+    // the full control gradient is grad_u + Ju^T * grad_x (see Trajectory::backprop)
+    // the default falls back to grad_uh/grad_ur, which need the jacobian blocks
+    virtual void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u);
+    virtual void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u);
+
     // set additional data
     virtual void set_data(const void* data) = 0;
 
@@ -44,6 +51,14 @@ public:
     void compute_nr(const Trajectory& robot_traj, const Trajectory& human_traj, double& cost) {
         cost = compute(robot_traj, human_traj);
     }
+
+protected:
+    // hess = sum_t Ju1_t^T * H_t * Ju2_t for costs that are sums of per-step terms
+    // Ju1_t are the rows of traj1.Ju for the states [s1, s1 + H.rows()) at step t, Ju2_t those of traj2.Ju
+    // starting at state s2, H holds the per-step blocks side by side
+    // only the first (t+1) * nU columns of Ju_t are non-zero, so this is far cheaper than Ju^T * hess_x * Ju
+    static void step_hessian(const Trajectory& traj1, int s1, const Trajectory& traj2, int s2,
+                             ConstMatRef& H, MatRef hess);
 };
 
 class FeatureTwiceDiff: public FeatureBase {
@@ -57,13 +72,17 @@ public:
 };
 
 // commonly used Gaussian feature for collision avoidance
+// outputs must be sized by the caller
 class GaussianCost {
+    typedef const Eigen::Ref<const Eigen::VectorXd> ConstVecRef;
 public:
-    static double compute(const Eigen::VectorXd& x, const int nX, const int T, const double a, const double b);
-    static void grad(const Eigen::VectorXd& x, const int nX, const int T,
-                     const double a, const double b, Eigen::VectorXd& grad);
-    static void hessian(const Eigen::VectorXd& x, const int nX1, const int nX2, const int T,
-                        const double a, const double b, Eigen::MatrixXd& hess);
+    static double compute(ConstVecRef& x, const int nX, const int T, const double a, const double b);
+    static void grad(ConstVecRef& x, const int nX, const int T,
+                     const double a, const double b, Eigen::Ref<Eigen::VectorXd> grad);
+
+    // the 2 x 2 hessian of each step, side by side in a 2 x 2T matrix
+    static void hessian(ConstVecRef& x, const int T, const double a, const double b,
+                        Eigen::Ref<Eigen::MatrixXd> hess);
 };
 
 }
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/8/2018
-// Last revision: 3/25/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -53,6 +53,12 @@ public:
         grad.setZero();
     };
 
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj,
+                 VecRef grad_x, VecRef grad_u) override {
+        grad_x.setZero();
+        grad_u.setZero();
+    };
+
     void hessian_uh_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override
     {
         hess.setZero();
@@ -63,6 +69,7 @@ public:
 class HumanVelCost: public FeatureHumanCostNonInt {
 public:
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
     void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
 
     double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
@@ -73,6 +80,7 @@ public:
 class HumanAccCost: public FeatureHumanCostNonInt {
 public:
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
     void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
 
     double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
@@ -80,11 +88,13 @@ public:
     void set_data(const void* data) override {};
 };
 
+// reg smooths the distance to the goal, sqrt(d^2 + reg^2), so the hessian stays bounded
 class HumanGoalCost: public FeatureHumanCostNonInt {
 public:
     explicit HumanGoalCost(const Eigen::VectorXd& x_goal, double reg=1e-2): x_goal_(x_goal), reg_(reg) {};
 
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
     void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
 
     double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
@@ -102,6 +112,7 @@ class HumanObsCost: public FeatureHumanCostNonInt {
 public:
     explicit HumanObsCost(const Eigen::VectorXd& x_obs): x_obs_(x_obs) {};
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
     void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
 
     double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
@@ -121,6 +132,8 @@ public:
 
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
     void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
     void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
     void hessian_uh_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
 
@@ -139,6 +152,8 @@ public:
     DynCollisionCost(double Rx, double Ry, double d): Rx_(Rx), Ry_(Ry), d_(d) {};
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
     void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
     void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
     void hessian_uh_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
 
@@ -162,18 +177,23 @@ class RobotControlCost: public FeatureRobotCost {
 public:
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
     void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
 
     double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
 
     void set_data(const void* data) override {};
 };
 
+// smoothed distance to the goal, same as HumanGoalCost
 class RobotGoalCost: public FeatureRobotCost {
 public:
     explicit RobotGoalCost(const Eigen::VectorXd& x_goal, double reg=1e-2): x_goal_(x_goal), reg_(reg) {};
 
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
     void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
 
     double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
 
@@ -0,0 +1,252 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#ifndef HRI_PLANNER_COST_FEATURES_AUTODIFF_H
+#define HRI_PLANNER_COST_FEATURES_AUTODIFF_H
+
+#include "hri_planner/autodiff.h"
+#include "hri_planner/cost_features.h"
+
+namespace hri_planner {
+
+// human cost feature that is a sum of per-step terms, with all derivatives from automatic differentiation
+// the per-step derivatives w.r.t. the states are computed in forward mode, and then taken to the
+// controls by the adjoint products of the trajectory jacobians
+//
+// a Term provides:
+//   enum { nXh = ..., nXr = ... };  - number of leading human/robot states it depends on
+//   template <typename S> S operator()(const S* xh, const S* xr) const;
+//   void set_data(const void* data);
+template <typename Term>
+class AutoDiffHumanCost: public FeatureHumanCost {
+    enum { nH = Term::nXh, nR = Term::nXr };
+
+    typedef autodiff::Dual<double, nH> DualH;
+    typedef autodiff::Dual<double, nR> DualR;
+    typedef autodiff::Dual<DualH, nH> DualHH;
+    typedef autodiff::Dual<DualH, nR> DualHR;
+public:
+    explicit AutoDiffHumanCost(const Term& term): term_(term) {};
+
+    double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
+
+    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
+    void hessian_uh_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
+
+    void set_data(const void* data) override {
+        term_.set_data(data);
+    };
+
+    const Term& term() const {
+        return term_;
+    }
+
+private:
+    Term term_;
+};
+
+//! gaussian collision avoidance, same as CollisionCost
+struct CollisionTerm {
+    enum { nXh = 2, nXr = 2 };
+
+    explicit CollisionTerm(double R_): R(R_) {};
+
+    template <typename S>
+    S operator()(const S* xh, const S* xr) const {
+        using std::exp;
+
+        S x = (xr[0] - xh[0]) / R;
+        S y = (xr[1] - xh[1]) / R;
+        return exp(-(x * x + y * y));
+    }
+
+    void set_data(const void* data) {
+        R = *static_cast<const double*>(data);
+    }
+
+    double R;
+};
+
+//! gaussian centered in front of the robot, same as DynCollisionCost
+struct DynCollisionTerm {
+    enum { nXh = 2, nXr = 3 };
+
+    DynCollisionTerm(double Rx_, double Ry_, double d_): Rx(Rx_), Ry(Ry_), d(d_) {};
+
+    template <typename S>
+    S operator()(const S* xh, const S* xr) const {
+        using std::exp;
+        using std::cos;
+        using std::sin;
+
+        S c = cos(xr[2]);
+        S s = sin(xr[2]);
+        S dx = xh[0] - xr[0];
+        S dy = xh[1] - xr[1];
+
+        // position in the robot frame, relative to the center of the gaussian
+        S x = (c * dx + s * dy - d) / Rx;
+        S y = (c * dy - s * dx) / Ry;
+        return exp(-(x * x + y * y));
+    }
+
+    void set_data(const void* data) {
+        auto data_vec = static_cast<const double*>(data);
+        Rx = data_vec[0];
+        Ry = data_vec[1];
+        d = data_vec[2];
+    }
+
+    double Rx;
+    double Ry;
+    double d;
+};
+
+//----------------------------------------------------------------------------------
+template <typename Term>
+double AutoDiffHumanCost<Term>::compute(const Trajectory &robot_traj, const Trajectory &human_traj)
+{
+    double cost = 0.0;
+
+    int nXr = robot_traj.state_size();
+    int nXh = human_traj.state_size();
+    for (int t = 0; t < human_traj.horizon(); ++t)
+        cost += term_(human_traj.x.data() + t * nXh, robot_traj.x.data() + t * nXr);
+
+    return cost;
+}
+
+//----------------------------------------------------------------------------------
+template <typename Term>
+void AutoDiffHumanCost<Term>::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(human_traj.traj_state_size());
+    grad_xh(robot_traj, human_traj, grad_x, grad);
+
+    human_traj.Ju_blocks.transpose_mult(grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+template <typename Term>
+void AutoDiffHumanCost<Term>::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(robot_traj.traj_state_size());
+    grad_xr(robot_traj, human_traj, grad_x, grad);
+
+    robot_traj.Ju_blocks.transpose_mult(grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+template <typename Term>
+void AutoDiffHumanCost<Term>::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                     VecRef grad_x, VecRef grad_u)
+{
+    int nXr = robot_traj.state_size();
+    int nXh = human_traj.state_size();
+
+    DualH xh[nH];
+    DualH xr[nR];
+
+    grad_x.setZero();
+    for (int t = 0; t < human_traj.horizon(); ++t) {
+        autodiff::Unroll<nH>::apply([&](int i) { xh[i] = DualH(human_traj.x(t * nXh + i), i); });
+        autodiff::Unroll<nR>::apply([&](int i) { xr[i] = DualH(robot_traj.x(t * nXr + i)); });
+
+        DualH c = term_(xh, xr);
+        autodiff::Unroll<nH>::apply([&](int i) { grad_x(t * nXh + i) = c.d[i]; });
+    }
+
+    grad_u.setZero();
+}
+
+//----------------------------------------------------------------------------------
+template <typename Term>
+void AutoDiffHumanCost<Term>::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                     VecRef grad_x, VecRef grad_u)
+{
+    int nXr = robot_traj.state_size();
+    int nXh = human_traj.state_size();
+
+    DualR xh[nH];
+    DualR xr[nR];
+
+    grad_x.setZero();
+    for (int t = 0; t < robot_traj.horizon(); ++t) {
+        autodiff::Unroll<nH>::apply([&](int i) { xh[i] = DualR(human_traj.x(t * nXh + i)); });
+        autodiff::Unroll<nR>::apply([&](int i) { xr[i] = DualR(robot_traj.x(t * nXr + i), i); });
+
+        DualR c = term_(xh, xr);
+        autodiff::Unroll<nR>::apply([&](int i) { grad_x(t * nXr + i) = c.d[i]; });
+    }
+
+    grad_u.setZero();
+}
+
+//----------------------------------------------------------------------------------
+template <typename Term>
+void AutoDiffHumanCost<Term>::hessian_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef hess)
+{
+    int T = human_traj.horizon();
+    int nXr = robot_traj.state_size();
+    int nXh = human_traj.state_size();
+
+    // both levels differentiate w.r.t. the human states
+    DualHH xh[nH];
+    DualHH xr[nR];
+
+    Scratch<Eigen::MatrixXd> hess_x(nH, T * nH);
+    for (int t = 0; t < T; ++t) {
+        autodiff::Unroll<nH>::apply([&](int i) { xh[i] = DualHH(DualH(human_traj.x(t * nXh + i), i), i); });
+        autodiff::Unroll<nR>::apply([&](int i) { xr[i] = DualHH(robot_traj.x(t * nXr + i)); });
+
+        DualHH c = term_(xh, xr);
+        for (int j = 0; j < nH; ++j) {
+            autodiff::Unroll<nH>::apply([&](int i) { hess_x(i, t * nH + j) = c.d[j].d[i]; });
+        }
+    }
+
+    step_hessian(human_traj, 0, human_traj, 0, hess_x, hess);
+}
+
+//----------------------------------------------------------------------------------
+template <typename Term>
+void AutoDiffHumanCost<Term>::hessian_uh_ur(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                            MatRef hess)
+{
+    int T = human_traj.horizon();
+    int nXr = robot_traj.state_size();
+    int nXh = human_traj.state_size();
+
+    // inner level w.r.t. the human states, outer level w.r.t. the robot states
+    DualHR xh[nH];
+    DualHR xr[nR];
+
+    Scratch<Eigen::MatrixXd> hess_x(nH, T * nR);
+    for (int t = 0; t < T; ++t) {
+        autodiff::Unroll<nH>::apply([&](int i) { xh[i] = DualHR(DualH(human_traj.x(t * nXh + i), i)); });
+        autodiff::Unroll<nR>::apply([&](int i) { xr[i] = DualHR(DualH(robot_traj.x(t * nXr + i)), i); });
+
+        DualHR c = term_(xh, xr);
+        for (int j = 0; j < nR; ++j) {
+            autodiff::Unroll<nH>::apply([&](int i) { hess_x(i, t * nR + j) = c.d[j].d[i]; });
+        }
+    }
+
+    step_hessian(human_traj, 0, robot_traj, 0, hess_x, hess);
+}
+
+}
+
+#endif //HRI_PLANNER_COST_FEATURES_AUTODIFF_H
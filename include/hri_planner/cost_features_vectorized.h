@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/18/2018
-// Last revision: 4/26/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -13,22 +13,51 @@
 #define HRI_PLANNER_COST_FEATURES_VECTORIZED_H
 
 #include <memory>
+#include <vector>
 
 #include <Eigen/Dense>
 
 #include "hri_planner/trajectory.h"
+#include "hri_planner/workspace.h"
 
 namespace hri_planner {
 
+// the jacobians of the cost sequences are block lower-triangular, row t only depends on the controls
+// up to step t, so only its first (t+1) * nU entries are used, the rest is neither written nor read
+void tril_set_zero(Eigen::Ref<Eigen::MatrixXd> J, int nU);
+
+// J += w * J_src over the lower part
+void tril_add(double w, const Eigen::Ref<const Eigen::MatrixXd>& J_src, int nU, Eigen::Ref<Eigen::MatrixXd> J);
+
+// y += J^T * v, about half the work of the dense product
+void tril_transpose_mult_add(const Eigen::Ref<const Eigen::MatrixXd>& J, int nU,
+                             const Eigen::Ref<const Eigen::VectorXd>& v, Eigen::Ref<Eigen::VectorXd> y);
+
 // cost feature that produce a sequence of costs rather than a sum
+// outputs must be sized by the caller, costs to T and jacobians to T x (T * nU)
 class FeatureVectorizedBase {
+protected:
+    typedef Eigen::Ref<Eigen::VectorXd> VecRef;
+    typedef Eigen::Ref<Eigen::MatrixXd> MatRef;
 public:
     // virtual destructor
     virtual ~FeatureVectorizedBase() = default;
 
-    virtual void compute(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::VectorXd& costs) = 0;
-    virtual void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Juh) = 0;
-    virtual void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Jur) = 0;
+    virtual void compute(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef costs) = 0;
+    virtual void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Juh) = 0;
+    virtual void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Jur) = 0;
+
+    // fused cost and jacobians, the outputs are accumulated with weight w rather than overwritten
+    // only the lower parts of Jur and Juh are accumulated (see tril_set_zero)
+    // the default falls back to the separate calls, features override it to share intermediates
+    virtual void evaluate(const Trajectory& robot_traj, const Trajectory& human_traj, double w,
+                          VecRef costs, MatRef Jur, MatRef Juh);
+
+    // same as evaluate, over a batch of M human trajectories against one robot trajectory
+    // costs is T x M, human m takes column m of costs and rows [m * T, (m+1) * T) of Jur and Juh
+    // the default evaluates the humans one at a time
+    virtual void evaluate_batch(const Trajectory& robot_traj, const std::vector<const Trajectory*>& human_trajs,
+                                double w, MatRef costs, MatRef Jur, MatRef Juh);
 
     static std::shared_ptr<FeatureVectorizedBase> create(const std::string &feature_type,
                                                          const std::vector<double> &args);
@@ -39,37 +68,64 @@ public:
 
 //! vectorized gaussian cost
 class GaussianCostVec {
+    typedef const Eigen::Ref<const Eigen::VectorXd> ConstVecRef;
 public:
-    static void compute(const Eigen::VectorXd& x, const int nX, const int T,
-                        const double a, const double b, Eigen::VectorXd& costs);
-    static void grad(const Eigen::VectorXd& x, const int nX, const int T,
-                     const double a, const double b, Eigen::VectorXd& grad);
+    static void compute(ConstVecRef& x, const int nX, const int T,
+                        const double a, const double b, Eigen::Ref<Eigen::VectorXd> costs);
+    static void grad(ConstVecRef& x, const int nX, const int T,
+                     const double a, const double b, Eigen::Ref<Eigen::VectorXd> grad);
+
+    // batch kernel over the whole horizon, the offsets are given as separate dx and dy arrays
+    // costs(t) = exp(-(dx/a)^2 - (dy/b)^2), gx/gy are the derivatives w.r.t. dx/dy
+    // uses AVX2 if the library is built with HRI_PLANNER_USE_AVX2
+    static void evaluate_batch(const double* dx, const double* dy, const int T, const double a, const double b,
+                               double* costs, double* gx, double* gy);
+
+    // squared radius of the offsets beyond which the cost is below tol, infinite if tol <= 0
+    static double cull_radius_sq(const double a, const double b, const double tol);
+
+    // steps [t_end, T) all have offsets beyond the radius, returns t_end (0 if all steps are culled)
+    static int active_horizon(const double* dx, const double* dy, const int T, const double r_sq);
 };
 
 //! gaussian collision avoidance feature
+// evaluate skips the steps where the robot and human are too far apart for the cost to exceed cull_tol,
+// and the rest of the horizon once they stay apart
 class CollisionCostVec: public FeatureVectorizedBase {
 public:
-    explicit CollisionCostVec(double R): R_(R) {};
+    explicit CollisionCostVec(double R, double cull_tol=1e-8):
+            R_(R), cull_r_sq_(GaussianCostVec::cull_radius_sq(R, R, cull_tol)) {};
 
-    void compute(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::VectorXd& costs) override;
-    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Juh) override;
-    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Jur) override;
+    void compute(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef costs) override;
+    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Juh) override;
+    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Jur) override;
+    void evaluate(const Trajectory& robot_traj, const Trajectory& human_traj, double w,
+                  VecRef costs, MatRef Jur, MatRef Juh) override;
+    void evaluate_batch(const Trajectory& robot_traj, const std::vector<const Trajectory*>& human_trajs,
+                        double w, MatRef costs, MatRef Jur, MatRef Juh) override;
 
     // set additional data
     void set_data(const void* data) override {};
 
 private:
     double R_;
+    double cull_r_sq_;
 };
 
 //! gaussian collision avoidance feature centered in front of the robot
+// culled the same way as CollisionCostVec, with the offsets taken from the center of the gaussian
 class DynCollisionCostVec: public FeatureVectorizedBase {
 public:
-    explicit DynCollisionCostVec(double Rx, double Ry, double d): Rx_(Rx), Ry_(Ry), d_(d) {};
+    explicit DynCollisionCostVec(double Rx, double Ry, double d, double cull_tol=1e-8):
+            Rx_(Rx), Ry_(Ry), d_(d), cull_r_sq_(GaussianCostVec::cull_radius_sq(Rx, Ry, cull_tol)) {};
 
-    void compute(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::VectorXd& costs) override;
-    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Juh) override;
-    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Jur) override;
+    void compute(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef costs) override;
+    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Juh) override;
+    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Jur) override;
+    void evaluate(const Trajectory& robot_traj, const Trajectory& human_traj, double w,
+                  VecRef costs, MatRef Jur, MatRef Juh) override;
+    void evaluate_batch(const Trajectory& robot_traj, const std::vector<const Trajectory*>& human_trajs,
+                        double w, MatRef costs, MatRef Jur, MatRef Juh) override;
 
     // set additional data
     void set_data(const void* data) override {};
@@ -78,14 +134,17 @@ private:
     double Rx_;
     double Ry_;
     double d_;
+    double cull_r_sq_;
 };
 
 //! human effort feature
 class HumanAccCostVec: public FeatureVectorizedBase {
 public:
-    void compute(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::VectorXd& costs) override;
-    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Juh) override;
-    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Jur) override;
+    void compute(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef costs) override;
+    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Juh) override;
+    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Jur) override;
+    void evaluate(const Trajectory& robot_traj, const Trajectory& human_traj, double w,
+                  VecRef costs, MatRef Jur, MatRef Juh) override;
 
     // set additional data
     void set_data(const void* data) override {};
@@ -96,9 +155,11 @@ class HumanGoalCostVec: public FeatureVectorizedBase {
 public:
     explicit HumanGoalCostVec(const Eigen::VectorXd& x_goal, double reg=1e-2): x_goal_(x_goal), reg_(reg) {};
 
-    void compute(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::VectorXd& costs) override;
-    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Juh) override;
-    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, Eigen::MatrixXd& Jur) override;
+    void compute(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef costs) override;
+    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Juh) override;
+    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef Jur) override;
+    void evaluate(const Trajectory& robot_traj, const Trajectory& human_traj, double w,
+                  VecRef costs, MatRef Jur, MatRef Juh) override;
 
     // set additional data
     void set_data(const void* data) override {
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/18/2018
-// Last revision: 3/28/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -19,21 +19,26 @@
 #include "hri_planner/cost_features_vectorized.h"
 #include "hri_planner/cost_features.h"
 #include "hri_planner/human_belief_model.h"
+#include "hri_planner/workspace.h"
+#include "hri_planner/thread_pool.h"
 
 namespace hri_planner {
 
 class ProbabilisticCostBase {
 public:
+    // gradients are written into caller-sized buffers, e.g. the optimizer's gradient storage
+    typedef Eigen::Ref<Eigen::VectorXd> VecRef;
+
     // requires a belief model to construct
     explicit ProbabilisticCostBase(const std::shared_ptr<BeliefModelBase>& belief_model):
-            belief_model_(belief_model) {};
+            belief_model_(belief_model), acomm_ex_(-1), tcomm_ex_(0.0), dt_ex_(0.0) {};
 
     virtual ~ProbabilisticCostBase() = default;
 
     // 3-in-1 computes everything
     virtual double compute(const Trajectory& robot_traj, const Trajectory& human_traj_hp,
                            const Trajectory& human_traj_rp, int acomm, double tcomm,
-                           Eigen::VectorXd& grad_ur, Eigen::VectorXd& grad_hp, Eigen::VectorXd& grad_rp) = 0;
+                           VecRef grad_ur, VecRef grad_hp, VecRef grad_rp) = 0;
 
     void set_features_non_int(const std::vector<double>& w, const std::vector<std::shared_ptr<FeatureBase> >& f);
     void set_features_int(const std::vector<double>& w, const std::vector<std::shared_ptr<FeatureVectorizedBase> >& f);
@@ -66,6 +71,16 @@ protected:
 
     Trajectory human_traj_pred_;
 
+    // explicit beliefs over the horizon, only recomputed when the communication action changes
+    // so they are evaluated once per optimization instead of in every cost evaluation
+    Eigen::VectorXd p_ex_hp_;
+    Eigen::VectorXd p_ex_rp_;
+    int acomm_ex_;
+    double tcomm_ex_;
+    double dt_ex_;
+
+    void update_explicit_belief(int acomm, double tcomm, int T, double dt);
+
     // record "partial costs" - cost for each scenario
     std::vector<double> costs_non_int_;
     double cost_hp_;
@@ -82,7 +97,7 @@ public:
 
     double compute(const Trajectory& robot_traj, const Trajectory& human_traj_hp,
                    const Trajectory& human_traj_rp, int acomm, double tcomm,
-                   Eigen::VectorXd& grad_ur, Eigen::VectorXd& grad_hp, Eigen::VectorXd& grad_rp) override;
+                   VecRef grad_ur, VecRef grad_hp, VecRef grad_rp) override;
 };
 
 
@@ -94,7 +109,149 @@ public:
 
     double compute(const Trajectory& robot_traj, const Trajectory& human_traj_hp,
                    const Trajectory& human_traj_rp, int acomm, double tcomm,
-                   Eigen::VectorXd& grad_ur, Eigen::VectorXd& grad_hp, Eigen::VectorXd& grad_rp) override;
+                   VecRef grad_ur, VecRef grad_hp, VecRef grad_rp) override;
+};
+
+
+//! cost over N human hypotheses, one per intent of a multi-intent belief model
+// the cost of each hypothesis is evaluated in parallel if there is a thread pool
+class ProbabilisticCostMulti: public ProbabilisticCostBase {
+public:
+    typedef Eigen::Ref<Eigen::MatrixXd> MatRef;
+
+    explicit ProbabilisticCostMulti(const std::shared_ptr<BeliefModelMulti>& belief_model);
+
+    // human_trajs[k] is the response under intent k, grad_uh.col(k) is the gradient w.r.t. its controls
+    double compute(const Trajectory& robot_traj, const std::vector<const Trajectory*>& human_trajs,
+                   int acomm, double tcomm, VecRef grad_ur, MatRef grad_uh);
+
+    // the two-trajectory interface, only valid for a model with two intents
+    double compute(const Trajectory& robot_traj, const Trajectory& human_traj_hp,
+                   const Trajectory& human_traj_rp, int acomm, double tcomm,
+                   VecRef grad_ur, VecRef grad_hp, VecRef grad_rp) override;
+
+    void set_thread_pool(std::shared_ptr<ThreadPool> thread_pool) {
+        thread_pool_ = std::move(thread_pool);
+    }
+
+    // belief-weighted cost of each intent from the last evaluation
+    const std::vector<double>& get_intent_costs() const {
+        return costs_intent_;
+    }
+
+private:
+    // per-hypothesis cost vector and jacobians, each evaluated in its own workspace
+    struct HypothesisData {
+        Workspace workspace;
+        Eigen::VectorXd costs;
+        Eigen::MatrixXd Jc;
+        Eigen::MatrixXd Jh;
+
+        void resize(int T, int len_ur, int len_uh);
+    };
+
+    std::shared_ptr<BeliefModelMulti> belief_model_multi_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+
+    std::vector<HypothesisData> hypotheses_;
+    std::vector<ThreadPool::Task> tasks_;
+
+    // belief of all intents and the shared jacobian direction
+    Eigen::MatrixXd belief_;
+    Eigen::MatrixXd belief_scale_;
+    Eigen::MatrixXd belief_jacobian_;
+
+    std::vector<double> costs_intent_;
+
+    // arguments of the current evaluation, read by the tasks
+    const Trajectory* robot_traj_eval_;
+    const std::vector<const Trajectory*>* human_trajs_eval_;
+
+    // argument list of the two-trajectory interface
+    std::vector<const Trajectory*> human_trajs_pair_;
+
+    void evaluate_belief();
+    void evaluate_hypothesis(int k);
+};
+
+
+//! cost over K humans, each with its own belief model and pair of hp/rp responses
+// the belief of each human is constant over the planning horizon, as in ProbabilisticCostSimplified
+// features set with set_features_int are shared by all humans and evaluated over the 2K
+// responses in one batch, features with per-human data (e.g. goals) are set with set_features_int_human
+class ProbabilisticCostMultiHuman: public ProbabilisticCostBase {
+public:
+    typedef Eigen::Ref<Eigen::MatrixXd> MatRef;
+
+    // one belief model per human, the number of models is the maximum number of humans
+    explicit ProbabilisticCostMultiHuman(const std::vector<std::shared_ptr<BeliefModelBase> >& belief_models);
+
+    // human k responds with human_trajs_hp[k] and human_trajs_rp[k], the number of humans is the size of the lists
+    // grad_hp.col(k) and grad_rp.col(k) are the gradients w.r.t. the controls of human k
+    double compute(const Trajectory& robot_traj, const std::vector<const Trajectory*>& human_trajs_hp,
+                   const std::vector<const Trajectory*>& human_trajs_rp, int acomm, double tcomm,
+                   VecRef grad_ur, MatRef grad_hp, MatRef grad_rp);
+
+    // same with the responses under the intermediate intents, see set_intent_levels
+    // the response of human k under level m is human_trajs_mid[m * K + k], its gradient is grad_mid.col(m * K + k)
+    double compute(const Trajectory& robot_traj, const std::vector<const Trajectory*>& human_trajs_hp,
+                   const std::vector<const Trajectory*>& human_trajs_rp,
+                   const std::vector<const Trajectory*>& human_trajs_mid, int acomm, double tcomm,
+                   VecRef grad_ur, MatRef grad_hp, MatRef grad_rp, MatRef grad_mid);
+
+    // the single human interface, uses the first belief model
+    double compute(const Trajectory& robot_traj, const Trajectory& human_traj_hp,
+                   const Trajectory& human_traj_rp, int acomm, double tcomm,
+                   VecRef grad_ur, VecRef grad_hp, VecRef grad_rp) override;
+
+    void set_features_int_human(int k, const std::vector<double>& w,
+                                const std::vector<std::shared_ptr<FeatureVectorizedBase> >& f);
+
+    int max_humans() const {
+        return static_cast<int>(belief_models_.size());
+    }
+
+    // levels of the intents between the two priorities (1 = human priority, 0 = robot priority)
+    // each human then also responds under every level, and the belief over its 2 + M intents
+    // is the softmax of BeliefModelMulti at the current two-intent belief
+    void set_intent_levels(const std::vector<double>& levels);
+
+    int num_intents() const {
+        return static_cast<int>(levels_.size());
+    }
+
+    // the belief model of each human, when the humans are reordered between planning cycles
+    void set_belief_models(const std::vector<std::shared_ptr<BeliefModelBase> >& belief_models);
+
+    double get_belief(int k) const {
+        return belief_models_[k]->get_belief();
+    }
+
+    // partial costs of human k from the last evaluation
+    void get_partial_cost_human(int k, double& cost_hp, double& cost_rp) const {
+        cost_hp = costs_hp_human_[k];
+        cost_rp = costs_rp_human_[k];
+    }
+
+private:
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models_;
+
+    std::vector<std::vector<double> > w_int_human_;
+    std::vector<std::vector<std::shared_ptr<FeatureVectorizedBase> > > f_int_human_;
+
+    std::vector<double> costs_hp_human_;
+    std::vector<double> costs_rp_human_;
+
+    // levels of all intents, 1 and 0 for the two priorities followed by the intermediate ones
+    Eigen::VectorXd levels_;
+
+    // hp responses, rp responses and then the intermediate ones, the batch of the shared features
+    std::vector<const Trajectory*> human_trajs_batch_;
+
+    // argument lists of the single human and two intent interfaces
+    std::vector<const Trajectory*> human_trajs_hp_single_;
+    std::vector<const Trajectory*> human_trajs_rp_single_;
+    std::vector<const Trajectory*> human_trajs_mid_none_;
 };
 
 }
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/7/2018
-// Last revision: 3/25/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -44,6 +44,14 @@ public:
     void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
     void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
 
+    // weighted sums of the feature state gradients
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+
+    // control gradients with a single adjoint pass, no jacobian required
+    void grad_uh_adjoint(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad);
+    void grad_ur_adjoint(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad);
+
     // incrementally add in features
     void add_feature(double weight, FeatureBase* feature);
     void add_feature(double weight, const std::shared_ptr<FeatureBase> feature);
@@ -89,6 +97,9 @@ public:
     // a new method that computes gradient
     virtual void grad(const Trajectory& traj, VecRef grad) = 0;
 
+    // same gradient through the adjoint pass, doesn't need the jacobian of traj
+    virtual void grad_adjoint(const Trajectory& traj, VecRef grad) = 0;
+
     // set the value for the constant trajectory
     virtual void set_trajectory_data(const Trajectory& traj);
 
@@ -109,6 +120,7 @@ public:
     // overloading the compute function
     virtual double compute(const Trajectory& traj);
     virtual void grad(const Trajectory& traj, VecRef grad);
+    virtual void grad_adjoint(const Trajectory& traj, VecRef grad);
 };
 
 //! cost defined over the human trajectory
@@ -124,10 +136,41 @@ public:
     // overloading the compute function
     virtual double compute(const Trajectory& traj);
     virtual void grad(const Trajectory& traj, VecRef grad);
+    virtual void grad_adjoint(const Trajectory& traj, VecRef grad);
 
     // also calculate hessians
-    void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess);
-    void hessian_uh_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess);
+    virtual void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess);
+    virtual void hessian_uh_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess);
+};
+
+//! human cost of an intent between the two priorities, level * cost_hp + (1 - level) * cost_rp
+// only the two-trajectory functions of the priority costs are used, so they can be shared
+// with the hp and rp follower optimizations running at the same time
+class InterpolatedHumanCost: public SingleTrajectoryCostHuman {
+public:
+    InterpolatedHumanCost(const std::shared_ptr<SingleTrajectoryCostHuman>& cost_hp,
+                          const std::shared_ptr<SingleTrajectoryCostHuman>& cost_rp, double level):
+            cost_hp_(cost_hp), cost_rp_(cost_rp), level_(level) {};
+
+    using SingleTrajectoryCostHuman::compute;
+    double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
+
+    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+
+    void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
+    void hessian_uh_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
+
+    double level() const {
+        return level_;
+    }
+
+private:
+    std::shared_ptr<SingleTrajectoryCostHuman> cost_hp_;
+    std::shared_ptr<SingleTrajectoryCostHuman> cost_rp_;
+    double level_;
 };
 
 } // namespace
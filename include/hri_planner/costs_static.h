@@ -0,0 +1,287 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#ifndef HRI_PLANNER_COSTS_STATIC_H
+#define HRI_PLANNER_COSTS_STATIC_H
+
+#include <tuple>
+#include <type_traits>
+
+#include "hri_planner/costs.h"
+
+namespace hri_planner {
+
+//! human cost with a feature set fixed at compile time
+// the features are called directly (no virtual dispatch), and the gradients of all features
+// are summed w.r.t. the states first, so that only one adjoint pass is needed per gradient
+// the weights are still set at runtime
+template <typename... Features>
+class StaticLinearCost: public SingleTrajectoryCostHuman {
+    enum { nF = sizeof...(Features) };
+
+public:
+    typedef std::tuple<std::shared_ptr<Features>...> FeatureTuple;
+
+    StaticLinearCost(const std::vector<double>& weights, const FeatureTuple& features):
+            feature_ptrs_(features)
+    {
+        if ((int) weights.size() != nF)
+            throw "Number of weights doesn't match the number of features!";
+
+        weights_ = weights;
+    }
+
+    StaticLinearCost(const std::vector<double>& weights, const std::shared_ptr<Features>&... features):
+            StaticLinearCost(weights, FeatureTuple(features...)) {};
+
+    // try to match a runtime feature list, returns nullptr if the types don't match
+    static std::shared_ptr<StaticLinearCost> create(const std::vector<double>& weights,
+                                                    const std::vector<std::shared_ptr<FeatureBase> >& features);
+
+    using SingleTrajectoryCostHuman::compute;
+    double compute(const Trajectory& robot_traj, const Trajectory& human_traj) override;
+
+    void grad_uh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_ur(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad) override;
+    void grad_xh(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+    void grad_xr(const Trajectory& robot_traj, const Trajectory& human_traj, VecRef grad_x, VecRef grad_u) override;
+
+    void hessian_uh(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
+    void hessian_uh_ur(const Trajectory& robot_traj, const Trajectory& human_traj, MatRef hess) override;
+
+private:
+    FeatureTuple feature_ptrs_;
+
+    template <int I>
+    using FeatureType = typename std::tuple_element<I, std::tuple<Features...> >::type;
+
+    // each op is applied to the features in order, the overload for nF ends the recursion
+    template <typename Op, int I>
+    void for_each_feature(Op& op, std::integral_constant<int, I>) {
+        op(weights_[I], *std::get<I>(feature_ptrs_));
+        for_each_feature(op, std::integral_constant<int, I+1>());
+    }
+
+    template <typename Op>
+    void for_each_feature(Op& op, std::integral_constant<int, nF>) {};
+
+    template <typename Op>
+    void for_each_feature(Op& op) {
+        for_each_feature(op, std::integral_constant<int, 0>());
+    }
+
+    template <int I>
+    static bool match_features(const std::vector<std::shared_ptr<FeatureBase> >& features,
+                               FeatureTuple& feature_ptrs, std::integral_constant<int, I>) {
+        std::get<I>(feature_ptrs) = std::dynamic_pointer_cast<FeatureType<I> >(features[I]);
+        if (!std::get<I>(feature_ptrs))
+            return false;
+        return match_features(features, feature_ptrs, std::integral_constant<int, I+1>());
+    }
+
+    static bool match_features(const std::vector<std::shared_ptr<FeatureBase> >& features,
+                               FeatureTuple& feature_ptrs, std::integral_constant<int, nF>) {
+        return true;
+    }
+
+    // the qualified calls (f.F::compute) bypass the vtable so the features can be inlined
+    struct ComputeOp {
+        const Trajectory& robot_traj;
+        const Trajectory& human_traj;
+        double cost;
+
+        template <typename F>
+        void operator()(double w, F& f) {
+            cost += w * f.F::compute(robot_traj, human_traj);
+        }
+    };
+
+    struct GradXhOp {
+        const Trajectory& robot_traj;
+        const Trajectory& human_traj;
+        VecRef grad_x;
+        VecRef grad_u;
+        VecRef grad_x_f;
+        VecRef grad_u_f;
+
+        template <typename F>
+        void operator()(double w, F& f) {
+            f.F::grad_xh(robot_traj, human_traj, grad_x_f, grad_u_f);
+            grad_x += w * grad_x_f;
+            grad_u += w * grad_u_f;
+        }
+    };
+
+    struct GradXrOp {
+        const Trajectory& robot_traj;
+        const Trajectory& human_traj;
+        VecRef grad_x;
+        VecRef grad_u;
+        VecRef grad_x_f;
+        VecRef grad_u_f;
+
+        template <typename F>
+        void operator()(double w, F& f) {
+            f.F::grad_xr(robot_traj, human_traj, grad_x_f, grad_u_f);
+            grad_x += w * grad_x_f;
+            grad_u += w * grad_u_f;
+        }
+    };
+
+    struct HessianUhOp {
+        const Trajectory& robot_traj;
+        const Trajectory& human_traj;
+        MatRef hess;
+        MatRef hess_f;
+
+        template <typename F>
+        void operator()(double w, F& f) {
+            f.F::hessian_uh(robot_traj, human_traj, hess_f);
+            hess += w * hess_f;
+        }
+    };
+
+    struct HessianUhUrOp {
+        const Trajectory& robot_traj;
+        const Trajectory& human_traj;
+        MatRef hess;
+        MatRef hess_f;
+
+        template <typename F>
+        void operator()(double w, F& f) {
+            f.F::hessian_uh_ur(robot_traj, human_traj, hess_f);
+            hess += w * hess_f;
+        }
+    };
+};
+
+//! the feature combinations that have a static version
+typedef StaticLinearCost<HumanVelCost, HumanAccCost, HumanGoalCost, CollisionCost> StaticHumanCost4;
+typedef StaticLinearCost<HumanVelCost, HumanAccCost, HumanGoalCost, CollisionCost, DynCollisionCost> StaticHumanCost5;
+
+// returns a static cost if the feature types match one of the combinations above, nullptr otherwise
+std::shared_ptr<SingleTrajectoryCostHuman> create_static_human_cost(
+        const std::vector<double>& weights, const std::vector<std::shared_ptr<FeatureBase> >& features);
+
+//----------------------------------------------------------------------------------
+template <typename... Features>
+std::shared_ptr<StaticLinearCost<Features...> > StaticLinearCost<Features...>::create(
+        const std::vector<double>& weights, const std::vector<std::shared_ptr<FeatureBase> >& features)
+{
+    if ((int) features.size() != nF || (int) weights.size() != nF)
+        return nullptr;
+
+    FeatureTuple feature_ptrs;
+    if (!match_features(features, feature_ptrs, std::integral_constant<int, 0>()))
+        return nullptr;
+
+    return std::make_shared<StaticLinearCost>(weights, feature_ptrs);
+}
+
+//----------------------------------------------------------------------------------
+template <typename... Features>
+double StaticLinearCost<Features...>::compute(const Trajectory &robot_traj, const Trajectory &human_traj)
+{
+    ComputeOp op{robot_traj, human_traj, 0.0};
+    for_each_feature(op);
+
+    return op.cost;
+}
+
+//----------------------------------------------------------------------------------
+template <typename... Features>
+void StaticLinearCost<Features...>::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(human_traj.traj_state_size());
+    Scratch<Eigen::VectorXd> grad_u(human_traj.traj_control_size());
+    grad_xh(robot_traj, human_traj, grad_x, grad_u);
+
+    // single adjoint pass for all features
+    human_traj.Ju_blocks.transpose_mult(grad_x, grad);
+    grad += grad_u;
+}
+
+//----------------------------------------------------------------------------------
+template <typename... Features>
+void StaticLinearCost<Features...>::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(robot_traj.traj_state_size());
+    Scratch<Eigen::VectorXd> grad_u(robot_traj.traj_control_size());
+    grad_xr(robot_traj, human_traj, grad_x, grad_u);
+
+    robot_traj.Ju_blocks.transpose_mult(grad_x, grad);
+    grad += grad_u;
+}
+
+//----------------------------------------------------------------------------------
+template <typename... Features>
+void StaticLinearCost<Features...>::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                            VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u.setZero();
+
+    Scratch<Eigen::VectorXd> grad_x_f(human_traj.traj_state_size());
+    Scratch<Eigen::VectorXd> grad_u_f(human_traj.traj_control_size());
+
+    GradXhOp op{robot_traj, human_traj, grad_x, grad_u, grad_x_f, grad_u_f};
+    for_each_feature(op);
+}
+
+//----------------------------------------------------------------------------------
+template <typename... Features>
+void StaticLinearCost<Features...>::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                            VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u.setZero();
+
+    Scratch<Eigen::VectorXd> grad_x_f(robot_traj.traj_state_size());
+    Scratch<Eigen::VectorXd> grad_u_f(robot_traj.traj_control_size());
+
+    GradXrOp op{robot_traj, human_traj, grad_x, grad_u, grad_x_f, grad_u_f};
+    for_each_feature(op);
+}
+
+//----------------------------------------------------------------------------------
+template <typename... Features>
+void StaticLinearCost<Features...>::hessian_uh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                               MatRef hess)
+{
+    hess.setZero();
+
+    int len = human_traj.traj_control_size();
+    Scratch<Eigen::MatrixXd> hess_f(len, len);
+
+    HessianUhOp op{robot_traj, human_traj, hess, hess_f};
+    for_each_feature(op);
+}
+
+//----------------------------------------------------------------------------------
+template <typename... Features>
+void StaticLinearCost<Features...>::hessian_uh_ur(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                                  MatRef hess)
+{
+    hess.setZero();
+
+    Scratch<Eigen::MatrixXd> hess_f(human_traj.traj_control_size(), robot_traj.traj_control_size());
+
+    HessianUhUrOp op{robot_traj, human_traj, hess, hess_f};
+    for_each_feature(op);
+}
+
+// the combinations are instantiated once, in costs_static.cpp
+extern template class StaticLinearCost<HumanVelCost, HumanAccCost, HumanGoalCost, CollisionCost>;
+extern template class StaticLinearCost<HumanVelCost, HumanAccCost, HumanGoalCost, CollisionCost, DynCollisionCost>;
+
+} // namespace
+
+#endif //HRI_PLANNER_COSTS_STATIC_H
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/7/2018
-// Last revision: 3/7/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -12,6 +12,8 @@
 #ifndef HRI_PLANNER_KINEMATICS_H
 #define HRI_PLANNER_KINEMATICS_H
 
+#include <cmath>
+
 #include <Eigen/Dense>
 
 namespace hri_planner {
@@ -21,6 +23,196 @@ typedef enum {
     DIFFERENTIAL_MODEL
 } DynamicsModel;
 
+//! compile-time dimensions and inlined kernels of the dynamics models
+// the virtual classes below and the trajectory rollouts share these implementations
+template<DynamicsModel M>
+struct DynamicsTraits;
+
+template<>
+struct DynamicsTraits<CONST_ACC_MODEL> {
+    enum { nX = 4, nU = 2, IsLinear = 1 };
+
+    template<typename DerivedX, typename DerivedU, typename DerivedXn>
+    static inline void forward_dyn(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                                   double dt, const Eigen::MatrixBase<DerivedXn>& x_new_out)
+    {
+        Eigen::MatrixBase<DerivedXn>& x_new = const_cast<Eigen::MatrixBase<DerivedXn>&>(x_new_out);
+        const double dt2 = 0.5 * dt * dt;
+
+        x_new(0) = x(0) + x(2) * dt + u(0) * dt2;
+        x_new(1) = x(1) + x(3) * dt + u(1) * dt2;
+        x_new(2) = x(2) + u(0) * dt;
+        x_new(3) = x(3) + u(1) * dt;
+    }
+
+    template<typename DerivedX, typename DerivedU, typename DerivedJ>
+    static inline void grad_x(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                              double dt, const Eigen::MatrixBase<DerivedJ>& Jx_out)
+    {
+        Eigen::MatrixBase<DerivedJ>& Jx = const_cast<Eigen::MatrixBase<DerivedJ>&>(Jx_out);
+
+        Jx.setIdentity();
+        Jx(0, 2) = dt;
+        Jx(1, 3) = dt;
+    }
+
+    template<typename DerivedX, typename DerivedU, typename DerivedJ>
+    static inline void grad_u(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                              double dt, const Eigen::MatrixBase<DerivedJ>& Ju_out)
+    {
+        Eigen::MatrixBase<DerivedJ>& Ju = const_cast<Eigen::MatrixBase<DerivedJ>&>(Ju_out);
+
+        Ju.setZero();
+        Ju(0, 0) = 0.5 * dt * dt;
+        Ju(1, 1) = 0.5 * dt * dt;
+        Ju(2, 0) = dt;
+        Ju(3, 1) = dt;
+    }
+
+    // vector-jacobian products (df/dx)^T * lambda and (df/du)^T * lambda
+    template<typename DerivedX, typename DerivedU, typename DerivedL, typename DerivedOut>
+    static inline void vjp_x(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                             double dt, const Eigen::MatrixBase<DerivedL>& lambda,
+                             const Eigen::MatrixBase<DerivedOut>& vjp_out)
+    {
+        Eigen::MatrixBase<DerivedOut>& out = const_cast<Eigen::MatrixBase<DerivedOut>&>(vjp_out);
+
+        out(0) = lambda(0);
+        out(1) = lambda(1);
+        out(2) = lambda(2) + dt * lambda(0);
+        out(3) = lambda(3) + dt * lambda(1);
+    }
+
+    template<typename DerivedX, typename DerivedU, typename DerivedL, typename DerivedOut>
+    static inline void vjp_u(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                             double dt, const Eigen::MatrixBase<DerivedL>& lambda,
+                             const Eigen::MatrixBase<DerivedOut>& vjp_out)
+    {
+        Eigen::MatrixBase<DerivedOut>& out = const_cast<Eigen::MatrixBase<DerivedOut>&>(vjp_out);
+
+        out(0) = 0.5 * dt * dt * lambda(0) + dt * lambda(2);
+        out(1) = 0.5 * dt * dt * lambda(1) + dt * lambda(3);
+    }
+
+    // closed-form block dx_t/du_s of the trajectory jacobian, k = t - s >= 0
+    template<typename DerivedJ>
+    static inline void trajectory_jacobian_block(int k, double dt, const Eigen::MatrixBase<DerivedJ>& J_out)
+    {
+        Eigen::MatrixBase<DerivedJ>& J = const_cast<Eigen::MatrixBase<DerivedJ>&>(J_out);
+
+        J.setZero();
+        J(0, 0) = (k + 0.5) * dt * dt;
+        J(1, 1) = (k + 0.5) * dt * dt;
+        J(2, 0) = dt;
+        J(3, 1) = dt;
+    }
+};
+
+template<>
+struct DynamicsTraits<DIFFERENTIAL_MODEL> {
+    enum { nX = 3, nU = 2, IsLinear = 0 };
+
+    template<typename DerivedX, typename DerivedU, typename DerivedXn>
+    static inline void forward_dyn(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                                   double dt, const Eigen::MatrixBase<DerivedXn>& x_new_out, double om_tol=1e-3)
+    {
+        Eigen::MatrixBase<DerivedXn>& x_new = const_cast<Eigen::MatrixBase<DerivedXn>&>(x_new_out);
+
+        const double th = x(2);
+        if (std::abs(u(1)) < om_tol) {
+            // approximately linear motion only
+            x_new(0) = x(0) + u(0) * std::cos(th) * dt;
+            x_new(1) = x(1) + u(0) * std::sin(th) * dt;
+            x_new(2) = x(2) + u(1) * dt;
+        }
+        else {
+            // constant curvature motion
+            const double R = u(0) / u(1);
+            const double dth = u(1) * dt;
+
+            x_new(0) = x(0) + R * (-std::sin(th) + std::sin(th + dth));
+            x_new(1) = x(1) + R * (std::cos(th) - std::cos(th + dth));
+            x_new(2) = x(2) + dth;
+        }
+    }
+
+    template<typename DerivedX, typename DerivedU, typename DerivedJ>
+    static inline void grad_x(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                              double dt, const Eigen::MatrixBase<DerivedJ>& Jx_out, double om_tol=1e-3)
+    {
+        Eigen::MatrixBase<DerivedJ>& Jx = const_cast<Eigen::MatrixBase<DerivedJ>&>(Jx_out);
+
+        Jx.setIdentity();
+
+        const double th = x(2);
+        if (std::abs(u(1)) < om_tol) {
+            Jx(0, 2) = u(0) * dt * (-std::sin(th));
+            Jx(1, 2) = u(0) * dt * std::cos(th);
+        }
+        else {
+            const double R = u(0) / u(1);
+            const double th_new = th + u(1) * dt;
+
+            Jx(0, 2) = R * (-std::cos(th) + std::cos(th_new));
+            Jx(1, 2) = R * (-std::sin(th) + std::sin(th_new));
+        }
+    }
+
+    template<typename DerivedX, typename DerivedU, typename DerivedJ>
+    static inline void grad_u(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                              double dt, const Eigen::MatrixBase<DerivedJ>& Ju_out, double om_tol=1e-3)
+    {
+        Eigen::MatrixBase<DerivedJ>& Ju = const_cast<Eigen::MatrixBase<DerivedJ>&>(Ju_out);
+
+        Ju.setZero();
+
+        const double th = x(2);
+        if (std::abs(u(1)) < om_tol) {
+            Ju(0, 0) = dt * std::cos(th);
+            Ju(1, 0) = dt * std::sin(th);
+            Ju(2, 1) = dt;
+        }
+        else {
+            const double om_inv = 1.0 / u(1);
+            const double th_new = th + u(1) * dt;
+            const double R = u(0) / u(1);
+
+            Ju(0, 0) = om_inv * (-std::sin(th) + std::sin(th_new));
+            Ju(1, 0) = om_inv * (std::cos(th) - std::cos(th_new));
+            Ju(0, 1) = R * (om_inv * (std::sin(th) - std::sin(th_new)) + dt * std::cos(th_new));
+            Ju(1, 1) = R * (-om_inv * (std::cos(th) - std::cos(th_new)) + dt * std::sin(th_new));
+            Ju(2, 1) = dt;
+        }
+    }
+
+    // vector-jacobian products (df/dx)^T * lambda and (df/du)^T * lambda
+    template<typename DerivedX, typename DerivedU, typename DerivedL, typename DerivedOut>
+    static inline void vjp_x(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                             double dt, const Eigen::MatrixBase<DerivedL>& lambda,
+                             const Eigen::MatrixBase<DerivedOut>& vjp_out, double om_tol=1e-3)
+    {
+        Eigen::MatrixBase<DerivedOut>& out = const_cast<Eigen::MatrixBase<DerivedOut>&>(vjp_out);
+        Eigen::Matrix3d Jx;
+        grad_x(x, u, dt, Jx, om_tol);
+
+        out(0) = lambda(0);
+        out(1) = lambda(1);
+        out(2) = lambda(2) + Jx(0, 2) * lambda(0) + Jx(1, 2) * lambda(1);
+    }
+
+    template<typename DerivedX, typename DerivedU, typename DerivedL, typename DerivedOut>
+    static inline void vjp_u(const Eigen::MatrixBase<DerivedX>& x, const Eigen::MatrixBase<DerivedU>& u,
+                             double dt, const Eigen::MatrixBase<DerivedL>& lambda,
+                             const Eigen::MatrixBase<DerivedOut>& vjp_out, double om_tol=1e-3)
+    {
+        Eigen::MatrixBase<DerivedOut>& out = const_cast<Eigen::MatrixBase<DerivedOut>&>(vjp_out);
+        Eigen::Matrix<double, 3, 2> Ju;
+        grad_u(x, u, dt, Ju, om_tol);
+
+        out.noalias() = Ju.transpose() * lambda;
+    }
+};
+
 class DynamicsBase {
 protected:
     typedef Eigen::Ref<Eigen::VectorXd> VecRef;
@@ -33,6 +225,15 @@ public:
     virtual void grad_x(ConstVecRef x, ConstVecRef u, MatRef Jx) = 0;
     virtual void grad_u(ConstVecRef x, ConstVecRef u, MatRef Ju) = 0;
 
+    // vector-jacobian products for the adjoint pass: (df/dx)^T * lambda and (df/du)^T * lambda
+    virtual void vjp_x(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out) = 0;
+    virtual void vjp_u(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out) = 0;
+
+    // linear time-invariant models have a constant trajectory jacobian
+    virtual bool is_linear() const {
+        return false;
+    }
+
 protected:
     int nX_;
     int nU_;
@@ -47,6 +248,12 @@ public:
     virtual void forward_dyn(ConstVecRef x, ConstVecRef u, VecRef x_new);
     virtual void grad_x(ConstVecRef x, ConstVecRef u, MatRef Jx);
     virtual void grad_u(ConstVecRef x, ConstVecRef u, MatRef Ju);
+    virtual void vjp_x(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out);
+    virtual void vjp_u(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out);
+
+    virtual bool is_linear() const {
+        return true;
+    }
 
 private:
     Eigen::MatrixXd A_;
@@ -61,6 +268,8 @@ public:
     virtual void forward_dyn(ConstVecRef x, ConstVecRef u, VecRef x_new);
     virtual void grad_x(ConstVecRef x, ConstVecRef u, MatRef Jx);
     virtual void grad_u(ConstVecRef x, ConstVecRef u, MatRef Ju);
+    virtual void vjp_x(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out);
+    virtual void vjp_u(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out);
 
 private:
     double om_tol_;
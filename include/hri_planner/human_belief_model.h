@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 2/25/2018
-// Last revision: 3/31/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -27,6 +27,10 @@
 namespace hri_planner {
 
 class BeliefModelBase {
+protected:
+    typedef Eigen::Ref<Eigen::VectorXd> VecRef;
+    typedef Eigen::Ref<Eigen::MatrixXd> MatRef;
+    typedef const Eigen::Ref<const Eigen::VectorXd> ConstVecRef;
 public:
     // requires the history length
     explicit BeliefModelBase(int T_hist, const std::vector<double>& fcorrection):
@@ -40,7 +44,15 @@ public:
     double update_belief(const Eigen::VectorXd& xr, const Eigen::VectorXd& ur, const Eigen::VectorXd& xh,
                          int acomm, double tcomm, double t0);
     void update_belief(const Trajectory& robot_traj, const Trajectory& human_traj,
-                       int acomm, double tcomm, double t0, Eigen::VectorXd& belief, Eigen::MatrixXd& jacobian);
+                       int acomm, double tcomm, double t0, VecRef belief, MatRef jacobian);
+
+    // same as above with the explicit beliefs of each step precomputed by explicit_belief()
+    void update_belief(const Trajectory& robot_traj, const Trajectory& human_traj,
+                       ConstVecRef p_ex_hp, ConstVecRef p_ex_rp, VecRef belief, MatRef jacobian);
+
+    // explicit beliefs over a horizon, step t is at time t0 + (t+1) * dt
+    // they only depend on the communication action, so can be reused within an optimization
+    void explicit_belief(int acomm, double tcomm, double t0, double dt, VecRef p_ex_hp, VecRef p_ex_rp);
 
     // reset
     void reset_hist(const Eigen::VectorXd& ur0);
@@ -80,15 +92,17 @@ protected:
     virtual double implicit_cost_simple(const int intent, const Eigen::VectorXd& xr,
                                         const Eigen::VectorXd& ur, const Eigen::VectorXd& xh) = 0;
     virtual void implicit_cost(const Trajectory& robot_traj, const Trajectory& human_traj,
-                               Eigen::VectorXd& costs_hp, Eigen::MatrixXd& jacobian_hp,
-                               Eigen::VectorXd& costs_rp, Eigen::MatrixXd& jacobian_rp) = 0;
+                               VecRef costs_hp, MatRef jacobian_hp, VecRef costs_rp, MatRef jacobian_rp) = 0;
 
     virtual double belief_explicit(const int intent, const double tcurr,
                                    const int acomm, const double tcomm) = 0;
 
-    // helper functions
-    void update_cost_hist(double ct, std::deque<double>& ct_hist, double& cost);
+    // helper functions, the history is copied to a sequence to avoid touching the deques
+    void init_cost_hist(const std::deque<double>& ct_hist, VecRef ct_seq, double& cost);
+    void update_cost_hist(double ct, int k, VecRef ct_seq, double& cost);
 
+    // the multi-intent model reuses the implicit costs and history
+    friend class BeliefModelMulti;
 };
 
 class BeliefModelExponential: public BeliefModelBase {
@@ -99,8 +113,7 @@ protected:
     double implicit_cost_simple(const int intent, const Eigen::VectorXd& xr,
                                 const Eigen::VectorXd& ur, const Eigen::VectorXd& xh) override;
     void implicit_cost(const Trajectory& robot_traj, const Trajectory& human_traj,
-                       Eigen::VectorXd& costs_hp, Eigen::MatrixXd& jacobian_hp,
-                       Eigen::VectorXd& costs_rp, Eigen::MatrixXd& jacobian_rp) override;
+                       VecRef costs_hp, MatRef jacobian_hp, VecRef costs_rp, MatRef jacobian_rp) override;
 
     double belief_explicit(const int intent, const double tcurr,
                            const int acomm, const double tcomm) override;
@@ -112,6 +125,45 @@ private:
     double ratio_;
 };
 
+//! belief over N intents, each one a level between the two priorities (1 = human priority, 0 = robot priority)
+// the log-likelihood of intent k interpolates the ones of the two priorities,
+//   z_k = l_k * z_hp + (1 - l_k) * z_rp,  z = log(p_explicit) - fcorrection * implicit_cost
+// and the belief is a softmax over the intents. levels {1, 0} give the two-intent model
+class BeliefModelMulti {
+protected:
+    typedef Eigen::Ref<Eigen::VectorXd> VecRef;
+    typedef Eigen::Ref<Eigen::MatrixXd> MatRef;
+    typedef const Eigen::Ref<const Eigen::VectorXd> ConstVecRef;
+public:
+    // the two-intent model provides the implicit costs, the explicit beliefs and the cost history
+    BeliefModelMulti(const std::shared_ptr<BeliefModelBase>& model, const std::vector<double>& levels);
+
+    // belief (T x N) of all intents, with the explicit beliefs from model->explicit_belief()
+    // all jacobians share one direction, d belief(t, k) / d ur = scale(t, k) * jacobian.row(t)
+    void update_belief(const Trajectory& robot_traj, const Trajectory& human_traj,
+                       ConstVecRef p_ex_hp, ConstVecRef p_ex_rp, MatRef belief, MatRef scale, MatRef jacobian);
+
+    // belief of all intents when the two-intent belief is constant over the horizon
+    // z_hp - z_rp = log(prob_hp / prob_rp), so the softmax only depends on the two-intent belief
+    static void constant_belief(double prob_hp, const Eigen::VectorXd& levels, VecRef belief);
+
+    int num_intents() const {
+        return static_cast<int>(levels_.size());
+    }
+
+    const Eigen::VectorXd& levels() const {
+        return levels_;
+    }
+
+    const std::shared_ptr<BeliefModelBase>& base_model() const {
+        return model_;
+    }
+
+private:
+    std::shared_ptr<BeliefModelBase> model_;
+    Eigen::VectorXd levels_;
+};
+
 }
 
 #endif //HRI_PLANNER_HUMAN_BELIEF_MODEL_H
@@ -0,0 +1,64 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#ifndef HRI_PLANNER_MAILBOX_H
+#define HRI_PLANNER_MAILBOX_H
+
+#include <atomic>
+#include <utility>
+
+namespace hri_planner {
+
+// lock-free single-producer single-consumer mailbox that only keeps the latest value
+// a triple buffer: the producer and the consumer each own one slot, and swap it with the
+// middle one, so a value that wasn't picked up yet is simply replaced by the newer one
+template <typename T>
+class Mailbox {
+public:
+    Mailbox(): middle_(1), back_(0), front_(2) {};
+
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    // producer side
+    void push(const T& value) {
+        slots_[back_] = value;
+        back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    // consumer side, returns false if there is nothing new since the last pop
+    bool pop(T& value) {
+        if (!(middle_.load(std::memory_order_acquire) & kFresh))
+            return false;
+
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+
+        // the old value goes back to the slot, to be overwritten by the producer
+        std::swap(value, slots_[front_]);
+        return true;
+    }
+
+private:
+    enum { kIndex = 3, kFresh = 4 };
+
+    T slots_[3];
+
+    // index of the middle slot, with a flag set when it holds a value not popped yet
+    std::atomic<int> middle_;
+
+    // owned by the producer and the consumer
+    int back_;
+    int front_;
+};
+
+}
+
+#endif //HRI_PLANNER_MAILBOX_H
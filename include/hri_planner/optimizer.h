@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/9/2018
-// Last revision: 4/26/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -14,7 +14,9 @@
 
 #include <vector>
 #include <memory>
-#include <thread>
+#include <functional>
+#include <mutex>
+#include <atomic>
 
 #include <Eigen/Dense>
 #include <nlopt.hpp>
@@ -22,10 +24,52 @@
 #include "hri_planner/trajectory.h"
 #include "hri_planner/costs.h"
 #include "hri_planner/cost_probabilistic.h"
+#include "hri_planner/workspace.h"
+#include "hri_planner/thread_pool.h"
 #include "utils/utils.h"
 
 namespace hri_planner {
 
+// zero-copy views of the nlopt decision and gradient buffers
+// the gradient view is empty if nlopt doesn't need the gradient
+typedef Eigen::Map<const Eigen::VectorXd> ConstVecMap;
+typedef Eigen::Map<Eigen::VectorXd> VecMap;
+
+// how the control gradients of the single trajectory costs are evaluated
+typedef enum {
+    GRADIENT_JACOBIAN,
+    GRADIENT_ADJOINT
+} GradientMode;
+
+// solver of the single trajectory optimizations
+typedef enum {
+    SOLVER_NLOPT,
+    SOLVER_PROJECTED_NEWTON
+} TrajectorySolver;
+
+//! cooperative cancellation of running optimizations
+// shared by the optimizers it should stop, which check it at every cost and constraint evaluation
+// and return their best point so far. a cancelled token stays cancelled until its owner resets it
+class CancellationToken {
+public:
+    CancellationToken(): flag_cancelled_(false) {};
+
+    void cancel() {
+        flag_cancelled_ = true;
+    }
+
+    void reset() {
+        flag_cancelled_ = false;
+    }
+
+    bool cancelled() const {
+        return flag_cancelled_;
+    }
+
+private:
+    std::atomic<bool> flag_cancelled_;
+};
+
 class TrajectoryOptimizer {
 public:
     // constructor
@@ -43,6 +87,37 @@ public:
     // set max iterations
     void set_max_iter(const int max_iter) {
         optimizer_.set_maxeval(max_iter);
+        max_iter_ = max_iter;
+    }
+
+    // jacobian products or adjoint pass for the cost gradient
+    void set_gradient_mode(GradientMode mode) {
+        grad_mode_ = mode;
+    }
+
+    // nlopt with the algorithm given to the constructor, or projected newton which needs a human cost
+    void set_solver(TrajectorySolver solver) {
+        solver_ = solver;
+    }
+
+    // stop once the projected gradient norm drops below the tolerance, 0 to disable
+    void set_grad_tol(const double grad_tol) {
+        grad_tol_ = grad_tol;
+    }
+
+    // start from the previous solution instead of the given initial guess
+    void set_warm_start(const bool flag_warm_start) {
+        flag_warm_start_ = flag_warm_start;
+    }
+
+    // forget the previous solution, the next call starts from the initial guess
+    void reset_warm_start() {
+        u_warm_.resize(0);
+    }
+
+    // stop early when the token is cancelled, nullptr to never stop
+    void set_cancellation_token(std::shared_ptr<const CancellationToken> cancel_token) {
+        cancel_token_ = std::move(cancel_token);
     }
 
     // optimize!
@@ -50,8 +125,8 @@ public:
 
     // get iteration
     int get_niter() {
-        int neval = optimizer_.get_numevals() - neval_last_;
-        neval_last_ = optimizer_.get_numevals();
+        int neval = optimizer_.get_numevals() + neval_newton_ - neval_last_;
+        neval_last_ = optimizer_.get_numevals() + neval_newton_;
         return neval;
     }
 
@@ -61,19 +136,55 @@ private:
 
     int neval_last_;
 
+    GradientMode grad_mode_;
+
+    // projected newton solver
+    TrajectorySolver solver_;
+    std::shared_ptr<SingleTrajectoryCostHuman> cost_human_;
+    Eigen::LDLT<Eigen::MatrixXd> ldlt_;
+
+    int neval_newton_;
+    int max_iter_;
+    double t_max_;
+
+    // early termination
+    double grad_tol_;
+    bool flag_stopped_;
+    Eigen::VectorXd u_stop_;
+
+    std::shared_ptr<const CancellationToken> cancel_token_;
+    bool flag_cancelled_;
+
+    // nlopt's decision vector, reused across calls
+    std::vector<double> u_opt_;
+
+    // last solution for warm start
+    bool flag_warm_start_;
+    Eigen::VectorXd u_warm_;
+
     // pointer to cost function
     std::shared_ptr<SingleTrajectoryCost> cost_;
 
     // an trajectory object to facilitate cost computation
     std::unique_ptr<Trajectory> traj_;
 
+    // scratch memory for the cost evaluations, reused across calls
+    Workspace workspace_;
+
     // lower and upper bounds
     Eigen::VectorXd lb_;
     Eigen::VectorXd ub_;
 
     // wrapper function for using nlopt interface
-    double cost_func(const std::vector<double>& u, std::vector<double>& grad);
-    static double cost_wrapper(const std::vector<double>& u, std::vector<double>& grad, void* data);
+    double cost_func(const ConstVecMap& u, VecMap& grad);
+    static double cost_wrapper(unsigned n, const double* u, double* grad, void* data);
+
+    // gradient norm with the components blocked by active bounds removed
+    double projected_grad_norm(const ConstVecMap& u, const VecMap& grad) const;
+
+    // box-constrained newton iterations with the analytic hessian, updates u in place
+    double optimize_projected_newton(const Trajectory& traj_const, Eigen::VectorXd& u);
+    void project_to_bounds(Eigen::Ref<Eigen::VectorXd> u) const;
 };
 
 class NestedOptimizerBase {
@@ -102,12 +213,57 @@ public:
         optimizer_.set_maxeval(max_iter);
     }
 
+    // gradient mode of the human trajectory optimizers
+    virtual void set_gradient_mode(GradientMode mode) {
+        grad_mode_ = mode;
+    }
+
+    // early termination of the follower optimizations, if there are any
+    virtual void set_follower_grad_tol(const double grad_tol) {}
+
+    // iteration limit of the follower optimizations, if there are any, 0 for no limit
+    virtual void set_follower_max_iter(const int max_iter) {}
+
+    // whether the follower optimizations start from their last solution, if there are any
+    virtual void set_follower_warm_start(const bool flag_warm_start) {}
+
+    // solver of the follower optimizations, if there are any
+    virtual void set_follower_solver(TrajectorySolver solver) {}
+
+    // whether to include the follower responses in the robot gradient, if there are any
+    virtual void set_implicit_gradient(const bool flag_implicit_grad) {}
+
+    // workers for the follower optimizations, runs them serially if not set
+    void set_thread_pool(std::shared_ptr<ThreadPool> thread_pool) {
+        thread_pool_ = std::move(thread_pool);
+    }
+
+    // called with the cost after every evaluation, returning false stops the optimization early
+    // optimize then returns the best point found so far
+    typedef std::function<bool(double)> ProgressCallback;
+    void set_progress_callback(ProgressCallback callback) {
+        progress_callback_ = std::move(callback);
+    }
+
+    // stop early when the token is cancelled, also passed on to the follower optimizations
+    // optimize then returns the best point found so far
+    virtual void set_cancellation_token(std::shared_ptr<const CancellationToken> cancel_token) {
+        cancel_token_ = std::move(cancel_token);
+    }
+
     // optimize!
     virtual double optimize(const Trajectory& robot_traj_init, const Trajectory& human_traj_hp_init,
                             const Trajectory& human_traj_rp_init, int acomm, double tcomm,
                             Trajectory& robot_traj_opt, Trajectory* human_traj_hp_opt=nullptr,
                             Trajectory* human_traj_rp_opt=nullptr) = 0;
 
+    // best iterate of the running (or last) optimization, safe to call while optimize runs on another thread
+    // returns false if no evaluation had a finite cost yet
+    bool get_best_iterate(Eigen::VectorXd& u, double& cost);
+
+    // forget the best iterate, until the next optimization has one
+    void clear_best_iterate();
+
     void optimize_nr(const Trajectory& robot_traj_init, const Trajectory& human_traj_hp_init,
                      const Trajectory& human_traj_rp_init, int acomm, double tcomm, double& min_cost,
                      Trajectory& robot_traj_opt, Trajectory* human_traj_hp_opt=nullptr,
@@ -142,6 +298,8 @@ protected:
     int neval_nested_hp_;
     int neval_nested_rp_;
 
+    GradientMode grad_mode_;
+
     // pointer to cost function
     std::shared_ptr<ProbabilisticCostBase> robot_cost_;
     std::shared_ptr<LinearCost> human_cost_hp_;
@@ -167,9 +325,65 @@ protected:
     double cost_rp_;
     std::vector<double> costs_non_int_;
 
+    // scratch memory and gradients of the robot cost, reused across calls
+    Workspace workspace_;
+    Eigen::VectorXd grad_ur_;
+    Eigen::VectorXd grad_uh_hp_;
+    Eigen::VectorXd grad_uh_rp_;
+
+    std::shared_ptr<ThreadPool> thread_pool_;
+
+    ProgressCallback progress_callback_;
+    std::shared_ptr<const CancellationToken> cancel_token_;
+    bool flag_stopped_;
+
+    // best iterate so far, only written by the optimizing thread with best_mutex_ held
+    std::mutex best_mutex_;
+    Eigen::VectorXd u_best_;
+    double cost_best_;
+    bool flag_has_best_;
+
+    // keep whatever else belongs to a new best iterate, called with best_mutex_ held
+    virtual void save_best_iterate() {};
+
+    // run the tasks on the thread pool if there is one
+    void run_parallel(const std::vector<ThreadPool::Task>& tasks);
+
+    // nlopt optimize, but a stop requested by the progress callback or the token isn't an error
+    nlopt::result run_optimizer(std::vector<double>& u, double& min_cost);
+
+    // force stop if the token is cancelled
+    bool check_cancelled();
+
+    // buffers for the implicit gradient through one follower, allocated once per optimization
+    // used by the nested optimizers with follower optimizations
+    struct ImplicitGradData {
+        Workspace workspace;
+        Eigen::MatrixXd hess_uh;
+        Eigen::MatrixXd hess_uh_ur;
+        Eigen::VectorXd sol;
+        Eigen::VectorXd sub_grad;
+
+        // hess_uh is symmetric, use LDLT unless it isn't positive definite
+        Eigen::LDLT<Eigen::MatrixXd> ldlt;
+        Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr;
+        bool flag_use_qr;
+
+        // trajectories the factorization was computed at
+        bool flag_factorized;
+        Eigen::VectorXd ur_factorized;
+        Eigen::VectorXd uh_factorized;
+
+        void resize(int T, int len_uh, int len_ur);
+    };
+
+    // implicit gradient hess_uh_ur^T * hess_uh^-1 * grad_uh of one follower, into data.sub_grad
+    void cost_func_subroutine(SingleTrajectoryCostHuman* cost, const Trajectory& human_traj,
+                              const Eigen::Ref<const Eigen::VectorXd>& grad_uh, ImplicitGradData& data);
+
     // wrapper cost function
-    virtual double cost_func(const std::vector<double>& u, std::vector<double>& grad) = 0;
-    static double cost_wrapper(const std::vector<double>& u, std::vector<double>& grad, void *cost_func_data);
+    virtual double cost_func(const ConstVecMap& u, VecMap& grad) = 0;
+    static double cost_wrapper(unsigned n, const double* u, double* grad, void *cost_func_data);
 };
 
 class NestedTrajectoryOptimizer: public NestedOptimizerBase {
@@ -197,11 +411,11 @@ public:
 
 private:
     // wrapper cost function
-    double cost_func(const std::vector<double>& u, std::vector<double>& grad) override;
+    double cost_func(const ConstVecMap& u, VecMap& grad) override;
 
     // wrapper constraint function
-    double constraint(const std::vector<double>& u, std::vector<double>& grad);
-    static double constraint_wrapper(const std::vector<double>& u, std::vector<double>& grad, void *constraint_data);
+    double constraint(const ConstVecMap& u, VecMap& grad);
+    static double constraint_wrapper(unsigned n, const double* u, double* grad, void *constraint_data);
 };
 
 //! the naive nested optimizer
@@ -226,12 +440,41 @@ public:
         optimizer_rp_->set_time_limit(t_max * 0.08);
     }
 
-    void set_max_iter(const int max_iter) override {
-        optimizer_.set_maxeval(max_iter);
+    void set_follower_max_iter(const int max_iter) override {
+        optimizer_hp_->set_max_iter(max_iter);
+        optimizer_rp_->set_max_iter(max_iter);
+    }
+
+    void set_gradient_mode(GradientMode mode) override {
+        grad_mode_ = mode;
+
+        optimizer_hp_->set_gradient_mode(mode);
+        optimizer_rp_->set_gradient_mode(mode);
+    }
+
+    void set_follower_grad_tol(const double grad_tol) override {
+        optimizer_hp_->set_grad_tol(grad_tol);
+        optimizer_rp_->set_grad_tol(grad_tol);
+    }
+
+    void set_follower_warm_start(const bool flag_warm_start) override {
+        optimizer_hp_->set_warm_start(flag_warm_start);
+        optimizer_rp_->set_warm_start(flag_warm_start);
+    }
+
+    void set_follower_solver(TrajectorySolver solver) override {
+        optimizer_hp_->set_solver(solver);
+        optimizer_rp_->set_solver(solver);
+    }
 
-        // FIXME: hard-coded limit
-        optimizer_hp_->set_max_iter(20);
-        optimizer_rp_->set_max_iter(20);
+    void set_implicit_gradient(const bool flag_implicit_grad) override {
+        flag_implicit_grad_ = flag_implicit_grad;
+    }
+
+    void set_cancellation_token(std::shared_ptr<const CancellationToken> cancel_token) override {
+        optimizer_hp_->set_cancellation_token(cancel_token);
+        optimizer_rp_->set_cancellation_token(cancel_token);
+        cancel_token_ = std::move(cancel_token);
     }
 
     // optimize!
@@ -241,13 +484,190 @@ public:
                     Trajectory* human_traj_rp_opt=nullptr) override;
 
 private:
+    bool flag_implicit_grad_;
+
     // optimizers for obtaining human trajectory
     std::unique_ptr<TrajectoryOptimizer> optimizer_hp_;
     std::unique_ptr<TrajectoryOptimizer> optimizer_rp_;
 
-    double cost_func(const std::vector<double>& u, std::vector<double>& grad) override;
-    void cost_func_subroutine(SingleTrajectoryCostHuman*& cost, const Trajectory& human_traj,
-                              const Eigen::VectorXd& grad_uh, Eigen::VectorXd& sub_grad);
+    // optimal human trajectories of the latest evaluation
+    std::unique_ptr<Trajectory> human_traj_hp_opt_;
+    std::unique_ptr<Trajectory> human_traj_rp_opt_;
+
+    ImplicitGradData implicit_hp_;
+    ImplicitGradData implicit_rp_;
+
+    // follower optimizations and implicit gradients, created once and run in pairs
+    std::vector<ThreadPool::Task> follower_tasks_;
+    std::vector<ThreadPool::Task> implicit_grad_tasks_;
+
+    double cost_func(const ConstVecMap& u, VecMap& grad) override;
+};
+
+//! nested optimizer with K humans, each with its own pair of follower optimizations
+// the followers of different humans only depend on the robot trajectory, so the 2K follower
+// optimizations (and then the 2K implicit gradients) are scheduled on the thread pool together
+class MultiHumanNestedOptimizer: public NestedOptimizerBase {
+public:
+    // slots for up to max_humans humans are created up front
+    MultiHumanNestedOptimizer(unsigned int dim_r, unsigned int dim_h, int max_humans,
+                              const nlopt::algorithm& alg, const nlopt::algorithm& sub_alg);
+
+    void set_robot_cost(const std::shared_ptr<ProbabilisticCostMultiHuman>& cost);
+
+    // human costs of human k
+    void set_human_cost(int k, const std::shared_ptr<SingleTrajectoryCostHuman>& cost_hp,
+                        const std::shared_ptr<SingleTrajectoryCostHuman>& cost_rp);
+
+    // human costs of the first human
+    void set_human_cost(LinearCost* cost_hp, LinearCost* cost_rp) override;
+    void set_human_cost(const std::shared_ptr<LinearCost>& cost_hp,
+                        const std::shared_ptr<LinearCost>& cost_rp) override;
+
+    void set_bounds(const Eigen::VectorXd& lb_ur, const Eigen::VectorXd& ub_ur,
+                    const Eigen::VectorXd& lb_uh, const Eigen::VectorXd& ub_uh) override;
+
+    void set_time_limit(const double t_max) override;
+    void set_gradient_mode(GradientMode mode) override;
+    void set_follower_grad_tol(const double grad_tol) override;
+    void set_follower_max_iter(const int max_iter) override;
+    void set_follower_warm_start(const bool flag_warm_start) override;
+    void set_follower_solver(TrajectorySolver solver) override;
+    void set_cancellation_token(std::shared_ptr<const CancellationToken> cancel_token) override;
+
+    void set_implicit_gradient(const bool flag_implicit_grad) override {
+        flag_implicit_grad_ = flag_implicit_grad;
+    }
+
+    int max_humans() const {
+        return static_cast<int>(humans_.size());
+    }
+
+    // levels of the intents between the two priorities, the robot cost needs the same levels
+    // each human gets one more follower optimization per level, with the human costs interpolated
+    // between its hp and rp costs. the new followers only get the settings made after this call
+    void set_intent_levels(const std::vector<double>& levels);
+
+    // optimize with one pair of initial human trajectories per human, the number of humans is the size of the lists
+    double optimize(const Trajectory& robot_traj_init, const std::vector<Trajectory>& human_trajs_hp_init,
+                    const std::vector<Trajectory>& human_trajs_rp_init, int acomm, double tcomm,
+                    Trajectory& robot_traj_opt, std::vector<Trajectory>* human_trajs_hp_opt=nullptr,
+                    std::vector<Trajectory>* human_trajs_rp_opt=nullptr);
+
+    // single human
+    double optimize(const Trajectory& robot_traj_init, const Trajectory& human_traj_hp_init,
+                    const Trajectory& human_traj_rp_init, int acomm, double tcomm,
+                    Trajectory& robot_traj_opt, Trajectory* human_traj_hp_opt=nullptr,
+                    Trajectory* human_traj_rp_opt=nullptr) override;
+
+    // best iterate with the responses of the humans it was evaluated with, safe to call from other threads
+    // the human lists need at least max_humans trajectories of the same horizon, and are shrunk to the
+    // number of humans of the optimization
+    using NestedOptimizerBase::get_best_iterate;
+    bool get_best_iterate(Trajectory& robot_traj, std::vector<Trajectory>& human_trajs_hp,
+                          std::vector<Trajectory>& human_trajs_rp, double& cost);
+
+    // robot cost with the human responses held fixed, without any follower optimization
+    // cheap enough to rank initial guesses, the trajectories need their jacobians computed
+    double evaluate_cost(const Trajectory& robot_traj, const std::vector<Trajectory>& human_trajs_hp,
+                         const std::vector<Trajectory>& human_trajs_rp, int acomm, double tcomm);
+
+private:
+    // everything that belongs to one human
+    struct HumanSlot {
+        std::shared_ptr<SingleTrajectoryCostHuman> cost_hp;
+        std::shared_ptr<SingleTrajectoryCostHuman> cost_rp;
+
+        std::unique_ptr<TrajectoryOptimizer> optimizer_hp;
+        std::unique_ptr<TrajectoryOptimizer> optimizer_rp;
+
+        // initial guesses and optimal responses of the latest evaluation
+        std::unique_ptr<Trajectory> traj_hp;
+        std::unique_ptr<Trajectory> traj_rp;
+        std::unique_ptr<Trajectory> traj_hp_opt;
+        std::unique_ptr<Trajectory> traj_rp_opt;
+
+        ImplicitGradData implicit_hp;
+        ImplicitGradData implicit_rp;
+
+        // initial state and responses of the best iterate
+        Eigen::VectorXd xh0_best;
+        Eigen::VectorXd uh_hp_best;
+        Eigen::VectorXd uh_rp_best;
+
+        // one follower per intermediate intent, started from the hp and rp guesses interpolated by level
+        struct Hypothesis {
+            std::shared_ptr<InterpolatedHumanCost> cost;
+            std::unique_ptr<TrajectoryOptimizer> optimizer;
+            std::unique_ptr<Trajectory> traj;
+            std::unique_ptr<Trajectory> traj_opt;
+            ImplicitGradData implicit;
+        };
+        std::vector<Hypothesis> hypotheses;
+
+        void create_hypotheses(const std::vector<double>& levels, unsigned int dim_h, const nlopt::algorithm& alg);
+    };
+
+    bool flag_implicit_grad_;
+
+    std::shared_ptr<ProbabilisticCostMultiHuman> robot_cost_multi_;
+
+    unsigned int dim_h_;
+    nlopt::algorithm sub_alg_;
+    std::vector<double> levels_;
+
+    std::vector<HumanSlot> humans_;
+    int n_humans_;
+    int n_humans_best_;
+    Eigen::VectorXd xr0_best_;
+
+    // optimal responses of all active humans, the arguments of the robot cost
+    // the intermediate intents are ordered by level, then by human
+    std::vector<const Trajectory*> human_trajs_hp_opt_;
+    std::vector<const Trajectory*> human_trajs_rp_opt_;
+    std::vector<const Trajectory*> human_trajs_mid_opt_;
+
+    // gradients w.r.t. the responses, one column per human (and level)
+    Eigen::MatrixXd grad_uh_hp_multi_;
+    Eigen::MatrixXd grad_uh_rp_multi_;
+    Eigen::MatrixXd grad_uh_mid_multi_;
+
+    // follower optimizations and implicit gradients of the active humans, rebuilt when the number changes
+    std::vector<ThreadPool::Task> follower_tasks_;
+    std::vector<ThreadPool::Task> implicit_grad_tasks_;
+
+    void create_tasks(int n_humans);
+
+    double cost_func(const ConstVecMap& u, VecMap& grad) override;
+
+    void save_best_iterate() override;
+};
+
+//! tracks the best cost of each seed of a multi-start optimization
+// the optimizers report to it through their progress callbacks, and a seed is stopped once
+// its best cost is worse than the best of all seeds by more than the given ratio
+class MultiStartMonitor {
+public:
+    MultiStartMonitor(int n_seeds, double ratio, int min_evals);
+
+    // clear the costs before a new optimization
+    void reset();
+
+    // record a cost of seed s, returns false if the seed should stop
+    bool update(int s, double cost);
+
+    // progress callback for the optimizer of seed s
+    NestedOptimizerBase::ProgressCallback callback(int s);
+
+private:
+    std::mutex mutex_;
+
+    // allowed relative gap to the best seed, and evaluations before a seed can be stopped
+    double ratio_;
+    int min_evals_;
+
+    std::vector<double> costs_best_;
+    std::vector<int> n_evals_;
 };
 
 } // namespace
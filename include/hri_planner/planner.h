@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/24/2018
-// Last revision: 4/23/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -15,6 +15,8 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <functional>
+#include <chrono>
 
 #include <ros/ros.h>
 #include <std_msgs/Int32.h>
@@ -28,9 +30,12 @@
 #include "hri_planner/trajectory.h"
 #include "hri_planner/cost_features.h"
 #include "hri_planner/cost_features_vectorized.h"
+#include "hri_planner/costs_static.h"
 #include "hri_planner/cost_probabilistic.h"
 #include "hri_planner/human_belief_model.h"
 #include "hri_planner/optimizer.h"
+#include "hri_planner/warm_start.h"
+#include "hri_planner/thread_pool.h"
 #include "utils/utils.h"
 
 #include "hri_planner/PlannedTrajectories.h"
@@ -46,8 +51,25 @@ public:
     // main update function
     virtual void compute_plan(double t_max=-1) = 0;
 
+    // messages of the latest plan, each one publishes a copy of its data when called
+    // so that they can be published from another thread while the next plan is computed
+    typedef std::function<void()> PlanMessage;
+    virtual void get_plan_messages(bool human_tracking_lost, std::vector<PlanMessage>& msgs) = 0;
+
     // publish the plan
-    virtual void publish_plan(bool human_tracking_lost) = 0;
+    void publish_plan(bool human_tracking_lost) {
+        std::vector<PlanMessage> msgs;
+        get_plan_messages(human_tracking_lost, msgs);
+
+        for (auto& msg: msgs)
+            msg();
+    }
+
+    // messages of the best plan so far, safe to call while compute_plan runs on another thread
+    // returns false if there is none yet, or the planner doesn't support it
+    virtual bool get_intermediate_plan_messages(bool human_tracking_lost, std::vector<PlanMessage>& msgs) {
+        return false;
+    }
 
     // reset the planner with new goals
     virtual void reset_planner(const Eigen::VectorXd& xr_goal, const Eigen::VectorXd& xh_goal,
@@ -60,6 +82,16 @@ public:
     // simply clear any histories and reset flags
     virtual void reset_planner() {};
 
+    // stop a compute_plan running on another thread early, it returns the best plan so far
+    // the following plans stop right away as well, until reset_cancel is called
+    void cancel_plan() {
+        cancel_token_->cancel();
+    }
+
+    void reset_cancel() {
+        cancel_token_->reset();
+    }
+
     // methods to send robot & human data in
     void set_robot_state(const Eigen::VectorXd& xr_meas, const Eigen::VectorXd& ur_meas) {
         xr_meas_ = xr_meas;
@@ -68,6 +100,30 @@ public:
 
     void set_human_state(const Eigen::VectorXd& xh_meas) {
         xh_meas_ = xh_meas;
+        xh_meas_all_.assign(1, xh_meas);
+        human_ids_meas_.assign(1, 0);
+    }
+
+    // all tracked humans, the first one is the human the goal and intent are given for
+    // the humans are identified by their order
+    void set_human_states(const std::vector<Eigen::VectorXd>& xh_meas) {
+        std::vector<int> human_ids(xh_meas.size());
+        for (int k = 0; k < human_ids.size(); ++k)
+            human_ids[k] = k;
+
+        set_human_states(xh_meas, human_ids);
+    }
+
+    // same as above, with an id for each human that stays the same as long as the person is tracked
+    void set_human_states(const std::vector<Eigen::VectorXd>& xh_meas, const std::vector<int>& human_ids) {
+        if (xh_meas.empty())
+            throw "At least one human state is needed!";
+        if (human_ids.size() != xh_meas.size())
+            throw "Each human state needs an id!";
+
+        xh_meas_ = xh_meas[0];
+        xh_meas_all_ = xh_meas;
+        human_ids_meas_ = human_ids;
     }
 
     // compute the closed-loop control for one time step
@@ -106,6 +162,8 @@ protected:
     Eigen::VectorXd xr_meas_;
     Eigen::VectorXd ur_meas_;
     Eigen::VectorXd xh_meas_;
+    std::vector<Eigen::VectorXd> xh_meas_all_;
+    std::vector<int> human_ids_meas_;
 
     // goals for robot and human
     Eigen::VectorXd xr_goal_;
@@ -114,12 +172,25 @@ protected:
     // true intent of the robot
     int intent_;
 
+    // shared with the optimizers of the derived classes
+    std::shared_ptr<CancellationToken> cancel_token_;
+
     // helper functions that can be useful to all derived classes
     virtual void update_init_guesses() = 0;
 
+    template <typename Msg>
+    static PlanMessage plan_message(const ros::Publisher& pub, const Msg& msg) {
+        return [pub, msg] {
+            pub.publish(msg);
+        };
+    }
+
     void shift_control(const Eigen::VectorXd& u_in, Eigen::VectorXd& u_out, int dim, bool pad_zero);
 
     void generate_steer_posq(const Eigen::VectorXd& x0, const Eigen::VectorXd& x_goal, Eigen::VectorXd& ur);
+    // steer to x_via first, then to x_goal once within r_via of it
+    void generate_steer_posq(const Eigen::VectorXd& x0, const Eigen::VectorXd& x_via, const Eigen::VectorXd& x_goal,
+                             double r_via, Eigen::VectorXd& ur);
     void generate_steer_acc(const Eigen::VectorXd& x0, const Eigen::VectorXd& x_goal, Eigen::VectorXd& uh);
 };
 
@@ -133,7 +204,8 @@ public:
     void compute_plan(double t_max=-1) override;
     void compute_plan_no_comm(double t_max=-1);
 
-    void publish_plan(bool human_tracking_lost) override;
+    void get_plan_messages(bool human_tracking_lost, std::vector<PlanMessage>& msgs) override;
+    bool get_intermediate_plan_messages(bool human_tracking_lost, std::vector<PlanMessage>& msgs) override;
 
     // reset the planner with new goals
     void reset_planner(const Eigen::VectorXd& xr_goal, const Eigen::VectorXd& xh_goal,
@@ -142,14 +214,21 @@ public:
     // simple reset
     void reset_planner() override;
 
+
     // get human prediction
     void get_human_pred(const int t, const int intent, Eigen::VectorXd& human_state);
 
 private:
-    // components
-    std::shared_ptr<BeliefModelBase> belief_model_;
-    std::shared_ptr<NestedOptimizerBase> optimizer_comm_;
-    std::shared_ptr<NestedOptimizerBase> optimizer_no_comm_;
+    // components, one belief model per human
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models_;
+    std::vector<std::shared_ptr<ProbabilisticCostMultiHuman> > robot_costs_;
+    std::shared_ptr<ThreadPool> thread_pool_;
+
+    // one optimizer per seed of the multi-start optimization, for each communication branch
+    std::vector<std::shared_ptr<MultiHumanNestedOptimizer> > optimizers_comm_;
+    std::vector<std::shared_ptr<MultiHumanNestedOptimizer> > optimizers_no_comm_;
+    std::shared_ptr<MultiStartMonitor> monitor_comm_;
+    std::shared_ptr<MultiStartMonitor> monitor_no_comm_;
 
     // map to retrieve features by name
     std::unordered_map<std::string, std::shared_ptr<FeatureBase> > features_human_;
@@ -167,18 +246,55 @@ private:
     Eigen::VectorXd xr_;
     Eigen::VectorXd ur_;
 
-    // human state
+    // human states, the first one is also kept in xh_
     Eigen::VectorXd xh_;
+    std::vector<Eigen::VectorXd> xh_all_;
+
+    // id of each human planned with, belief_models_[k] belongs to human_ids_[k]
+    std::vector<int> human_ids_;
+
+    // number of humans planned with, up to max_humans_
+    int max_humans_;
+    int n_humans_;
+
+    // intermediate intent levels between robot priority (0) and human priority (1) planned with
+    std::vector<double> intent_levels_;
+
+    // goals of all humans, only the first one is given
+    std::vector<Eigen::VectorXd> xh_goals_;
 
     // the optimal plan
     Trajectory robot_traj_opt_;
-    Trajectory human_traj_hp_opt_;
-    Trajectory human_traj_rp_opt_;
+    std::vector<Trajectory> human_trajs_hp_opt_;
+    std::vector<Trajectory> human_trajs_rp_opt_;
 
     // initial guesses
     Trajectory robot_traj_init_;
-    Trajectory human_traj_hp_init_;
-    Trajectory human_traj_rp_init_;
+    std::vector<Trajectory> human_trajs_hp_init_;
+    std::vector<Trajectory> human_trajs_rp_init_;
+
+    // recent plans reused as initial guesses, and the candidate being ranked
+    WarmStartCache warm_start_;
+    Trajectory robot_traj_cand_;
+    std::vector<Trajectory> human_trajs_hp_cand_;
+    std::vector<Trajectory> human_trajs_rp_cand_;
+
+    // age of the plan the initial guess came from, -1 for the steer law rollout
+    int init_guess_age_;
+
+    // robot initial guesses of the seeds, the first one is the ranked initial guess
+    // all seeds share the human initial guesses
+    int n_seeds_;
+    double detour_offset_;
+    std::vector<Trajectory> robot_trajs_seed_;
+
+    // seeds the plans of the last planning cycle came from
+    int seed_no_comm_;
+    int seed_comm_;
+
+    // outer iterations of the last planning cycle
+    int niter_no_comm_;
+    int niter_comm_;
 
     // control bounds
     std::vector<double> lb_uh_vec_;
@@ -201,7 +317,7 @@ private:
 
     bool flag_publish_debug_info_;
 
-    // whether to generate initial guess from scratch
+    // whether the stored plans can't be reused (new goals)
     bool flag_gen_init_guesses_;
 
     // subscribers & publishers
@@ -218,14 +334,28 @@ private:
 //                            std::shared_ptr<SingleTrajectoryCostHuman>& single_cost_rp);
     void create_human_costs(std::vector<std::shared_ptr<SingleTrajectoryCostHuman> >& single_cost_hp,
                             std::vector<std::shared_ptr<SingleTrajectoryCostHuman> >& single_cost_rp,
-                            int n);
-    void create_robot_costs(std::vector<std::shared_ptr<ProbabilisticCostBase> >& robot_costs,
+                            int n, const std::string& suffix="");
+    void create_robot_costs(std::vector<std::shared_ptr<ProbabilisticCostMultiHuman> >& robot_costs,
                             int n, const std::string& ns="~");
     void create_optimizer();
 
     // other helper functions
-    void generate_init_guesses(Trajectory& robot_traj, Trajectory& human_traj_hp, Trajectory& human_traj_rp);
+    void update_humans(const Eigen::VectorXd& ur_d);
+    void assign_humans(int n_humans);
+    void generate_init_guesses(Trajectory& robot_traj, std::vector<Trajectory>& human_trajs_hp,
+                               std::vector<Trajectory>& human_trajs_rp);
     void update_init_guesses() override;
+    void generate_seeds();
+
+    // set the time left before the shared deadline, returns false if there is none
+    static bool start_seed(MultiHumanNestedOptimizer& optimizer, const std::chrono::steady_clock::time_point& t_start,
+                           double t_max);
+
+    // seed with the lowest cost, nan costs are skipped
+    static int select_seed(const std::vector<double>& costs);
+
+    // the best iterates are only published during a planning cycle
+    void clear_best_iterates();
 };
 
 
@@ -236,8 +366,8 @@ public:
     // main update function
     void compute_plan(double t_max=-1) override;
 
-    // publish plans
-    void publish_plan(bool human_tracking_lost) override;
+    // messages of the plan
+    void get_plan_messages(bool human_tracking_lost, std::vector<PlanMessage>& msgs) override;
 
     // reset the planner with new goals
     void reset_planner(const Eigen::VectorXd& xr_goal, const Eigen::VectorXd& xh_goal,
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 4/4/2018
-// Last revision: 4/23/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -14,6 +14,10 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 #include <Eigen/Dense>
 
@@ -28,6 +32,7 @@
 #include "people_msgs/PositionMeasurementArray.h"
 
 #include "hri_planner/planner.h"
+#include "hri_planner/mailbox.h"
 
 // enum for state machine
 enum PlannerStates {
@@ -37,6 +42,34 @@ enum PlannerStates {
     Pausing
 };
 
+// measurements of one planning cycle, from the state machine to the planning thread
+struct PlanningRequest {
+    // requests and plans from before a cancellation are dropped
+    int epoch;
+
+    std::shared_ptr<hri_planner::PlannerBase> planner;
+    bool flag_allow_comm;
+    bool flag_human_detected;
+    int intent;
+
+    Eigen::VectorXd xr;
+    Eigen::VectorXd ur;
+    std::vector<Eigen::VectorXd> xh;
+    std::vector<int> human_ids;
+
+    // the real measurements, published with the plan
+    std_msgs::Float64MultiArray state_data;
+};
+
+// a computed plan, from the planning thread to the publisher thread
+// or the best plan so far of a cycle in progress, from the state machine to the publisher thread
+struct PlanningResult {
+    int epoch;
+    int cycle;
+    std::vector<hri_planner::PlannerBase::PlanMessage> msgs;
+    std_msgs::Float64MultiArray state_data;
+};
+
 // the planner node class
 class PlannerNode {
 public:
@@ -53,10 +86,44 @@ private:
     // planner state
     PlannerStates state_;
 
+    // planning runs on its own thread and the plans are published from another one,
+    // so that the state machine keeps spinning while the optimizer runs
+    hri_planner::Mailbox<PlanningRequest> requests_;
+    hri_planner::Mailbox<PlanningResult> results_;
+    hri_planner::Mailbox<PlanningResult> intermediate_results_;
+
+    std::thread planning_thread_;
+    std::thread publisher_thread_;
+    std::atomic<bool> flag_threads_running_;
+
+    // bumped to drop the requests and plans in flight
+    std::atomic<int> planning_epoch_;
+
+    // held by the planning thread for a whole cycle, and by the callbacks that reset the planners
+    std::mutex planner_mutex_;
+
+    // resets asked for by the state machine, done by the planning thread before the next plan
+    std::atomic<bool> flag_reset_interactive_;
+    std::atomic<bool> flag_reset_simple_;
+
+    // planner and epoch of the cycle in progress, for the intermediate plans
+    std::atomic<hri_planner::PlannerBase*> planner_running_;
+    std::atomic<int> epoch_running_;
+    std::atomic<bool> flag_human_detected_running_;
+    std::atomic<int> n_cycles_;
+
+    // cycle of the latest intermediate plan, only used by the state machine
+    int cycle_intermediate_;
+
+    // human prediction of the latest interactive plan, used while the human isn't detected
+    std::mutex pred_mutex_;
+    Eigen::VectorXd xh_pred_;
+
     // control flags
     bool flag_start_planning_;
     bool flag_pause_planning_;
     bool flag_stop_planning_;
+    bool flag_pause_requested_;
     bool flag_human_detected_;
     bool flag_human_detected_frame_;
     bool flag_human_tracking_lost_;
@@ -79,6 +146,13 @@ private:
     Eigen::VectorXd ur_meas_;
     Eigen::VectorXd xh_meas_;
 
+    // other humans near the robot, closest first
+    std::vector<Eigen::VectorXd> xh_meas_others_;
+
+    // ids that follow each of the other humans across callbacks, the human with the goal is always 0
+    std::vector<int> ids_others_;
+    int next_human_id_;
+
     // rates
     double planning_rate_;
     double controller_rate_;
@@ -93,10 +167,17 @@ private:
     // human filter parameters
     double human_filter_dist_th_;
 
+    // other humans within this distance to the robot are also planned with, up to max_humans_ in total
+    int max_humans_;
+    double crowd_dist_th_;
+
     // mode
     std::string mode_;
     bool flag_allow_explicit_comm_;
 
+    // publish the best plan so far while the optimization is still running
+    bool flag_publish_intermediate_plan_;
+
     // node handler
     ros::NodeHandle nh_;
 
@@ -116,13 +197,25 @@ private:
     ros::Publisher robot_human_state_pub_;
 
     // helper functions
-    void plan(const std::shared_ptr<hri_planner::PlannerBase>& planenr);
+    void plan(const std::shared_ptr<hri_planner::PlannerBase>& planner);
+
+    void planning_loop();
+    void publishing_loop();
+
+    // hand the best plan so far of the running cycle to the publisher thread, once per cycle
+    void push_intermediate_plan();
+
+    // drop the requests and plans in flight, and stop the optimization
+    void cancel_planning();
+
     void compute_and_publish_control();
 
     void reset_state_machine();
 
     double point_line_dist(const Eigen::VectorXd& p, const Eigen::VectorXd& a, const Eigen::VectorXd& b);
 
+    void select_other_humans(std::vector<Eigen::VectorXd>& xh_candidates);
+
     // callback functions
     void goal_callback(const std_msgs::Float64MultiArrayConstPtr& goal_msg);
     void planner_ctrl_callback(const std_msgs::StringConstPtr& msg);
@@ -0,0 +1,79 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#ifndef HRI_PLANNER_THREAD_POOL_H
+#define HRI_PLANNER_THREAD_POOL_H
+
+#include <vector>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace hri_planner {
+
+// long-lived workers that replace the per-call thread spawns of the planner and optimizers
+// tasks can submit and wait for other tasks, a waiting thread executes the queued tasks of its own call
+// itself, so that it neither deadlocks nor gets stuck in an unrelated long task
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    // n_workers doesn't count the calling thread, which always takes part in the work
+    explicit ThreadPool(int n_workers=3, int queue_capacity=16, bool pin_workers=false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // run all tasks and return when they are finished
+    // the first task runs on the calling thread, the first exception thrown is re-thrown
+    void run_parallel(const std::vector<Task>& tasks);
+
+    int num_workers() const {
+        return static_cast<int>(workers_.size());
+    }
+
+private:
+    // completion state of one run_parallel call
+    struct TaskGroup {
+        int n_pending;
+        std::exception_ptr error;
+    };
+
+    struct QueuedTask {
+        const Task* task;
+        TaskGroup* group;
+    };
+
+    std::vector<std::thread> workers_;
+
+    // bounded ring buffer, tasks that don't fit are run by the caller
+    std::vector<QueuedTask> queue_;
+    std::size_t head_;
+    std::size_t size_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stop_;
+
+    void worker_loop(int id, bool pin);
+
+    // pop a task and run it, must be called with the lock held
+    // only a task of the given group if there is one, returns false if there is no such task queued
+    bool run_one(std::unique_lock<std::mutex>& lock, const TaskGroup* group=nullptr);
+    static void execute(const QueuedTask& queued, std::exception_ptr& error);
+};
+
+} // namespace
+
+#endif //HRI_PLANNER_THREAD_POOL_H
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/7/2018
-// Last revision: 3/13/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -13,23 +13,244 @@
 #define HRI_PLANNER_TRAJECTORY_H
 
 #include <memory>
+#include <map>
+#include <mutex>
+#include <tuple>
+
 #include <Eigen/Dense>
 
 #include "hri_planner/dynamics.h"
 
 namespace hri_planner {
 
+//! rolls out the dynamics over the horizon with the inlined kernels, no allocations
+template<DynamicsModel M, typename DerivedX0, typename DerivedU, typename DerivedX>
+inline void rollout_dynamics(const Eigen::MatrixBase<DerivedX0>& x0, const Eigen::MatrixBase<DerivedU>& u,
+                             int T, double dt, const Eigen::MatrixBase<DerivedX>& x_out)
+{
+    typedef DynamicsTraits<M> Dyn;
+    Eigen::MatrixBase<DerivedX>& x = const_cast<Eigen::MatrixBase<DerivedX>&>(x_out);
+
+    if (T < 1)
+        return;
+
+    Dyn::forward_dyn(x0, u.template segment<Dyn::nU>(0), dt, x.template segment<Dyn::nX>(0));
+    for (int t = 1; t < T; ++t) {
+        Dyn::forward_dyn(x.template segment<Dyn::nX>((t-1) * Dyn::nX),
+                         u.template segment<Dyn::nU>(t * Dyn::nU),
+                         dt, x.template segment<Dyn::nX>(t * Dyn::nX));
+    }
+}
+
+//! evaluates the per-step dynamics jacobians A_t = df/dx_{t-1}, B_t = df/du_t
+template<DynamicsModel M, typename DerivedX0, typename DerivedX, typename DerivedU, typename DerivedA, typename DerivedB>
+inline void rollout_jacobian_blocks(const Eigen::MatrixBase<DerivedX0>& x0, const Eigen::MatrixBase<DerivedX>& x,
+                                    const Eigen::MatrixBase<DerivedU>& u, int T, double dt,
+                                    const Eigen::MatrixBase<DerivedA>& A_out, const Eigen::MatrixBase<DerivedB>& B_out)
+{
+    typedef DynamicsTraits<M> Dyn;
+    const int nX = Dyn::nX;
+    const int nU = Dyn::nU;
+
+    Eigen::MatrixBase<DerivedA>& A = const_cast<Eigen::MatrixBase<DerivedA>&>(A_out);
+    Eigen::MatrixBase<DerivedB>& B = const_cast<Eigen::MatrixBase<DerivedB>&>(B_out);
+
+    if (T < 1)
+        return;
+
+    Dyn::grad_x(x0, u.template segment<nU>(0), dt, A.template block<nX, nX>(0, 0));
+    Dyn::grad_u(x0, u.template segment<nU>(0), dt, B.template block<nX, nU>(0, 0));
+    for (int t = 1; t < T; ++t) {
+        Dyn::grad_x(x.template segment<nX>((t-1)*nX), u.template segment<nU>(t*nU), dt,
+                    A.template block<nX, nX>(0, t*nX));
+        Dyn::grad_u(x.template segment<nX>((t-1)*nX), u.template segment<nU>(t*nU), dt,
+                    B.template block<nX, nU>(0, t*nU));
+    }
+}
+
+//! adjoint pass grad_u += Ju^T * grad_x, without forming any jacobian
+template<DynamicsModel M, typename DerivedX0, typename DerivedX, typename DerivedU, typename DerivedG, typename DerivedGu>
+inline void rollout_backprop(const Eigen::MatrixBase<DerivedX0>& x0, const Eigen::MatrixBase<DerivedX>& x,
+                             const Eigen::MatrixBase<DerivedU>& u, int T, double dt,
+                             const Eigen::MatrixBase<DerivedG>& grad_x,
+                             const Eigen::MatrixBase<DerivedGu>& grad_u_out)
+{
+    typedef DynamicsTraits<M> Dyn;
+    const int nX = Dyn::nX;
+    const int nU = Dyn::nU;
+
+    Eigen::MatrixBase<DerivedGu>& grad_u = const_cast<Eigen::MatrixBase<DerivedGu>&>(grad_u_out);
+
+    // lambda_t = grad_x_t + A_{t+1}^T * lambda_{t+1}, grad_u_t += B_t^T * lambda_t
+    Eigen::Matrix<double, nX, 1> lambda;
+    Eigen::Matrix<double, nX, 1> lambda_next;
+    Eigen::Matrix<double, nU, 1> gu;
+
+    lambda_next.setZero();
+    for (int t = T-1; t > 0; --t) {
+        lambda = grad_x.template segment<nX>(t*nX) + lambda_next;
+
+        Dyn::vjp_u(x.template segment<nX>((t-1)*nX), u.template segment<nU>(t*nU), dt, lambda, gu);
+        grad_u.template segment<nU>(t*nU) += gu;
+        Dyn::vjp_x(x.template segment<nX>((t-1)*nX), u.template segment<nU>(t*nU), dt, lambda, lambda_next);
+    }
+
+    if (T > 0) {
+        lambda = grad_x.template segment<nX>(0) + lambda_next;
+        Dyn::vjp_u(x0, u.template segment<nU>(0), dt, lambda, gu);
+        grad_u.template segment<nU>(0) += gu;
+    }
+}
+
+//! horizons of the common planner settings, rolled out with compile-time sizes
+enum { HORIZON_SHORT = 6, HORIZON_LONG = 10 };
+
+//! rollouts with the state/control sizes and the horizon fixed at compile time
+// the data is viewed through fixed-size maps, so the loops over the horizon unroll fully
+template<DynamicsModel M, int T>
+struct FixedHorizonRollout {
+    typedef DynamicsTraits<M> Dyn;
+    enum { nX = Dyn::nX, nU = Dyn::nU, nXt = T * Dyn::nX, nUt = T * Dyn::nU };
+
+    typedef Eigen::Map<const Eigen::Matrix<double, nX, 1> > ConstStateMap;
+    typedef Eigen::Map<const Eigen::Matrix<double, nXt, 1> > ConstTrajStateMap;
+    typedef Eigen::Map<const Eigen::Matrix<double, nUt, 1> > ConstTrajControlMap;
+    typedef Eigen::Map<Eigen::Matrix<double, nXt, 1> > TrajStateMap;
+    typedef Eigen::Map<Eigen::Matrix<double, nUt, 1> > TrajControlMap;
+
+    static inline void compute(const double* x0, const double* u, double dt, double* x) {
+        rollout_dynamics<M>(ConstStateMap(x0), ConstTrajControlMap(u), T, dt, TrajStateMap(x));
+    }
+
+    // A and B are the column-major nX x (T*nX) and nX x (T*nU) stacked blocks
+    static inline void jacobian_blocks(const double* x0, const double* x, const double* u, double dt,
+                                       double* A, double* B) {
+        rollout_jacobian_blocks<M>(ConstStateMap(x0), ConstTrajStateMap(x), ConstTrajControlMap(u), T, dt,
+                                   Eigen::Map<Eigen::Matrix<double, nX, nXt> >(A),
+                                   Eigen::Map<Eigen::Matrix<double, nX, nUt> >(B));
+    }
+
+    static inline void backprop(const double* x0, const double* x, const double* u, double dt,
+                                const double* grad_x, double* grad_u) {
+        rollout_backprop<M>(ConstStateMap(x0), ConstTrajStateMap(x), ConstTrajControlMap(u), T, dt,
+                            ConstTrajStateMap(grad_x), TrajControlMap(grad_u));
+    }
+};
+
+//! block representation of the trajectory jacobian Ju = dx/du
+// only the per-step A_t/B_t are stored, so products with Ju cost O(T) instead of O(T^2)
+class StructuredJacobian {
+public:
+    typedef Eigen::Ref<Eigen::VectorXd> VecRef;
+    typedef Eigen::Ref<Eigen::MatrixXd> MatRef;
+    typedef const Eigen::Ref<const Eigen::VectorXd> ConstVecRef;
+    typedef Eigen::Ref<Eigen::VectorXd, 0, Eigen::InnerStride<> > StridedVecRef;
+
+    // stack storage large enough for the state of any dynamics model
+    enum { MaxStateSize = 4 };
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MaxStateSize, 1> StateBuffer;
+
+    StructuredJacobian(): nX_(0), nU_(0), T_(0) {};
+    StructuredJacobian(int nX, int nU, int T);
+
+    void resize(int nX, int nU, int T);
+
+    // out = Ju * v, forward propagation
+    void mult(ConstVecRef v, VecRef out) const;
+
+    // out = Ju^T * w, backward (adjoint) propagation
+    void transpose_mult(ConstVecRef w, VecRef out) const;
+
+    // out = Ju^T * w for a w that is only non-zero at step t
+    // w_t may only cover the leading states (e.g. the position)
+    void transpose_mult_step(int t, ConstVecRef w_t, StridedVecRef out) const;
+
+    // out += Ju^T * w for the same single-step w, only touches the controls up to step t
+    void transpose_mult_step_add(int t, ConstVecRef w_t, StridedVecRef out) const;
+
+    // assemble the dense nXt x nUt jacobian
+    void to_dense(MatRef Ju) const;
+
+    inline Eigen::Block<Eigen::MatrixXd> A(int t) {
+        return A_.block(0, t * nX_, nX_, nX_);
+    }
+
+    inline Eigen::Block<const Eigen::MatrixXd> A(int t) const {
+        return A_.block(0, t * nX_, nX_, nX_);
+    }
+
+    inline Eigen::Block<Eigen::MatrixXd> B(int t) {
+        return B_.block(0, t * nU_, nX_, nU_);
+    }
+
+    inline Eigen::Block<const Eigen::MatrixXd> B(int t) const {
+        return B_.block(0, t * nU_, nX_, nU_);
+    }
+
+    inline Eigen::MatrixXd& A_blocks() {
+        return A_;
+    }
+
+    inline Eigen::MatrixXd& B_blocks() {
+        return B_;
+    }
+
+private:
+    int nX_;
+    int nU_;
+    int T_;
+
+    // A_t and B_t stacked horizontally
+    Eigen::MatrixXd A_;
+    Eigen::MatrixXd B_;
+};
+
+//! constant trajectory jacobians of the linear time-invariant models
+// they only depend on the horizon and the time step, so all trajectories share one copy
+class LinearJacobianCache {
+public:
+    struct Entry {
+        Eigen::MatrixXd Ju;
+        StructuredJacobian Ju_blocks;
+    };
+
+    // thread-safe, builds the entry in closed form on first use
+    static std::shared_ptr<const Entry> get(DynamicsModel dyn_type, int T, double dt);
+
+private:
+    typedef std::tuple<int, int, double> Key;
+
+    static std::shared_ptr<Entry> create(DynamicsModel dyn_type, int T, double dt);
+
+    static std::mutex mutex_;
+    static std::map<Key, std::shared_ptr<const Entry> > cache_;
+};
+
 class Trajectory {
 public:
     // constructors
     Trajectory() = default;
     Trajectory(DynamicsModel dyn_type, int T, double dt);
 
-    void update(const Eigen::VectorXd& x0_new, const Eigen::VectorXd& u_new);
-    void update(const Eigen::VectorXd& u_new);
+    // takes refs so that mapped optimizer data can be passed in without a copy
+    void update(const Eigen::Ref<const Eigen::VectorXd>& x0_new, const Eigen::Ref<const Eigen::VectorXd>& u_new);
+    void update(const Eigen::Ref<const Eigen::VectorXd>& u_new);
     void compute();
+
+    // computes both the structured and the dense jacobian
     void compute_jacobian();
 
+    // only computes the per-step blocks, Ju is left untouched
+    void compute_jacobian_blocks();
+
+    // true if the jacobian is constant and doesn't need recomputation
+    inline bool jacobian_const() const {
+        return jacobian_const_;
+    }
+
+    // adjoint pass through the dynamics: grad_u += Ju^T * grad_x, needs no jacobian
+    void backprop(const Eigen::Ref<const Eigen::VectorXd>& grad_x, Eigen::Ref<Eigen::VectorXd> grad_u) const;
+
     // overloading the = operator
     Trajectory& operator=(const Trajectory& traj);
 
@@ -61,6 +282,7 @@ public:
     Eigen::VectorXd x;
     Eigen::VectorXd u;
     Eigen::MatrixXd Ju;
+    StructuredJacobian Ju_blocks;
 
     DynamicsModel dyn_type;
 
@@ -73,7 +295,23 @@ private:
     int nXt_;
     int nUt_;
 
+    // linear dynamics load the cached jacobian once
+    bool jacobian_const_ = false;
+    bool jacobian_loaded_ = false;
+
     std::shared_ptr<DynamicsBase> dyn_;
+
+    void load_const_jacobian();
+
+    // dispatch to the fixed-horizon rollouts for the common horizons, dynamic sizes otherwise
+    template<DynamicsModel M>
+    void compute_model();
+
+    template<DynamicsModel M>
+    void compute_jacobian_blocks_model();
+
+    template<DynamicsModel M>
+    void backprop_model(const Eigen::Ref<const Eigen::VectorXd>& grad_x, Eigen::Ref<Eigen::VectorXd> grad_u) const;
 };
 
 }
@@ -0,0 +1,77 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#ifndef HRI_PLANNER_WARM_START_H
+#define HRI_PLANNER_WARM_START_H
+
+#include <vector>
+#include <deque>
+
+#include <Eigen/Dense>
+
+#include "hri_planner/trajectory.h"
+
+namespace hri_planner {
+
+// keeps the last few plans with the human responses, to be reused as initial guesses
+// a plan stored k cycles ago is shifted by k steps, so older plans stay usable when the latest one fails
+class WarmStartCache {
+public:
+    explicit WarmStartCache(int capacity=3);
+
+    // store a plan solved in the current cycle, the oldest one is dropped when full
+    // human_ids[k] identifies the person human k responded for
+    void push(const Trajectory& robot_traj, const std::vector<Trajectory>& human_trajs_hp,
+              const std::vector<Trajectory>& human_trajs_rp, const std::vector<int>& human_ids);
+
+    // start a new planning cycle, plans older than the horizon are dropped
+    void advance();
+
+    void clear() {
+        entries_.clear();
+    }
+
+    int size() const {
+        return static_cast<int>(entries_.size());
+    }
+
+    // number of cycles since plan i was stored, plan 0 is the latest
+    int age(int i) const {
+        return entries_[i].age;
+    }
+
+    // shifted plan i rolled out from the current states, each human gets the stored responses of the same id
+    // returns false if one of the humans isn't in the plan
+    bool get_candidate(int i, const Eigen::VectorXd& xr, const std::vector<Eigen::VectorXd>& xh,
+                       const std::vector<int>& human_ids, Trajectory& robot_traj,
+                       std::vector<Trajectory>& human_trajs_hp, std::vector<Trajectory>& human_trajs_rp) const;
+
+private:
+    struct Entry {
+        Eigen::VectorXd ur;
+        std::vector<Eigen::VectorXd> uh_hp;
+        std::vector<Eigen::VectorXd> uh_rp;
+        std::vector<int> human_ids;
+        int horizon;
+        int age;
+    };
+
+    int capacity_;
+    std::deque<Entry> entries_;
+
+    // shift the controls by n steps and roll out from x0
+    // the robot keeps its last control (pad_zero false) and the humans stop accelerating (pad_zero true)
+    static void rollout(const Eigen::VectorXd& x0, const Eigen::VectorXd& u, int n, bool pad_zero, Trajectory& traj);
+};
+
+}
+
+#endif //HRI_PLANNER_WARM_START_H
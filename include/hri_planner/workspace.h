@@ -0,0 +1,130 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#ifndef HRI_PLANNER_WORKSPACE_H
+#define HRI_PLANNER_WORKSPACE_H
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Dense>
+
+namespace hri_planner {
+
+// preallocated storage for the temporaries of the cost evaluations
+// buffers are taken and returned in stack order, so the memory is reused across evaluations
+class Workspace {
+public:
+    explicit Workspace(std::size_t capacity=0);
+
+    // grow the storage, can't be called while buffers are in use
+    void reserve(std::size_t capacity);
+
+    // returns nullptr if the request doesn't fit
+    double* allocate(std::size_t size);
+    void release(double* data);
+
+    std::size_t capacity() const {
+        return buffer_.size();
+    }
+
+    std::size_t used() const {
+        return top_;
+    }
+
+    // usage statistics, to check the reserved size
+    std::size_t peak() const {
+        return peak_;
+    }
+
+    int overflow_count() const {
+        return overflow_count_;
+    }
+
+    void reset_stats() {
+        peak_ = top_;
+        overflow_count_ = 0;
+    }
+
+    // workspace installed on the calling thread, nullptr if none
+    static Workspace* current() {
+        return current_;
+    }
+
+    // a generous bound of the scratch memory needed by one evaluation with horizon T
+    static std::size_t default_capacity(int T);
+
+private:
+    friend class WorkspaceScope;
+
+    std::vector<double> buffer_;
+    std::size_t top_;
+
+    std::size_t peak_;
+    int overflow_count_;
+
+    static thread_local Workspace* current_;
+};
+
+// installs a workspace on the calling thread for the lifetime of the scope
+class WorkspaceScope {
+public:
+    explicit WorkspaceScope(Workspace& workspace): prev_(Workspace::current_) {
+        Workspace::current_ = &workspace;
+    }
+
+    ~WorkspaceScope() {
+        Workspace::current_ = prev_;
+    }
+
+    WorkspaceScope(const WorkspaceScope&) = delete;
+    WorkspaceScope& operator=(const WorkspaceScope&) = delete;
+
+private:
+    Workspace* prev_;
+};
+
+namespace internal {
+
+class ScratchStorage {
+protected:
+    explicit ScratchStorage(std::size_t size);
+    ~ScratchStorage();
+
+    ScratchStorage(const ScratchStorage&) = delete;
+    ScratchStorage& operator=(const ScratchStorage&) = delete;
+
+    double* data_;
+    std::size_t size_;
+    Workspace* workspace_;
+};
+
+} // namespace internal
+
+// a temporary vector/matrix that lives in the current workspace
+// falls back to the heap if there is no workspace or it is full
+template <typename PlainType>
+class Scratch: private internal::ScratchStorage, public Eigen::Map<PlainType> {
+    typedef Eigen::Map<PlainType> Base;
+public:
+    explicit Scratch(int size): ScratchStorage(size), Base(data_, size) {}
+    Scratch(int rows, int cols): ScratchStorage(rows * cols), Base(data_, rows, cols) {}
+
+    using Base::operator=;
+    Scratch& operator=(const Scratch& other) {
+        Base::operator=(other);
+        return *this;
+    }
+};
+
+} // namespace
+
+#endif //HRI_PLANNER_WORKSPACE_H
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 2/27/2018
-// Last revision: 3/29/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -12,6 +12,10 @@
 #include <string>
 #include <fstream>
 #include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <limits>
 
 #include "ros/ros.h"
 #include "std_msgs/Float64.h"
@@ -21,12 +25,31 @@
 #include "hri_planner/human_belief_model.h"
 #include "hri_planner/cost_features.h"
 #include "hri_planner/cost_features_vectorized.h"
+#include "hri_planner/cost_features_autodiff.h"
+#include "hri_planner/costs_static.h"
 #include "hri_planner/cost_probabilistic.h"
 #include "hri_planner/optimizer.h"
+#include "hri_planner/warm_start.h"
+#include "hri_planner/mailbox.h"
 
 #include "hri_planner/BeliefUpdate.h"
 #include "hri_planner/TestComponent.h"
 
+#ifdef __GLIBC__
+// count heap allocations made by the calling thread, for test_allocations
+extern "C" void* __libc_malloc(size_t size);
+
+static thread_local bool count_allocations = false;
+static thread_local long allocation_count = 0;
+
+extern "C" void* malloc(size_t size)
+{
+    if (count_allocations)
+        ++allocation_count;
+    return __libc_malloc(size);
+}
+#endif
+
 
 //! helper functions to reuse code
 void create_belief_model(std::shared_ptr<hri_planner::BeliefModelBase>& belief_model)
@@ -85,7 +108,408 @@ void create_probabilistic_cost(std::shared_ptr<hri_planner::NestedTrajectoryOpti
 
 }
 
+// squared distance to the robot over the human horizon, the robot horizon may be longer
+// so that the human costs are tested with a cross hessian that isn't square
+class RobotDistanceTestCost: public hri_planner::FeatureHumanCost {
+public:
+    double compute(const hri_planner::Trajectory& robot_traj, const hri_planner::Trajectory& human_traj) override
+    {
+        double cost = 0.0;
+        for (int t = 0; t < human_traj.horizon(); ++t)
+            cost += pos_diff(robot_traj, human_traj, t).squaredNorm();
+
+        return cost;
+    }
+
+    void grad_uh(const hri_planner::Trajectory& robot_traj, const hri_planner::Trajectory& human_traj,
+                 VecRef grad) override
+    {
+        Eigen::VectorXd grad_x = Eigen::VectorXd::Zero(human_traj.traj_state_size());
+        for (int t = 0; t < human_traj.horizon(); ++t)
+            grad_x.segment(t * human_traj.state_size(), 2) = 2.0 * pos_diff(robot_traj, human_traj, t);
+
+        grad = human_traj.Ju.transpose() * grad_x;
+    }
+
+    void grad_ur(const hri_planner::Trajectory& robot_traj, const hri_planner::Trajectory& human_traj,
+                 VecRef grad) override
+    {
+        Eigen::VectorXd grad_x = Eigen::VectorXd::Zero(robot_traj.traj_state_size());
+        for (int t = 0; t < human_traj.horizon(); ++t)
+            grad_x.segment(t * robot_traj.state_size(), 2) = -2.0 * pos_diff(robot_traj, human_traj, t);
+
+        grad = robot_traj.Ju.transpose() * grad_x;
+    }
+
+    void hessian_uh(const hri_planner::Trajectory& robot_traj, const hri_planner::Trajectory& human_traj,
+                    MatRef hess) override
+    {
+        step_hessian(human_traj, 0, human_traj, 0, step_blocks(human_traj.horizon(), 2.0), hess);
+    }
+
+    void hessian_uh_ur(const hri_planner::Trajectory& robot_traj, const hri_planner::Trajectory& human_traj,
+                       MatRef hess) override
+    {
+        step_hessian(human_traj, 0, robot_traj, 0, step_blocks(human_traj.horizon(), -2.0), hess);
+    }
+
+    void set_data(const void* data) override {};
+
+private:
+    static Eigen::Vector2d pos_diff(const hri_planner::Trajectory& robot_traj,
+                                    const hri_planner::Trajectory& human_traj, int t)
+    {
+        return human_traj.x.segment(t * human_traj.state_size(), 2) -
+                robot_traj.x.segment(t * robot_traj.state_size(), 2);
+    }
+
+    static Eigen::MatrixXd step_blocks(int T, double val)
+    {
+        Eigen::MatrixXd H(2, 2 * T);
+        for (int t = 0; t < T; ++t)
+            H.block(0, t * 2, 2, 2) = val * Eigen::Matrix2d::Identity();
+
+        return H;
+    }
+};
+
+// a control cost with a broken hessian, for the fallback of the projected newton solver
+class NanHessianTestCost: public hri_planner::HumanAccCost {
+public:
+    void hessian_uh(const hri_planner::Trajectory& robot_traj, const hri_planner::Trajectory& human_traj,
+                    MatRef hess) override
+    {
+        hess.setConstant(std::numeric_limits<double>::quiet_NaN());
+    }
+};
+
+// the trajectory belief update as it was before the explicit beliefs were precomputed, one step at a time
+class LoopBeliefModel: public hri_planner::BeliefModelExponential {
+public:
+    using hri_planner::BeliefModelExponential::BeliefModelExponential;
+
+    void update_belief_loop(const hri_planner::Trajectory& robot_traj, const hri_planner::Trajectory& human_traj,
+                            int acomm, double tcomm, double t0, VecRef belief, MatRef jacobian)
+    {
+        int T = robot_traj.horizon();
+        Eigen::VectorXd costs_hp(T);
+        Eigen::VectorXd costs_rp(T);
+        Eigen::MatrixXd jacobian_hp(T, robot_traj.traj_control_size());
+        Eigen::MatrixXd jacobian_rp(T, robot_traj.traj_control_size());
+
+        implicit_cost(robot_traj, human_traj, costs_hp, jacobian_hp, costs_rp, jacobian_rp);
+
+        double dt = robot_traj.dt();
+        double tcurr = t0;
+        for (int t = 0; t < T; ++t) {
+            tcurr += dt;
+            double p_ex_hp = belief_explicit(hri_planner::HumanPriority, tcurr, acomm, tcomm);
+            double p_ex_rp = belief_explicit(hri_planner::RobotPriority, tcurr, acomm, tcomm);
+
+            double p_im_hp = std::exp(-fcorrection_[hri_planner::HumanPriority] * costs_hp(t));
+            double p_im_rp = std::exp(-fcorrection_[hri_planner::RobotPriority] * costs_rp(t));
+
+            double den_inv = 1.0 / (p_ex_hp * p_im_hp + p_ex_rp * p_im_rp);
+            belief(t) = p_ex_hp * p_im_hp * den_inv;
+
+            jacobian.row(t) = den_inv * den_inv * p_ex_hp * p_im_hp * p_ex_rp * p_im_rp *
+                    (fcorrection_[hri_planner::RobotPriority] * jacobian_rp.row(t) -
+                            fcorrection_[hri_planner::HumanPriority] * jacobian_hp.row(t));
+        }
+    }
+};
+
+// the exponential belief with a smooth implicit cost and exact jacobians, so that gradient checks of the
+// multi-intent costs are not limited by the approximate jacobian of the history-based implicit cost
+class SmoothBeliefModel: public hri_planner::BeliefModelExponential {
+public:
+    using hri_planner::BeliefModelExponential::BeliefModelExponential;
+
+protected:
+    void implicit_cost(const hri_planner::Trajectory& robot_traj, const hri_planner::Trajectory& human_traj,
+                       VecRef costs_hp, MatRef jacobian_hp, VecRef costs_rp, MatRef jacobian_rp) override
+    {
+        jacobian_hp.setZero();
+        jacobian_rp.setZero();
+
+        double cost_hp = 0.0;
+        double cost_rp = 0.0;
+        for (int t = 0; t < robot_traj.horizon(); ++t) {
+            const int st = t * 2;
+            const double v = robot_traj.u(st);
+            const double om = robot_traj.u(st + 1);
+
+            cost_hp += 0.05 * v * v;
+            cost_rp += 0.05 * (om - 0.2) * (om - 0.2);
+            costs_hp(t) = cost_hp;
+            costs_rp(t) = cost_rp;
+
+            if (t > 0) {
+                jacobian_hp.row(t) = jacobian_hp.row(t-1);
+                jacobian_rp.row(t) = jacobian_rp.row(t-1);
+            }
+            jacobian_hp(t, st) = 0.1 * v;
+            jacobian_rp(t, st + 1) = 0.1 * (om - 0.2);
+        }
+    }
+};
+
+// largest central difference error of grad, the gradient of eval() w.r.t. the controls of traj,
+// relative to the gradient size
+template <typename Eval>
+double central_diff_error(hri_planner::Trajectory& traj, const Eigen::VectorXd& grad, Eval eval)
+{
+    const double eps = 1e-6;
+
+    Eigen::VectorXd u = traj.u;
+    Eigen::VectorXd u_diff = u;
+    Eigen::VectorXd grad_diff(u.size());
+
+    for (int i = 0; i < u.size(); ++i) {
+        u_diff(i) = u(i) + eps;
+        traj.update(u_diff);
+        traj.compute_jacobian();
+        double cost_plus = eval();
+
+        u_diff(i) = u(i) - eps;
+        traj.update(u_diff);
+        traj.compute_jacobian();
+        double cost_minus = eval();
+
+        u_diff(i) = u(i);
+        grad_diff(i) = (cost_plus - cost_minus) / (2.0 * eps);
+    }
+    traj.update(u);
+    traj.compute_jacobian();
+
+    return (grad - grad_diff).cwiseAbs().maxCoeff() / std::max(1.0, grad_diff.cwiseAbs().maxCoeff());
+}
+
+// largest central difference error of the feature gradients w.r.t. uh and ur, relative to the gradient size
+double feature_grad_error(hri_planner::FeatureBase& feature, hri_planner::Trajectory robot_traj,
+                          hri_planner::Trajectory human_traj)
+{
+    const double eps = 1e-6;
+
+    robot_traj.compute_jacobian();
+    human_traj.compute_jacobian();
+
+    Eigen::VectorXd grad[2] = {Eigen::VectorXd(human_traj.traj_control_size()),
+                               Eigen::VectorXd(robot_traj.traj_control_size())};
+    feature.grad_uh(robot_traj, human_traj, grad[0]);
+    feature.grad_ur(robot_traj, human_traj, grad[1]);
+
+    double err = 0.0;
+    for (int k = 0; k < 2; ++k) {
+        hri_planner::Trajectory& traj = k == 0 ? human_traj : robot_traj;
+        Eigen::VectorXd u = traj.u;
+        Eigen::VectorXd u_diff = u;
+        Eigen::VectorXd grad_diff(u.size());
+
+        for (int i = 0; i < u.size(); ++i) {
+            u_diff(i) = u(i) + eps;
+            traj.update(u_diff);
+            double cost_plus = feature(robot_traj, human_traj);
+
+            u_diff(i) = u(i) - eps;
+            traj.update(u_diff);
+            double cost_minus = feature(robot_traj, human_traj);
+
+            u_diff(i) = u(i);
+            grad_diff(i) = (cost_plus - cost_minus) / (2.0 * eps);
+        }
+        traj.update(u);
+
+        double scale = std::max(1.0, grad_diff.cwiseAbs().maxCoeff());
+        err = std::max(err, (grad[k] - grad_diff).cwiseAbs().maxCoeff() / scale);
+    }
+
+    return err;
+}
+
+// largest central difference error of the feature hessians w.r.t. uh and (uh, ur), relative to the hessian size
+// the differences are taken of the analytic gradient w.r.t. uh, which is checked by feature_grad_error
+double feature_hessian_error(hri_planner::FeatureHumanCost& feature, hri_planner::Trajectory robot_traj,
+                             hri_planner::Trajectory human_traj)
+{
+    const double eps = 1e-6;
+
+    robot_traj.compute_jacobian();
+    human_traj.compute_jacobian();
+
+    int len_uh = human_traj.traj_control_size();
+    int len_ur = robot_traj.traj_control_size();
+
+    Eigen::MatrixXd hess[2] = {Eigen::MatrixXd(len_uh, len_uh), Eigen::MatrixXd(len_uh, len_ur)};
+    feature.hessian_uh(robot_traj, human_traj, hess[0]);
+    feature.hessian_uh_ur(robot_traj, human_traj, hess[1]);
+
+    Eigen::VectorXd grad_plus(len_uh);
+    Eigen::VectorXd grad_minus(len_uh);
+
+    double err = 0.0;
+    for (int k = 0; k < 2; ++k) {
+        hri_planner::Trajectory& traj = k == 0 ? human_traj : robot_traj;
+        Eigen::VectorXd u = traj.u;
+        Eigen::VectorXd u_diff = u;
+        Eigen::MatrixXd hess_diff(len_uh, u.size());
+
+        for (int i = 0; i < u.size(); ++i) {
+            u_diff(i) = u(i) + eps;
+            traj.update(u_diff);
+            traj.compute_jacobian();
+            feature.grad_uh(robot_traj, human_traj, grad_plus);
+
+            u_diff(i) = u(i) - eps;
+            traj.update(u_diff);
+            traj.compute_jacobian();
+            feature.grad_uh(robot_traj, human_traj, grad_minus);
+
+            u_diff(i) = u(i);
+            hess_diff.col(i) = (grad_plus - grad_minus) / (2.0 * eps);
+        }
+        traj.update(u);
+        traj.compute_jacobian();
+
+        double scale = std::max(1.0, hess_diff.cwiseAbs().maxCoeff());
+        err = std::max(err, (hess[k] - hess_diff).cwiseAbs().maxCoeff() / scale);
+    }
+
+    return err;
+}
+
 // function for testing the belief update
+// create a naive nested optimizer with the test costs and bounds
+std::shared_ptr<hri_planner::NaiveNestedOptimizer> create_naive_nested_optimizer(const std::vector<double>& weights,
+                                                                                 int T, int nUr, int nUh)
+{
+    using namespace hri_planner;
+
+    // human costs
+    std::vector<std::shared_ptr<FeatureBase> > features_hp;
+    std::vector<std::shared_ptr<FeatureBase> > features_rp;
+
+    Eigen::VectorXd x_goal(2);
+    x_goal << 0.73216, 6.00955;
+
+    create_human_costs(features_hp, x_goal);
+    create_human_costs(features_rp, x_goal);
+
+    int nf_human = 5;
+    std::vector<double> w_hp(weights.begin(), weights.begin()+nf_human);
+    std::vector<double> w_rp(weights.begin()+nf_human, weights.begin()+nf_human*2);
+
+    auto single_cost_hp = std::make_shared<SingleTrajectoryCostHuman>(w_hp, features_hp);
+    auto single_cost_rp = std::make_shared<SingleTrajectoryCostHuman>(w_rp, features_rp);
+
+    // robot cost
+    std::vector<std::shared_ptr<FeatureBase> > f_non_int;
+    std::vector<std::shared_ptr<FeatureVectorizedBase> > f_int;
+
+    x_goal << 4., 4.;
+    create_robot_costs(f_non_int, f_int, x_goal);
+
+    std::shared_ptr<BeliefModelBase> belief_model;
+    create_belief_model(belief_model);
+
+    auto robot_cost = std::make_shared<ProbabilisticCostSimplified>(belief_model);
+
+    int n_f_non_int = 2;
+    std::vector<double> w_non_int(weights.begin()+nf_human*2, weights.begin()+nf_human*2+n_f_non_int);
+    std::vector<double> w_int(weights.begin()+nf_human*2+n_f_non_int, weights.end());
+
+    robot_cost->set_features_non_int(w_non_int, f_non_int);
+    robot_cost->set_features_int(w_int, f_int);
+
+    // the optimizer
+    auto optimizer = std::make_shared<NaiveNestedOptimizer>(static_cast<unsigned int>(T * nUr),
+                                                            static_cast<unsigned int>(T * nUh),
+                                                            nlopt::LD_SLSQP, nlopt::LD_SLSQP);
+    optimizer->set_human_cost(single_cost_hp, single_cost_rp);
+    optimizer->set_robot_cost(robot_cost);
+
+    // bounds
+    Eigen::VectorXd lb_ur(T * nUr);
+    Eigen::VectorXd ub_ur(T * nUr);
+    Eigen::VectorXd lb_uh(T * nUh);
+    Eigen::VectorXd ub_uh(T * nUh);
+
+    for (int t = 0; t < T; ++t) {
+        int stu = t * nUr;
+        lb_ur(stu) = -0.55;
+        ub_ur(stu) = 0.55;
+        lb_ur(stu+1) = -2.0;
+        ub_ur(stu+1) = 2.0;
+    }
+
+    lb_uh.setOnes(); lb_uh *= -10.0;
+    ub_uh.setOnes(); ub_uh *= 10.0;
+
+    optimizer->set_bounds(lb_ur, ub_ur, lb_uh, ub_uh);
+
+    return optimizer;
+}
+
+// create a multi-human nested optimizer with the test costs and bounds, one human per belief model
+// and optionally intents between the two priorities
+std::shared_ptr<hri_planner::MultiHumanNestedOptimizer> create_multi_human_optimizer(
+        const std::vector<std::shared_ptr<hri_planner::BeliefModelBase> >& belief_models, int T,
+        const std::vector<double>& levels = std::vector<double>())
+{
+    using namespace hri_planner;
+
+    std::vector<double> w_human = {7.0, 20.0, 10.0, 100.0, 100.0};
+    std::vector<double> w_non_int = {1.0, 10.0};
+    std::vector<double> w_int = {1.0, 5.0};
+
+    Eigen::VectorXd xh_goal(2);
+    xh_goal << 0.73216, 6.00955;
+    Eigen::VectorXd xr_goal(2);
+    xr_goal << 4.0, 4.0;
+
+    // robot cost
+    std::vector<std::shared_ptr<FeatureBase> > f_non_int;
+    std::vector<std::shared_ptr<FeatureVectorizedBase> > f_int;
+    create_robot_costs(f_non_int, f_int, xr_goal);
+
+    auto robot_cost = std::make_shared<ProbabilisticCostMultiHuman>(belief_models);
+    robot_cost->set_features_non_int(w_non_int, f_non_int);
+    robot_cost->set_features_int(w_int, f_int);
+    robot_cost->set_intent_levels(levels);
+
+    // the optimizer
+    int n_humans = static_cast<int>(belief_models.size());
+    auto optimizer = std::make_shared<MultiHumanNestedOptimizer>(2 * T, 2 * T, n_humans, nlopt::LD_SLSQP,
+                                                                 nlopt::LD_SLSQP);
+    optimizer->set_robot_cost(robot_cost);
+    optimizer->set_intent_levels(levels);
+
+    // human costs
+    for (int k = 0; k < n_humans; ++k) {
+        std::vector<std::shared_ptr<FeatureBase> > features_hp;
+        std::vector<std::shared_ptr<FeatureBase> > features_rp;
+        create_human_costs(features_hp, xh_goal);
+        create_human_costs(features_rp, xh_goal);
+
+        optimizer->set_human_cost(k, create_static_human_cost(w_human, features_hp),
+                                  create_static_human_cost(w_human, features_rp));
+    }
+
+    // bounds
+    Eigen::VectorXd lb_ur(2 * T);
+    Eigen::VectorXd ub_ur(2 * T);
+    Eigen::VectorXd lb_uh = Eigen::VectorXd::Constant(2 * T, -1.0);
+    Eigen::VectorXd ub_uh = Eigen::VectorXd::Constant(2 * T, 1.0);
+    for (int t = 0; t < T; ++t) {
+        lb_ur.segment(2 * t, 2) << 0.0, -2.0;
+        ub_ur.segment(2 * t, 2) << 0.7, 2.0;
+    }
+
+    optimizer->set_bounds(lb_ur, ub_ur, lb_uh, ub_uh);
+
+    return optimizer;
+}
+
 bool test_belief_update(hri_planner::TestComponent::Request& req,
                         hri_planner::TestComponent::Response& res) {
     // extract the messages
@@ -341,10 +765,54 @@ bool test_cost_features(hri_planner::TestComponent::Request& req,
     logger << "gradient:" << std::endl;
     logger << grad_ur.transpose() << std::endl;
 
-    logger.close();
-    traj_logger.close();
+    // check the gradients against central differences, on the rollout of the controls
+    robot_traj.update(xr0, ur);
+
+    const double tol = 1e-4;
+    FeatureBase* features[7] = {&human_vel_cost, &human_acc_cost, &human_goal_cost, &collision_cost,
+                                &dyn_collision_cost, &robot_control_cost, &robot_goal_cost};
+    const char* names[7] = {"velocity", "acceleration", "human goal", "collision", "dynamic collision",
+                            "robot control", "robot goal"};
 
     res.succeeded = true;
+    logger << std::endl;
+    for (int i = 0; i < 7; ++i) {
+        double err = feature_grad_error(*features[i], robot_traj, human_traj);
+        logger << names[i] << " feature gradient error: " << err << std::endl;
+
+        if (!(err < tol))
+            res.succeeded = false;
+    }
+
+    // the hessians of the human features
+    FeatureHumanCost* features_human[5] = {&human_vel_cost, &human_acc_cost, &human_goal_cost, &collision_cost,
+                                           &dyn_collision_cost};
+    for (int i = 0; i < 5; ++i) {
+        double err = feature_hessian_error(*features_human[i], robot_traj, human_traj);
+        logger << names[i] << " feature hessian error: " << err << std::endl;
+
+        if (!(err < tol))
+            res.succeeded = false;
+    }
+
+    // again with the human right next to the robot, where the collision terms don't vanish
+    Trajectory human_traj_close = human_traj;
+    Eigen::VectorXd xh0_close = human_traj.x0;
+    xh0_close.head(2) = xr0.head(2) + Eigen::Vector2d(0.3, 0.2);
+    human_traj_close.update(xh0_close, human_traj.u);
+
+    for (int i = 3; i < 5; ++i) {
+        double err = std::max(feature_grad_error(*features[i], robot_traj, human_traj_close),
+                              feature_hessian_error(*features_human[i], robot_traj, human_traj_close));
+        logger << names[i] << " feature error next to the robot: " << err << ", value "
+               << (*features[i])(robot_traj, human_traj_close) << std::endl;
+
+        if (!(err < tol))
+            res.succeeded = false;
+    }
+
+    logger.close();
+    traj_logger.close();
 
     return true;
 }
@@ -420,6 +888,14 @@ bool test_simple_optimizer(hri_planner::TestComponent::Request& req,
     ros::Duration t_elapse = ros::Time::now() - t_start;
     logger << "optimization finished successfully, took " << t_elapse.toSec() << " seconds." << std::endl;
 
+    // the optimized controls have to stay within the bounds and can't be worse than the initial ones
+    double cost_init = cost_human->compute(traj_init);
+    double cost_opt = cost_human->compute(traj_opt);
+    logger << "initial cost: " << cost_init << ", optimized cost: " << cost_opt << std::endl;
+
+    res.succeeded = std::isfinite(cost_opt) && cost_opt <= cost_init &&
+            (traj_opt.u - lb).minCoeff() >= 0.0 && (ub - traj_opt.u).minCoeff() >= 0.0;
+
     std::ofstream traj_logger(log_path + "/log_traj.txt");
 
     traj_logger << traj_opt.x << std::endl;
@@ -428,8 +904,6 @@ bool test_simple_optimizer(hri_planner::TestComponent::Request& req,
     logger.close();
     traj_logger.close();
 
-    res.succeeded = true;
-
     return true;
 }
 
@@ -505,9 +979,13 @@ bool test_probabilistic_cost(hri_planner::TestComponent::Request& req,
     human_traj_pred.update(xh0, Eigen::VectorXd::Zero(ur.size()));
 
     // compute
-    Eigen::VectorXd grad_ur;
-    Eigen::VectorXd grad_uh_hp;
-    Eigen::VectorXd grad_uh_rp;
+    Eigen::VectorXd grad_ur(robot_traj.traj_control_size());
+    Eigen::VectorXd grad_uh_hp(human_traj_hp.traj_control_size());
+    Eigen::VectorXd grad_uh_rp(human_traj_rp.traj_control_size());
+
+    robot_traj.compute_jacobian();
+    human_traj_hp.compute_jacobian();
+    human_traj_rp.compute_jacobian();
 
     cost.update_human_pred(human_traj_pred);
     double val = cost.compute(robot_traj, human_traj_hp, human_traj_rp,
@@ -522,11 +1000,189 @@ bool test_probabilistic_cost(hri_planner::TestComponent::Request& req,
     logger << "gradient w.r.t. uh_rp is: " << std::endl;
     logger << grad_uh_rp.transpose() << std::endl;
 
+    // check the gradients against central differences
+    const double eps = 1e-6;
+    const double tol = 1e-4;
+
+    Trajectory* trajs[3] = {&robot_traj, &human_traj_hp, &human_traj_rp};
+    Eigen::VectorXd* grads[3] = {&grad_ur, &grad_uh_hp, &grad_uh_rp};
+    const char* names[3] = {"ur", "uh_hp", "uh_rp"};
+
+    Eigen::VectorXd grad_ur_diff(grad_ur.size());
+    Eigen::VectorXd grad_hp_diff(grad_uh_hp.size());
+    Eigen::VectorXd grad_rp_diff(grad_uh_rp.size());
+
+    res.succeeded = std::isfinite(val);
+    for (int k = 0; k < 3; ++k) {
+        Eigen::VectorXd u = trajs[k]->u;
+        Eigen::VectorXd u_diff = u;
+        Eigen::VectorXd grad_diff(u.size());
+
+        for (int i = 0; i < u.size(); ++i) {
+            u_diff(i) = u(i) + eps;
+            trajs[k]->update(u_diff);
+            double cost_plus = cost.compute(robot_traj, human_traj_hp, human_traj_rp, req.acomm, req.tcomm,
+                                            grad_ur_diff, grad_hp_diff, grad_rp_diff);
+
+            u_diff(i) = u(i) - eps;
+            trajs[k]->update(u_diff);
+            double cost_minus = cost.compute(robot_traj, human_traj_hp, human_traj_rp, req.acomm, req.tcomm,
+                                             grad_ur_diff, grad_hp_diff, grad_rp_diff);
+
+            u_diff(i) = u(i);
+            grad_diff(i) = (cost_plus - cost_minus) / (2.0 * eps);
+        }
+        trajs[k]->update(u);
+
+        double err = (*grads[k] - grad_diff).cwiseAbs().maxCoeff() / std::max(1.0, grad_diff.cwiseAbs().maxCoeff());
+        logger << "gradient error w.r.t. " << names[k] << ": " << err << std::endl;
+
+        if (!(err < tol))
+            res.succeeded = false;
+    }
+
+    return true;
+}
+
+bool test_explicit_belief(hri_planner::TestComponent::Request& req,
+                          hri_planner::TestComponent::Response& res)
+{
+    // extract the messages
+    Eigen::Map<Eigen::VectorXd> ur(req.ur.data(), req.ur.size());
+    Eigen::Map<Eigen::VectorXd> uh(req.uh.data(), req.uh.size());
+    Eigen::Map<Eigen::VectorXd> xr0(req.xr0.data(), req.xr0.size());
+    Eigen::Map<Eigen::VectorXd> xh0(req.xh0.data(), req.xh0.size());
+
+    std::string log_path = req.log_path;
+
+    // create a log file to store the result
+    std::ofstream logger(log_path + "/log_explicit_belief.txt");
+
+    using namespace hri_planner;
+    int T = 10;
+    double dt = 0.5;
+    const double tol = 1e-12;
+
+    // same parameters as create_belief_model
+    int T_hist;
+    double ratio;
+    double decay_rate;
+    std::vector<double> fcorrection(2, 0);
+
+    ros::param::param<int>("~explicit_comm/history_length", T_hist, 10);
+    ros::param::param<double>("~explicit_comm/ratio", ratio, 100.0);
+    ros::param::param<double>("~explicit_comm/decay_rate", decay_rate, 2.5);
+    ros::param::param<double>("~explicit_comm/fcorrection_hp", fcorrection[HumanPriority], 2.0);
+    ros::param::param<double>("~explicit_comm/fcorrection_rp", fcorrection[RobotPriority], 20.0);
+
+    auto belief_model = std::make_shared<LoopBeliefModel>(T_hist, fcorrection, ratio, decay_rate);
+    belief_model->reset_hist(Eigen::Vector2d::Zero());
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    robot_traj.update(xr0, ur);
+    robot_traj.compute_jacobian();
+
+    Trajectory human_traj(CONST_ACC_MODEL, T, dt);
+    human_traj.update(xh0, uh);
+    human_traj.compute_jacobian();
+
     res.succeeded = true;
 
+    //! the forwarding and the precomputed overloads against the per-step loop
+    // for both communication actions, before and after the communication time
+    int len_ur = robot_traj.traj_control_size();
+    Eigen::VectorXd belief_loop(T);
+    Eigen::VectorXd belief(T);
+    Eigen::VectorXd p_ex_hp(T);
+    Eigen::VectorXd p_ex_rp(T);
+    Eigen::MatrixXd jacobian_loop(T, len_ur);
+    Eigen::MatrixXd jacobian(T, len_ur);
+
+    for (int acomm = 0; acomm < 2; ++acomm) {
+        for (double tcomm: {req.tcomm - 1.0, req.tcomm, req.tcomm + 2.0}) {
+            belief_model->update_belief_loop(robot_traj, human_traj, acomm, tcomm, 0.0, belief_loop, jacobian_loop);
+
+            belief_model->update_belief(robot_traj, human_traj, acomm, tcomm, 0.0, belief, jacobian);
+            double err_full = std::max((belief - belief_loop).cwiseAbs().maxCoeff(),
+                                       (jacobian - jacobian_loop).cwiseAbs().maxCoeff());
+
+            belief_model->explicit_belief(acomm, tcomm, 0.0, dt, p_ex_hp, p_ex_rp);
+            belief_model->update_belief(robot_traj, human_traj, p_ex_hp, p_ex_rp, belief, jacobian);
+            double err_ex = std::max((belief - belief_loop).cwiseAbs().maxCoeff(),
+                                     (jacobian - jacobian_loop).cwiseAbs().maxCoeff());
+
+            logger << "acomm " << acomm << ", tcomm " << tcomm << ": error " << err_full
+                   << " (full), " << err_ex << " (precomputed)" << std::endl;
+
+            if (!(err_full < tol && err_ex < tol))
+                res.succeeded = false;
+        }
+    }
+
+    //! probabilistic cost with the explicit beliefs cached or not
+    std::vector<std::shared_ptr<FeatureBase> > f_non_int;
+    std::vector<std::shared_ptr<FeatureVectorizedBase> > f_int;
+
+    Eigen::VectorXd x_goal(2);
+    x_goal << 4., 4.;
+    create_robot_costs(f_non_int, f_int, x_goal);
+
+    std::vector<double> w_non_int = {1.0, 10.0};
+    std::vector<double> w_int = {1.0, 5.0};
+
+    Trajectory human_traj_pred(CONST_ACC_MODEL, T, dt);
+    human_traj_pred.update(xh0, Eigen::VectorXd::Zero(uh.size()));
+
+    // different human responses for the two intents, otherwise the beliefs cancel out of the cost
+    Trajectory human_traj_rp(CONST_ACC_MODEL, T, dt);
+    human_traj_rp.update(xh0, -0.5 * uh);
+    human_traj_rp.compute_jacobian();
+
+    ProbabilisticCost cost_warm(belief_model);
+    cost_warm.set_features_non_int(w_non_int, f_non_int);
+    cost_warm.set_features_int(w_int, f_int);
+    cost_warm.update_human_pred(human_traj_pred);
+
+    Eigen::VectorXd grad[2][3];
+    for (auto& g: grad) {
+        g[0].resize(len_ur);
+        g[1].resize(human_traj.traj_control_size());
+        g[2].resize(human_traj.traj_control_size());
+    }
+
+    // the warm cost is reused for all calls, the cached explicit beliefs are either hit
+    // or replaced because the communication action changed. a new cost is always cold
+    int acomms[4] = {req.acomm, req.acomm, 1 - req.acomm, req.acomm};
+    double tcomms[4] = {req.tcomm, req.tcomm, req.tcomm, req.tcomm + 1.0};
+
+    for (int k = 0; k < 4; ++k) {
+        ProbabilisticCost cost_cold(belief_model);
+        cost_cold.set_features_non_int(w_non_int, f_non_int);
+        cost_cold.set_features_int(w_int, f_int);
+        cost_cold.update_human_pred(human_traj_pred);
+
+        double val_cold = cost_cold.compute(robot_traj, human_traj, human_traj_rp, acomms[k], tcomms[k],
+                                            grad[0][0], grad[0][1], grad[0][2]);
+        double val_warm = cost_warm.compute(robot_traj, human_traj, human_traj_rp, acomms[k], tcomms[k],
+                                            grad[1][0], grad[1][1], grad[1][2]);
+
+        double err = std::abs(val_cold - val_warm);
+        for (int j = 0; j < 3; ++j)
+            err = std::max(err, (grad[0][j] - grad[1][j]).cwiseAbs().maxCoeff());
+
+        logger << "cost with acomm " << acomms[k] << ", tcomm " << tcomms[k] << ": " << val_warm
+               << ", cold/warm error " << err << std::endl;
+
+        if (!(err < tol))
+            res.succeeded = false;
+    }
+
+    logger.close();
+
     return true;
 }
 
+
 bool test_nested_optimizer(hri_planner::TestComponent::Request& req,
                            hri_planner::TestComponent::Response& res)
 {
@@ -628,6 +1284,8 @@ bool test_nested_optimizer(hri_planner::TestComponent::Request& req,
                                                            static_cast<unsigned int>(dim_r),
                                                            nlopt::LD_SLSQP, nlopt::LD_SLSQP);
         optimizer->set_human_cost(single_cost_hp, single_cost_rp);
+        optimizer->set_thread_pool(std::make_shared<ThreadPool>(1));
+        optimizer->set_follower_grad_tol(1e-3);
     }
     else {
         optimizer = std::make_shared<NestedTrajectoryOptimizer>(static_cast<unsigned int>(dim),
@@ -688,6 +1346,7 @@ bool test_nested_optimizer(hri_planner::TestComponent::Request& req,
     // create a simple optimizer
     // first need to create single trajectory costs
     ros::Time t_start;
+    double cost_opt;
     Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T ,dt);
     Trajectory human_traj_hp_new(CONST_ACC_MODEL, T, dt);
     Trajectory human_traj_rp_new(CONST_ACC_MODEL, T, dt);
@@ -727,19 +1386,24 @@ bool test_nested_optimizer(hri_planner::TestComponent::Request& req,
 
         // perform the full optimization!
         t_start = ros::Time::now();
-        optimizer->optimize(robot_traj, human_traj_hp_opt, human_traj_rp_opt, req.acomm, req.tcomm,
+        cost_opt = optimizer->optimize(robot_traj, human_traj_hp_opt, human_traj_rp_opt, req.acomm, req.tcomm,
                             robot_traj_opt, &human_traj_hp_new, &human_traj_rp_new);
     }
     else {
         // perform the full optimization!
         t_start = ros::Time::now();
-        optimizer->optimize(robot_traj, human_traj_hp, human_traj_rp, req.acomm, req.tcomm,
+        cost_opt = optimizer->optimize(robot_traj, human_traj_hp, human_traj_rp, req.acomm, req.tcomm,
                             robot_traj_opt, &human_traj_hp_new, &human_traj_rp_new);
     }
 
     // log the data
     ros::Duration t_elapse = ros::Time::now() - t_start;
     logger << "optimization finished! time taken: " << t_elapse.toSec() << std::endl;
+
+    int neval_hp, neval_rp;
+    optimizer->get_niter_nested(neval_hp, neval_rp);
+    logger << "number of iterations: " << optimizer->get_niter()
+           << ", nested iterations: (" << neval_hp << ", " << neval_rp << ")" << std::endl;
     logger << "optimized robot trajectory is:" << std::endl;
     logger << robot_traj_opt.x.transpose() << std::endl;
     logger << "optimized robot control is:" << std::endl;
@@ -747,6 +1411,12 @@ bool test_nested_optimizer(hri_planner::TestComponent::Request& req,
     logger << "difference from initial control: " << std::endl;
     logger << robot_traj_opt.u.transpose() - robot_traj.u.transpose() << std::endl;
 
+    // the robot controls have to stay within the bounds, with finite human responses
+    res.succeeded = std::isfinite(cost_opt) && (robot_traj_opt.u - lb_ur).minCoeff() >= 0.0 &&
+            (ub_ur - robot_traj_opt.u).minCoeff() >= 0.0 && human_traj_hp_new.x.allFinite() &&
+            human_traj_rp_new.x.allFinite();
+    logger << "optimized cost: " << cost_opt << std::endl;
+
     robot_traj_logger << robot_traj_opt.x.transpose() << std::endl;
     human_traj_logger << human_traj_hp_new.x.transpose() << std::endl;
     human_traj_logger << human_traj_rp_new.x.transpose() << std::endl;
@@ -756,11 +1426,1872 @@ bool test_nested_optimizer(hri_planner::TestComponent::Request& req,
     human_traj_logger.close();
     robot_traj_logger.close();
 
-    res.succeeded = true;
-
     return true;
 }
 
+// compare the jacobian and adjoint gradient paths of the human cost
+bool test_gradient_modes(hri_planner::TestComponent::Request& req,
+                         hri_planner::TestComponent::Response& res)
+{
+    // extract the messages
+    Eigen::Map<Eigen::VectorXd> ur(req.ur.data(), req.ur.size());
+    Eigen::Map<Eigen::VectorXd> uh(req.uh.data(), req.uh.size());
+    Eigen::Map<Eigen::VectorXd> xr0(req.xr0.data(), req.xr0.size());
+    Eigen::Map<Eigen::VectorXd> xh0(req.xh0.data(), req.xh0.size());
+
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_gradient_modes.txt");
+
+    using namespace hri_planner;
+
+    int nUh = 2;
+    double dt = 0.5;
+    int T = (int)req.uh.size() / nUh;
+
+    Eigen::VectorXd x_goal(2);
+    x_goal << 0.73216, 6.00955;
+
+    std::vector<std::shared_ptr<FeatureBase> > features;
+    create_human_costs(features, x_goal);
+
+    auto cost_human = std::make_shared<SingleTrajectoryCostHuman>(req.weights, features);
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    robot_traj.update(xr0, ur);
+    robot_traj.compute_jacobian();
+    cost_human->set_trajectory_data(robot_traj);
+
+    Trajectory human_traj(CONST_ACC_MODEL, T, dt);
+    human_traj.update(xh0, uh);
+
+    // time the gradient evaluations
+    const int n_eval = 1000;
+    Eigen::VectorXd grad_jacobian(T * nUh);
+    Eigen::VectorXd grad_adjoint(T * nUh);
+
+    ros::Time t_start = ros::Time::now();
+    for (int i = 0; i < n_eval; ++i) {
+        human_traj.compute_jacobian_blocks();
+        cost_human->grad(human_traj, grad_jacobian);
+    }
+    double t_jacobian = (ros::Time::now() - t_start).toSec();
+
+    t_start = ros::Time::now();
+    for (int i = 0; i < n_eval; ++i)
+        cost_human->grad_adjoint(human_traj, grad_adjoint);
+    double t_adjoint = (ros::Time::now() - t_start).toSec();
+
+    logger << "T = " << T << ", " << n_eval << " gradient evaluations" << std::endl;
+    logger << "jacobian path: " << t_jacobian << " s, adjoint path: " << t_adjoint << " s" << std::endl;
+    double grad_err = (grad_jacobian - grad_adjoint).cwiseAbs().maxCoeff() /
+            std::max(1.0, grad_jacobian.cwiseAbs().maxCoeff());
+    logger << "max difference: " << (grad_jacobian - grad_adjoint).cwiseAbs().maxCoeff()
+           << ", relative " << grad_err << std::endl;
+
+    // run the optimizer with both modes
+    int dim = T * nUh;
+    TrajectoryOptimizer optimizer(static_cast<unsigned int>(dim), nlopt::LD_LBFGS);
+    optimizer.set_cost_function(cost_human);
+    optimizer.set_bounds(Eigen::VectorXd::Constant(dim, -10.0), Eigen::VectorXd::Constant(dim, 10.0));
+
+    GradientMode modes[2] = {GRADIENT_JACOBIAN, GRADIENT_ADJOINT};
+    double cost_opt[2];
+    for (int i = 0; i < 2; ++i) {
+        optimizer.set_gradient_mode(modes[i]);
+
+        Trajectory traj_opt(CONST_ACC_MODEL, T, dt);
+        t_start = ros::Time::now();
+        optimizer.optimize(human_traj, robot_traj, traj_opt);
+        cost_opt[i] = cost_human->compute(traj_opt);
+
+        logger << (modes[i] == GRADIENT_ADJOINT ? "adjoint" : "jacobian") << " optimization took "
+               << (ros::Time::now() - t_start).toSec() << " s, " << optimizer.get_niter()
+               << " evaluations, cost " << cost_opt[i] << std::endl;
+    }
+
+    logger.close();
+
+    // both paths compute the same gradient, so the optimizations should end up at the same cost
+    const double tol = 1e-8;
+    res.succeeded = grad_err < tol && std::isfinite(cost_opt[0]) &&
+            std::abs(cost_opt[1] - cost_opt[0]) <= 1e-3 * std::max(1.0, std::abs(cost_opt[0]));
+
+    return true;
+}
+
+// count the heap allocations of n_eval cost evaluations with a workspace installed
+// after one warm-up evaluation, which may still size the output buffers
+template <typename Func>
+long count_allocations_in_evals(Func eval, int n_eval)
+{
+#ifdef __GLIBC__
+    eval();
+
+    allocation_count = 0;
+    count_allocations = true;
+    for (int i = 0; i < n_eval; ++i)
+        eval();
+    count_allocations = false;
+
+    return allocation_count;
+#else
+    return -1;
+#endif
+}
+
+// check that the cost, feature and belief routines don't allocate when given a workspace
+bool test_allocations(hri_planner::TestComponent::Request& req,
+                      hri_planner::TestComponent::Response& res)
+{
+    // extract the messages
+    Eigen::Map<Eigen::VectorXd> ur(req.ur.data(), req.ur.size());
+    Eigen::Map<Eigen::VectorXd> uh(req.uh.data(), req.uh.size());
+    Eigen::Map<Eigen::VectorXd> xr0(req.xr0.data(), req.xr0.size());
+    Eigen::Map<Eigen::VectorXd> xh0(req.xh0.data(), req.xh0.size());
+
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_allocations.txt");
+
+    using namespace hri_planner;
+
+    int nUh = 2;
+    double dt = 0.5;
+    int T = (int)req.uh.size() / nUh;
+    int len_ur = (int)req.ur.size();
+    int len_uh = (int)req.uh.size();
+
+    Eigen::VectorXd x_goal(2);
+    x_goal << 0.73216, 6.00955;
+
+    // human cost
+    std::vector<std::shared_ptr<FeatureBase> > features;
+    create_human_costs(features, x_goal);
+
+    std::vector<double> w_human(features.size(), 1.0);
+    auto cost_human = std::make_shared<SingleTrajectoryCostHuman>(w_human, features);
+
+    // robot costs
+    std::vector<std::shared_ptr<FeatureBase> > f_non_int;
+    std::vector<std::shared_ptr<FeatureVectorizedBase> > f_int;
+    create_robot_costs(f_non_int, f_int, x_goal);
+
+    std::shared_ptr<BeliefModelBase> belief_model;
+    create_belief_model(belief_model);
+
+    std::vector<double> w_non_int(f_non_int.size(), 1.0);
+    std::vector<double> w_int(f_int.size(), 1.0);
+
+    ProbabilisticCost cost_full(belief_model);
+    cost_full.set_features_non_int(w_non_int, f_non_int);
+    cost_full.set_features_int(w_int, f_int);
+
+    ProbabilisticCostSimplified cost_simplified(belief_model);
+    cost_simplified.set_features_non_int(w_non_int, f_non_int);
+    cost_simplified.set_features_int(w_int, f_int);
+
+    // trajectories
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    robot_traj.update(xr0, ur);
+    robot_traj.compute_jacobian();
+
+    Trajectory human_traj(CONST_ACC_MODEL, T, dt);
+    human_traj.update(xh0, uh);
+    human_traj.compute_jacobian();
+
+    cost_human->set_trajectory_data(robot_traj);
+    cost_full.update_human_pred(human_traj);
+
+    // outputs are allocated once, like the optimizers do
+    Eigen::VectorXd grad_uh(len_uh);
+    Eigen::MatrixXd hess_uh(len_uh, len_uh);
+    Eigen::MatrixXd hess_uh_ur(len_uh, len_ur);
+    Eigen::VectorXd grad_ur(len_ur);
+    Eigen::VectorXd grad_hp(len_uh);
+    Eigen::VectorXd grad_rp(len_uh);
+
+    Workspace workspace(Workspace::default_capacity(T));
+    WorkspaceScope scope(workspace);
+
+    const int n_eval = 100;
+    long n_alloc[5];
+
+    n_alloc[0] = count_allocations_in_evals([&]() {
+        human_traj.compute_jacobian_blocks();
+        cost_human->compute(human_traj);
+        cost_human->grad(human_traj, grad_uh);
+    }, n_eval);
+    n_alloc[1] = count_allocations_in_evals([&]() {
+        cost_human->grad_adjoint(human_traj, grad_uh);
+    }, n_eval);
+    n_alloc[2] = count_allocations_in_evals([&]() {
+        cost_human->hessian_uh(robot_traj, human_traj, hess_uh);
+        cost_human->hessian_uh_ur(robot_traj, human_traj, hess_uh_ur);
+    }, n_eval);
+    n_alloc[3] = count_allocations_in_evals([&]() {
+        cost_full.compute(robot_traj, human_traj, human_traj, req.acomm, req.tcomm, grad_ur, grad_hp, grad_rp);
+    }, n_eval);
+    n_alloc[4] = count_allocations_in_evals([&]() {
+        cost_simplified.compute(robot_traj, human_traj, human_traj, req.acomm, req.tcomm,
+                                grad_ur, grad_hp, grad_rp);
+    }, n_eval);
+
+    const char* names[5] = {"human cost gradient", "human cost adjoint gradient", "human cost hessians",
+                            "probabilistic cost", "simplified probabilistic cost"};
+
+    res.succeeded = true;
+    for (int i = 0; i < 5; ++i) {
+        logger << names[i] << ": " << n_alloc[i] << " allocations in " << n_eval << " evaluations" << std::endl;
+        if (n_alloc[i] != 0)
+            res.succeeded = false;
+    }
+
+#ifdef __GLIBC__
+    // the nlopt cost function of the nested optimizer, with the followers solved by projected newton
+    // on this thread, counted between consecutive evaluations after the first one set up the buffers
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models(1, belief_model);
+    auto cost_multi = std::make_shared<ProbabilisticCostMultiHuman>(belief_models);
+    cost_multi->set_features_non_int(w_non_int, f_non_int);
+    cost_multi->set_features_int(w_int, f_int);
+
+    std::vector<std::shared_ptr<FeatureBase> > features_hp;
+    std::vector<std::shared_ptr<FeatureBase> > features_rp;
+    create_human_costs(features_hp, x_goal);
+    create_human_costs(features_rp, x_goal);
+
+    MultiHumanNestedOptimizer optimizer(len_ur, len_uh, 1, nlopt::LD_SLSQP, nlopt::LD_SLSQP);
+    optimizer.set_robot_cost(cost_multi);
+    optimizer.set_human_cost(0, create_static_human_cost(w_human, features_hp),
+                             create_static_human_cost(w_human, features_rp));
+    optimizer.set_bounds(Eigen::VectorXd::Constant(len_ur, -2.0), Eigen::VectorXd::Constant(len_ur, 2.0),
+                         Eigen::VectorXd::Constant(len_uh, -1.0), Eigen::VectorXd::Constant(len_uh, 1.0));
+    optimizer.set_follower_solver(SOLVER_PROJECTED_NEWTON);
+    optimizer.set_max_iter(n_eval);
+    optimizer.set_follower_max_iter(20);
+
+    long n_alloc_prev = -1;
+    long n_alloc_nested = 0;
+    int n_eval_nested = 0;
+    optimizer.set_progress_callback([&](double cost) {
+        if (n_alloc_prev >= 0) {
+            n_alloc_nested += allocation_count - n_alloc_prev;
+            ++n_eval_nested;
+        }
+        n_alloc_prev = allocation_count;
+        return true;
+    });
+
+    std::vector<Trajectory> human_trajs(1, human_traj);
+    Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T, dt);
+
+    allocation_count = 0;
+    count_allocations = true;
+    optimizer.optimize(robot_traj, human_trajs, human_trajs, req.acomm, req.tcomm, robot_traj_opt);
+    count_allocations = false;
+
+    logger << "nested optimizer cost function: " << n_alloc_nested << " allocations in "
+           << n_eval_nested << " evaluations" << std::endl;
+    if (n_eval_nested == 0 || n_alloc_nested != 0)
+        res.succeeded = false;
+#endif
+
+    logger << "workspace peak usage: " << workspace.peak() << " of " << workspace.capacity()
+           << " doubles, " << workspace.overflow_count() << " overflows" << std::endl;
+
+    logger.close();
+
+    return true;
+}
+
+// compare the fixed-horizon rollouts of the trajectory against the dynamically sized kernels
+template<hri_planner::DynamicsModel M>
+double fixed_horizon_error(int T, double dt, std::ofstream& logger, long& n_alloc)
+{
+    using namespace hri_planner;
+
+    typedef DynamicsTraits<M> Dyn;
+    const int nX = Dyn::nX;
+    const int nU = Dyn::nU;
+
+    Eigen::VectorXd x0 = Eigen::VectorXd::Random(nX);
+    Eigen::VectorXd u = Eigen::VectorXd::Random(T * nU);
+    Eigen::VectorXd grad_x = Eigen::VectorXd::Random(T * nX);
+
+    Trajectory traj(M, T, dt);
+    traj.update(x0, u);
+    traj.compute_jacobian();
+
+    Eigen::VectorXd grad_u = Eigen::VectorXd::Zero(T * nU);
+    traj.backprop(grad_x, grad_u);
+
+    // reference with the horizon only known at run time
+    Eigen::VectorXd x_ref(T * nX);
+    rollout_dynamics<M>(x0, u, T, dt, x_ref);
+
+    Eigen::MatrixXd A_ref(nX, T * nX);
+    Eigen::MatrixXd B_ref(nX, T * nU);
+    rollout_jacobian_blocks<M>(x0, x_ref, u, T, dt, A_ref, B_ref);
+
+    StructuredJacobian Ju_ref(nX, nU, T);
+    Ju_ref.A_blocks() = A_ref;
+    Ju_ref.B_blocks() = B_ref;
+
+    Eigen::MatrixXd Ju_dense(T * nX, T * nU);
+    Ju_ref.to_dense(Ju_dense);
+
+    Eigen::VectorXd grad_u_ref = Ju_dense.transpose() * grad_x;
+
+    double err = std::max((traj.x - x_ref).cwiseAbs().maxCoeff(), (traj.Ju - Ju_dense).cwiseAbs().maxCoeff());
+    err = std::max(err, (grad_u - grad_u_ref).cwiseAbs().maxCoeff() / (grad_u_ref.cwiseAbs().maxCoeff() + 1e-12));
+
+    n_alloc = count_allocations_in_evals([&]() {
+        traj.compute();
+        traj.compute_jacobian_blocks();
+        traj.backprop(grad_x, grad_u);
+    }, 100);
+
+    logger << "model " << M << ", T = " << T << ": error " << err << ", "
+           << n_alloc << " allocations in 100 evaluations" << std::endl;
+
+    return err;
+}
+
+bool test_fixed_horizon(hri_planner::TestComponent::Request& req,
+                        hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_fixed_horizon.txt");
+
+    using namespace hri_planner;
+
+    double dt = 0.5;
+
+    // the two fixed horizons and one that falls back to the dynamic sizes
+    const int horizons[3] = {HORIZON_SHORT, HORIZON_LONG, 7};
+
+    res.succeeded = true;
+    for (int i = 0; i < 3; ++i) {
+        long n_alloc[2];
+        double err_acc = fixed_horizon_error<CONST_ACC_MODEL>(horizons[i], dt, logger, n_alloc[0]);
+        double err_diff = fixed_horizon_error<DIFFERENTIAL_MODEL>(horizons[i], dt, logger, n_alloc[1]);
+
+        if (!(err_acc < 1e-10 && err_diff < 1e-10) || n_alloc[0] != 0 || n_alloc[1] != 0)
+            res.succeeded = false;
+    }
+
+    logger.close();
+
+    return true;
+}
+
+// compare the dispatch latency of the thread pool against spawning threads per call
+bool test_thread_pool(hri_planner::TestComponent::Request& req,
+                      hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_thread_pool.txt");
+
+    using namespace hri_planner;
+    using namespace std::chrono;
+
+    const int n_trials = 1000;
+    const int n_work = 2000;
+
+    // a small amount of work per task, similar to a short follower optimization
+    double sink[4] = {0.0, 0.0, 0.0, 0.0};
+    auto work = [&](int id) {
+        double acc = 0.0;
+        for (int i = 0; i < n_work; ++i)
+            acc += std::sin(i * 1e-3 + id);
+        sink[id] += acc;
+    };
+
+    std::vector<ThreadPool::Task> tasks;
+    tasks.emplace_back([&] { work(0); });
+    tasks.emplace_back([&] { work(1); });
+
+    // nested use, as the planner runs two optimizers that each run two followers
+    ThreadPool pool(3);
+
+    std::vector<ThreadPool::Task> inner_tasks[2];
+    for (int k = 0; k < 2; ++k) {
+        inner_tasks[k].emplace_back([&, k] { work(2 * k); });
+        inner_tasks[k].emplace_back([&, k] { work(2 * k + 1); });
+    }
+
+    std::vector<ThreadPool::Task> outer_tasks;
+    outer_tasks.emplace_back([&] { pool.run_parallel(inner_tasks[0]); });
+    outer_tasks.emplace_back([&] { pool.run_parallel(inner_tasks[1]); });
+
+    const char* names[3] = {"spawned threads", "thread pool", "nested thread pool"};
+    double t_mean[3] = {0.0, 0.0, 0.0};
+    double t_max[3] = {0.0, 0.0, 0.0};
+
+    for (int trial = 0; trial < n_trials; ++trial) {
+        for (int i = 0; i < 3; ++i) {
+            steady_clock::time_point t1 = steady_clock::now();
+
+            if (i == 0) {
+                std::thread th1(tasks[0]);
+                std::thread th2(tasks[1]);
+                th1.join();
+                th2.join();
+            }
+            else if (i == 1) {
+                pool.run_parallel(tasks);
+            }
+            else {
+                pool.run_parallel(outer_tasks);
+            }
+
+            double t = duration_cast<duration<double> >(steady_clock::now() - t1).count();
+            t_mean[i] += t / n_trials;
+            t_max[i] = std::max(t_max[i], t);
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        logger << names[i] << ": mean " << t_mean[i] * 1e6 << " us, max " << t_max[i] * 1e6 << " us" << std::endl;
+    }
+    logger << "(checksum " << sink[0] + sink[1] + sink[2] + sink[3] << ")" << std::endl;
+
+    // more seed optimizations than workers, as the multi-start planner runs them
+    // a seed waiting for its followers must not pick up another whole seed on its thread
+    const int n_seeds = 10;
+    const int n_evals = 20;
+
+    static thread_local int seed_running = -1;
+    std::atomic<int> n_nested_seeds(0);
+
+    // the followers of a seed
+    std::vector<ThreadPool::Task> follower_tasks;
+    for (int k = 0; k < 2; ++k)
+        follower_tasks.emplace_back([] { std::this_thread::sleep_for(std::chrono::microseconds(100)); });
+
+    std::vector<ThreadPool::Task> seed_tasks;
+    for (int s = 0; s < n_seeds; ++s) {
+        seed_tasks.emplace_back([&, s] {
+            if (seed_running >= 0)
+                ++n_nested_seeds;
+
+            int seed_prev = seed_running;
+            seed_running = s;
+            for (int i = 0; i < n_evals; ++i)
+                pool.run_parallel(follower_tasks);
+            seed_running = seed_prev;
+        });
+    }
+
+    pool.run_parallel(seed_tasks);
+    logger << n_seeds << " seeds: " << n_nested_seeds << " seeds run inside another seed" << std::endl;
+
+    logger.close();
+
+    res.succeeded = n_nested_seeds == 0;
+
+    return true;
+}
+
+// compare the outer iterations with and without the implicit follower gradient
+bool test_implicit_gradient(hri_planner::TestComponent::Request& req,
+                            hri_planner::TestComponent::Response& res)
+{
+    // extract the messages
+    Eigen::Map<Eigen::VectorXd> ur(req.ur.data(), req.ur.size());
+    Eigen::Map<Eigen::VectorXd> uh(req.uh.data(), req.uh.size());
+    Eigen::Map<Eigen::VectorXd> xr0(req.xr0.data(), req.xr0.size());
+    Eigen::Map<Eigen::VectorXd> xh0(req.xh0.data(), req.xh0.size());
+
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_implicit_gradient.txt");
+
+    using namespace hri_planner;
+
+    int nUr = 2;
+    int nUh = 2;
+    double dt = 0.5;
+    int T = (int)req.ur.size() / nUr;
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    robot_traj.update(xr0, ur);
+
+    Trajectory human_traj(CONST_ACC_MODEL, T, dt);
+    human_traj.update(xh0, uh);
+
+    auto thread_pool = std::make_shared<ThreadPool>(1);
+
+    const char* names[2] = {"partial gradient", "implicit gradient"};
+    double cost_opt[2];
+    for (int i = 0; i < 2; ++i) {
+        auto optimizer = create_naive_nested_optimizer(req.weights, T, nUr, nUh);
+        optimizer->set_thread_pool(thread_pool);
+        optimizer->set_implicit_gradient(i == 1);
+
+        Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T, dt);
+
+        ros::Time t_start = ros::Time::now();
+        cost_opt[i] = optimizer->optimize(robot_traj, human_traj, human_traj, req.acomm, req.tcomm,
+                                          robot_traj_opt);
+        ros::Duration t_elapse = ros::Time::now() - t_start;
+
+        int neval_hp, neval_rp;
+        optimizer->get_niter_nested(neval_hp, neval_rp);
+
+        logger << names[i] << ": cost " << cost_opt[i] << ", outer iterations " << optimizer->get_niter()
+               << ", nested iterations (" << neval_hp << ", " << neval_rp << "), time "
+               << t_elapse.toSec() << "s" << std::endl;
+        logger << robot_traj_opt.u.transpose() << std::endl;
+    }
+
+    logger.close();
+
+    // the implicit gradient is the better descent direction, it must not end up at a clearly worse cost
+    res.succeeded = std::isfinite(cost_opt[0]) && std::isfinite(cost_opt[1]) &&
+            cost_opt[1] <= cost_opt[0] + 1e-2 * std::abs(cost_opt[0]);
+
+    return true;
+}
+
+// compare the nested iterations with and without the follower warm start
+bool test_follower_warm_start(hri_planner::TestComponent::Request& req,
+                              hri_planner::TestComponent::Response& res)
+{
+    // extract the messages
+    Eigen::Map<Eigen::VectorXd> ur(req.ur.data(), req.ur.size());
+    Eigen::Map<Eigen::VectorXd> uh(req.uh.data(), req.uh.size());
+    Eigen::Map<Eigen::VectorXd> xr0(req.xr0.data(), req.xr0.size());
+    Eigen::Map<Eigen::VectorXd> xh0(req.xh0.data(), req.xh0.size());
+
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_follower_warm_start.txt");
+
+    using namespace hri_planner;
+
+    int nUr = 2;
+    int nUh = 2;
+    double dt = 0.5;
+    int T = (int)req.ur.size() / nUr;
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    robot_traj.update(xr0, ur);
+
+    Trajectory human_traj(CONST_ACC_MODEL, T, dt);
+    human_traj.update(xh0, uh);
+
+    auto thread_pool = std::make_shared<ThreadPool>(1);
+
+    // same problem, same outer iteration budget and follower tolerance
+    const int n_outer = 30;
+    const double grad_tol = 1e-3;
+
+    const char* names[2] = {"cold start", "warm start"};
+    double neval_per_outer[2];
+    for (int i = 0; i < 2; ++i) {
+        auto optimizer = create_naive_nested_optimizer(req.weights, T, nUr, nUh);
+        optimizer->set_thread_pool(thread_pool);
+        optimizer->set_max_iter(n_outer);
+        optimizer->set_follower_max_iter(20);
+        optimizer->set_follower_grad_tol(grad_tol);
+        optimizer->set_follower_warm_start(i == 1);
+
+        Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T, dt);
+
+        ros::Time t_start = ros::Time::now();
+        double cost = optimizer->optimize(robot_traj, human_traj, human_traj, req.acomm, req.tcomm, robot_traj_opt);
+        ros::Duration t_elapse = ros::Time::now() - t_start;
+
+        int neval_hp, neval_rp;
+        optimizer->get_niter_nested(neval_hp, neval_rp);
+        int neval_outer = optimizer->get_niter();
+
+        // the outer optimization may stop before the budget, so compare per outer iteration
+        neval_per_outer[i] = static_cast<double>(neval_hp + neval_rp) / std::max(neval_outer, 1);
+
+        logger << names[i] << ": cost " << cost << ", outer iterations " << neval_outer
+               << ", nested iterations (" << neval_hp << ", " << neval_rp << "), "
+               << neval_per_outer[i] << " per outer iteration, time " << t_elapse.toSec() << "s" << std::endl;
+    }
+
+    logger.close();
+
+    res.succeeded = neval_per_outer[1] < neval_per_outer[0];
+
+    return true;
+}
+
+// compare the nlopt and projected newton solvers on the human trajectory optimization
+bool test_follower_solvers(hri_planner::TestComponent::Request& req,
+                           hri_planner::TestComponent::Response& res)
+{
+    // extract the messages
+    Eigen::Map<Eigen::VectorXd> ur(req.ur.data(), req.ur.size());
+    Eigen::Map<Eigen::VectorXd> uh(req.uh.data(), req.uh.size());
+    Eigen::Map<Eigen::VectorXd> xr0(req.xr0.data(), req.xr0.size());
+    Eigen::Map<Eigen::VectorXd> xh0(req.xh0.data(), req.xh0.size());
+
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_follower_solvers.txt");
+
+    using namespace hri_planner;
+
+    int nUh = 2;
+    double dt = 0.5;
+    int T = (int)req.uh.size() / nUh;
+    int dim = T * nUh;
+
+    Eigen::VectorXd x_goal(2);
+    x_goal << 0.73216, 6.00955;
+
+    std::vector<std::shared_ptr<FeatureBase> > features;
+    create_human_costs(features, x_goal);
+
+    auto cost_human = std::make_shared<SingleTrajectoryCostHuman>(req.weights, features);
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    robot_traj.update(xr0, ur);
+
+    Trajectory traj_init(CONST_ACC_MODEL, T, dt);
+    traj_init.update(xh0, uh);
+
+    Eigen::VectorXd lb = Eigen::VectorXd::Constant(dim, -10.0);
+    Eigen::VectorXd ub = Eigen::VectorXd::Constant(dim, 10.0);
+
+    const char* names[2] = {"nlopt SLSQP", "projected newton"};
+    TrajectorySolver solvers[2] = {SOLVER_NLOPT, SOLVER_PROJECTED_NEWTON};
+    Eigen::VectorXd u_opt[2];
+    double cost_opt[2];
+
+    for (int i = 0; i < 2; ++i) {
+        TrajectoryOptimizer optimizer(static_cast<unsigned int>(dim), nlopt::LD_SLSQP);
+        optimizer.set_cost_function(cost_human);
+        optimizer.set_bounds(lb, ub);
+        optimizer.set_solver(solvers[i]);
+
+        Trajectory traj_opt(CONST_ACC_MODEL, T, dt);
+
+        ros::Time t_start = ros::Time::now();
+        optimizer.optimize(traj_init, robot_traj, traj_opt);
+        ros::Duration t_elapse = ros::Time::now() - t_start;
+
+        u_opt[i] = traj_opt.u;
+        cost_opt[i] = cost_human->compute(traj_opt);
+
+        logger << names[i] << ": cost " << cost_opt[i] << ", evaluations "
+               << optimizer.get_niter() << ", time " << t_elapse.toSec() << "s" << std::endl;
+    }
+
+    logger << "solution difference: " << (u_opt[0] - u_opt[1]).norm() << std::endl;
+
+    // projected newton should do at least as well as nlopt
+    res.succeeded = std::isfinite(cost_opt[1]) && cost_opt[1] <= cost_opt[0] + 1e-2 * std::abs(cost_opt[0]);
+
+    // a hessian with NaNs can't be factorized, the solver has to return with gradient steps
+    std::vector<std::shared_ptr<FeatureBase> > features_nan = {std::make_shared<NanHessianTestCost>()};
+    auto cost_nan = std::make_shared<SingleTrajectoryCostHuman>(std::vector<double>(1, 1.0), features_nan);
+    cost_nan->set_trajectory_data(robot_traj);
+
+    TrajectoryOptimizer optimizer_nan(static_cast<unsigned int>(dim), nlopt::LD_SLSQP);
+    optimizer_nan.set_cost_function(cost_nan);
+    optimizer_nan.set_bounds(lb, ub);
+    optimizer_nan.set_solver(SOLVER_PROJECTED_NEWTON);
+
+    Trajectory traj_nan(CONST_ACC_MODEL, T, dt);
+    optimizer_nan.optimize(traj_init, robot_traj, traj_nan);
+
+    double cost_nan_init = cost_nan->compute(traj_init);
+    double cost_nan_opt = cost_nan->compute(traj_nan);
+    logger << "NaN hessian: cost " << cost_nan_init << " -> " << cost_nan_opt << std::endl;
+
+    if (!std::isfinite(cost_nan_opt) || cost_nan_opt >= cost_nan_init)
+        res.succeeded = false;
+
+    logger.close();
+
+    return true;
+}
+
+// benchmark the batch gaussian kernel against the per-step compute and grad
+bool test_gaussian_kernel(hri_planner::TestComponent::Request& req,
+                          hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_gaussian_kernel.txt");
+
+    using namespace hri_planner;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    logger << "batch kernel: AVX2" << std::endl;
+#else
+    logger << "batch kernel: scalar" << std::endl;
+#endif
+
+    const int n_eval = 100000;
+    const double a = 0.5;
+    const double b = 0.4;
+    const int horizons[4] = {6, 10, 20, 50};
+
+    // the vectorized exp is a polynomial approximation, not bit-exact
+    const double tol = 1e-12;
+    res.succeeded = true;
+
+    for (int T: horizons) {
+        // interleaved offsets for the old kernels, separate arrays for the batch one
+        Eigen::VectorXd x = Eigen::VectorXd::Random(2 * T);
+        Eigen::VectorXd dx(T);
+        Eigen::VectorXd dy(T);
+        for (int t = 0; t < T; ++t) {
+            dx(t) = x(t*2);
+            dy(t) = x(t*2+1);
+        }
+
+        Eigen::VectorXd costs(T);
+        Eigen::VectorXd grad(2 * T);
+        ros::Time t_start = ros::Time::now();
+        for (int i = 0; i < n_eval; ++i) {
+            GaussianCostVec::compute(x, 2, T, a, b, costs);
+            GaussianCostVec::grad(x, 2, T, a, b, grad);
+        }
+        double t_old = (ros::Time::now() - t_start).toSec();
+
+        Eigen::VectorXd costs_batch(T);
+        Eigen::VectorXd gx(T);
+        Eigen::VectorXd gy(T);
+        t_start = ros::Time::now();
+        for (int i = 0; i < n_eval; ++i)
+            GaussianCostVec::evaluate_batch(dx.data(), dy.data(), T, a, b, costs_batch.data(), gx.data(), gy.data());
+        double t_batch = (ros::Time::now() - t_start).toSec();
+
+        double err = (costs - costs_batch).cwiseAbs().maxCoeff();
+        for (int t = 0; t < T; ++t) {
+            err = std::max(err, std::abs(grad(t*2) - gx(t)));
+            err = std::max(err, std::abs(grad(t*2+1) - gy(t)));
+        }
+
+        logger << "T = " << T << ": compute + grad " << t_old / n_eval * 1e9 << " ns, batch "
+               << t_batch / n_eval * 1e9 << " ns, speedup " << t_old / t_batch
+               << ", max difference " << err << std::endl;
+
+        if (!(err < tol))
+            res.succeeded = false;
+    }
+
+    logger.close();
+
+    return true;
+}
+
+// compare the autodiff features against the hand-written derivatives, and time both
+bool test_autodiff(hri_planner::TestComponent::Request& req,
+                   hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_autodiff.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const int n_eval = 20000;
+    const double dt = 0.5;
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    Trajectory human_traj(CONST_ACC_MODEL, T, dt);
+
+    Eigen::VectorXd xr0(3);
+    Eigen::VectorXd xh0(4);
+    xr0 << 0.0, 0.0, 0.3;
+    xh0 << 1.5, 0.5, -0.3, 0.1;
+
+    Eigen::VectorXd ur = 0.3 * Eigen::VectorXd::Random(2 * T) + Eigen::VectorXd::Constant(2 * T, 0.4);
+    Eigen::VectorXd uh = 0.3 * Eigen::VectorXd::Random(2 * T);
+    robot_traj.update(xr0, ur);
+    human_traj.update(xh0, uh);
+    robot_traj.compute_jacobian();
+    human_traj.compute_jacobian();
+
+    std::vector<std::string> names = {"collision", "dynamic collision"};
+    std::vector<std::shared_ptr<FeatureHumanCost> > hand_features = {
+            std::make_shared<CollisionCost>(0.8),
+            std::make_shared<DynCollisionCost>(0.6, 0.4, 0.5)
+    };
+    std::vector<std::shared_ptr<FeatureHumanCost> > ad_features = {
+            std::make_shared<AutoDiffHumanCost<CollisionTerm> >(CollisionTerm(0.8)),
+            std::make_shared<AutoDiffHumanCost<DynCollisionTerm> >(DynCollisionTerm(0.6, 0.4, 0.5))
+    };
+
+    std::vector<std::string> func_names = {"grad_uh", "grad_ur", "hessian_uh", "hessian_uh_ur"};
+
+    const double tol = 1e-10;
+    double err_max = 0.0;
+
+    for (int k = 0; k < (int) names.size(); ++k) {
+        logger << names[k] << ":" << std::endl;
+
+        Eigen::VectorXd grad_hand(2 * T);
+        Eigen::VectorXd grad_ad(2 * T);
+        Eigen::MatrixXd hess_hand(2 * T, 2 * T);
+        Eigen::MatrixXd hess_ad(2 * T, 2 * T);
+
+        double err[5];
+        err[0] = std::abs(hand_features[k]->compute(robot_traj, human_traj) -
+                          ad_features[k]->compute(robot_traj, human_traj));
+
+        hand_features[k]->grad_uh(robot_traj, human_traj, grad_hand);
+        ad_features[k]->grad_uh(robot_traj, human_traj, grad_ad);
+        err[1] = (grad_hand - grad_ad).cwiseAbs().maxCoeff();
+
+        hand_features[k]->grad_ur(robot_traj, human_traj, grad_hand);
+        ad_features[k]->grad_ur(robot_traj, human_traj, grad_ad);
+        err[2] = (grad_hand - grad_ad).cwiseAbs().maxCoeff();
+
+        hand_features[k]->hessian_uh(robot_traj, human_traj, hess_hand);
+        ad_features[k]->hessian_uh(robot_traj, human_traj, hess_ad);
+        err[3] = (hess_hand - hess_ad).cwiseAbs().maxCoeff();
+
+        hand_features[k]->hessian_uh_ur(robot_traj, human_traj, hess_hand);
+        ad_features[k]->hessian_uh_ur(robot_traj, human_traj, hess_ad);
+        err[4] = (hess_hand - hess_ad).cwiseAbs().maxCoeff();
+
+        logger << "  compute difference: " << err[0] << std::endl;
+        for (int f = 0; f < (int) func_names.size(); ++f)
+            logger << "  " << func_names[f] << " difference: " << err[f+1] << std::endl;
+
+        for (double e: err)
+            err_max = std::max(err_max, e);
+
+        // timing
+        std::shared_ptr<FeatureHumanCost> features[2] = {hand_features[k], ad_features[k]};
+        for (int f = 0; f < (int) func_names.size(); ++f) {
+            double t_eval[2];
+            for (int m = 0; m < 2; ++m) {
+                ros::Time t_start = ros::Time::now();
+                for (int i = 0; i < n_eval; ++i) {
+                    if (f == 0)
+                        features[m]->grad_uh(robot_traj, human_traj, grad_hand);
+                    else if (f == 1)
+                        features[m]->grad_ur(robot_traj, human_traj, grad_hand);
+                    else if (f == 2)
+                        features[m]->hessian_uh(robot_traj, human_traj, hess_hand);
+                    else
+                        features[m]->hessian_uh_ur(robot_traj, human_traj, hess_hand);
+                }
+                t_eval[m] = (ros::Time::now() - t_start).toSec() / n_eval;
+            }
+
+            logger << "  " << func_names[f] << ": hand " << t_eval[0] * 1e9 << " ns, autodiff "
+                   << t_eval[1] * 1e9 << " ns, ratio " << t_eval[1] / t_eval[0] << std::endl;
+        }
+    }
+
+    logger.close();
+    res.succeeded = err_max < tol;
+
+    return true;
+}
+
+// compare the compile-time human cost against the feature-list version, and time both
+bool test_static_cost(hri_planner::TestComponent::Request& req,
+                      hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_static_cost.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const int n_eval = 20000;
+    const double dt = 0.5;
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    Trajectory human_traj(CONST_ACC_MODEL, T, dt);
+
+    Eigen::VectorXd xr0(3);
+    Eigen::VectorXd xh0(4);
+    xr0 << 0.0, 0.0, 0.3;
+    xh0 << 1.5, 0.5, -0.3, 0.1;
+
+    Eigen::VectorXd ur = 0.3 * Eigen::VectorXd::Random(2 * T) + Eigen::VectorXd::Constant(2 * T, 0.4);
+    Eigen::VectorXd uh = 0.3 * Eigen::VectorXd::Random(2 * T);
+    robot_traj.update(xr0, ur);
+    human_traj.update(xh0, uh);
+    robot_traj.compute_jacobian();
+    human_traj.compute_jacobian();
+
+    Eigen::VectorXd x_goal(2);
+    x_goal << 0.7, 6.0;
+
+    std::vector<std::shared_ptr<FeatureBase> > features;
+    create_human_costs(features, x_goal);
+    std::vector<double> weights = {8.0, 20.0, 40.0, 5.0, 15.0};
+
+    std::shared_ptr<SingleTrajectoryCostHuman> costs[2];
+    costs[0] = std::make_shared<SingleTrajectoryCostHuman>(weights, features);
+    costs[1] = create_static_human_cost(weights, features);
+
+    if (!costs[1]) {
+        logger << "feature list doesn't match a static cost!" << std::endl;
+        res.succeeded = false;
+        return true;
+    }
+
+    Eigen::VectorXd grad[2];
+    Eigen::MatrixXd hess[2];
+    double cost[2];
+    for (int k = 0; k < 2; ++k) {
+        grad[k].resize(2 * T);
+        hess[k].resize(2 * T, 2 * T);
+
+        cost[k] = costs[k]->compute(robot_traj, human_traj);
+        costs[k]->grad_uh(robot_traj, human_traj, grad[k]);
+        costs[k]->hessian_uh(robot_traj, human_traj, hess[k]);
+    }
+
+    const double tol = 1e-6;
+    double err[3] = {std::abs(cost[0] - cost[1]),
+                     (grad[0] - grad[1]).cwiseAbs().maxCoeff(),
+                     (hess[0] - hess[1]).cwiseAbs().maxCoeff()};
+
+    logger << "compute difference: " << err[0] << std::endl;
+    logger << "grad_uh difference: " << err[1] << std::endl;
+    logger << "hessian_uh difference: " << err[2] << std::endl;
+
+    res.succeeded = err[0] < tol && err[1] < tol && err[2] < tol;
+
+    // a robot horizon longer than the human one, so the cross terms have nUr != nUh
+    const int T_r = T + 3;
+    Trajectory robot_traj_long(DIFFERENTIAL_MODEL, T_r, dt);
+    robot_traj_long.update(xr0, 0.3 * Eigen::VectorXd::Random(2 * T_r) + Eigen::VectorXd::Constant(2 * T_r, 0.4));
+    robot_traj_long.compute_jacobian();
+
+    std::vector<std::shared_ptr<FeatureBase> > features_cross = {features[0], features[1], features[2],
+                                                                 std::make_shared<RobotDistanceTestCost>()};
+    std::vector<double> weights_cross = {8.0, 20.0, 40.0, 3.0};
+
+    std::shared_ptr<SingleTrajectoryCostHuman> costs_cross[2];
+    costs_cross[0] = std::make_shared<SingleTrajectoryCostHuman>(weights_cross, features_cross);
+    costs_cross[1] = StaticLinearCost<HumanVelCost, HumanAccCost, HumanGoalCost, RobotDistanceTestCost>::create(
+            weights_cross, features_cross);
+
+    Eigen::VectorXd grad_ur[2];
+    Eigen::MatrixXd hess_uh_ur[2];
+    for (int k = 0; k < 2; ++k) {
+        grad_ur[k].resize(2 * T_r);
+        hess_uh_ur[k].resize(2 * T, 2 * T_r);
+
+        costs_cross[k]->grad_ur(robot_traj_long, human_traj, grad_ur[k]);
+        costs_cross[k]->hessian_uh_ur(robot_traj_long, human_traj, hess_uh_ur[k]);
+    }
+
+    double err_cross[2] = {(grad_ur[0] - grad_ur[1]).cwiseAbs().maxCoeff(),
+                           (hess_uh_ur[0] - hess_uh_ur[1]).cwiseAbs().maxCoeff()};
+
+    logger << "robot horizon " << T_r << ", grad_ur difference: " << err_cross[0]
+           << ", hessian_uh_ur difference: " << err_cross[1]
+           << ", hessian_uh_ur norm: " << hess_uh_ur[1].norm() << std::endl;
+
+    if (err_cross[0] >= tol || err_cross[1] >= tol || hess_uh_ur[1].norm() == 0.0)
+        res.succeeded = false;
+
+    // timing
+    std::vector<std::string> func_names = {"compute", "grad_uh", "hessian_uh"};
+    for (int f = 0; f < (int) func_names.size(); ++f) {
+        double t_eval[2];
+        for (int k = 0; k < 2; ++k) {
+            ros::Time t_start = ros::Time::now();
+            for (int i = 0; i < n_eval; ++i) {
+                if (f == 0)
+                    cost[k] = costs[k]->compute(robot_traj, human_traj);
+                else if (f == 1)
+                    costs[k]->grad_uh(robot_traj, human_traj, grad[k]);
+                else
+                    costs[k]->hessian_uh(robot_traj, human_traj, hess[k]);
+            }
+            t_eval[k] = (ros::Time::now() - t_start).toSec() / n_eval;
+        }
+
+        logger << func_names[f] << ": feature list " << t_eval[0] * 1e9 << " ns, static "
+               << t_eval[1] * 1e9 << " ns, speedup " << t_eval[0] / t_eval[1] << std::endl;
+    }
+
+    logger.close();
+
+    return true;
+}
+
+// check the multi-intent cost against the two-intent one, and time it with 2 and 4 intents
+// the N-intent beliefs and costs: levels {1, 0} against the two-intent versions, the gradients against
+// central differences, and the nested optimizer with 2 and 4 intents, the followers run in parallel
+bool test_multi_intent(hri_planner::TestComponent::Request& req,
+                       hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_multi_intent.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const int n_eval = 200;
+    const double dt = 0.5;
+    const double tol_match = 1e-12;
+    const double tol_grad = 1e-4;
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    std::vector<Trajectory> human_trajs(4, Trajectory(CONST_ACC_MODEL, T, dt));
+
+    Eigen::VectorXd xr0(3);
+    Eigen::VectorXd xh0(4);
+    xr0 << 0.0, 0.0, 0.3;
+    xh0 << 1.5, 0.5, -0.3, 0.1;
+
+    Eigen::VectorXd ur = 0.3 * Eigen::VectorXd::Random(2 * T) + Eigen::VectorXd::Constant(2 * T, 0.4);
+    robot_traj.update(xr0, ur);
+    robot_traj.compute_jacobian();
+    for (auto& human_traj: human_trajs) {
+        human_traj.update(xh0, 0.3 * Eigen::VectorXd::Random(2 * T));
+        human_traj.compute_jacobian();
+    }
+
+    Eigen::VectorXd x_goal(2);
+    x_goal << 0.73216, 6.00955;
+
+    std::vector<std::shared_ptr<FeatureBase> > f_non_int;
+    std::vector<std::shared_ptr<FeatureVectorizedBase> > f_int;
+    create_robot_costs(f_non_int, f_int, x_goal);
+    std::vector<double> w_non_int = {1.0, 10.0};
+    std::vector<double> w_int = {1.0, 5.0};
+
+    std::shared_ptr<BeliefModelBase> belief_model;
+    create_belief_model(belief_model);
+
+    auto belief_model2 = std::make_shared<BeliefModelMulti>(belief_model, std::vector<double>{1.0, 0.0});
+    // the four-intent gradient is checked with a smooth implicit cost, the jacobian of the history-based
+    // implicit cost is only approximate
+    auto smooth_model = std::make_shared<SmoothBeliefModel>(10, std::vector<double>{2.0, 20.0}, 100.0, 2.5);
+    smooth_model->reset_hist(Eigen::Vector2d::Zero());
+    auto belief_model4 = std::make_shared<BeliefModelMulti>(smooth_model, std::vector<double>{1.0, 0.67, 0.33, 0.0});
+
+    ProbabilisticCost cost(belief_model);
+    ProbabilisticCostMulti cost2(belief_model2);
+    ProbabilisticCostMulti cost4(belief_model4);
+
+    ProbabilisticCostBase* costs[3] = {&cost, &cost2, &cost4};
+    for (auto c: costs) {
+        c->set_features_non_int(w_non_int, f_non_int);
+        c->set_features_int(w_int, f_int);
+        c->update_human_pred(human_trajs[0]);
+    }
+
+    int n_cores = static_cast<int>(std::thread::hardware_concurrency());
+    auto thread_pool = std::make_shared<ThreadPool>(std::max(n_cores - 1, 1));
+    cost2.set_thread_pool(thread_pool);
+    cost4.set_thread_pool(thread_pool);
+
+    Workspace workspace(Workspace::default_capacity(T));
+    WorkspaceScope scope(workspace);
+
+    res.succeeded = true;
+
+    //! levels {1, 0} should give the same results as the two-intent cost
+    Eigen::VectorXd grad_ur[2];
+    Eigen::VectorXd grad_hp[2];
+    Eigen::VectorXd grad_rp[2];
+    double cost_val[2];
+    for (int k = 0; k < 2; ++k) {
+        grad_ur[k].resize(2 * T);
+        grad_hp[k].resize(2 * T);
+        grad_rp[k].resize(2 * T);
+        cost_val[k] = costs[k]->compute(robot_traj, human_trajs[1], human_trajs[2], HumanPriority, -1.0,
+                                        grad_ur[k], grad_hp[k], grad_rp[k]);
+    }
+
+    // relative to the magnitude of the values, the two paths sum the features in a different order
+    double scale = std::max(1.0, std::max(std::abs(cost_val[0]), grad_ur[0].cwiseAbs().maxCoeff()));
+    double err = std::max(std::max(std::abs(cost_val[0] - cost_val[1]), (grad_ur[0] - grad_ur[1]).cwiseAbs().maxCoeff()),
+                          std::max((grad_hp[0] - grad_hp[1]).cwiseAbs().maxCoeff(),
+                                   (grad_rp[0] - grad_rp[1]).cwiseAbs().maxCoeff())) / scale;
+    logger << "two intents, largest difference to the two-intent cost: " << err << std::endl;
+    if (!(err < tol_match))
+        res.succeeded = false;
+
+    // same for the belief at a constant two-intent belief
+    Eigen::VectorXd levels2(2);
+    levels2 << 1.0, 0.0;
+    Eigen::VectorXd belief2(2);
+    for (double prob_hp: {1e-3, 0.3, 0.5, 0.9, 1.0}) {
+        BeliefModelMulti::constant_belief(prob_hp, levels2, belief2);
+        err = std::max(std::abs(belief2(0) - prob_hp), std::abs(belief2(1) - (1.0 - prob_hp)));
+        logger << "constant belief " << prob_hp << ", difference: " << err << std::endl;
+
+        if (!(err < tol_match))
+            res.succeeded = false;
+    }
+
+    //! four intents, gradients w.r.t. the robot and each response against central differences
+    std::vector<const Trajectory*> trajs4 = {&human_trajs[0], &human_trajs[1], &human_trajs[2], &human_trajs[3]};
+    Eigen::VectorXd grad_ur4(2 * T);
+    Eigen::MatrixXd grad_uh4(2 * T, 4);
+    cost4.compute(robot_traj, trajs4, HumanPriority, -1.0, grad_ur4, grad_uh4);
+
+    Eigen::VectorXd grad_ur_diff(2 * T);
+    Eigen::MatrixXd grad_uh_diff(2 * T, 4);
+    auto eval4 = [&] {
+        return cost4.compute(robot_traj, trajs4, HumanPriority, -1.0, grad_ur_diff, grad_uh_diff);
+    };
+
+    err = central_diff_error(robot_traj, grad_ur4, eval4);
+    for (int k = 0; k < 4; ++k) {
+        err = std::max(err, central_diff_error(human_trajs[k], grad_uh4.col(k), eval4));
+    }
+    logger << "four intents, gradient error: " << err << std::endl;
+    if (!(err < tol_grad))
+        res.succeeded = false;
+
+    //! the constant-belief version of the planner, two intermediate intents for one human
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models(1, belief_model);
+    ProbabilisticCostMultiHuman cost_human(belief_models);
+    cost_human.set_features_non_int(w_non_int, f_non_int);
+    cost_human.set_features_int(w_int, f_int);
+    cost_human.set_intent_levels({0.67, 0.33});
+
+    std::vector<const Trajectory*> trajs_hp = {&human_trajs[0]};
+    std::vector<const Trajectory*> trajs_rp = {&human_trajs[3]};
+    std::vector<const Trajectory*> trajs_mid = {&human_trajs[1], &human_trajs[2]};
+    Eigen::MatrixXd grad_hp_human(2 * T, 1);
+    Eigen::MatrixXd grad_rp_human(2 * T, 1);
+    Eigen::MatrixXd grad_mid_human(2 * T, 2);
+    double cost_human_val = cost_human.compute(robot_traj, trajs_hp, trajs_rp, trajs_mid, HumanPriority, -1.0,
+                                               grad_ur4, grad_hp_human, grad_rp_human, grad_mid_human);
+
+    auto eval_human = [&] {
+        return cost_human.compute(robot_traj, trajs_hp, trajs_rp, trajs_mid, HumanPriority, -1.0,
+                                  grad_ur_diff, grad_uh_diff.col(0), grad_uh_diff.col(1), grad_uh_diff.rightCols(2));
+    };
+
+    err = std::max(central_diff_error(robot_traj, grad_ur4, eval_human),
+                   central_diff_error(human_trajs[0], grad_hp_human.col(0), eval_human));
+    err = std::max(err, central_diff_error(human_trajs[3], grad_rp_human.col(0), eval_human));
+    for (int m = 0; m < 2; ++m)
+        err = std::max(err, central_diff_error(human_trajs[m + 1], grad_mid_human.col(m), eval_human));
+    logger << "four intents at constant belief, cost " << cost_human_val << ", gradient error: " << err << std::endl;
+    if (!(err < tol_grad))
+        res.succeeded = false;
+
+    //! the human cost of an intermediate intent
+    std::vector<std::shared_ptr<FeatureBase> > features_hp;
+    std::vector<std::shared_ptr<FeatureBase> > features_rp;
+    create_human_costs(features_hp, x_goal);
+    create_human_costs(features_rp, x_goal);
+    auto cost_hp = std::make_shared<SingleTrajectoryCostHuman>(std::vector<double>{7.0, 20.0, 10.0, 100.0, 100.0},
+                                                               features_hp);
+    auto cost_rp = std::make_shared<SingleTrajectoryCostHuman>(std::vector<double>{7.0, 2.0, 40.0, 10.0, 10.0},
+                                                               features_rp);
+    InterpolatedHumanCost cost_mid(cost_hp, cost_rp, 0.3);
+
+    Eigen::MatrixXd hess_hp(2 * T, 2 * T);
+    Eigen::MatrixXd hess_rp(2 * T, 2 * T);
+    Eigen::MatrixXd hess_mid(2 * T, 2 * T);
+    cost_hp->hessian_uh(robot_traj, human_trajs[1], hess_hp);
+    cost_rp->hessian_uh(robot_traj, human_trajs[1], hess_rp);
+    cost_mid.hessian_uh(robot_traj, human_trajs[1], hess_mid);
+    err = (hess_mid - 0.3 * hess_hp - 0.7 * hess_rp).cwiseAbs().maxCoeff();
+
+    cost_hp->hessian_uh_ur(robot_traj, human_trajs[1], hess_hp);
+    cost_rp->hessian_uh_ur(robot_traj, human_trajs[1], hess_rp);
+    cost_mid.hessian_uh_ur(robot_traj, human_trajs[1], hess_mid);
+    err = std::max(err, (hess_mid - 0.3 * hess_hp - 0.7 * hess_rp).cwiseAbs().maxCoeff());
+
+    err = std::max(err, std::abs(cost_mid.compute(robot_traj, human_trajs[1]) -
+            0.3 * cost_hp->compute(robot_traj, human_trajs[1]) - 0.7 * cost_rp->compute(robot_traj, human_trajs[1])));
+
+    double err_grad = feature_grad_error(cost_mid, robot_traj, human_trajs[1]);
+    logger << "intermediate human cost, difference: " << err << ", gradient error: " << err_grad << std::endl;
+    if (!(err < tol_match && err_grad < tol_grad))
+        res.succeeded = false;
+
+    //! nested optimization with 2 and 4 intents, one follower optimization per intent
+    std::vector<Trajectory> human_trajs_init(1, Trajectory(CONST_ACC_MODEL, T, dt));
+    human_trajs_init[0].update(xh0, Eigen::VectorXd::Zero(2 * T));
+    Trajectory robot_traj_init(DIFFERENTIAL_MODEL, T, dt);
+    robot_traj_init.update(xr0, Eigen::VectorXd::Constant(2 * T, 0.3));
+
+    std::vector<double> levels_mid[2] = {std::vector<double>(), std::vector<double>{0.67, 0.33}};
+    double t_eval[2];
+    for (int i = 0; i < 2; ++i) {
+        auto optimizer = create_multi_human_optimizer(belief_models, T, levels_mid[i]);
+        optimizer->set_follower_solver(SOLVER_PROJECTED_NEWTON);
+        optimizer->set_thread_pool(thread_pool);
+
+        std::vector<Trajectory> human_trajs_hp_opt;
+        std::vector<Trajectory> human_trajs_rp_opt;
+        Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T, dt);
+
+        // the same number of evaluations for both, restarting when an optimization converges before
+        int n_done = 0;
+        optimizer->set_progress_callback([&](double cost) {
+            return ++n_done < n_eval;
+        });
+
+        double cost_opt = 0.0;
+        ros::Time t_start = ros::Time::now();
+        while (n_done < n_eval) {
+            cost_opt = optimizer->optimize(robot_traj_init, human_trajs_init, human_trajs_init, HumanPriority, -1.0,
+                                           robot_traj_opt, &human_trajs_hp_opt, &human_trajs_rp_opt);
+        }
+        t_eval[i] = (ros::Time::now() - t_start).toSec() / n_eval;
+
+        logger << 2 + levels_mid[i].size() << " intents: cost " << cost_opt << ", "
+               << t_eval[i] * 1e3 << " ms per evaluation" << std::endl;
+
+        if (!std::isfinite(cost_opt))
+            res.succeeded = false;
+    }
+
+    // the four followers can each have a core
+    double ratio = t_eval[1] / t_eval[0];
+    logger << n_cores << " cores, 4 intents take " << ratio << " times the 2 intents"
+           << (n_cores >= 4 ? "" : ", the scaling is not checked") << std::endl;
+    if (n_cores >= 4 && ratio >= 2.0)
+        res.succeeded = false;
+
+    logger.close();
+
+    return true;
+}
+
+// time the nested cost evaluations with 1, 2, 4 and 8 humans, the followers run in parallel
+// so up to the number of cores the latency should grow slower than the number of humans
+bool test_multi_human(hri_planner::TestComponent::Request& req,
+                      hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_multi_human.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const int n_eval = 200;
+    const double dt = 0.5;
+    const int n_humans_max = 8;
+
+    // the humans start next to each other in front of the robot
+    Eigen::VectorXd xr0(3);
+    xr0 << 0.0, 0.0, 0.78;
+    Trajectory robot_traj_init(DIFFERENTIAL_MODEL, T, dt);
+    robot_traj_init.update(xr0, Eigen::VectorXd::Constant(2 * T, 0.3));
+
+    std::vector<Trajectory> human_trajs_init;
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models;
+    for (int k = 0; k < n_humans_max; ++k) {
+        Eigen::VectorXd xh0(4);
+        xh0 << 1.5 + 0.4 * k, 0.2 * k, -0.2, 0.3;
+        human_trajs_init.emplace_back(CONST_ACC_MODEL, T, dt);
+        human_trajs_init.back().update(xh0, Eigen::VectorXd::Zero(2 * T));
+
+        std::shared_ptr<BeliefModelBase> belief_model;
+        create_belief_model(belief_model);
+        belief_models.push_back(belief_model);
+    }
+
+    // the calling thread takes part in the parallel runs, so one worker less than the cores
+    int n_cores = static_cast<int>(std::thread::hardware_concurrency());
+    auto thread_pool = std::make_shared<ThreadPool>(std::max(n_cores - 1, 1));
+    logger << n_cores << " cores" << (n_cores > 1 ? "" : ", the scaling is not checked") << std::endl;
+
+    double t_single = 0.0;
+    res.succeeded = true;
+    for (int n_humans = 1; n_humans <= n_humans_max; n_humans *= 2) {
+        std::vector<std::shared_ptr<BeliefModelBase> > models(belief_models.begin(),
+                                                              belief_models.begin() + n_humans);
+        auto optimizer = create_multi_human_optimizer(models, T);
+        optimizer->set_follower_solver(SOLVER_PROJECTED_NEWTON);
+        optimizer->set_thread_pool(thread_pool);
+
+        std::vector<Trajectory> human_trajs(human_trajs_init.begin(), human_trajs_init.begin() + n_humans);
+        std::vector<Trajectory> human_trajs_hp_opt;
+        std::vector<Trajectory> human_trajs_rp_opt;
+        Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T, dt);
+
+        // the same number of evaluations for every K, restarting when an optimization converges before
+        int n_done = 0;
+        optimizer->set_progress_callback([&](double cost) {
+            return ++n_done < n_eval;
+        });
+
+        double cost = 0.0;
+        ros::Time t_start = ros::Time::now();
+        while (n_done < n_eval) {
+            cost = optimizer->optimize(robot_traj_init, human_trajs, human_trajs, HumanPriority, -1.0,
+                                       robot_traj_opt, &human_trajs_hp_opt, &human_trajs_rp_opt);
+        }
+        double t_eval = (ros::Time::now() - t_start).toSec() / n_eval;
+
+        if (n_humans == 1)
+            t_single = t_eval;
+
+        double ratio = t_eval / t_single;
+        logger << n_humans << " humans: cost " << cost << ", " << t_eval * 1e3 << " ms per evaluation, "
+               << ratio << " times the single human, " << ratio / n_humans << " per human" << std::endl;
+
+        if (!std::isfinite(cost) || static_cast<int>(human_trajs_hp_opt.size()) != n_humans ||
+                static_cast<int>(human_trajs_rp_opt.size()) != n_humans)
+            res.succeeded = false;
+
+        // sublinear in the number of humans, as long as each one can have a core
+        if (n_cores > 1 && n_humans > 1 && n_humans <= n_cores && ratio >= n_humans)
+            res.succeeded = false;
+    }
+
+    logger.close();
+
+    return true;
+}
+
+// compare the collision features with and without culling, for humans at increasing distances
+bool test_feature_culling(hri_planner::TestComponent::Request& req,
+                          hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_feature_culling.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const int n_eval = 100000;
+    const double dt = 0.5;
+    const double dists[4] = {1.5, 3.0, 5.0, 8.0};
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    Eigen::VectorXd xr0(3);
+    xr0 << 0.0, 0.0, 0.3;
+    robot_traj.update(xr0, 0.3 * Eigen::VectorXd::Random(2 * T) + Eigen::VectorXd::Constant(2 * T, 0.4));
+    robot_traj.compute_jacobian();
+
+    // tolerance 0 disables the culling
+    std::shared_ptr<FeatureVectorizedBase> features[2][2] = {
+            {std::make_shared<CollisionCostVec>(0.5, 0.0), std::make_shared<CollisionCostVec>(0.5)},
+            {std::make_shared<DynCollisionCostVec>(0.3, 0.5, 0.5, 0.0),
+             std::make_shared<DynCollisionCostVec>(0.3, 0.5, 0.5)}
+    };
+    const char* names[2] = {"Collision", "DynCollision"};
+
+    Workspace workspace(Workspace::default_capacity(T));
+    WorkspaceScope scope(workspace);
+
+    // default culling tolerance of the features
+    const double tol_cost = 1e-8;
+    const double tol_jac = 1e-6;
+    res.succeeded = true;
+
+    for (double dist: dists) {
+        Trajectory human_traj(CONST_ACC_MODEL, T, dt);
+        Eigen::VectorXd xh0(4);
+        xh0 << dist, 0.5, -0.3, 0.1;
+        human_traj.update(xh0, 0.3 * Eigen::VectorXd::Random(2 * T));
+        human_traj.compute_jacobian();
+
+        for (int f = 0; f < 2; ++f) {
+            Eigen::VectorXd costs[2];
+            Eigen::MatrixXd Jur[2];
+            Eigen::MatrixXd Juh[2];
+            double t_eval[2];
+
+            // the outputs are accumulated, so the timing runs into separate ones
+            Eigen::VectorXd costs_acc(T);
+            Eigen::MatrixXd Jur_acc(T, 2 * T);
+            Eigen::MatrixXd Juh_acc(T, 2 * T);
+
+            for (int k = 0; k < 2; ++k) {
+                costs[k].setZero(T);
+                Jur[k].setZero(T, 2 * T);
+                Juh[k].setZero(T, 2 * T);
+                features[f][k]->evaluate(robot_traj, human_traj, 1.0, costs[k], Jur[k], Juh[k]);
+
+                ros::Time t_start = ros::Time::now();
+                for (int i = 0; i < n_eval; ++i)
+                    features[f][k]->evaluate(robot_traj, human_traj, 1.0, costs_acc, Jur_acc, Juh_acc);
+                t_eval[k] = (ros::Time::now() - t_start).toSec() / n_eval;
+            }
+
+            // only the lower parts are written
+            double err_cost = (costs[0] - costs[1]).cwiseAbs().maxCoeff();
+            double err_jac = 0.0;
+            for (int t = 0; t < T; ++t) {
+                int len = 2 * (t + 1);
+                err_jac = std::max(err_jac, (Jur[0].row(t).head(len) - Jur[1].row(t).head(len)).cwiseAbs().maxCoeff());
+                err_jac = std::max(err_jac, (Juh[0].row(t).head(len) - Juh[1].row(t).head(len)).cwiseAbs().maxCoeff());
+            }
+
+            logger << names[f] << ", human at " << dist << " m: " << t_eval[0] * 1e9 << " ns, culled "
+                   << t_eval[1] * 1e9 << " ns, max difference " << err_cost << " (costs), " << err_jac
+                   << " (jacobians)" << std::endl;
+
+            // the culled steps have costs below the tolerance, their gradients are a few times larger
+            if (!(err_cost <= tol_cost && err_jac <= tol_jac))
+                res.succeeded = false;
+        }
+    }
+
+    logger.close();
+
+    return true;
+}
+
+// outer iterations per planning cycle, starting cold from a constant control vs. from the warm start cache
+bool test_warm_start(hri_planner::TestComponent::Request& req,
+                     hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_warm_start.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const int n_cycles = 10;
+    const double dt = 0.5;
+
+    const char* names[2] = {"cold start", "warm start"};
+    int niter_totals[2];
+    bool flag_finite = true;
+    for (int mode = 0; mode < 2; ++mode) {
+        std::shared_ptr<BeliefModelBase> belief_model;
+        create_belief_model(belief_model);
+
+        std::vector<std::shared_ptr<BeliefModelBase> > belief_models(1, belief_model);
+        auto optimizer = create_multi_human_optimizer(belief_models, T);
+
+        WarmStartCache warm_start(3);
+
+        Eigen::VectorXd xr(3);
+        xr << 0.0, 0.0, 0.78;
+        std::vector<Eigen::VectorXd> xh(1, Eigen::VectorXd(4));
+        xh[0] << 2.5, 0.0, 0.0, 0.8;
+        std::vector<int> human_ids(1, 0);
+
+        Trajectory robot_traj_init(DIFFERENTIAL_MODEL, T, dt);
+        std::vector<Trajectory> human_trajs_hp_init(1, Trajectory(CONST_ACC_MODEL, T, dt));
+        std::vector<Trajectory> human_trajs_rp_init(1, Trajectory(CONST_ACC_MODEL, T, dt));
+
+        Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T, dt);
+        std::vector<Trajectory> human_trajs_hp_opt;
+        std::vector<Trajectory> human_trajs_rp_opt;
+
+        int niter_total = 0;
+        logger << names[mode] << ", outer iterations:";
+        for (int cycle = 0; cycle < n_cycles; ++cycle) {
+            warm_start.advance();
+
+            Eigen::VectorXd ur_init(2 * T);
+            for (int t = 0; t < T; ++t)
+                ur_init.segment(2 * t, 2) << 0.3, 0.0;
+
+            robot_traj_init.update(xr, ur_init);
+            human_trajs_hp_init[0].update(xh[0], Eigen::VectorXd::Zero(2 * T));
+            human_trajs_rp_init[0].update(xh[0], Eigen::VectorXd::Zero(2 * T));
+
+            if (mode == 1 && warm_start.size() > 0)
+                warm_start.get_candidate(0, xr, xh, human_ids, robot_traj_init, human_trajs_hp_init,
+                                         human_trajs_rp_init);
+
+            double cost = optimizer->optimize(robot_traj_init, human_trajs_hp_init, human_trajs_rp_init,
+                                              HumanPriority, -1.0, robot_traj_opt, &human_trajs_hp_opt,
+                                              &human_trajs_rp_opt);
+            if (!std::isnan(cost))
+                warm_start.push(robot_traj_opt, human_trajs_hp_opt, human_trajs_rp_opt, human_ids);
+            else
+                flag_finite = false;
+
+            int niter = optimizer->get_niter();
+            niter_total += niter;
+            logger << " " << niter;
+
+            // execute the first step of the plan, the human follows the hp response
+            xr = robot_traj_opt.x.segment(0, 3);
+            xh[0] = human_trajs_hp_opt[0].x.segment(0, 4);
+        }
+
+        logger << ", total " << niter_total << std::endl;
+        niter_totals[mode] = niter_total;
+    }
+
+    // the stored responses follow the ids of the humans, not their order
+    WarmStartCache warm_start(3);
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    std::vector<Trajectory> human_trajs_hp(2, Trajectory(CONST_ACC_MODEL, T, dt));
+    std::vector<Trajectory> human_trajs_rp(2, Trajectory(CONST_ACC_MODEL, T, dt));
+    std::vector<Eigen::VectorXd> xh(2, Eigen::VectorXd::Zero(4));
+    for (int k = 0; k < 2; ++k) {
+        human_trajs_hp[k].update(xh[k], Eigen::VectorXd::Constant(2 * T, 0.1 * (k + 1)));
+        human_trajs_rp[k].update(xh[k], Eigen::VectorXd::Constant(2 * T, -0.1 * (k + 1)));
+    }
+    warm_start.push(robot_traj, human_trajs_hp, human_trajs_rp, std::vector<int>{0, 5});
+
+    std::vector<Trajectory> human_trajs_hp_cand(2, Trajectory(CONST_ACC_MODEL, T, dt));
+    std::vector<Trajectory> human_trajs_rp_cand(2, Trajectory(CONST_ACC_MODEL, T, dt));
+    bool flag_swapped = warm_start.get_candidate(0, Eigen::VectorXd::Zero(3), xh, std::vector<int>{5, 0}, robot_traj,
+                                                 human_trajs_hp_cand, human_trajs_rp_cand) &&
+            human_trajs_hp_cand[0].u == human_trajs_hp[1].u && human_trajs_rp_cand[1].u == human_trajs_rp[0].u;
+    bool flag_new = warm_start.get_candidate(0, Eigen::VectorXd::Zero(3), xh, std::vector<int>{0, 7}, robot_traj,
+                                             human_trajs_hp_cand, human_trajs_rp_cand);
+
+    logger << "responses follow the human ids: " << flag_swapped << ", candidate with a new human: "
+           << flag_new << std::endl;
+
+    logger.close();
+
+    // every cycle has to produce a plan, and starting from the cache must not take more iterations
+    // a plan can't seed a human it wasn't planned with
+    res.succeeded = flag_finite && niter_totals[1] <= niter_totals[0] && flag_swapped && !flag_new;
+
+    return true;
+}
+
+// multi-start optimization with a human in the way, one seed against the seeds running in parallel
+// the seeds that fall behind are stopped by the monitor
+bool test_multi_start(hri_planner::TestComponent::Request& req,
+                      hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_multi_start.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const int n_seeds = 4;
+    const double dt = 0.5;
+    const double t_max = 0.4;
+
+    std::shared_ptr<BeliefModelBase> belief_model;
+    create_belief_model(belief_model);
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models(1, belief_model);
+
+    // the human stands on the straight line to the goal
+    Eigen::VectorXd xr0(3);
+    xr0 << 0.0, 0.0, 0.78;
+    Eigen::VectorXd xh0(4);
+    xh0 << 1.5, 1.5, 0.0, 0.0;
+
+    std::vector<Trajectory> human_trajs_init(1, Trajectory(CONST_ACC_MODEL, T, dt));
+    human_trajs_init[0].update(xh0, Eigen::VectorXd::Zero(2 * T));
+
+    // seeds: straight, detours to the left and right, and stopping
+    std::vector<Trajectory> seeds(n_seeds, Trajectory(DIFFERENTIAL_MODEL, T, dt));
+    for (int s = 0; s < n_seeds; ++s) {
+        Eigen::VectorXd ur(2 * T);
+        for (int t = 0; t < T; ++t) {
+            double om = (s == 1 || s == 2) ? (t < 3 ? 0.5 : -0.3) : 0.0;
+            ur.segment(2 * t, 2) << (s == 3 ? 0.0 : 0.5), (s == 2 ? -om : om);
+        }
+        seeds[s].update(xr0, ur);
+    }
+
+    auto thread_pool = std::make_shared<ThreadPool>(n_seeds);
+    auto monitor = std::make_shared<MultiStartMonitor>(n_seeds, 0.2, 5);
+
+    std::vector<std::shared_ptr<MultiHumanNestedOptimizer> > optimizers;
+    for (int s = 0; s < n_seeds; ++s) {
+        auto optimizer = create_multi_human_optimizer(belief_models, T);
+        optimizer->set_time_limit(t_max);
+        optimizer->set_progress_callback(monitor->callback(s));
+        optimizers.push_back(optimizer);
+    }
+
+    std::vector<double> costs(n_seeds);
+    std::vector<Trajectory> robot_trajs_opt(n_seeds, Trajectory(DIFFERENTIAL_MODEL, T, dt));
+
+    // single seed
+    ros::Time t_start = ros::Time::now();
+    costs[0] = optimizers[0]->optimize(seeds[0], human_trajs_init, human_trajs_init, HumanPriority, -1.0,
+                                       robot_trajs_opt[0]);
+    double t_single = (ros::Time::now() - t_start).toSec();
+    double cost_single = costs[0];
+
+    logger << "single seed: cost " << costs[0] << ", " << optimizers[0]->get_niter() << " iterations, "
+           << t_single * 1e3 << " ms" << std::endl;
+
+    // all seeds in parallel
+    monitor->reset();
+
+    std::vector<ThreadPool::Task> tasks;
+    for (int s = 0; s < n_seeds; ++s) {
+        tasks.emplace_back([&, s] {
+            costs[s] = optimizers[s]->optimize(seeds[s], human_trajs_init, human_trajs_init, HumanPriority, -1.0,
+                                               robot_trajs_opt[s]);
+        });
+    }
+
+    t_start = ros::Time::now();
+    thread_pool->run_parallel(tasks);
+    double t_multi = (ros::Time::now() - t_start).toSec();
+
+    int s_best = 0;
+    for (int s = 0; s < n_seeds; ++s) {
+        logger << "seed " << s << ": cost " << costs[s] << ", " << optimizers[s]->get_niter() << " iterations"
+               << std::endl;
+        if (costs[s] < costs[s_best])
+            s_best = s;
+    }
+
+    logger << n_seeds << " seeds: best seed " << s_best << ", cost " << costs[s_best] << ", "
+           << t_multi * 1e3 << " ms" << std::endl;
+
+    logger.close();
+
+    // the seeds share the deadline, and the best of them can't be clearly worse than the single seed
+    res.succeeded = std::isfinite(costs[s_best]) && t_multi <= 1.25 * t_max &&
+            costs[s_best] <= cost_single + 1e-2 * std::abs(cost_single);
+
+    return true;
+}
+
+// hand values from a producer to a consumer thread through the mailbox, as between the planner node threads
+// the consumer must only see whole values, in order, and end up with the last one
+bool test_mailbox(hri_planner::TestComponent::Request& req,
+                  hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_mailbox.txt");
+
+    using namespace hri_planner;
+
+    const int n_push = 100000;
+    const int len = 64;
+
+    // every element holds the index of the push, so that a torn copy shows up
+    Mailbox<Eigen::VectorXd> mailbox;
+    Eigen::VectorXd value;
+
+    res.succeeded = !mailbox.pop(value);
+
+    std::thread producer([&] {
+        for (int i = 1; i <= n_push; ++i) {
+            mailbox.push(Eigen::VectorXd::Constant(len, i));
+            if (i % 16 == 0)
+                std::this_thread::yield();
+        }
+    });
+
+    int n_pop = 0;
+    int last = 0;
+    bool flag_whole = true;
+    bool flag_ordered = true;
+    while (last < n_push) {
+        if (!mailbox.pop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        int i = static_cast<int>(value(0));
+        if (value.size() != len || (value.array() != i).any())
+            flag_whole = false;
+        if (i <= last)
+            flag_ordered = false;
+
+        last = i;
+        ++n_pop;
+    }
+    producer.join();
+
+    // nothing new after the last value
+    bool flag_empty = !mailbox.pop(value);
+
+    logger << n_push << " pushes, " << n_pop << " pops, last value " << last << ", whole values "
+           << flag_whole << ", in order " << flag_ordered << std::endl;
+    logger.close();
+
+    res.succeeded = res.succeeded && flag_whole && flag_ordered && flag_empty && last == n_push;
+
+    return true;
+}
+
+// poll the best iterate while the optimization runs on another thread, as the planner node does
+// the snapshots must only improve, and the last one must reproduce its cost with the stored human responses
+bool test_best_iterate(hri_planner::TestComponent::Request& req,
+                       hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_best_iterate.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const double dt = 0.5;
+    const double t_max = 0.4;
+
+    std::shared_ptr<BeliefModelBase> belief_model;
+    create_belief_model(belief_model);
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models(1, belief_model);
+
+    auto optimizer = create_multi_human_optimizer(belief_models, T);
+    optimizer->set_time_limit(t_max);
+
+    Eigen::VectorXd xr0(3);
+    xr0 << 0.0, 0.0, 0.78;
+    Eigen::VectorXd xh0(4);
+    xh0 << 1.5, 1.5, 0.0, 0.0;
+
+    Trajectory robot_traj_init(DIFFERENTIAL_MODEL, T, dt);
+    Eigen::VectorXd ur_init(2 * T);
+    for (int t = 0; t < T; ++t)
+        ur_init.segment(2 * t, 2) << 0.5, 0.0;
+    robot_traj_init.update(xr0, ur_init);
+
+    std::vector<Trajectory> human_trajs_init(1, Trajectory(CONST_ACC_MODEL, T, dt));
+    human_trajs_init[0].update(xh0, Eigen::VectorXd::Zero(2 * T));
+
+    Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T, dt);
+    std::atomic<bool> flag_done(false);
+    double cost_opt;
+
+    std::thread planning_thread([&] {
+        cost_opt = optimizer->optimize(robot_traj_init, human_trajs_init, human_trajs_init, HumanPriority, -1.0,
+                                       robot_traj_opt);
+        flag_done = true;
+    });
+
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T, dt);
+    std::vector<Trajectory> human_trajs_hp(1, Trajectory(CONST_ACC_MODEL, T, dt));
+    std::vector<Trajectory> human_trajs_rp(1, Trajectory(CONST_ACC_MODEL, T, dt));
+    double cost;
+    double cost_prev = std::numeric_limits<double>::infinity();
+    int n_snapshots = 0;
+    bool flag_improving = true;
+
+    while (!flag_done) {
+        if (optimizer->get_best_iterate(robot_traj, human_trajs_hp, human_trajs_rp, cost)) {
+            if (!(cost <= cost_prev))
+                flag_improving = false;
+            cost_prev = cost;
+            ++n_snapshots;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    planning_thread.join();
+
+    logger << n_snapshots << " snapshots while running, last cost " << cost_prev << std::endl;
+
+    // the last snapshot, evaluated again with the human responses held fixed
+    res.succeeded = false;
+    if (optimizer->get_best_iterate(robot_traj, human_trajs_hp, human_trajs_rp, cost)) {
+        robot_traj.compute_jacobian();
+        human_trajs_hp[0].compute_jacobian();
+        human_trajs_rp[0].compute_jacobian();
+        double cost_eval = optimizer->evaluate_cost(robot_traj, human_trajs_hp, human_trajs_rp, HumanPriority, -1.0);
+
+        logger << "final snapshot: cost " << cost << ", evaluated again " << cost_eval << ", optimized cost "
+               << cost_opt << std::endl;
+
+        res.succeeded = flag_improving && cost <= cost_prev && std::isfinite(cost) &&
+                std::abs(cost_eval - cost) <= 1e-8 * std::max(1.0, std::abs(cost)) &&
+                cost <= cost_opt + 1e-8 * std::max(1.0, std::abs(cost_opt));
+    }
+
+    logger.close();
+
+    return true;
+}
+
+// an optimization cancelled from another thread, and one started with the token already cancelled
+// both return their best point so far instead of running to the time limit
+bool test_cancellation(hri_planner::TestComponent::Request& req,
+                       hri_planner::TestComponent::Response& res)
+{
+    std::string log_path = req.log_path;
+    std::ofstream logger(log_path + "/log_cancellation.txt");
+
+    using namespace hri_planner;
+
+    const int T = 10;
+    const double dt = 0.5;
+    const double t_max = 1.0;
+    const double t_cancel = 0.05;
+
+    std::shared_ptr<BeliefModelBase> belief_model;
+    create_belief_model(belief_model);
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models(1, belief_model);
+
+    auto cancel_token = std::make_shared<CancellationToken>();
+
+    auto optimizer = create_multi_human_optimizer(belief_models, T);
+    optimizer->set_time_limit(t_max);
+    optimizer->set_cancellation_token(cancel_token);
+
+    Eigen::VectorXd xr0(3);
+    xr0 << 0.0, 0.0, 0.78;
+    Eigen::VectorXd xh0(4);
+    xh0 << 1.5, 1.5, 0.0, 0.0;
+
+    Trajectory robot_traj_init(DIFFERENTIAL_MODEL, T, dt);
+    Eigen::VectorXd ur_init(2 * T);
+    for (int t = 0; t < T; ++t)
+        ur_init.segment(2 * t, 2) << 0.5, 0.0;
+    robot_traj_init.update(xr0, ur_init);
+
+    std::vector<Trajectory> human_trajs_init(1, Trajectory(CONST_ACC_MODEL, T, dt));
+    human_trajs_init[0].update(xh0, Eigen::VectorXd::Zero(2 * T));
+
+    Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T, dt);
+    double cost;
+
+    // full optimization
+    ros::Time t_start = ros::Time::now();
+    double cost_full = optimizer->optimize(robot_traj_init, human_trajs_init, human_trajs_init, HumanPriority,
+                                           -1.0, robot_traj_opt);
+    int niter_full = optimizer->get_niter();
+    logger << "not cancelled: cost " << cost_full << ", " << niter_full << " iterations, "
+           << (ros::Time::now() - t_start).toSec() * 1e3 << " ms" << std::endl;
+
+    // cancelled after a fixed number of evaluations, independent of how fast the optimization converges
+    // the evaluation after the cancel is skipped, so at most one more is counted
+    const int n_cancel = 3;
+    int n_done = 0;
+    optimizer->set_progress_callback([&](double cost) {
+        if (++n_done == n_cancel)
+            cancel_token->cancel();
+        return true;
+    });
+
+    cost = optimizer->optimize(robot_traj_init, human_trajs_init, human_trajs_init, HumanPriority, -1.0,
+                               robot_traj_opt);
+    int niter_cancelled = optimizer->get_niter();
+    logger << "cancelled after " << n_cancel << " evaluations: cost " << cost << ", " << niter_cancelled
+           << " iterations" << std::endl;
+
+    optimizer->set_progress_callback(nullptr);
+    cancel_token->reset();
+
+    bool flag_stopped = std::isfinite(cost) && niter_cancelled <= n_cancel + 1 &&
+            (niter_full <= n_cancel + 1 || niter_cancelled < niter_full);
+
+    // cancelled from another thread while running, returns the best point so far
+    t_start = ros::Time::now();
+    std::thread canceller([&] {
+        std::this_thread::sleep_for(std::chrono::duration<double>(t_cancel));
+        cancel_token->cancel();
+    });
+    cost = optimizer->optimize(robot_traj_init, human_trajs_init, human_trajs_init, HumanPriority, -1.0,
+                               robot_traj_opt);
+    double t_cancelled = (ros::Time::now() - t_start).toSec();
+    canceller.join();
+
+    logger << "cancelled after " << t_cancel * 1e3 << " ms: cost " << cost << ", "
+           << optimizer->get_niter() << " iterations, " << t_cancelled * 1e3 << " ms" << std::endl;
+
+    // still cancelled, stops at the first evaluation
+    t_start = ros::Time::now();
+    cost = optimizer->optimize(robot_traj_init, human_trajs_init, human_trajs_init, HumanPriority, -1.0,
+                               robot_traj_opt);
+    int niter_before = optimizer->get_niter();
+    logger << "cancelled before: cost " << cost << ", " << niter_before << " iterations, "
+           << (ros::Time::now() - t_start).toSec() * 1e3 << " ms" << std::endl;
+
+    cancel_token->reset();
+
+    logger.close();
+    res.succeeded = std::isfinite(cost_full) && flag_stopped && niter_before <= 1 && t_cancelled < 0.5 * t_max;
+
+    return true;
+}
+
+
 int main(int argc, char **argv)
 {
     ros::init(argc, argv, "component_test_service");
@@ -770,7 +3301,26 @@ int main(int argc, char **argv)
     ros::ServiceServer feature_service = n.advertiseService("test_cost_features", test_cost_features);
     ros::ServiceServer simple_optimizer_service = n.advertiseService("test_simple_optimizer", test_simple_optimizer);
     ros::ServiceServer prob_cost_service = n.advertiseService("test_prob_cost", test_probabilistic_cost);
+    ros::ServiceServer explicit_belief_service = n.advertiseService("test_explicit_belief", test_explicit_belief);
     ros::ServiceServer nested_optimizer_service = n.advertiseService("test_nested_optimizer", test_nested_optimizer);
+    ros::ServiceServer gradient_mode_service = n.advertiseService("test_gradient_modes", test_gradient_modes);
+    ros::ServiceServer allocation_service = n.advertiseService("test_allocations", test_allocations);
+    ros::ServiceServer fixed_horizon_service = n.advertiseService("test_fixed_horizon", test_fixed_horizon);
+    ros::ServiceServer thread_pool_service = n.advertiseService("test_thread_pool", test_thread_pool);
+    ros::ServiceServer implicit_grad_service = n.advertiseService("test_implicit_gradient", test_implicit_gradient);
+    ros::ServiceServer follower_warm_start_service = n.advertiseService("test_follower_warm_start", test_follower_warm_start);
+    ros::ServiceServer follower_solver_service = n.advertiseService("test_follower_solvers", test_follower_solvers);
+    ros::ServiceServer gaussian_kernel_service = n.advertiseService("test_gaussian_kernel", test_gaussian_kernel);
+    ros::ServiceServer autodiff_service = n.advertiseService("test_autodiff", test_autodiff);
+    ros::ServiceServer static_cost_service = n.advertiseService("test_static_cost", test_static_cost);
+    ros::ServiceServer multi_intent_service = n.advertiseService("test_multi_intent", test_multi_intent);
+    ros::ServiceServer multi_human_service = n.advertiseService("test_multi_human", test_multi_human);
+    ros::ServiceServer feature_culling_service = n.advertiseService("test_feature_culling", test_feature_culling);
+    ros::ServiceServer warm_start_service = n.advertiseService("test_warm_start", test_warm_start);
+    ros::ServiceServer multi_start_service = n.advertiseService("test_multi_start", test_multi_start);
+    ros::ServiceServer best_iterate_service = n.advertiseService("test_best_iterate", test_best_iterate);
+    ros::ServiceServer mailbox_service = n.advertiseService("test_mailbox", test_mailbox);
+    ros::ServiceServer cancellation_service = n.advertiseService("test_cancellation", test_cancellation);
 
     ROS_INFO("Services are ready!");
     ros::spin();
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/7/2018
-// Last revision: 3/13/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -16,7 +16,47 @@
 namespace hri_planner {
 
 //----------------------------------------------------------------------------------
-double GaussianCost::compute(const Eigen::VectorXd &x, const int nX, const int T, const double a, const double b)
+void FeatureBase::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_uh(robot_traj, human_traj, grad_u);
+}
+
+//----------------------------------------------------------------------------------
+void FeatureBase::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_ur(robot_traj, human_traj, grad_u);
+}
+
+//----------------------------------------------------------------------------------
+void FeatureBase::step_hessian(const Trajectory &traj1, int s1, const Trajectory &traj2, int s2,
+                               ConstMatRef &H, MatRef hess)
+{
+    int T = traj1.horizon();
+    int n1 = (int) H.rows();
+    int n2 = (int) H.cols() / T;
+
+    int nX1 = traj1.state_size();
+    int nU1 = traj1.control_size();
+    int nX2 = traj2.state_size();
+    int nU2 = traj2.control_size();
+
+    Scratch<Eigen::MatrixXd> H_Ju(n1, traj2.traj_control_size());
+
+    hess.setZero();
+    for (int t = 0; t < T; ++t) {
+        int len1 = (t + 1) * nU1;
+        int len2 = (t + 1) * nU2;
+
+        H_Ju.leftCols(len2).noalias() = H.middleCols(t * n2, n2) * traj2.Ju.block(t * nX2 + s2, 0, n2, len2);
+        hess.topLeftCorner(len1, len2).noalias() +=
+                traj1.Ju.block(t * nX1 + s1, 0, n1, len1).transpose() * H_Ju.leftCols(len2);
+    }
+}
+
+//----------------------------------------------------------------------------------
+double GaussianCost::compute(ConstVecRef &x, const int nX, const int T, const double a, const double b)
 {
     double cost = 0.0;
 
@@ -30,10 +70,10 @@ double GaussianCost::compute(const Eigen::VectorXd &x, const int nX, const int T
 }
 
 //----------------------------------------------------------------------------------
-void GaussianCost::grad(const Eigen::VectorXd &x, const int nX, const int T, const double a, const double b,
-                        Eigen::VectorXd &grad)
+void GaussianCost::grad(ConstVecRef &x, const int nX, const int T, const double a, const double b,
+                        Eigen::Ref<Eigen::VectorXd> grad)
 {
-    grad.setZero(T * nX);
+    grad.setZero();
 
     for (int t = 0; t < T; ++t) {
         int st = t * nX;
@@ -47,22 +87,19 @@ void GaussianCost::grad(const Eigen::VectorXd &x, const int nX, const int T, con
 }
 
 //----------------------------------------------------------------------------------
-void GaussianCost::hessian(const Eigen::VectorXd &x, const int nX1, const int nX2, const int T,
-                           const double a, const double b, Eigen::MatrixXd &hess)
+void GaussianCost::hessian(ConstVecRef &x, const int T, const double a, const double b,
+                           Eigen::Ref<Eigen::MatrixXd> hess)
 {
-    hess.setZero(T*nX1, T*nX2);
-
     for (int t = 0; t < T; ++t) {
-        int st1 = t * nX1;
-        int st2 = t * nX2;
+        int st = t * 2;
         double xt = x(t*2) / a;
         double yt = x(t*2+1) / b;
         double c = std::exp(-(xt * xt + yt * yt));
 
-        hess(st1, st2) = (4.0 * xt * xt - 2.0) * c / (a * a);
-        hess(st1, st2+1) = 4.0 * xt * yt * c / (a * b);
-        hess(st1+1, st2) = hess(st1, st2+1);
-        hess(st1+1, st2+1) = (4.0 * yt * yt - 2.0) * c / (b * b);
+        hess(0, st) = (4.0 * xt * xt - 2.0) * c / (a * a);
+        hess(0, st+1) = 4.0 * xt * yt * c / (a * b);
+        hess(1, st) = hess(0, st+1);
+        hess(1, st+1) = (4.0 * yt * yt - 2.0) * c / (b * b);
     }
 }
 
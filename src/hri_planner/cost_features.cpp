@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/8/2018
-// Last revision: 3/25/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -14,8 +14,6 @@
 
 namespace hri_planner {
 
-// TODO: some of the second derivatives are not exact, maybe fix them later?
-
 //----------------------------------------------------------------------------------
 std::shared_ptr<FeatureHumanCost> FeatureHumanCost::create(const std::string &feature_type,
                                                            const std::vector<double> &args)
@@ -78,8 +76,17 @@ double HumanVelCost::compute(const Trajectory &robot_traj, const Trajectory &hum
 void HumanVelCost::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
 {
     // compute the gradient w.r.t. xh first
-    Eigen::VectorXd grad_x(human_traj.traj_state_size());
+    Scratch<Eigen::VectorXd> grad_x(human_traj.traj_state_size());
+    grad_xh(robot_traj, human_traj, grad_x, grad);
+
+    // compute gradient w.r.t. uh
+    human_traj.Ju_blocks.transpose_mult(grad_x, grad);
+}
 
+//----------------------------------------------------------------------------------
+void HumanVelCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                           VecRef grad_x, VecRef grad_u)
+{
     int nX = human_traj.state_size();
     for (int t = 0; t < human_traj.horizon(); ++t) {
         int xs = t * nX;
@@ -89,26 +96,20 @@ void HumanVelCost::grad_uh(const Trajectory &robot_traj, const Trajectory &human
         grad_x(xs+3) = 2.0 * human_traj.x(xs+3);
     }
 
-    // compute gradient w.r.t. uh
-    grad = human_traj.Ju.transpose() * grad_x;
+    grad_u.setZero();
 }
 
 //----------------------------------------------------------------------------------
 void HumanVelCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef hess)
 {
-    // compute the hessian w.r.t. xh first
-    Eigen::MatrixXd hess_x;
-    hess_x.setZero(human_traj.traj_state_size(), human_traj.traj_state_size());
-
-    int nX = human_traj.state_size();
-    for (int t = 0; t < human_traj.horizon(); ++t) {
-        int xs = t * nX;
-        hess_x(xs+2, xs+2) = 2.0;
-        hess_x(xs+3, xs+3) = 2.0;
-    }
+    // the hessian w.r.t. the velocity of each step is simply 2I
+    int T = human_traj.horizon();
+    Scratch<Eigen::MatrixXd> hess_x(2, 2 * T);
+    for (int t = 0; t < T; ++t)
+        hess_x.block(0, t*2, 2, 2) = 2.0 * Eigen::Matrix2d::Identity();
 
     // compute hessian w.r.t. uh
-    hess = human_traj.Ju.transpose() * hess_x * human_traj.Ju;
+    step_hessian(human_traj, 2, human_traj, 2, hess_x, hess);
 }
 
 //----------------------------------------------------------------------------------
@@ -123,6 +124,14 @@ void HumanAccCost::grad_uh(const Trajectory &robot_traj, const Trajectory &human
     grad = 2.0 * human_traj.u;
 }
 
+//----------------------------------------------------------------------------------
+void HumanAccCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                           VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u = 2.0 * human_traj.u;
+}
+
 //----------------------------------------------------------------------------------
 void HumanAccCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef hess)
 {
@@ -137,7 +146,8 @@ double HumanGoalCost::compute(const Trajectory &robot_traj, const Trajectory &hu
     double x_diff = x_goal_(0) - human_traj.x(xs);
     double y_diff = x_goal_(1) - human_traj.x(xs+1);
 
-    double cost = std::sqrt(x_diff * x_diff + y_diff * y_diff);
+    // smoothed distance, so that the derivatives are exact and bounded at the goal
+    double cost = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
     return cost;
 }
 
@@ -148,12 +158,29 @@ void HumanGoalCost::grad_uh(const Trajectory &robot_traj, const Trajectory &huma
     int xs = human_traj.traj_state_size() - human_traj.state_size();
     double x_diff = human_traj.x(xs) - x_goal_(0);
     double y_diff = human_traj.x(xs+1) - x_goal_(1);
-    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff) + reg_;
+    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
 
     grad_x(0) = x_diff / d;
     grad_x(1) = y_diff / d;
 
-    grad = human_traj.Ju.middleRows(xs, 2).transpose() * grad_x;
+    human_traj.Ju_blocks.transpose_mult_step(human_traj.horizon()-1, grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+void HumanGoalCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                            VecRef grad_x, VecRef grad_u)
+{
+    int xs = human_traj.traj_state_size() - human_traj.state_size();
+    double x_diff = human_traj.x(xs) - x_goal_(0);
+    double y_diff = human_traj.x(xs+1) - x_goal_(1);
+    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
+
+    // only the final position matters
+    grad_x.setZero();
+    grad_x(xs) = x_diff / d;
+    grad_x(xs+1) = y_diff / d;
+
+    grad_u.setZero();
 }
 
 //----------------------------------------------------------------------------------
@@ -163,7 +190,7 @@ void HumanGoalCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &h
     int xs = human_traj.traj_state_size() - human_traj.state_size();
     double x_diff = human_traj.x(xs) - x_goal_(0);
     double y_diff = human_traj.x(xs+1) - x_goal_(1);
-    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff) + reg_;
+    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
     double d3 = d * d * d;
 
     hess_x(0, 0) = -x_diff * x_diff / d3 + 1.0 / d;
@@ -171,7 +198,9 @@ void HumanGoalCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &h
     hess_x(1, 0) = hess_x(0, 1);
     hess_x(1, 1) = -y_diff * y_diff / d3 + 1.0 / d;
 
-    hess = human_traj.Ju.middleRows(xs, 2).transpose() * hess_x * human_traj.Ju.middleRows(xs, 2);
+    Scratch<Eigen::MatrixXd> hess_xu(2, human_traj.traj_control_size());
+    hess_xu.noalias() = hess_x * human_traj.Ju.middleRows(xs, 2);
+    hess.noalias() = human_traj.Ju.middleRows(xs, 2).transpose() * hess_xu;
 }
 
 //----------------------------------------------------------------------------------
@@ -192,11 +221,19 @@ void HumanObsCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &hu
 
 }
 
+//----------------------------------------------------------------------------------
+void HumanObsCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                           VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u.setZero();
+}
+
 //----------------------------------------------------------------------------------
 double CollisionCost::compute(const Trajectory &robot_traj, const Trajectory &human_traj)
 {
     // construct the pos diff vector
-    Eigen::VectorXd x_diff(2 * robot_traj.horizon());
+    Scratch<Eigen::VectorXd> x_diff(2 * robot_traj.horizon());
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -211,9 +248,28 @@ double CollisionCost::compute(const Trajectory &robot_traj, const Trajectory &hu
 
 //----------------------------------------------------------------------------------
 void CollisionCost::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(human_traj.traj_state_size());
+    grad_xh(robot_traj, human_traj, grad_x, grad);
+
+    human_traj.Ju_blocks.transpose_mult(grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+void CollisionCost::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(robot_traj.traj_state_size());
+    grad_xr(robot_traj, human_traj, grad_x, grad);
+
+    robot_traj.Ju_blocks.transpose_mult(grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+void CollisionCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                            VecRef grad_x, VecRef grad_u)
 {
     // construct the pos diff vector
-    Eigen::VectorXd x_diff(2 * human_traj.horizon());
+    Scratch<Eigen::VectorXd> x_diff(2 * human_traj.horizon());
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -224,17 +280,16 @@ void CollisionCost::grad_uh(const Trajectory &robot_traj, const Trajectory &huma
     }
 
     // compute gradient
-    Eigen::VectorXd grad_x;
     GaussianCost::grad(x_diff, human_traj.state_size(), human_traj.horizon(), R_, R_, grad_x);
-
-    grad = human_traj.Ju.transpose() * grad_x;
+    grad_u.setZero();
 }
 
 //----------------------------------------------------------------------------------
-void CollisionCost::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+void CollisionCost::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj,
+                            VecRef grad_x, VecRef grad_u)
 {
     // construct the pos diff vector
-    Eigen::VectorXd x_diff(2 * robot_traj.horizon());
+    Scratch<Eigen::VectorXd> x_diff(2 * robot_traj.horizon());
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -245,17 +300,15 @@ void CollisionCost::grad_ur(const Trajectory &robot_traj, const Trajectory &huma
     }
 
     // compute gradient
-    Eigen::VectorXd grad_x;
     GaussianCost::grad(x_diff, robot_traj.state_size(), robot_traj.horizon(), R_, R_, grad_x);
-
-    grad = robot_traj.Ju.transpose() * grad_x;
+    grad_u.setZero();
 }
 
 //----------------------------------------------------------------------------------
 void CollisionCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef hess)
 {
     // construct the pos diff vector
-    Eigen::VectorXd x_diff(2 * robot_traj.horizon());
+    Scratch<Eigen::VectorXd> x_diff(2 * robot_traj.horizon());
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -265,19 +318,18 @@ void CollisionCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &h
         x_diff(t*2+1) = human_traj.x(t*nXh+1) - robot_traj.x(t*nXr+1);
     }
 
-    // compute gradient
-    Eigen::MatrixXd hess_x;
-    GaussianCost::hessian(x_diff, human_traj.state_size(), human_traj.state_size(),
-                          human_traj.horizon(), R_, R_, hess_x);
+    // compute the per-step hessians w.r.t. the human position
+    Scratch<Eigen::MatrixXd> hess_x(2, 2 * robot_traj.horizon());
+    GaussianCost::hessian(x_diff, robot_traj.horizon(), R_, R_, hess_x);
 
-    hess = human_traj.Ju.transpose() * hess_x * human_traj.Ju;
+    step_hessian(human_traj, 0, human_traj, 0, hess_x, hess);
 }
 
 //----------------------------------------------------------------------------------
 void CollisionCost::hessian_uh_ur(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef hess)
 {
     // construct the pos diff vector
-    Eigen::VectorXd x_diff(2 * robot_traj.horizon());
+    Scratch<Eigen::VectorXd> x_diff(2 * robot_traj.horizon());
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -287,12 +339,12 @@ void CollisionCost::hessian_uh_ur(const Trajectory &robot_traj, const Trajectory
         x_diff(t*2+1) = human_traj.x(t*nXh+1) - robot_traj.x(t*nXr+1);
     }
 
-    // compute gradient
-    Eigen::MatrixXd hess_x;
-    GaussianCost::hessian(x_diff, human_traj.state_size(), robot_traj.state_size(),
-                          robot_traj.horizon(), R_, R_, hess_x);
+    // the cost only depends on the position difference, so the mixed hessian is the negative
+    Scratch<Eigen::MatrixXd> hess_x(2, 2 * robot_traj.horizon());
+    GaussianCost::hessian(x_diff, robot_traj.horizon(), R_, R_, hess_x);
+    hess_x *= -1.0;
 
-    hess = human_traj.Ju.transpose() * (-hess_x) * robot_traj.Ju;
+    step_hessian(human_traj, 0, robot_traj, 0, hess_x, hess);
 }
 
 //----------------------------------------------------------------------------------
@@ -300,7 +352,7 @@ double DynCollisionCost::compute(const Trajectory &robot_traj, const Trajectory
 {
     // compute the transformed coordinates
     int T = robot_traj.horizon();
-    Eigen::VectorXd x_trans(2 * T);
+    Scratch<Eigen::VectorXd> x_trans(2 * T);
 
     for (int t = 0; t < T; ++t) {
         int str = t * robot_traj.state_size();
@@ -324,13 +376,34 @@ double DynCollisionCost::compute(const Trajectory &robot_traj, const Trajectory
 
 //----------------------------------------------------------------------------------
 void DynCollisionCost::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(human_traj.traj_state_size());
+    grad_xh(robot_traj, human_traj, grad_x, grad);
+
+    // compute gradient w.r.t. the control
+    human_traj.Ju_blocks.transpose_mult(grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+void DynCollisionCost::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(robot_traj.traj_state_size());
+    grad_xr(robot_traj, human_traj, grad_x, grad);
+
+    // compute gradient w.r.t. the control
+    robot_traj.Ju_blocks.transpose_mult(grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+void DynCollisionCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                               VecRef grad_x, VecRef grad_u)
 {
     // compute the transformed coordinates
     int T = robot_traj.horizon();
-    Eigen::VectorXd x_trans(2 * T);
+    Scratch<Eigen::VectorXd> x_trans(2 * T);
 
     // to cache the computation
-    std::vector<Eigen::Matrix2d> rot;
+    Scratch<Eigen::MatrixXd> rot(2, 2 * T);
 
     for (int t = 0; t < T; ++t) {
         int str = t * robot_traj.state_size();
@@ -348,34 +421,35 @@ void DynCollisionCost::grad_uh(const Trajectory &robot_traj, const Trajectory &h
                 -std::sin(th), std::cos(th);
         x_trans.segment(t*2, 2) = rot_t * (human_traj.x.segment(sth, 2) - xc);
 
-        rot.push_back(rot_t);
+        rot.block(0, t*2, 2, 2) = rot_t;
     }
 
     // get gradient w.r.t. the transformed coordinate
-    Eigen::VectorXd grad_x;
     GaussianCost::grad(x_trans, human_traj.state_size(), T, Rx_, Ry_, grad_x);
 
     // get gradient w.r.t. the original pose
+    Eigen::Vector2d grad_t;
     for (int t = 0; t < T; ++t) {
         int sth = t * human_traj.state_size();
-        grad_x.segment(sth, 2) = rot[t].transpose() * grad_x.segment(sth, 2);
+        grad_t.noalias() = rot.block(0, t*2, 2, 2).transpose() * grad_x.segment(sth, 2);
+        grad_x.segment(sth, 2) = grad_t;
     }
 
-    // compute gradient w.r.t. the control
-    grad = human_traj.Ju.transpose() * grad_x;
+    grad_u.setZero();
 }
 
 //----------------------------------------------------------------------------------
-void DynCollisionCost::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+void DynCollisionCost::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj,
+                               VecRef grad_x, VecRef grad_u)
 {
     // compute the transformed coordinates
     int T = robot_traj.horizon();
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
-    Eigen::VectorXd x_trans(2 * T);
+    Scratch<Eigen::VectorXd> x_trans(2 * T);
 
     // to cache the computation
-    std::vector<Eigen::MatrixXd> Jxr;
+    Scratch<Eigen::MatrixXd> Jxr(2, T * nXr);
 
     for (int t = 0; t < T; ++t) {
         int str = t * nXr;
@@ -394,33 +468,25 @@ void DynCollisionCost::grad_ur(const Trajectory &robot_traj, const Trajectory &h
         x_trans.segment(t*2, 2) = rot_t * (human_traj.x.segment(sth, 2) - xc);
 
         // compute the jacobian w.r.t. xr
-        Eigen::MatrixXd J(2, nXr);
-//        J(0, 2) = x_trans(t*2+1);
-//        J(1, 2) = -x_trans(t*2);
-//
-//        Eigen::MatrixXd Jp(2, nXr);
-//        Jp << 1.0, 0.0, -d_ * std::sin(th),
-//                0.0, 1.0, -d_ * std::cos(th);
-//
-//        J -= rot_t.transpose() * Jp;
+        // x_trans = rot * (xh - xr) - (d, 0), and d(rot)/d(th) = [0, 1; -1, 0] * rot
+        auto J = Jxr.block(0, str, 2, nXr);
         J.block(0, 0, 2, 2) = -rot_t;
         J(0, 2) = x_trans(t*2+1);
-        J(1, 2) = -x_trans(t*2);
-        Jxr.push_back(J);
+        J(1, 2) = -x_trans(t*2) - d_;
     }
 
     // get gradient w.r.t. the transformed coordinate
-    Eigen::VectorXd grad_x;
     GaussianCost::grad(x_trans, robot_traj.state_size(), T, Rx_, Ry_, grad_x);
 
     // get gradient w.r.t. the original pose
+    Eigen::Vector2d grad_t;
     for (int t = 0; t < T; ++t) {
         int str = t * nXr;
-        grad_x.segment(str, nXr) = Jxr[t].transpose() * grad_x.segment(str, 2);
+        grad_t = grad_x.segment(str, 2);
+        grad_x.segment(str, nXr).noalias() = Jxr.block(0, str, 2, nXr).transpose() * grad_t;
     }
 
-    // compute gradient w.r.t. the control
-    grad = robot_traj.Ju.transpose() * grad_x;
+    grad_u.setZero();
 }
 
 //----------------------------------------------------------------------------------
@@ -430,10 +496,10 @@ void DynCollisionCost::hessian_uh(const Trajectory &robot_traj, const Trajectory
     int T = robot_traj.horizon();
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
-    Eigen::VectorXd x_trans(2 * T);
+    Scratch<Eigen::VectorXd> x_trans(2 * T);
 
     // to cache the computation
-    std::vector<Eigen::Matrix2d> rot;
+    Scratch<Eigen::MatrixXd> rot(2, 2 * T);
 
     for (int t = 0; t < T; ++t) {
         int str = t * nXr;
@@ -451,21 +517,22 @@ void DynCollisionCost::hessian_uh(const Trajectory &robot_traj, const Trajectory
                 -std::sin(th), std::cos(th);
         x_trans.segment(t*2, 2) = rot_t * (human_traj.x.segment(sth, 2) - xc);
 
-        rot.push_back(rot_t);
+        rot.block(0, t*2, 2, 2) = rot_t;
     }
 
     // get hessian w.r.t. x_trans
-    Eigen::MatrixXd hess_x;
-    GaussianCost::hessian(x_trans, nXh, nXh, T, Rx_, Ry_, hess_x);
+    Scratch<Eigen::MatrixXd> hess_x(2, 2 * T);
+    GaussianCost::hessian(x_trans, T, Rx_, Ry_, hess_x);
 
-    // get gradient w.r.t. the original pose
+    // get hessian w.r.t. the human position, rot^T * H * rot
+    Eigen::Matrix2d hess_t;
     for (int t = 0; t < T; ++t) {
-        int sth = t * nXh;
-        hess_x.block(sth, sth, 2, 2) = rot[t].transpose() * hess_x.block(sth, sth, 2, 2) * rot[t];
+        hess_t.noalias() = hess_x.block(0, t*2, 2, 2) * rot.block(0, t*2, 2, 2);
+        hess_x.block(0, t*2, 2, 2).noalias() = rot.block(0, t*2, 2, 2).transpose() * hess_t;
     }
 
-    // compute gradient w.r.t. the control
-    hess = human_traj.Ju.transpose() * hess_x * human_traj.Ju;
+    // compute hessian w.r.t. the control
+    step_hessian(human_traj, 0, human_traj, 0, hess_x, hess);
 }
 
 //----------------------------------------------------------------------------------
@@ -475,11 +542,11 @@ void DynCollisionCost::hessian_uh_ur(const Trajectory &robot_traj, const Traject
     int T = robot_traj.horizon();
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
-    Eigen::VectorXd x_trans(2 * T);
+    Scratch<Eigen::VectorXd> x_trans(2 * T);
 
     // to cache the computation
-    std::vector<Eigen::MatrixXd> Jxr;
-    std::vector<Eigen::Matrix2d> Jxh;
+    Scratch<Eigen::MatrixXd> Jxr(2, T * nXr);
+    Scratch<Eigen::MatrixXd> Jxh(2, 2 * T);
 
     for (int t = 0; t < T; ++t) {
         int str = t * nXr;
@@ -497,35 +564,37 @@ void DynCollisionCost::hessian_uh_ur(const Trajectory &robot_traj, const Traject
                 -std::sin(th), std::cos(th);
         x_trans.segment(t*2, 2) = rot_t * (human_traj.x.segment(sth, 2) - xc);
 
-        Jxh.push_back(rot_t);
+        Jxh.block(0, t*2, 2, 2) = rot_t;
 
-        // compute the jacobian w.r.t. xr
-        Eigen::MatrixXd J(2, nXr);
+        // compute the jacobian w.r.t. xr, same as in grad_xr
+        auto J = Jxr.block(0, str, 2, nXr);
         J.block(0, 0, 2, 2) = -rot_t;
         J(0, 2) = x_trans(t*2+1);
-        J(1, 2) = -x_trans(t*2);
-
-        Jxr.push_back(J);
+        J(1, 2) = -x_trans(t*2) - d_;
     }
 
-    // get gradient w.r.t. the transformed coordinate
-    Eigen::VectorXd grad_x;
-    Eigen::MatrixXd hess_x;
-    GaussianCost::grad(x_trans, nXh, T, Rx_, Ry_, grad_x);
-    GaussianCost::hessian(x_trans, nXh, nXr, T, Rx_, Ry_, hess_x);
-
-    // get gradient w.r.t. the original pose
+    // get gradient and hessian w.r.t. the transformed coordinate
+    Scratch<Eigen::VectorXd> grad_x(2 * T);
+    Scratch<Eigen::MatrixXd> hess_z(2, 2 * T);
+    GaussianCost::grad(x_trans, 2, T, Rx_, Ry_, grad_x);
+    GaussianCost::hessian(x_trans, T, Rx_, Ry_, hess_z);
+
+    // the gradient w.r.t. the human position is rot^T * grad_z, differentiate it w.r.t. xr
+    // d(rot^T * g)/d(th) = [0, -1; 1, 0] * rot^T * g adds to the heading column
+    Scratch<Eigen::MatrixXd> hess_x(2, T * nXr);
+    Eigen::Vector2d grad_t;
+    Eigen::Matrix2d hess_t;
     for (int t = 0; t < T; ++t) {
         int str = t * nXr;
-        int sth = t * nXh;
-        grad_x.segment(sth, 2) = Jxh[t].transpose() * grad_x.segment(sth, 2);
-        hess_x.block(sth, str, 2, nXr) = Jxh[t].transpose() * hess_x.block(sth, str, 2, 2) * Jxr[t];
-        hess_x(sth, str+2) += grad_x(sth+1);
-        hess_x(sth+1, str+2) -= grad_x(sth);
+        grad_t.noalias() = Jxh.block(0, t*2, 2, 2).transpose() * grad_x.segment(t*2, 2);
+        hess_t.noalias() = Jxh.block(0, t*2, 2, 2).transpose() * hess_z.block(0, t*2, 2, 2);
+        hess_x.block(0, str, 2, nXr).noalias() = hess_t * Jxr.block(0, str, 2, nXr);
+        hess_x(0, str+2) -= grad_t(1);
+        hess_x(1, str+2) += grad_t(0);
     }
 
-    // compute gradient w.r.t. the control
-    hess = human_traj.Ju.transpose() * hess_x * robot_traj.Ju;
+    // compute hessian w.r.t. the controls
+    step_hessian(human_traj, 0, robot_traj, 0, hess_x, hess);
 }
 
 //----------------------------------------------------------------------------------
@@ -546,6 +615,22 @@ void RobotControlCost::grad_uh(const Trajectory &robot_traj, const Trajectory &h
     grad.setZero();
 }
 
+//----------------------------------------------------------------------------------
+void RobotControlCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                               VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u.setZero();
+}
+
+//----------------------------------------------------------------------------------
+void RobotControlCost::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj,
+                               VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u = 2.0 * robot_traj.u;
+}
+
 //----------------------------------------------------------------------------------
 double RobotGoalCost::compute(const Trajectory &robot_traj, const Trajectory &human_traj)
 {
@@ -553,7 +638,8 @@ double RobotGoalCost::compute(const Trajectory &robot_traj, const Trajectory &hu
     double x_diff = robot_traj.x(xs) - x_goal_(0);
     double y_diff = robot_traj.x(xs+1) - x_goal_(1);
 
-    return std::sqrt(x_diff * x_diff + y_diff * y_diff);
+    // smoothed distance, consistent with the gradient
+    return std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
 }
 
 //----------------------------------------------------------------------------------
@@ -562,6 +648,14 @@ void RobotGoalCost::grad_uh(const Trajectory &robot_traj, const Trajectory &huma
     grad.setZero();
 }
 
+//----------------------------------------------------------------------------------
+void RobotGoalCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                            VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u.setZero();
+}
+
 //----------------------------------------------------------------------------------
 void RobotGoalCost::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
 {
@@ -569,12 +663,29 @@ void RobotGoalCost::grad_ur(const Trajectory &robot_traj, const Trajectory &huma
     int xs = robot_traj.traj_state_size() - robot_traj.state_size();
     double x_diff = robot_traj.x(xs) - x_goal_(0);
     double y_diff = robot_traj.x(xs+1) - x_goal_(1);
-    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff) + reg_;
+    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
 
     grad_x(0) = x_diff / d;
     grad_x(1) = y_diff / d;
 
-    grad = robot_traj.Ju.middleRows(xs, 2).transpose() * grad_x;
+    robot_traj.Ju_blocks.transpose_mult_step(robot_traj.horizon()-1, grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+void RobotGoalCost::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj,
+                            VecRef grad_x, VecRef grad_u)
+{
+    int xs = robot_traj.traj_state_size() - robot_traj.state_size();
+    double x_diff = robot_traj.x(xs) - x_goal_(0);
+    double y_diff = robot_traj.x(xs+1) - x_goal_(1);
+    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
+
+    // only the final position matters
+    grad_x.setZero();
+    grad_x(xs) = x_diff / d;
+    grad_x(xs+1) = y_diff / d;
+
+    grad_u.setZero();
 }
 
 }
\ No newline at end of file
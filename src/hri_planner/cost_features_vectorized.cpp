@@ -3,16 +3,86 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/18/2018
-// Last revision: 4/26/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
 //----------------------------------------------------------------------------------
 
+#include <limits>
+#include <algorithm>
+
 #include "hri_planner/cost_features_vectorized.h"
 
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define HRI_PLANNER_AVX2_KERNELS
+#endif
+
 namespace hri_planner {
 
+//----------------------------------------------------------------------------------
+void tril_set_zero(Eigen::Ref<Eigen::MatrixXd> J, int nU)
+{
+    // column j is used from step j / nU on, columns are contiguous
+    int T = (int) J.rows();
+    for (int j = 0; j < J.cols(); ++j)
+        J.col(j).tail(T - j / nU).setZero();
+}
+
+//----------------------------------------------------------------------------------
+void tril_add(double w, const Eigen::Ref<const Eigen::MatrixXd> &J_src, int nU, Eigen::Ref<Eigen::MatrixXd> J)
+{
+    int T = (int) J.rows();
+    for (int j = 0; j < J.cols(); ++j)
+        J.col(j).tail(T - j / nU) += w * J_src.col(j).tail(T - j / nU);
+}
+
+//----------------------------------------------------------------------------------
+void tril_transpose_mult_add(const Eigen::Ref<const Eigen::MatrixXd> &J, int nU,
+                             const Eigen::Ref<const Eigen::VectorXd> &v, Eigen::Ref<Eigen::VectorXd> y)
+{
+    int T = (int) J.rows();
+    for (int j = 0; j < J.cols(); ++j) {
+        int n = T - j / nU;
+        y(j) += J.col(j).tail(n).dot(v.tail(n));
+    }
+}
+
+#ifdef HRI_PLANNER_AVX2_KERNELS
+//----------------------------------------------------------------------------------
+// exp(x) for 4 doubles, accurate to a few ulp for the non-positive arguments of the gaussians
+static inline __m256d exp_avx2(__m256d x)
+{
+    const double x_min = -708.0;
+
+    // exp(x) = 2^n * exp(r) with |r| <= ln(2) / 2
+    __m256d x_clamped = _mm256_max_pd(x, _mm256_set1_pd(x_min));
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x_clamped, _mm256_set1_pd(1.4426950408889634)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(6.93145751953125e-1), x_clamped);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(1.42860682030941723212e-6), r);
+
+    // taylor series up to r^12, the truncation error is below 1e-16
+    static const double coeffs[13] = {
+            1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+            1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600
+    };
+
+    __m256d p = _mm256_set1_pd(coeffs[12]);
+    for (int k = 11; k >= 0; --k)
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(coeffs[k]));
+
+    // 2^n from the exponent bits
+    __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+    e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+    p = _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+
+    // flush what would underflow to zero
+    return _mm256_and_pd(p, _mm256_cmp_pd(x, _mm256_set1_pd(x_min), _CMP_GE_OQ));
+}
+#endif
+
 //----------------------------------------------------------------------------------
 std::shared_ptr<FeatureVectorizedBase> FeatureVectorizedBase::create(const std::string &feature_type,
                                                                      const std::vector<double> &args)
@@ -21,9 +91,14 @@ std::shared_ptr<FeatureVectorizedBase> FeatureVectorizedBase::create(const std::
         return std::make_shared<HumanAccCostVec>();
     }
     else if (feature_type == "Collision") {
+        // optional culling tolerance as the last argument
+        if (args.size() > 1)
+            return std::make_shared<CollisionCostVec>(args[0], args[1]);
         return std::make_shared<CollisionCostVec>(args[0]);
     }
     else if (feature_type == "DynCollision") {
+        if (args.size() > 3)
+            return std::make_shared<DynCollisionCostVec>(args[0], args[1], args[2], args[3]);
         return std::make_shared<DynCollisionCostVec>(args[0], args[1], args[2]);
     }
     else if (feature_type == "HumanGoal") {
@@ -37,10 +112,36 @@ std::shared_ptr<FeatureVectorizedBase> FeatureVectorizedBase::create(const std::
 }
 
 //----------------------------------------------------------------------------------
-void GaussianCostVec::compute(const Eigen::VectorXd &x, const int nX, const int T, const double a, const double b,
-                              Eigen::VectorXd &costs)
+void FeatureVectorizedBase::evaluate(const Trajectory &robot_traj, const Trajectory &human_traj, double w,
+                                     VecRef costs, MatRef Jur, MatRef Juh)
+{
+    Scratch<Eigen::VectorXd> costs_f(costs.size());
+    compute(robot_traj, human_traj, costs_f);
+    costs += w * costs_f;
+
+    Scratch<Eigen::MatrixXd> Jur_f(Jur.rows(), Jur.cols());
+    grad_ur(robot_traj, human_traj, Jur_f);
+    tril_add(w, Jur_f, robot_traj.control_size(), Jur);
+
+    Scratch<Eigen::MatrixXd> Juh_f(Juh.rows(), Juh.cols());
+    grad_uh(robot_traj, human_traj, Juh_f);
+    tril_add(w, Juh_f, human_traj.control_size(), Juh);
+}
+
+//----------------------------------------------------------------------------------
+void FeatureVectorizedBase::evaluate_batch(const Trajectory &robot_traj,
+                                           const std::vector<const Trajectory *> &human_trajs, double w,
+                                           MatRef costs, MatRef Jur, MatRef Juh)
+{
+    int T = robot_traj.horizon();
+    for (int m = 0; m < (int) human_trajs.size(); ++m)
+        evaluate(robot_traj, *human_trajs[m], w, costs.col(m), Jur.middleRows(m * T, T), Juh.middleRows(m * T, T));
+}
+
+//----------------------------------------------------------------------------------
+void GaussianCostVec::compute(ConstVecRef &x, const int nX, const int T, const double a, const double b,
+                              Eigen::Ref<Eigen::VectorXd> costs)
 {
-    costs.setZero(T);
 
     for (int t = 0; t < T; ++t) {
         double xt = x(t*2) / a;
@@ -50,10 +151,10 @@ void GaussianCostVec::compute(const Eigen::VectorXd &x, const int nX, const int
 }
 
 //----------------------------------------------------------------------------------
-void GaussianCostVec::grad(const Eigen::VectorXd &x, const int nX, const int T, const double a, const double b,
-                           Eigen::VectorXd &grad)
+void GaussianCostVec::grad(ConstVecRef &x, const int nX, const int T, const double a, const double b,
+                           Eigen::Ref<Eigen::VectorXd> grad)
 {
-    grad.setZero(T * nX);
+    grad.setZero();
 
     for (int t = 0; t < T; ++t) {
         int st = t * nX;
@@ -67,10 +168,75 @@ void GaussianCostVec::grad(const Eigen::VectorXd &x, const int nX, const int T,
 }
 
 //----------------------------------------------------------------------------------
-void CollisionCostVec::compute(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::VectorXd &costs)
+void GaussianCostVec::evaluate_batch(const double *dx, const double *dy, const int T, const double a,
+                                     const double b, double *costs, double *gx, double *gy)
+{
+    double a_inv = 1.0 / a;
+    double b_inv = 1.0 / b;
+    double ga = -2.0 * a_inv * a_inv;
+    double gb = -2.0 * b_inv * b_inv;
+
+    int t = 0;
+
+#ifdef HRI_PLANNER_AVX2_KERNELS
+    __m256d a_inv4 = _mm256_set1_pd(a_inv);
+    __m256d b_inv4 = _mm256_set1_pd(b_inv);
+    __m256d ga4 = _mm256_set1_pd(ga);
+    __m256d gb4 = _mm256_set1_pd(gb);
+
+    for (; t + 4 <= T; t += 4) {
+        __m256d dx4 = _mm256_loadu_pd(dx + t);
+        __m256d dy4 = _mm256_loadu_pd(dy + t);
+
+        __m256d xt = _mm256_mul_pd(dx4, a_inv4);
+        __m256d yt = _mm256_mul_pd(dy4, b_inv4);
+        __m256d d_sq = _mm256_fmadd_pd(xt, xt, _mm256_mul_pd(yt, yt));
+        __m256d c = exp_avx2(_mm256_sub_pd(_mm256_setzero_pd(), d_sq));
+
+        _mm256_storeu_pd(costs + t, c);
+        _mm256_storeu_pd(gx + t, _mm256_mul_pd(_mm256_mul_pd(ga4, dx4), c));
+        _mm256_storeu_pd(gy + t, _mm256_mul_pd(_mm256_mul_pd(gb4, dy4), c));
+    }
+#endif
+
+    // remainder, or the whole horizon without AVX2
+    for (; t < T; ++t) {
+        double xt = dx[t] * a_inv;
+        double yt = dy[t] * b_inv;
+        double c = std::exp(-(xt * xt + yt * yt));
+
+        costs[t] = c;
+        gx[t] = ga * dx[t] * c;
+        gy[t] = gb * dy[t] * c;
+    }
+}
+
+//----------------------------------------------------------------------------------
+double GaussianCostVec::cull_radius_sq(const double a, const double b, const double tol)
+{
+    if (tol <= 0.0)
+        return std::numeric_limits<double>::infinity();
+
+    // exp(-(dx/a)^2 - (dy/b)^2) <= exp(-(dx^2 + dy^2) / max(a, b)^2)
+    double r = std::max(a, b);
+    return -std::log(tol) * r * r;
+}
+
+//----------------------------------------------------------------------------------
+int GaussianCostVec::active_horizon(const double *dx, const double *dy, const int T, const double r_sq)
+{
+    int t_end = T;
+    while (t_end > 0 && dx[t_end-1] * dx[t_end-1] + dy[t_end-1] * dy[t_end-1] >= r_sq)
+        --t_end;
+
+    return t_end;
+}
+
+//----------------------------------------------------------------------------------
+void CollisionCostVec::compute(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef costs)
 {
     // construct the pos diff vector
-    Eigen::VectorXd x_diff(2 * robot_traj.horizon());
+    Scratch<Eigen::VectorXd> x_diff(2 * robot_traj.horizon());
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -86,10 +252,10 @@ void CollisionCostVec::compute(const Trajectory &robot_traj, const Trajectory &h
 }
 
 //----------------------------------------------------------------------------------
-void CollisionCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::MatrixXd &Juh)
+void CollisionCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef Juh)
 {
     // construct the pos diff vector
-    Eigen::VectorXd x_diff(2 * human_traj.horizon());
+    Scratch<Eigen::VectorXd> x_diff(2 * human_traj.horizon());
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -102,21 +268,19 @@ void CollisionCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &h
     }
 
     // compute gradient
-    Eigen::VectorXd grad_x;
+    Scratch<Eigen::VectorXd> grad_x(2 * human_traj.horizon());
     GaussianCostVec::grad(x_diff, 2, human_traj.horizon(), R_, R_, grad_x);
 
-    Juh.setZero(human_traj.horizon(), human_traj.traj_control_size());
-    for (int t = 0; t < human_traj.horizon(); ++t) {
-        Juh.row(t) = grad_x.segment(t*2, 2).transpose() *
-                human_traj.Ju.block(t*nXh, 0, 2, human_traj.traj_control_size());
-    }
+    Juh.setZero();
+    for (int t = 0; t < human_traj.horizon(); ++t)
+        human_traj.Ju_blocks.transpose_mult_step(t, grad_x.segment(t*2, 2), Juh.row(t));
 }
 
 //----------------------------------------------------------------------------------
-void CollisionCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::MatrixXd &Jur)
+void CollisionCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef Jur)
 {
     // construct the pos diff vector
-    Eigen::VectorXd x_diff(2 * human_traj.horizon());
+    Scratch<Eigen::VectorXd> x_diff(2 * human_traj.horizon());
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -129,22 +293,120 @@ void CollisionCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &h
     }
 
     // compute gradient
-    Eigen::VectorXd grad_x;
+    Scratch<Eigen::VectorXd> grad_x(2 * robot_traj.horizon());
     GaussianCostVec::grad(x_diff, 2, robot_traj.horizon(), R_, R_, grad_x);
 
-    Jur.setZero(robot_traj.horizon(), robot_traj.traj_control_size());
-    for (int t = 0; t < human_traj.horizon(); ++t) {
-        Jur.row(t) = grad_x.segment(t*2, 2).transpose() *
-                     robot_traj.Ju.block(t*nXr, 0, 2, robot_traj.traj_control_size());
+    Jur.setZero();
+    for (int t = 0; t < robot_traj.horizon(); ++t)
+        robot_traj.Ju_blocks.transpose_mult_step(t, grad_x.segment(t*2, 2), Jur.row(t));
+}
+
+//----------------------------------------------------------------------------------
+void CollisionCostVec::evaluate(const Trajectory &robot_traj, const Trajectory &human_traj, double w,
+                                VecRef costs, MatRef Jur, MatRef Juh)
+{
+    // construct the pos diffs once for the cost and both gradients
+    int T = robot_traj.horizon();
+    Scratch<Eigen::VectorXd> dx(T);
+    Scratch<Eigen::VectorXd> dy(T);
+
+    int nXr = robot_traj.state_size();
+    int nXh = human_traj.state_size();
+
+    for (int t = 0; t < T; ++t) {
+        int str = t * nXr;
+        int sth = t * nXh;
+        dx(t) = robot_traj.x(str) - human_traj.x(sth);
+        dy(t) = robot_traj.x(str+1) - human_traj.x(sth+1);
+    }
+
+    // nothing to add once the two stay apart
+    int t_end = GaussianCostVec::active_horizon(dx.data(), dy.data(), T, cull_r_sq_);
+    if (t_end == 0)
+        return;
+
+    Scratch<Eigen::VectorXd> costs_f(t_end);
+    Scratch<Eigen::VectorXd> gx(t_end);
+    Scratch<Eigen::VectorXd> gy(t_end);
+    GaussianCostVec::evaluate_batch(dx.data(), dy.data(), t_end, R_, R_, costs_f.data(), gx.data(), gy.data());
+
+    // the gradient w.r.t. the human position is the negative of the robot one
+    Eigen::Vector2d grad_t;
+    for (int t = 0; t < t_end; ++t) {
+        if (dx(t) * dx(t) + dy(t) * dy(t) >= cull_r_sq_)
+            continue;
+
+        costs(t) += w * costs_f(t);
+
+        grad_t << w * gx(t), w * gy(t);
+        robot_traj.Ju_blocks.transpose_mult_step_add(t, grad_t, Jur.row(t));
+
+        grad_t = -grad_t;
+        human_traj.Ju_blocks.transpose_mult_step_add(t, grad_t, Juh.row(t));
     }
 }
 
 //----------------------------------------------------------------------------------
-void DynCollisionCostVec::compute(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::VectorXd &costs)
+void CollisionCostVec::evaluate_batch(const Trajectory &robot_traj, const std::vector<const Trajectory *> &human_trajs,
+                                      double w, MatRef costs, MatRef Jur, MatRef Juh)
+{
+    // the pos diffs of all humans are stacked, so that the kernel runs once over M * T steps
+    int T = robot_traj.horizon();
+    int M = static_cast<int>(human_trajs.size());
+    int nXr = robot_traj.state_size();
+
+    Scratch<Eigen::VectorXd> dx(M * T);
+    Scratch<Eigen::VectorXd> dy(M * T);
+
+    for (int m = 0; m < M; ++m) {
+        const Trajectory& human_traj = *human_trajs[m];
+        int nXh = human_traj.state_size();
+
+        for (int t = 0; t < T; ++t) {
+            int str = t * nXr;
+            int sth = t * nXh;
+            dx(m * T + t) = robot_traj.x(str) - human_traj.x(sth);
+            dy(m * T + t) = robot_traj.x(str+1) - human_traj.x(sth+1);
+        }
+    }
+
+    Scratch<Eigen::VectorXd> costs_f(M * T);
+    Scratch<Eigen::VectorXd> gx(M * T);
+    Scratch<Eigen::VectorXd> gy(M * T);
+
+    // culled per human, distant humans are skipped entirely
+    Eigen::Vector2d grad_t;
+    for (int m = 0; m < M; ++m) {
+        int st = m * T;
+        int t_end = GaussianCostVec::active_horizon(dx.data() + st, dy.data() + st, T, cull_r_sq_);
+        if (t_end == 0)
+            continue;
+
+        GaussianCostVec::evaluate_batch(dx.data() + st, dy.data() + st, t_end, R_, R_,
+                                        costs_f.data() + st, gx.data() + st, gy.data() + st);
+
+        for (int t = 0; t < t_end; ++t) {
+            int row = st + t;
+            if (dx(row) * dx(row) + dy(row) * dy(row) >= cull_r_sq_)
+                continue;
+
+            costs(t, m) += w * costs_f(row);
+
+            grad_t << w * gx(row), w * gy(row);
+            robot_traj.Ju_blocks.transpose_mult_step_add(t, grad_t, Jur.row(row));
+
+            grad_t = -grad_t;
+            human_trajs[m]->Ju_blocks.transpose_mult_step_add(t, grad_t, Juh.row(row));
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------
+void DynCollisionCostVec::compute(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef costs)
 {
     // construct the pos diff vector
     int T = robot_traj.horizon();
-    Eigen::VectorXd x_trans(2 * T);
+    Scratch<Eigen::VectorXd> x_trans(2 * T);
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -170,14 +432,14 @@ void DynCollisionCostVec::compute(const Trajectory &robot_traj, const Trajectory
 }
 
 //----------------------------------------------------------------------------------
-void DynCollisionCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::MatrixXd &Juh)
+void DynCollisionCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef Juh)
 {
     // compute the transformed coordinates
     int T = robot_traj.horizon();
-    Eigen::VectorXd x_trans(2 * T);
+    Scratch<Eigen::VectorXd> x_trans(2 * T);
 
     // to cache the computation
-    std::vector<Eigen::Matrix2d> rot;
+    Scratch<Eigen::MatrixXd> rot(2, 2 * T);
 
     for (int t = 0; t < T; ++t) {
         int str = t * robot_traj.state_size();
@@ -195,40 +457,39 @@ void DynCollisionCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory
                 -std::sin(th), std::cos(th);
         x_trans.segment(t*2, 2) = rot_t * (human_traj.x.segment(sth, 2) - xc);
 
-        rot.push_back(rot_t);
+        rot.block(0, t*2, 2, 2) = rot_t;
     }
 
     // get gradient w.r.t. the transformed coordinate
-    Eigen::VectorXd grad_x;
-    GaussianCostVec::grad(x_trans, human_traj.state_size(), T, Rx_, Ry_, grad_x);
-
-    // get gradient w.r.t. the original pose
     int nXh = human_traj.state_size();
+    Scratch<Eigen::VectorXd> grad_x(T * nXh);
+    GaussianCostVec::grad(x_trans, nXh, T, Rx_, Ry_, grad_x);
 
+    // get gradient w.r.t. the original pose
+    Eigen::Vector2d grad_t;
     for (int t = 0; t < T; ++t) {
         int sth = t * nXh;
-        grad_x.segment(sth, 2) = rot[t].transpose() * grad_x.segment(sth, 2);
+        grad_t.noalias() = rot.block(0, t*2, 2, 2).transpose() * grad_x.segment(sth, 2);
+        grad_x.segment(sth, 2) = grad_t;
     }
 
     // compute gradient w.r.t. the control
-    Juh.setZero(human_traj.horizon(), human_traj.traj_control_size());
-    for (int t = 0; t < human_traj.horizon(); ++t) {
-        Juh.row(t) = grad_x.segment(t*2, 2).transpose() *
-                     human_traj.Ju.block(t*nXh, 0, 2, human_traj.traj_control_size());
-    }
+    Juh.setZero();
+    for (int t = 0; t < human_traj.horizon(); ++t)
+        human_traj.Ju_blocks.transpose_mult_step(t, grad_x.segment(t*nXh, 2), Juh.row(t));
 }
 
 //----------------------------------------------------------------------------------
-void DynCollisionCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::MatrixXd &Jur)
+void DynCollisionCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef Jur)
 {
     // compute the transformed coordinates
     int T = robot_traj.horizon();
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
-    Eigen::VectorXd x_trans(2 * T);
+    Scratch<Eigen::VectorXd> x_trans(2 * T);
 
     // to cache the computation
-    std::vector<Eigen::MatrixXd> Jxr;
+    Scratch<Eigen::MatrixXd> Jxr(2, T * nXr);
 
     for (int t = 0; t < T; ++t) {
         int str = t * nXr;
@@ -247,35 +508,173 @@ void DynCollisionCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory
         x_trans.segment(t*2, 2) = rot_t * (human_traj.x.segment(sth, 2) - xc);
 
         // compute the jacobian w.r.t. xr
-        Eigen::MatrixXd J(2, nXr);
+        // x_trans = rot * (xh - xr) - (d, 0), and d(rot)/d(th) = [0, 1; -1, 0] * rot
+        auto J = Jxr.block(0, str, 2, nXr);
         J.block(0, 0, 2, 2) = -rot_t;
         J(0, 2) = x_trans(t*2+1);
-        J(1, 2) = -x_trans(t*2);
-        Jxr.push_back(J);
+        J(1, 2) = -x_trans(t*2) - d_;
     }
 
     // get gradient w.r.t. the transformed coordinate
-    Eigen::VectorXd grad_x;
-    GaussianCostVec::grad(x_trans, robot_traj.state_size(), T, Rx_, Ry_, grad_x);
+    Scratch<Eigen::VectorXd> grad_x(T * nXr);
+    GaussianCostVec::grad(x_trans, nXr, T, Rx_, Ry_, grad_x);
 
     // get gradient w.r.t. the original pose
+    Eigen::Vector2d grad_t;
     for (int t = 0; t < T; ++t) {
         int str = t * nXr;
-        grad_x.segment(str, nXr) = Jxr[t].transpose() * grad_x.segment(str, 2);
+        grad_t = grad_x.segment(str, 2);
+        grad_x.segment(str, nXr).noalias() = Jxr.block(0, str, 2, nXr).transpose() * grad_t;
     }
 
-    Jur.setZero(robot_traj.horizon(), robot_traj.traj_control_size());
-    for (int t = 0; t < human_traj.horizon(); ++t) {
-        Jur.row(t) = grad_x.segment(t*2, 2).transpose() *
-                     robot_traj.Ju.block(t*nXr, 0, 2, robot_traj.traj_control_size());
+    Jur.setZero();
+    for (int t = 0; t < robot_traj.horizon(); ++t)
+        robot_traj.Ju_blocks.transpose_mult_step(t, grad_x.segment(t*nXr, nXr), Jur.row(t));
+}
+
+//----------------------------------------------------------------------------------
+void DynCollisionCostVec::evaluate(const Trajectory &robot_traj, const Trajectory &human_traj, double w,
+                                   VecRef costs, MatRef Jur, MatRef Juh)
+{
+    // compute the transformed coordinates once for the cost and both gradients
+    int T = robot_traj.horizon();
+    int nXr = robot_traj.state_size();
+    int nXh = human_traj.state_size();
+    Scratch<Eigen::VectorXd> x_trans(T);
+    Scratch<Eigen::VectorXd> y_trans(T);
+
+    // to cache the computation
+    Scratch<Eigen::MatrixXd> rot(2, 2 * T);
+
+    for (int t = 0; t < T; ++t) {
+        int str = t * nXr;
+        int sth = t * nXh;
+        double th = robot_traj.x(str + 2);
+
+        // compute the center of gaussian cost
+        Eigen::Vector2d xc;
+        xc << robot_traj.x(str) + d_ * std::cos(th),
+                robot_traj.x(str+1) + d_ * std::sin(th);
+
+        // compute the transformed coordinate
+        Eigen::Matrix2d rot_t;
+        rot_t << std::cos(th), std::sin(th),
+                -std::sin(th), std::cos(th);
+
+        Eigen::Vector2d x_trans_t = rot_t * (human_traj.x.segment(sth, 2) - xc);
+        x_trans(t) = x_trans_t(0);
+        y_trans(t) = x_trans_t(1);
+
+        rot.block(0, t*2, 2, 2) = rot_t;
+    }
+
+    int t_end = GaussianCostVec::active_horizon(x_trans.data(), y_trans.data(), T, cull_r_sq_);
+    if (t_end == 0)
+        return;
+
+    Scratch<Eigen::VectorXd> costs_f(t_end);
+    Scratch<Eigen::VectorXd> gx(t_end);
+    Scratch<Eigen::VectorXd> gy(t_end);
+    GaussianCostVec::evaluate_batch(x_trans.data(), y_trans.data(), t_end, Rx_, Ry_,
+                                    costs_f.data(), gx.data(), gy.data());
+
+    // get gradients w.r.t. the original poses, same jacobians as in grad_uh and grad_ur
+    Eigen::Vector2d grad_t;
+    Eigen::Vector2d grad_xh;
+    Eigen::Vector3d grad_xr;
+    for (int t = 0; t < t_end; ++t) {
+        if (x_trans(t) * x_trans(t) + y_trans(t) * y_trans(t) >= cull_r_sq_)
+            continue;
+
+        costs(t) += w * costs_f(t);
+
+        grad_t << w * gx(t), w * gy(t);
+        grad_xh.noalias() = rot.block(0, t*2, 2, 2).transpose() * grad_t;
+        human_traj.Ju_blocks.transpose_mult_step_add(t, grad_xh, Juh.row(t));
+
+        grad_xr.head(2) = -grad_xh;
+        grad_xr(2) = grad_t(0) * y_trans(t) - grad_t(1) * (x_trans(t) + d_);
+        robot_traj.Ju_blocks.transpose_mult_step_add(t, grad_xr, Jur.row(t));
     }
 }
 
 //----------------------------------------------------------------------------------
-void HumanAccCostVec::compute(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::VectorXd &costs)
+void DynCollisionCostVec::evaluate_batch(const Trajectory &robot_traj,
+                                         const std::vector<const Trajectory *> &human_trajs, double w,
+                                         MatRef costs, MatRef Jur, MatRef Juh)
 {
-    costs.setZero(human_traj.horizon());
+    // the robot frames only depend on the robot trajectory, so they are shared by all humans
+    int T = robot_traj.horizon();
+    int M = static_cast<int>(human_trajs.size());
+    int nXr = robot_traj.state_size();
+
+    Scratch<Eigen::MatrixXd> rot(2, 2 * T);
+    Scratch<Eigen::MatrixXd> xc(2, T);
+
+    for (int t = 0; t < T; ++t) {
+        int str = t * nXr;
+        double th = robot_traj.x(str + 2);
+        double c = std::cos(th);
+        double s = std::sin(th);
+
+        xc(0, t) = robot_traj.x(str) + d_ * c;
+        xc(1, t) = robot_traj.x(str+1) + d_ * s;
 
+        rot.block(0, t*2, 2, 2) << c, s, -s, c;
+    }
+
+    Scratch<Eigen::VectorXd> x_trans(M * T);
+    Scratch<Eigen::VectorXd> y_trans(M * T);
+
+    for (int m = 0; m < M; ++m) {
+        const Trajectory& human_traj = *human_trajs[m];
+        int nXh = human_traj.state_size();
+
+        for (int t = 0; t < T; ++t) {
+            Eigen::Vector2d x_trans_t = rot.block<2, 2>(0, t*2) * (human_traj.x.segment<2>(t * nXh) - xc.col(t));
+            x_trans(m * T + t) = x_trans_t(0);
+            y_trans(m * T + t) = x_trans_t(1);
+        }
+    }
+
+    Scratch<Eigen::VectorXd> costs_f(M * T);
+    Scratch<Eigen::VectorXd> gx(M * T);
+    Scratch<Eigen::VectorXd> gy(M * T);
+
+    // same culling and gradients as in evaluate
+    Eigen::Vector2d grad_t;
+    Eigen::Vector2d grad_xh;
+    Eigen::Vector3d grad_xr;
+    for (int m = 0; m < M; ++m) {
+        int st = m * T;
+        int t_end = GaussianCostVec::active_horizon(x_trans.data() + st, y_trans.data() + st, T, cull_r_sq_);
+        if (t_end == 0)
+            continue;
+
+        GaussianCostVec::evaluate_batch(x_trans.data() + st, y_trans.data() + st, t_end, Rx_, Ry_,
+                                        costs_f.data() + st, gx.data() + st, gy.data() + st);
+
+        for (int t = 0; t < t_end; ++t) {
+            int row = st + t;
+            if (x_trans(row) * x_trans(row) + y_trans(row) * y_trans(row) >= cull_r_sq_)
+                continue;
+
+            costs(t, m) += w * costs_f(row);
+
+            grad_t << w * gx(row), w * gy(row);
+            grad_xh.noalias() = rot.block(0, t*2, 2, 2).transpose() * grad_t;
+            human_trajs[m]->Ju_blocks.transpose_mult_step_add(t, grad_xh, Juh.row(row));
+
+            grad_xr.head(2) = -grad_xh;
+            grad_xr(2) = grad_t(0) * y_trans(row) - grad_t(1) * (x_trans(row) + d_);
+            robot_traj.Ju_blocks.transpose_mult_step_add(t, grad_xr, Jur.row(row));
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------
+void HumanAccCostVec::compute(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef costs)
+{
     int nUh = human_traj.control_size();
     for (int t = 0; t < human_traj.horizon(); ++t) {
         costs(t) = human_traj.u.segment(t * nUh, 2).squaredNorm();
@@ -283,10 +682,10 @@ void HumanAccCostVec::compute(const Trajectory &robot_traj, const Trajectory &hu
 }
 
 //----------------------------------------------------------------------------------
-void HumanAccCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::MatrixXd &Juh)
+void HumanAccCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef Juh)
 {
     // simply "diagonal"
-    Juh.setZero(human_traj.horizon(), human_traj.traj_control_size());
+    Juh.setZero();
 
     int nUh = human_traj.control_size();
     for (int t = 0; t < human_traj.horizon(); ++t) {
@@ -297,45 +696,80 @@ void HumanAccCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &hu
 }
 
 //----------------------------------------------------------------------------------
-void HumanAccCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::MatrixXd &Jur)
+void HumanAccCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef Jur)
 {
     // doesn't depend on ur
-    Jur.setZero(robot_traj.horizon(), robot_traj.traj_control_size());
+    Jur.setZero();
+}
+
+//----------------------------------------------------------------------------------
+void HumanAccCostVec::evaluate(const Trajectory &robot_traj, const Trajectory &human_traj, double w,
+                               VecRef costs, MatRef Jur, MatRef Juh)
+{
+    // doesn't depend on ur, so Jur is left as it is
+    int nUh = human_traj.control_size();
+    for (int t = 0; t < human_traj.horizon(); ++t) {
+        int stu = t * nUh;
+        costs(t) += w * human_traj.u.segment(stu, 2).squaredNorm();
+        Juh(t, stu) += 2.0 * w * human_traj.u(stu);
+        Juh(t, stu+1) += 2.0 * w * human_traj.u(stu+1);
+    }
 }
 
 //----------------------------------------------------------------------------------
-void HumanGoalCostVec::compute(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::VectorXd &costs)
+void HumanGoalCostVec::compute(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef costs)
 {
     int xs = human_traj.traj_state_size() - human_traj.state_size();
     double x_diff = x_goal_(0) - human_traj.x(xs);
     double y_diff = x_goal_(1) - human_traj.x(xs+1);
 
-    costs.setZero(human_traj.horizon());
-    costs(human_traj.horizon()-1) = std::sqrt(x_diff * x_diff + y_diff * y_diff);
+    // smoothed distance, same as HumanGoalCost
+    costs.setZero();
+    costs(human_traj.horizon()-1) = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
 }
 
 //----------------------------------------------------------------------------------
-void HumanGoalCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::MatrixXd &Juh)
+void HumanGoalCostVec::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef Juh)
 {
     Eigen::Vector2d grad_x;
     int xs = human_traj.traj_state_size() - human_traj.state_size();
     double x_diff = human_traj.x(xs) - x_goal_(0);
     double y_diff = human_traj.x(xs+1) - x_goal_(1);
-    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff) + reg_;
+    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
 
     grad_x(0) = x_diff / d;
     grad_x(1) = y_diff / d;
 
     // only the last row has non-zero elements
-    Juh.setZero(human_traj.horizon(), human_traj.traj_control_size());
-    Juh.row(human_traj.horizon()-1) = grad_x.transpose() * human_traj.Ju.middleRows(xs, 2);
+    Juh.setZero();
+    human_traj.Ju_blocks.transpose_mult_step(human_traj.horizon()-1, grad_x, Juh.row(human_traj.horizon()-1));
 }
 
 //----------------------------------------------------------------------------------
-void HumanGoalCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, Eigen::MatrixXd &Jur)
+void HumanGoalCostVec::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef Jur)
 {
     // doesn't depend on ur
-    Jur.setZero(robot_traj.horizon(), robot_traj.traj_control_size());
+    Jur.setZero();
+}
+
+//----------------------------------------------------------------------------------
+void HumanGoalCostVec::evaluate(const Trajectory &robot_traj, const Trajectory &human_traj, double w,
+                                VecRef costs, MatRef Jur, MatRef Juh)
+{
+    int T = human_traj.horizon();
+    int xs = human_traj.traj_state_size() - human_traj.state_size();
+    double x_diff = human_traj.x(xs) - x_goal_(0);
+    double y_diff = human_traj.x(xs+1) - x_goal_(1);
+    double d = std::sqrt(x_diff * x_diff + y_diff * y_diff + reg_ * reg_);
+
+    costs(T-1) += w * d;
+
+    // only the last row has non-zero elements, doesn't depend on ur
+    Eigen::Vector2d grad_x;
+    grad_x(0) = w * x_diff / d;
+    grad_x(1) = w * y_diff / d;
+
+    human_traj.Ju_blocks.transpose_mult_step_add(T-1, grad_x, Juh.row(T-1));
 }
 
 }
\ No newline at end of file
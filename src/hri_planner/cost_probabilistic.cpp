@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/18/2018
-// Last revision: 3/28/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -29,113 +29,99 @@ void ProbabilisticCostBase::set_features_int(const std::vector<double> &w,
     f_int_ = f;
 }
 
+//----------------------------------------------------------------------------------
+void ProbabilisticCostBase::update_explicit_belief(int acomm, double tcomm, int T, double dt)
+{
+    if (acomm == acomm_ex_ && tcomm == tcomm_ex_ && dt == dt_ex_ && p_ex_hp_.size() == T)
+        return;
+
+    p_ex_hp_.resize(T);
+    p_ex_rp_.resize(T);
+
+    // FIXME: same as in compute, the current time is assumed to be 0
+    belief_model_->explicit_belief(acomm, tcomm, 0.0, dt, p_ex_hp_, p_ex_rp_);
+
+    acomm_ex_ = acomm;
+    tcomm_ex_ = tcomm;
+    dt_ex_ = dt;
+}
+
 //----------------------------------------------------------------------------------
 double ProbabilisticCost::compute(const Trajectory& robot_traj, const Trajectory& human_traj_hp,
                                   const Trajectory& human_traj_rp, int acomm, double tcomm,
-                                  Eigen::VectorXd& grad_ur, Eigen::VectorXd& grad_hp, Eigen::VectorXd& grad_rp)
+                                  VecRef grad_ur, VecRef grad_hp, VecRef grad_rp)
 {
     double cost = 0.0;
 
+    int T = robot_traj.horizon();
+    int len_ur = robot_traj.traj_control_size();
+    int len_uh = human_traj_hp.traj_control_size();
+    int nUr = robot_traj.control_size();
+    int nUh = human_traj_hp.control_size();
+
     //! first compute non-interactive costs
     // doesn't matter which human trajectory to use
     for (int i = 0; i < w_non_int_.size(); ++i)
         cost += w_non_int_[i] * f_non_int_[i]->compute(robot_traj, human_traj_hp);
 
     //! compute the interactive costs weighted by beliefs
-    Eigen::VectorXd costs_hp;
-    Eigen::VectorXd costs_rp;
-
-    // compute the vectorized costs first
-    int T = robot_traj.horizon();
-    costs_hp.setZero(T);
-    costs_rp.setZero(T);
+    // all temporaries live in the workspace of the calling optimizer
+    Scratch<Eigen::VectorXd> costs_hp(T);
+    Scratch<Eigen::VectorXd> costs_rp(T);
+
+    // cost vectors and their jacobians w.r.t. ur and uh, in a single pass over the features
+    // the jacobians are block lower-triangular, the upper parts are never touched
+    Scratch<Eigen::MatrixXd> Jc_hp(T, len_ur);
+    Scratch<Eigen::MatrixXd> Jc_rp(T, len_ur);
+    Scratch<Eigen::MatrixXd> Jh_hp(T, len_uh);
+    Scratch<Eigen::MatrixXd> Jh_rp(T, len_uh);
+
+    costs_hp.setZero();
+    costs_rp.setZero();
+    tril_set_zero(Jc_hp, nUr);
+    tril_set_zero(Jc_rp, nUr);
+    tril_set_zero(Jh_hp, nUh);
+    tril_set_zero(Jh_rp, nUh);
 
-    Eigen::VectorXd cost_vec;
     for (int i = 0; i < w_int_.size(); ++i) {
-        f_int_[i]->compute(robot_traj, human_traj_hp, cost_vec);
-        costs_hp += w_int_[i] * cost_vec;
-
-        f_int_[i]->compute(robot_traj, human_traj_rp, cost_vec);
-        costs_rp += w_int_[i] * cost_vec;
+        f_int_[i]->evaluate(robot_traj, human_traj_hp, w_int_[i], costs_hp, Jc_hp, Jh_hp);
+        f_int_[i]->evaluate(robot_traj, human_traj_rp, w_int_[i], costs_rp, Jc_rp, Jh_rp);
     }
 
-    // create a human trajectory with const vel prediction
-    // Trajectory human_traj_const(CONST_ACC_MODEL, human_traj_hp.horizon(), human_traj_hp.dt());
-
     // FIXME: assuming that "current time" is always 0, and tcomm is adjusted already
-    Eigen::VectorXd prob_hp(T);
-    Eigen::MatrixXd Jur(T, robot_traj.traj_control_size());
-    belief_model_->update_belief(robot_traj, human_traj_pred_, acomm, tcomm, 0.0, prob_hp, Jur);
+    Scratch<Eigen::VectorXd> prob_hp(T);
+    Scratch<Eigen::MatrixXd> Jur(T, len_ur);
+    update_explicit_belief(acomm, tcomm, T, robot_traj.dt());
+    belief_model_->update_belief(robot_traj, human_traj_pred_, p_ex_hp_, p_ex_rp_, prob_hp, Jur);
 
-    Eigen::VectorXd prob_rp;
-    prob_rp.setOnes(T);
+    Scratch<Eigen::VectorXd> prob_rp(T);
+    prob_rp.setOnes();
     prob_rp -= prob_hp;
 
     cost_hp_ = prob_hp.dot(costs_hp);
     cost_rp_ = prob_rp.dot(costs_rp);
     cost += cost_hp_ + cost_rp_;
 
-    // output for debug
-    static int counter = 0;
-    ++counter;
-//
-//    std::cout << "control at iteration " << counter << " are: " << std::endl;
-//    std::cout << human_traj_hp.u.transpose() << std::endl;
-//    std::cout << human_traj_rp.u.transpose() << std::endl;
-//    std::cout << "---------------" << std::endl;
-//
-    std::cout << "cost at iteration " << counter << " is: " << cost << ", cost vectors are:" << std::endl;
-    std::cout << costs_hp.transpose() << std::endl;
-    std::cout << costs_rp.transpose() << std::endl;
-    std::cout << "-------------------" << std::endl;
-    std::cout << "probabilities are:" << std::endl;
-    std::cout << prob_hp.transpose() << std::endl;
-    std::cout << "------------------" << std::endl;
-    std::cout << "controls are:" << std::endl;
-    std::cout << robot_traj.u.transpose() << std::endl;
-    std::cout << std::endl;
-
     //! compute the gradient w.r.t. ur
     // non-interactive features
-    grad_ur.setZero(robot_traj.traj_control_size());
-    Eigen::VectorXd grad(robot_traj.traj_control_size());
+    grad_ur.setZero();
+    Scratch<Eigen::VectorXd> grad(len_ur);
     for (int i = 0; i < w_non_int_.size(); ++i) {
         f_non_int_[i]->grad_ur(robot_traj, human_traj_hp, grad);
         grad_ur += w_non_int_[i] * grad;
     }
 
-    // compute the jacobians for the interactive cost vectors
-    Eigen::MatrixXd Jc_hp;
-    Eigen::MatrixXd Jc_rp;
-    Eigen::MatrixXd Jc;
-
-    Jc_hp.setZero(T, robot_traj.traj_control_size());
-    Jc_rp.setZero(T, robot_traj.traj_control_size());
-
-    for (int i = 0; i < w_int_.size(); ++i) {
-        f_int_[i]->grad_ur(robot_traj, human_traj_hp, Jc);
-        Jc_hp += w_int_[i] * Jc;
-
-        f_int_[i]->grad_ur(robot_traj, human_traj_rp, Jc);
-        Jc_rp += w_int_[i] * Jc;
-    }
-
-    grad_ur += Jur.transpose() * (costs_hp - costs_rp) + Jc_hp.transpose() * prob_hp + Jc_rp.transpose() * prob_rp;
+    // evaluate the cost difference first so that the product doesn't need a temporary
+    costs_hp -= costs_rp;
+    grad_ur.noalias() += Jur.transpose() * costs_hp;
+    tril_transpose_mult_add(Jc_hp, nUr, prob_hp, grad_ur);
+    tril_transpose_mult_add(Jc_rp, nUr, prob_rp, grad_ur);
 
     //! compute gradient w.r.t. uh_hp and uh_rp
-    Jc_hp.setZero(T, robot_traj.traj_control_size());
-    Jc_rp.setZero(T, robot_traj.traj_control_size());
-
-    for (int i = 0; i < w_int_.size(); ++i) {
-        f_int_[i]->grad_uh(robot_traj, human_traj_hp, Jc);
-        Jc_hp += w_int_[i] * Jc;
-
-        f_int_[i]->grad_uh(robot_traj, human_traj_rp, Jc);
-        Jc_rp += w_int_[i] * Jc;
-    }
-
-    grad_hp = Jc_hp.transpose() * prob_hp;
-    grad_rp = Jc_rp.transpose() * prob_rp;
+    grad_hp.setZero();
+    grad_rp.setZero();
+    tril_transpose_mult_add(Jh_hp, nUh, prob_hp, grad_hp);
+    tril_transpose_mult_add(Jh_rp, nUh, prob_rp, grad_rp);
 
     return cost;
 }
@@ -143,36 +129,45 @@ double ProbabilisticCost::compute(const Trajectory& robot_traj, const Trajectory
 //----------------------------------------------------------------------------------
 double ProbabilisticCostSimplified::compute(const Trajectory &robot_traj, const Trajectory &human_traj_hp,
                                             const Trajectory &human_traj_rp, int acomm, double tcomm,
-                                            Eigen::VectorXd &grad_ur, Eigen::VectorXd &grad_hp,
-                                            Eigen::VectorXd &grad_rp)
+                                            VecRef grad_ur, VecRef grad_hp, VecRef grad_rp)
 {
     double cost = 0.0;
 
+    int T = robot_traj.horizon();
+    int len_ur = robot_traj.traj_control_size();
+    int len_uh = human_traj_hp.traj_control_size();
+    int nUr = robot_traj.control_size();
+    int nUh = human_traj_hp.control_size();
+
     //! first compute non-interactive costs
     // doesn't matter which human trajectory to use
-    costs_non_int_.clear();
+    costs_non_int_.resize(w_non_int_.size());
     for (int i = 0; i < w_non_int_.size(); ++i) {
-        double t_cost = f_non_int_[i]->compute(robot_traj, human_traj_hp);
-        costs_non_int_.push_back(t_cost);
-        cost += w_non_int_[i] * t_cost;
+        costs_non_int_[i] = f_non_int_[i]->compute(robot_traj, human_traj_hp);
+        cost += w_non_int_[i] * costs_non_int_[i];
     }
 
     //! compute the interactive costs
-    Eigen::VectorXd costs_hp;
-    Eigen::VectorXd costs_rp;
-
-    // compute the vectorized costs first
-    int T = robot_traj.horizon();
-    costs_hp.setZero(T);
-    costs_rp.setZero(T);
+    Scratch<Eigen::VectorXd> costs_hp(T);
+    Scratch<Eigen::VectorXd> costs_rp(T);
+
+    // cost vectors and their jacobians w.r.t. ur and uh, in a single pass over the features
+    // the jacobians are block lower-triangular, the upper parts are never touched
+    Scratch<Eigen::MatrixXd> Jc_hp(T, len_ur);
+    Scratch<Eigen::MatrixXd> Jc_rp(T, len_ur);
+    Scratch<Eigen::MatrixXd> Jh_hp(T, len_uh);
+    Scratch<Eigen::MatrixXd> Jh_rp(T, len_uh);
+
+    costs_hp.setZero();
+    costs_rp.setZero();
+    tril_set_zero(Jc_hp, nUr);
+    tril_set_zero(Jc_rp, nUr);
+    tril_set_zero(Jh_hp, nUh);
+    tril_set_zero(Jh_rp, nUh);
 
-    Eigen::VectorXd cost_vec;
     for (int i = 0; i < w_int_.size(); ++i) {
-        f_int_[i]->compute(robot_traj, human_traj_hp, cost_vec);
-        costs_hp += w_int_[i] * cost_vec;
-
-        f_int_[i]->compute(robot_traj, human_traj_rp, cost_vec);
-        costs_rp += w_int_[i] * cost_vec;
+        f_int_[i]->evaluate(robot_traj, human_traj_hp, w_int_[i], costs_hp, Jc_hp, Jh_hp);
+        f_int_[i]->evaluate(robot_traj, human_traj_rp, w_int_[i], costs_rp, Jc_rp, Jh_rp);
     }
 
     // update the current belief with explicit communication
@@ -180,73 +175,386 @@ double ProbabilisticCostSimplified::compute(const Trajectory &robot_traj, const
     double prob_hp = belief_model_->update_belief(acomm, tcomm, 0.0);
     double prob_rp = 1.0 - prob_hp;
 
-    Eigen::VectorXd ones;
-    ones.setOnes(costs_hp.size());
-
-    cost_hp_ = ones.dot(costs_hp);
-    cost_rp_ = ones.dot(costs_rp);
-
-//    std::cout << ">>>>>>>> costs are: " << cost << ", (";
-//
-//    for (auto c: costs_non_int_)
-//        std::cout << c << ", ";
-//
-//    std::cout << "), (" << prob_hp << ", " << cost_hp_ << "), ("
-//              << prob_rp << ", " << cost_rp_ << "), | ";
+    cost_hp_ = costs_hp.sum();
+    cost_rp_ = costs_rp.sum();
 
     cost += prob_hp * cost_hp_ + prob_rp * cost_rp_;
 
-//    std::cout << cost << std::endl;
-
-
     //! compute the gradient w.r.t. ur
     // non-interactive features
-    grad_ur.setZero(robot_traj.traj_control_size());
-    Eigen::VectorXd grad(robot_traj.traj_control_size());
+    grad_ur.setZero();
+    Scratch<Eigen::VectorXd> grad(len_ur);
     for (int i = 0; i < w_non_int_.size(); ++i) {
         f_non_int_[i]->grad_ur(robot_traj, human_traj_hp, grad);
         grad_ur += w_non_int_[i] * grad;
     }
 
-    // compute the jacobians for the interactive cost vectors
-    Eigen::MatrixXd Jc_hp;
-    Eigen::MatrixXd Jc_rp;
-    Eigen::MatrixXd Jc;
+    // the belief is constant, so the cost vectors are simply summed up
+    Scratch<Eigen::VectorXd> w_hp(T);
+    Scratch<Eigen::VectorXd> w_rp(T);
+    w_hp.setConstant(prob_hp);
+    w_rp.setConstant(prob_rp);
 
-    Jc_hp.setZero(T, robot_traj.traj_control_size());
-    Jc_rp.setZero(T, robot_traj.traj_control_size());
+    tril_transpose_mult_add(Jc_hp, nUr, w_hp, grad_ur);
+    tril_transpose_mult_add(Jc_rp, nUr, w_rp, grad_ur);
 
-    for (int i = 0; i < w_int_.size(); ++i) {
-        f_int_[i]->grad_ur(robot_traj, human_traj_hp, Jc);
-        Jc_hp += w_int_[i] * Jc;
+    //! compute gradient w.r.t. uh_hp and uh_rp
+    grad_hp.setZero();
+    grad_rp.setZero();
+    tril_transpose_mult_add(Jh_hp, nUh, w_hp, grad_hp);
+    tril_transpose_mult_add(Jh_rp, nUh, w_rp, grad_rp);
 
-        f_int_[i]->grad_ur(robot_traj, human_traj_rp, Jc);
-        Jc_rp += w_int_[i] * Jc;
+    return cost;
+}
+
+//----------------------------------------------------------------------------------
+ProbabilisticCostMulti::ProbabilisticCostMulti(const std::shared_ptr<BeliefModelMulti> &belief_model):
+        ProbabilisticCostBase(belief_model->base_model()), belief_model_multi_(belief_model),
+        robot_traj_eval_(nullptr), human_trajs_eval_(nullptr), human_trajs_pair_(2, nullptr)
+{
+    int N = belief_model->num_intents();
+    hypotheses_.resize(N);
+    costs_intent_.resize(N);
+
+    // the belief doesn't depend on the hypotheses, so it is computed alongside them
+    tasks_.emplace_back([this] { evaluate_belief(); });
+    for (int k = 0; k < N; ++k)
+        tasks_.emplace_back([this, k] { evaluate_hypothesis(k); });
+}
+
+//----------------------------------------------------------------------------------
+double ProbabilisticCostMulti::compute(const Trajectory &robot_traj, const std::vector<const Trajectory *> &human_trajs,
+                                       int acomm, double tcomm, VecRef grad_ur, MatRef grad_uh)
+{
+    double cost = 0.0;
+
+    int N = belief_model_multi_->num_intents();
+    if (human_trajs.size() != N)
+        throw "Number of human trajectories doesn't match the number of intents!";
+
+    int T = robot_traj.horizon();
+    int len_ur = robot_traj.traj_control_size();
+    int len_uh = human_trajs[0]->traj_control_size();
+    int nUr = robot_traj.control_size();
+    int nUh = human_trajs[0]->control_size();
+
+    //! non-interactive costs, doesn't matter which human trajectory to use
+    for (int i = 0; i < w_non_int_.size(); ++i)
+        cost += w_non_int_[i] * f_non_int_[i]->compute(robot_traj, *human_trajs[0]);
+
+    //! beliefs and the costs of all hypotheses
+    if (belief_.rows() != T || hypotheses_[0].Jc.cols() != len_ur || hypotheses_[0].Jh.cols() != len_uh) {
+        for (auto& hypothesis: hypotheses_)
+            hypothesis.resize(T, len_ur, len_uh);
+
+        belief_.resize(T, N);
+        belief_scale_.resize(T, N);
+        belief_jacobian_.resize(T, len_ur);
     }
 
-    Eigen::VectorXd grad_inc = Jc_hp.transpose() * ones * prob_hp + Jc_rp.transpose() * ones * prob_rp;
-    grad_ur += grad_inc;
-//    std::cout << "---------------" << std::endl;
-//    std::cout << grad_inc.transpose() << std::endl;
-//    std::cout << "---------------" << std::endl;
-//    grad_ur += Jc_hp.transpose() * ones * prob_hp + Jc_rp.transpose() * ones * prob_rp;
+    // FIXME: assuming that "current time" is always 0, and tcomm is adjusted already
+    update_explicit_belief(acomm, tcomm, T, robot_traj.dt());
 
-    //! compute gradient w.r.t. uh_hp and uh_rp
-    Jc_hp.setZero(T, robot_traj.traj_control_size());
-    Jc_rp.setZero(T, robot_traj.traj_control_size());
+    robot_traj_eval_ = &robot_traj;
+    human_trajs_eval_ = &human_trajs;
 
-    for (int i = 0; i < w_int_.size(); ++i) {
-        f_int_[i]->grad_uh(robot_traj, human_traj_hp, Jc);
-        Jc_hp += w_int_[i] * Jc;
+    if (thread_pool_) {
+        thread_pool_->run_parallel(tasks_);
+    }
+    else {
+        for (auto& task: tasks_)
+            task();
+    }
 
-        f_int_[i]->grad_uh(robot_traj, human_traj_rp, Jc);
-        Jc_rp += w_int_[i] * Jc;
+    //! combine the hypotheses, the belief jacobian of all intents only needs one product
+    // sum_k J_k^T c_k = J^T sum_k (scale_k .* c_k)
+    grad_ur.setZero();
+    Scratch<Eigen::VectorXd> grad(len_ur);
+    for (int i = 0; i < w_non_int_.size(); ++i) {
+        f_non_int_[i]->grad_ur(robot_traj, *human_trajs[0], grad);
+        grad_ur += w_non_int_[i] * grad;
     }
 
-    grad_hp = Jc_hp.transpose() * ones * prob_hp;
-    grad_rp = Jc_rp.transpose() * ones * prob_rp;
+    Scratch<Eigen::VectorXd> costs_scaled(T);
+    costs_scaled.setZero();
+
+    cost_hp_ = 0.0;
+    cost_rp_ = 0.0;
+    const Eigen::VectorXd& levels = belief_model_multi_->levels();
+    for (int k = 0; k < N; ++k) {
+        HypothesisData& hypothesis = hypotheses_[k];
+
+        costs_intent_[k] = belief_.col(k).dot(hypothesis.costs);
+        cost += costs_intent_[k];
+
+        // split between the two priorities by level, the same as ProbabilisticCost for levels {1, 0}
+        cost_hp_ += levels(k) * costs_intent_[k];
+        cost_rp_ += (1.0 - levels(k)) * costs_intent_[k];
+
+        costs_scaled += belief_scale_.col(k).cwiseProduct(hypothesis.costs);
+        tril_transpose_mult_add(hypothesis.Jc, nUr, belief_.col(k), grad_ur);
+
+        grad_uh.col(k).setZero();
+        tril_transpose_mult_add(hypothesis.Jh, nUh, belief_.col(k), grad_uh.col(k));
+    }
+
+    grad_ur.noalias() += belief_jacobian_.transpose() * costs_scaled;
 
     return cost;
 }
 
+//----------------------------------------------------------------------------------
+double ProbabilisticCostMulti::compute(const Trajectory &robot_traj, const Trajectory &human_traj_hp,
+                                       const Trajectory &human_traj_rp, int acomm, double tcomm,
+                                       VecRef grad_ur, VecRef grad_hp, VecRef grad_rp)
+{
+    if (belief_model_multi_->num_intents() != 2)
+        throw "Two-trajectory cost requires a belief model with two intents!";
+
+    human_trajs_pair_[HumanPriority] = &human_traj_hp;
+    human_trajs_pair_[RobotPriority] = &human_traj_rp;
+    Scratch<Eigen::MatrixXd> grad_uh(human_traj_hp.traj_control_size(), 2);
+
+    double cost = compute(robot_traj, human_trajs_pair_, acomm, tcomm, grad_ur, grad_uh);
+
+    grad_hp = grad_uh.col(HumanPriority);
+    grad_rp = grad_uh.col(RobotPriority);
+
+    return cost;
+}
+
+//----------------------------------------------------------------------------------
+void ProbabilisticCostMulti::evaluate_belief()
+{
+    belief_model_multi_->update_belief(*robot_traj_eval_, human_traj_pred_, p_ex_hp_, p_ex_rp_,
+                                       belief_, belief_scale_, belief_jacobian_);
+}
+
+//----------------------------------------------------------------------------------
+void ProbabilisticCostMulti::evaluate_hypothesis(int k)
+{
+    HypothesisData& hypothesis = hypotheses_[k];
+
+    // may run on a pool worker, so uses a separate workspace
+    WorkspaceScope scope(hypothesis.workspace);
+
+    const Trajectory& robot_traj = *robot_traj_eval_;
+    const Trajectory& human_traj = *(*human_trajs_eval_)[k];
+
+    hypothesis.costs.setZero();
+    tril_set_zero(hypothesis.Jc, robot_traj.control_size());
+    tril_set_zero(hypothesis.Jh, human_traj.control_size());
+
+    for (int i = 0; i < w_int_.size(); ++i)
+        f_int_[i]->evaluate(robot_traj, human_traj, w_int_[i], hypothesis.costs, hypothesis.Jc, hypothesis.Jh);
+}
+
+//----------------------------------------------------------------------------------
+void ProbabilisticCostMulti::HypothesisData::resize(int T, int len_ur, int len_uh)
+{
+    if (workspace.capacity() < Workspace::default_capacity(T))
+        workspace.reserve(Workspace::default_capacity(T));
+
+    costs.resize(T);
+    Jc.resize(T, len_ur);
+    Jh.resize(T, len_uh);
+}
+
+//----------------------------------------------------------------------------------
+ProbabilisticCostMultiHuman::ProbabilisticCostMultiHuman(
+        const std::vector<std::shared_ptr<BeliefModelBase> > &belief_models):
+        ProbabilisticCostBase(belief_models.empty() ? nullptr : belief_models[0]), belief_models_(belief_models),
+        human_trajs_hp_single_(1, nullptr), human_trajs_rp_single_(1, nullptr)
+{
+    if (belief_models.empty())
+        throw "Multi-human cost needs at least one belief model!";
+
+    int K = static_cast<int>(belief_models.size());
+    w_int_human_.resize(K);
+    f_int_human_.resize(K);
+    costs_hp_human_.assign(K, 0.0);
+    costs_rp_human_.assign(K, 0.0);
+
+    levels_.resize(2);
+    levels_ << 1.0, 0.0;
+}
+
+//----------------------------------------------------------------------------------
+void ProbabilisticCostMultiHuman::set_intent_levels(const std::vector<double> &levels)
+{
+    levels_.resize(2 + levels.size());
+    levels_(0) = 1.0;
+    levels_(1) = 0.0;
+
+    for (int m = 0; m < levels.size(); ++m) {
+        if (levels[m] < 0.0 || levels[m] > 1.0)
+            throw "Intent levels must be in [0, 1]!";
+        levels_(2 + m) = levels[m];
+    }
+}
+
+//----------------------------------------------------------------------------------
+void ProbabilisticCostMultiHuman::set_belief_models(const std::vector<std::shared_ptr<BeliefModelBase> > &belief_models)
+{
+    if (belief_models.size() != belief_models_.size())
+        throw "Number of belief models doesn't match the maximum number of humans!";
+
+    belief_models_ = belief_models;
+    belief_model_ = belief_models_[0];
+}
+
+//----------------------------------------------------------------------------------
+void ProbabilisticCostMultiHuman::set_features_int_human(int k, const std::vector<double> &w,
+                                                         const std::vector<std::shared_ptr<FeatureVectorizedBase> > &f)
+{
+    w_int_human_[k] = w;
+    f_int_human_[k] = f;
+}
+
+//----------------------------------------------------------------------------------
+double ProbabilisticCostMultiHuman::compute(const Trajectory &robot_traj,
+                                            const std::vector<const Trajectory *> &human_trajs_hp,
+                                            const std::vector<const Trajectory *> &human_trajs_rp,
+                                            int acomm, double tcomm, VecRef grad_ur, MatRef grad_hp, MatRef grad_rp)
+{
+    if (num_intents() > 2)
+        throw "Intermediate intents need their human responses!";
+
+    Eigen::Map<Eigen::MatrixXd> grad_mid(grad_hp.data(), grad_hp.rows(), 0);
+
+    return compute(robot_traj, human_trajs_hp, human_trajs_rp, human_trajs_mid_none_, acomm, tcomm,
+                   grad_ur, grad_hp, grad_rp, grad_mid);
+}
+
+//----------------------------------------------------------------------------------
+double ProbabilisticCostMultiHuman::compute(const Trajectory &robot_traj,
+                                            const std::vector<const Trajectory *> &human_trajs_hp,
+                                            const std::vector<const Trajectory *> &human_trajs_rp,
+                                            const std::vector<const Trajectory *> &human_trajs_mid,
+                                            int acomm, double tcomm, VecRef grad_ur, MatRef grad_hp,
+                                            MatRef grad_rp, MatRef grad_mid)
+{
+    double cost = 0.0;
+
+    int K = static_cast<int>(human_trajs_hp.size());
+    if (K > max_humans())
+        throw "Number of humans exceeds the number of belief models!";
+
+    int N = num_intents();
+    if (human_trajs_mid.size() != (N - 2) * K)
+        throw "Number of human responses doesn't match the number of intents!";
+
+    int T = robot_traj.horizon();
+    int len_ur = robot_traj.traj_control_size();
+    int len_uh = human_trajs_hp[0]->traj_control_size();
+    int nUr = robot_traj.control_size();
+    int nUh = human_trajs_hp[0]->control_size();
+
+    //! first compute non-interactive costs
+    // doesn't matter which human trajectory to use
+    costs_non_int_.resize(w_non_int_.size());
+    for (int i = 0; i < w_non_int_.size(); ++i) {
+        costs_non_int_[i] = f_non_int_[i]->compute(robot_traj, *human_trajs_hp[0]);
+        cost += w_non_int_[i] * costs_non_int_[i];
+    }
+
+    //! compute the interactive costs
+    // column/row block n * K + k is the response of human k under intent n: hp, rp, then the intermediate ones
+    human_trajs_batch_.assign(human_trajs_hp.begin(), human_trajs_hp.end());
+    human_trajs_batch_.insert(human_trajs_batch_.end(), human_trajs_rp.begin(), human_trajs_rp.end());
+    human_trajs_batch_.insert(human_trajs_batch_.end(), human_trajs_mid.begin(), human_trajs_mid.end());
+
+    Scratch<Eigen::MatrixXd> costs(T, N * K);
+    Scratch<Eigen::MatrixXd> Jc(N * K * T, len_ur);
+    Scratch<Eigen::MatrixXd> Jh(N * K * T, len_uh);
+
+    costs.setZero();
+    for (int m = 0; m < N * K; ++m) {
+        tril_set_zero(Jc.middleRows(m * T, T), nUr);
+        tril_set_zero(Jh.middleRows(m * T, T), nUh);
+    }
+
+    for (int i = 0; i < w_int_.size(); ++i)
+        f_int_[i]->evaluate_batch(robot_traj, human_trajs_batch_, w_int_[i], costs, Jc, Jh);
+
+    for (int k = 0; k < K; ++k) {
+        for (int i = 0; i < w_int_human_[k].size(); ++i) {
+            double w = w_int_human_[k][i];
+            for (int n = 0; n < N; ++n) {
+                int m = n * K + k;
+                f_int_human_[k][i]->evaluate(robot_traj, *human_trajs_batch_[m], w, costs.col(m),
+                                             Jc.middleRows(m * T, T), Jh.middleRows(m * T, T));
+            }
+        }
+    }
+
+    //! combine with the belief of each human and compute the gradients
+    // all responses go into the same robot gradient, weighted by the belief of their intent
+    grad_ur.setZero();
+    Scratch<Eigen::VectorXd> grad(len_ur);
+    for (int i = 0; i < w_non_int_.size(); ++i) {
+        f_non_int_[i]->grad_ur(robot_traj, *human_trajs_hp[0], grad);
+        grad_ur += w_non_int_[i] * grad;
+    }
+
+    cost_hp_ = 0.0;
+    cost_rp_ = 0.0;
+
+    Scratch<Eigen::VectorXd> prob(N);
+    Scratch<Eigen::VectorXd> w_intent(T);
+    for (int k = 0; k < K; ++k) {
+        // FIXME: assuming that "current time" is always 0, and tcomm is adjusted already
+        double prob_hp = belief_models_[k]->update_belief(acomm, tcomm, 0.0);
+
+        // the softmax gives the same two-intent belief, but not to the last bit
+        if (N == 2) {
+            prob(HumanPriority) = prob_hp;
+            prob(RobotPriority) = 1.0 - prob_hp;
+        }
+        else {
+            BeliefModelMulti::constant_belief(prob_hp, levels_, prob);
+        }
+
+        costs_hp_human_[k] = costs.col(k).sum();
+        costs_rp_human_[k] = costs.col(K + k).sum();
+        cost_hp_ += costs_hp_human_[k];
+        cost_rp_ += costs_rp_human_[k];
+
+        for (int n = 0; n < N; ++n) {
+            int m = n * K + k;
+            cost += prob(n) * costs.col(m).sum();
+
+            w_intent.setConstant(prob(n));
+            tril_transpose_mult_add(Jc.middleRows(m * T, T), nUr, w_intent, grad_ur);
+        }
+
+        for (int n = 0; n < N; ++n) {
+            int m = n * K + k;
+            auto grad_uh = n == HumanPriority ? grad_hp.col(k) :
+                           (n == RobotPriority ? grad_rp.col(k) : grad_mid.col(m - 2 * K));
+
+            w_intent.setConstant(prob(n));
+            grad_uh.setZero();
+            tril_transpose_mult_add(Jh.middleRows(m * T, T), nUh, w_intent, grad_uh);
+        }
+    }
+
+    return cost;
+}
+
+//----------------------------------------------------------------------------------
+double ProbabilisticCostMultiHuman::compute(const Trajectory &robot_traj, const Trajectory &human_traj_hp,
+                                            const Trajectory &human_traj_rp, int acomm, double tcomm,
+                                            VecRef grad_ur, VecRef grad_hp, VecRef grad_rp)
+{
+    human_trajs_hp_single_[0] = &human_traj_hp;
+    human_trajs_rp_single_[0] = &human_traj_rp;
+
+    Eigen::Map<Eigen::MatrixXd> grad_hp_mat(grad_hp.data(), grad_hp.size(), 1);
+    Eigen::Map<Eigen::MatrixXd> grad_rp_mat(grad_rp.data(), grad_rp.size(), 1);
+
+    return compute(robot_traj, human_trajs_hp_single_, human_trajs_rp_single_, acomm, tcomm,
+                   grad_ur, grad_hp_mat, grad_rp_mat);
+}
+
 }
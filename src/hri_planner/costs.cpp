@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/7/2018
-// Last revision: 3/22/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -47,7 +47,7 @@ void LinearCost::grad_ur(const Trajectory &robot_traj, const Trajectory &human_t
 {
     grad.setZero();
 
-    int len = human_traj.traj_control_size();
+    int len = robot_traj.traj_control_size();
 
 //    std::vector<std::thread> th_list;
 //    std::vector<Eigen::VectorXd> grads(nfeatures_, Eigen::VectorXd());
@@ -64,8 +64,8 @@ void LinearCost::grad_ur(const Trajectory &robot_traj, const Trajectory &human_t
 //        grad += weights_[i] * grads[i];
 //    }
 
+    Scratch<Eigen::VectorXd> grad_f(len);
     for (int i = 0; i < nfeatures_; ++i) {
-        Eigen::VectorXd grad_f(len);
         features_[i]->grad_ur(robot_traj, human_traj, grad_f);
 
         grad += weights_[i] * grad_f;
@@ -94,14 +94,67 @@ void LinearCost::grad_uh(const Trajectory &robot_traj, const Trajectory &human_t
 //        grad += weights_[i] * grads[i];
 //    }
 
+    Scratch<Eigen::VectorXd> grad_f(len);
     for (int i = 0; i < nfeatures_; ++i) {
-        Eigen::VectorXd grad_f(len);
         features_[i]->grad_uh(robot_traj, human_traj, grad_f);
 
         grad += weights_[i] * grad_f;
     }
 }
 
+//----------------------------------------------------------------------------------
+void LinearCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u.setZero();
+
+    Scratch<Eigen::VectorXd> grad_x_f(human_traj.traj_state_size());
+    Scratch<Eigen::VectorXd> grad_u_f(human_traj.traj_control_size());
+
+    for (int i = 0; i < nfeatures_; ++i) {
+        features_[i]->grad_xh(robot_traj, human_traj, grad_x_f, grad_u_f);
+
+        grad_x += weights_[i] * grad_x_f;
+        grad_u += weights_[i] * grad_u_f;
+    }
+}
+
+//----------------------------------------------------------------------------------
+void LinearCost::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad_x, VecRef grad_u)
+{
+    grad_x.setZero();
+    grad_u.setZero();
+
+    Scratch<Eigen::VectorXd> grad_x_f(robot_traj.traj_state_size());
+    Scratch<Eigen::VectorXd> grad_u_f(robot_traj.traj_control_size());
+
+    for (int i = 0; i < nfeatures_; ++i) {
+        features_[i]->grad_xr(robot_traj, human_traj, grad_x_f, grad_u_f);
+
+        grad_x += weights_[i] * grad_x_f;
+        grad_u += weights_[i] * grad_u_f;
+    }
+}
+
+//----------------------------------------------------------------------------------
+void LinearCost::grad_uh_adjoint(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    // accumulate the state gradient of all features, then propagate back once
+    Scratch<Eigen::VectorXd> grad_x(human_traj.traj_state_size());
+    grad_xh(robot_traj, human_traj, grad_x, grad);
+
+    human_traj.backprop(grad_x, grad);
+}
+
+//----------------------------------------------------------------------------------
+void LinearCost::grad_ur_adjoint(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_x(robot_traj.traj_state_size());
+    grad_xr(robot_traj, human_traj, grad_x, grad);
+
+    robot_traj.backprop(grad_x, grad);
+}
+
 //----------------------------------------------------------------------------------
 void LinearCost::add_feature(double weight, FeatureBase *feature)
 {
@@ -122,7 +175,7 @@ void HumanCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &human
     hess.setZero();
 
     int len = human_traj.traj_control_size();
-    Eigen::MatrixXd hess_f(len, len);
+    Scratch<Eigen::MatrixXd> hess_f(len, len);
 
     for (int i = 0; i < nfeatures_; ++i) {
         static_cast<FeatureHumanCost*>(features_[i].get())->hessian_uh(robot_traj, human_traj, hess_f);
@@ -136,8 +189,7 @@ void HumanCost::hessian_uh_ur(const Trajectory &robot_traj, const Trajectory &hu
 {
     hess.setZero();
 
-    int len = human_traj.traj_control_size();
-    Eigen::MatrixXd hess_f(len, len);
+    Scratch<Eigen::MatrixXd> hess_f(human_traj.traj_control_size(), robot_traj.traj_control_size());
 
     for (int i = 0; i < nfeatures_; ++i) {
         static_cast<FeatureHumanCost*>(features_[i].get())->hessian_uh_ur(robot_traj, human_traj, hess_f);
@@ -164,6 +216,12 @@ void SingleTrajectoryCostRobot::grad(const Trajectory &traj, VecRef grad)
     grad_ur(traj, const_traj_, grad);
 }
 
+//----------------------------------------------------------------------------------
+void SingleTrajectoryCostRobot::grad_adjoint(const Trajectory &traj, VecRef grad)
+{
+    grad_ur_adjoint(traj, const_traj_, grad);
+}
+
 //----------------------------------------------------------------------------------
 double SingleTrajectoryCostHuman::compute(const Trajectory &traj)
 {
@@ -176,13 +234,19 @@ void SingleTrajectoryCostHuman::grad(const Trajectory &traj, VecRef grad)
     grad_uh(const_traj_, traj, grad);
 }
 
+//----------------------------------------------------------------------------------
+void SingleTrajectoryCostHuman::grad_adjoint(const Trajectory &traj, VecRef grad)
+{
+    grad_uh_adjoint(const_traj_, traj, grad);
+}
+
 //----------------------------------------------------------------------------------
 void SingleTrajectoryCostHuman::hessian_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef hess)
 {
     hess.setZero();
 
     int len = human_traj.traj_control_size();
-    Eigen::MatrixXd hess_f(len, len);
+    Scratch<Eigen::MatrixXd> hess_f(len, len);
 
     for (int i = 0; i < nfeatures_; ++i) {
         static_cast<FeatureHumanCost*>(features_[i].get())->hessian_uh(robot_traj, human_traj, hess_f);
@@ -196,8 +260,7 @@ void SingleTrajectoryCostHuman::hessian_uh_ur(const Trajectory &robot_traj, cons
 {
     hess.setZero();
 
-    int len = human_traj.traj_control_size();
-    Eigen::MatrixXd hess_f(len, len);
+    Scratch<Eigen::MatrixXd> hess_f(human_traj.traj_control_size(), robot_traj.traj_control_size());
 
     for (int i = 0; i < nfeatures_; ++i) {
         static_cast<FeatureHumanCost*>(features_[i].get())->hessian_uh_ur(robot_traj, human_traj, hess_f);
@@ -206,4 +269,77 @@ void SingleTrajectoryCostHuman::hessian_uh_ur(const Trajectory &robot_traj, cons
     }
 }
 
+//----------------------------------------------------------------------------------
+double InterpolatedHumanCost::compute(const Trajectory &robot_traj, const Trajectory &human_traj)
+{
+    return level_ * cost_hp_->compute(robot_traj, human_traj) +
+            (1.0 - level_) * cost_rp_->compute(robot_traj, human_traj);
+}
+
+//----------------------------------------------------------------------------------
+void InterpolatedHumanCost::grad_uh(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_rp(grad.size());
+    cost_hp_->grad_uh(robot_traj, human_traj, grad);
+    cost_rp_->grad_uh(robot_traj, human_traj, grad_rp);
+
+    grad = level_ * grad + (1.0 - level_) * grad_rp;
+}
+
+//----------------------------------------------------------------------------------
+void InterpolatedHumanCost::grad_ur(const Trajectory &robot_traj, const Trajectory &human_traj, VecRef grad)
+{
+    Scratch<Eigen::VectorXd> grad_rp(grad.size());
+    cost_hp_->grad_ur(robot_traj, human_traj, grad);
+    cost_rp_->grad_ur(robot_traj, human_traj, grad_rp);
+
+    grad = level_ * grad + (1.0 - level_) * grad_rp;
+}
+
+//----------------------------------------------------------------------------------
+void InterpolatedHumanCost::grad_xh(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                    VecRef grad_x, VecRef grad_u)
+{
+    Scratch<Eigen::VectorXd> grad_x_rp(grad_x.size());
+    Scratch<Eigen::VectorXd> grad_u_rp(grad_u.size());
+    cost_hp_->grad_xh(robot_traj, human_traj, grad_x, grad_u);
+    cost_rp_->grad_xh(robot_traj, human_traj, grad_x_rp, grad_u_rp);
+
+    grad_x = level_ * grad_x + (1.0 - level_) * grad_x_rp;
+    grad_u = level_ * grad_u + (1.0 - level_) * grad_u_rp;
+}
+
+//----------------------------------------------------------------------------------
+void InterpolatedHumanCost::grad_xr(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                    VecRef grad_x, VecRef grad_u)
+{
+    Scratch<Eigen::VectorXd> grad_x_rp(grad_x.size());
+    Scratch<Eigen::VectorXd> grad_u_rp(grad_u.size());
+    cost_hp_->grad_xr(robot_traj, human_traj, grad_x, grad_u);
+    cost_rp_->grad_xr(robot_traj, human_traj, grad_x_rp, grad_u_rp);
+
+    grad_x = level_ * grad_x + (1.0 - level_) * grad_x_rp;
+    grad_u = level_ * grad_u + (1.0 - level_) * grad_u_rp;
+}
+
+//----------------------------------------------------------------------------------
+void InterpolatedHumanCost::hessian_uh(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef hess)
+{
+    Scratch<Eigen::MatrixXd> hess_rp(hess.rows(), hess.cols());
+    cost_hp_->hessian_uh(robot_traj, human_traj, hess);
+    cost_rp_->hessian_uh(robot_traj, human_traj, hess_rp);
+
+    hess = level_ * hess + (1.0 - level_) * hess_rp;
+}
+
+//----------------------------------------------------------------------------------
+void InterpolatedHumanCost::hessian_uh_ur(const Trajectory &robot_traj, const Trajectory &human_traj, MatRef hess)
+{
+    Scratch<Eigen::MatrixXd> hess_rp(hess.rows(), hess.cols());
+    cost_hp_->hessian_uh_ur(robot_traj, human_traj, hess);
+    cost_rp_->hessian_uh_ur(robot_traj, human_traj, hess_rp);
+
+    hess = level_ * hess + (1.0 - level_) * hess_rp;
+}
+
 } // namespace
\ No newline at end of file
@@ -0,0 +1,31 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#include "hri_planner/costs_static.h"
+
+namespace hri_planner {
+
+// the precompiled combinations
+template class StaticLinearCost<HumanVelCost, HumanAccCost, HumanGoalCost, CollisionCost>;
+template class StaticLinearCost<HumanVelCost, HumanAccCost, HumanGoalCost, CollisionCost, DynCollisionCost>;
+
+//----------------------------------------------------------------------------------
+std::shared_ptr<SingleTrajectoryCostHuman> create_static_human_cost(
+        const std::vector<double>& weights, const std::vector<std::shared_ptr<FeatureBase> >& features)
+{
+    std::shared_ptr<SingleTrajectoryCostHuman> cost = StaticHumanCost5::create(weights, features);
+    if (cost)
+        return cost;
+
+    return StaticHumanCost4::create(weights, features);
+}
+
+} // namespace
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/7/2018
-// Last revision: 3/7/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -32,7 +32,7 @@ ConstAccDynamics::ConstAccDynamics(double dt): DynamicsBase(4, 2, dt) {
 //----------------------------------------------------------------------------------
 void ConstAccDynamics::forward_dyn(ConstVecRef x, ConstVecRef u, VecRef x_new)
 {
-    x_new = A_ * x + B_ * u;
+    DynamicsTraits<CONST_ACC_MODEL>::forward_dyn(x, u, dt_, x_new);
 }
 
 //----------------------------------------------------------------------------------
@@ -47,70 +47,46 @@ void ConstAccDynamics::grad_u(ConstVecRef x, ConstVecRef u, MatRef Ju)
     Ju = B_;
 }
 
+//----------------------------------------------------------------------------------
+void ConstAccDynamics::vjp_x(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out)
+{
+    DynamicsTraits<CONST_ACC_MODEL>::vjp_x(x, u, dt_, lambda, out);
+}
+
+//----------------------------------------------------------------------------------
+void ConstAccDynamics::vjp_u(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out)
+{
+    DynamicsTraits<CONST_ACC_MODEL>::vjp_u(x, u, dt_, lambda, out);
+}
+
 //----------------------------------------------------------------------------------
 void DifferentialDynamics::forward_dyn(ConstVecRef x, ConstVecRef u, VecRef x_new)
 {
-    x_new.setZero();
-
-    const double th = x(2);
-    if (std::abs(u(1)) < om_tol_) {
-        // approximately linear motion only
-        x_new(0) = x(0) + u(0) * std::cos(th) * dt_;
-        x_new(1) = x(1) + u(0) * std::sin(th) * dt_;
-        x_new(2) = x(2) + u(1) * dt_;
-    }
-    else {
-        // constant curvature motion
-        const double R = u(0) / u(1);
-        const double dth = u(1) * dt_;
-
-        x_new(0) = x(0) + R * (-std::sin(th) + std::sin(th + dth));
-        x_new(1) = x(1) + R * (std::cos(th) - std::cos(th + dth));
-        x_new(2) = x(2) + dth;
-    }
+    DynamicsTraits<DIFFERENTIAL_MODEL>::forward_dyn(x, u, dt_, x_new, om_tol_);
 }
 
 //----------------------------------------------------------------------------------
 void DifferentialDynamics::grad_x(ConstVecRef x, ConstVecRef u, MatRef Jx)
 {
-    Jx.setIdentity();
-
-    const double th = x(2);
-    if (std::abs(u(1)) < om_tol_) {
-        Jx(0, 2) = u(0) * dt_ * (-std::sin(th));
-        Jx(1, 2) = u(0) * dt_ * std::cos(th);
-    }
-    else {
-        const double R = u(0) / u(1);
-        const double th_new = th + u(1) * dt_;
-
-        Jx(0, 2) = R * (-std::cos(th) + std::cos(th_new));
-        Jx(1, 2) = R * (-std::sin(th) + std::sin(th_new));
-    }
+    DynamicsTraits<DIFFERENTIAL_MODEL>::grad_x(x, u, dt_, Jx, om_tol_);
 }
 
 //----------------------------------------------------------------------------------
 void DifferentialDynamics::grad_u(ConstVecRef x, ConstVecRef u, MatRef Ju)
 {
-    Ju.setZero();
-
-    const double th = x(2);
-    if (std::abs(u(1)) < om_tol_) {
-        Ju(0, 0) = dt_ * std::cos(th);
-        Ju(1, 0) = dt_ * std::sin(th);
-        Ju(2, 1) = dt_;
-    }
-    else {
-        double om_inv = 1.0 / u(1);
-        double th_new = th + u(1) * dt_;
-        double R = u(0) / u(1);
-
-        Ju(0, 0) = om_inv * (-std::sin(th) + std::sin(th_new));
-        Ju(1, 0) = om_inv * (std::cos(th) - std::cos(th_new));
-        Ju(0, 1) = R * (om_inv * (std::sin(th) - std::sin(th_new)) + dt_ * std::cos(th_new));
-        Ju(1, 1) = R * (-om_inv * (std::cos(th) - std::cos(th_new)) + dt_ * std::sin(th_new));
-        Ju(2, 1) = dt_;
-    }
+    DynamicsTraits<DIFFERENTIAL_MODEL>::grad_u(x, u, dt_, Ju, om_tol_);
+}
+
+//----------------------------------------------------------------------------------
+void DifferentialDynamics::vjp_x(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out)
+{
+    DynamicsTraits<DIFFERENTIAL_MODEL>::vjp_x(x, u, dt_, lambda, out, om_tol_);
+}
+
+//----------------------------------------------------------------------------------
+void DifferentialDynamics::vjp_u(ConstVecRef x, ConstVecRef u, ConstVecRef lambda, VecRef out)
+{
+    DynamicsTraits<DIFFERENTIAL_MODEL>::vjp_u(x, u, dt_, lambda, out, om_tol_);
 }
 
 } // namespace
@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 2/25/2018
-// Last revision: 3/31/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -65,36 +65,52 @@ double BeliefModelBase::update_belief(const Eigen::VectorXd &xr, const Eigen::Ve
 
 //----------------------------------------------------------------------------------
 void BeliefModelBase::update_belief(const Trajectory &robot_traj, const Trajectory &human_traj, int acomm,
-                                    double tcomm, double t0, Eigen::VectorXd &belief, Eigen::MatrixXd &jacobian)
+                                    double tcomm, double t0, VecRef belief, MatRef jacobian)
+{
+    int T = robot_traj.horizon();
+    Scratch<Eigen::VectorXd> p_ex_hp(T);
+    Scratch<Eigen::VectorXd> p_ex_rp(T);
+    explicit_belief(acomm, tcomm, t0, robot_traj.dt(), p_ex_hp, p_ex_rp);
+
+    update_belief(robot_traj, human_traj, p_ex_hp, p_ex_rp, belief, jacobian);
+}
+
+//----------------------------------------------------------------------------------
+void BeliefModelBase::update_belief(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                    ConstVecRef p_ex_hp, ConstVecRef p_ex_rp, VecRef belief, MatRef jacobian)
 {
     // compute the implicit costs
-    Eigen::VectorXd costs_hp;
-    Eigen::VectorXd costs_rp;
-    Eigen::MatrixXd jacobian_hp;
-    Eigen::MatrixXd jacobian_rp;
+    int T = robot_traj.horizon();
+    Scratch<Eigen::VectorXd> costs_hp(T);
+    Scratch<Eigen::VectorXd> costs_rp(T);
+    Scratch<Eigen::MatrixXd> jacobian_hp(T, robot_traj.traj_control_size());
+    Scratch<Eigen::MatrixXd> jacobian_rp(T, robot_traj.traj_control_size());
 
     implicit_cost(robot_traj, human_traj, costs_hp, jacobian_hp, costs_rp, jacobian_rp);
 
-    // compute the probabilities and jacobians
-    double dt = robot_traj.dt();
-    double tcurr = t0;
-    for (int t = 0; t < robot_traj.horizon(); ++t) {
-        // explicit part
-        tcurr += dt;
-        double p_ex_hp = belief_explicit(HumanPriority, tcurr, acomm, tcomm);
-        double p_ex_rp = belief_explicit(RobotPriority, tcurr, acomm, tcomm);
+    // probabilities of all steps at once, the implicit costs are overwritten by the scaled exponentials
+    costs_hp = p_ex_hp.array() * (-fcorrection_[HumanPriority] * costs_hp.array()).exp();
+    costs_rp = p_ex_rp.array() * (-fcorrection_[RobotPriority] * costs_rp.array()).exp();
 
-        // implicit part
-        double p_im_hp = std::exp(-fcorrection_[HumanPriority] * costs_hp(t));
-        double p_im_rp = std::exp(-fcorrection_[RobotPriority] * costs_rp(t));
+    // p_hp / (p_hp + p_rp), the jacobian scales with p_hp * p_rp / (p_hp + p_rp)^2
+    Scratch<Eigen::VectorXd> den_inv(T);
+    den_inv = (costs_hp + costs_rp).cwiseInverse();
+    belief = costs_hp.cwiseProduct(den_inv);
+    den_inv = belief.cwiseProduct(costs_rp).cwiseProduct(den_inv);
 
-        // probability
-        double den_inv = 1.0 / (p_ex_hp * p_im_hp + p_ex_rp * p_im_rp);
-        belief(t) = p_ex_hp * p_im_hp * den_inv;
+    jacobian = den_inv.asDiagonal() *
+            (fcorrection_[RobotPriority] * jacobian_rp - fcorrection_[HumanPriority] * jacobian_hp);
+}
 
-        // gradient/jacobian
-        jacobian.row(t) = den_inv * den_inv * p_ex_hp * p_im_hp * p_ex_rp * p_im_rp *
-                (fcorrection_[RobotPriority] * jacobian_rp.row(t) - fcorrection_[HumanPriority] * jacobian_hp.row(t));
+//----------------------------------------------------------------------------------
+void BeliefModelBase::explicit_belief(int acomm, double tcomm, double t0, double dt,
+                                      VecRef p_ex_hp, VecRef p_ex_rp)
+{
+    double tcurr = t0;
+    for (int t = 0; t < p_ex_hp.size(); ++t) {
+        tcurr += dt;
+        p_ex_hp(t) = belief_explicit(HumanPriority, tcurr, acomm, tcomm);
+        p_ex_rp(t) = belief_explicit(RobotPriority, tcurr, acomm, tcomm);
     }
 }
 
@@ -111,15 +127,24 @@ void BeliefModelBase::reset_hist(const Eigen::VectorXd &ur0)
 }
 
 //----------------------------------------------------------------------------------
-void BeliefModelBase::update_cost_hist(double ct, std::deque<double> &ct_hist, double &cost)
+void BeliefModelBase::init_cost_hist(const std::deque<double> &ct_hist, VecRef ct_seq, double &cost)
 {
+    cost = 0.0;
+    for (int k = 0; k < ct_hist.size(); ++k) {
+        ct_seq(k) = ct_hist[k];
+        cost += ct_hist[k];
+    }
+}
+
+//----------------------------------------------------------------------------------
+void BeliefModelBase::update_cost_hist(double ct, int k, VecRef ct_seq, double &cost)
+{
+    // same as pushing to the history and popping out the oldest one
+    ct_seq(k) = ct;
     cost += ct;
 
-    ct_hist.push_back(ct);
-    if (ct_hist.size() > T_hist_) {
-        cost -= ct_hist.front();
-        ct_hist.pop_front();
-    }
+    if (k >= T_hist_)
+        cost -= ct_seq(k - T_hist_);
 }
 
 //----------------------------------------------------------------------------------
@@ -189,26 +214,27 @@ double BeliefModelExponential::implicit_cost_simple(const int intent, const Eige
 
 //----------------------------------------------------------------------------------
 void BeliefModelExponential::implicit_cost(const Trajectory& robot_traj, const Trajectory& human_traj,
-                                           Eigen::VectorXd& costs_hp, Eigen::MatrixXd& jacobian_hp,
-                                           Eigen::VectorXd& costs_rp, Eigen::MatrixXd& jacobian_rp)
+                                           VecRef costs_hp, MatRef jacobian_hp, VecRef costs_rp, MatRef jacobian_rp)
 {
     int T = robot_traj.horizon();
-    costs_hp.setZero(T);
-    costs_rp.setZero(T);
-    jacobian_hp.setZero(T, robot_traj.traj_control_size());
-    jacobian_rp.setZero(T, robot_traj.traj_control_size());
+    costs_hp.setZero();
+    costs_rp.setZero();
+    jacobian_hp.setZero();
+    jacobian_rp.setZero();
 
-    Eigen::VectorXd grad_u(robot_traj.traj_control_size());
-    Eigen::VectorXd grad_x(robot_traj.traj_state_size());
+    Scratch<Eigen::VectorXd> grad_step(robot_traj.traj_control_size());
 
-    Eigen::VectorXd grad_u_rp(robot_traj.traj_control_size());
+    double u_last = ur_last_(0);
 
-    Eigen::VectorXd u_last = ur_last_;
+    // the cost history followed by the predicted costs
+    int n_hist = (int) cost_hist_hp_.size();
+    Scratch<Eigen::VectorXd> cost_seq_hp(n_hist + T);
+    Scratch<Eigen::VectorXd> cost_seq_rp(n_hist + T);
 
-    std::deque<double> cost_hist_hp(cost_hist_hp_.begin(), cost_hist_hp_.end());
-    std::deque<double> cost_hist_rp(cost_hist_rp_.begin(), cost_hist_rp_.end());
-    double cost_hp = std::accumulate(cost_hist_hp.begin(), cost_hist_hp.end(), 0.0);
-    double cost_rp = std::accumulate(cost_hist_rp.begin(), cost_hist_rp.end(), 0.0);
+    double cost_hp;
+    double cost_rp;
+    init_cost_hist(cost_hist_hp_, cost_seq_hp, cost_hp);
+    init_cost_hist(cost_hist_rp_, cost_seq_rp, cost_rp);
 
     int nXr = robot_traj.state_size();
     int nXh = human_traj.state_size();
@@ -230,23 +256,26 @@ void BeliefModelExponential::implicit_cost(const Trajectory& robot_traj, const T
 
         double ct_hp, ct_rp;
         Eigen::Vector2d gradu_hp;
-        Eigen::VectorXd gradu_rp(robot_traj.traj_control_size());
         Eigen::Vector2d gradx_hp;
 
+        // the robot priority gradient only involves the current and the last velocity
+        double gradu_rp = 0.0;
+        double gradu_rp_last = 0.0;
+
         // only non-zero when prod is greater than 0
         if (prod > 0) {
             //! compute cost for robot priority
             double v_inc = 0.0;
-            v_inc = vr - u_last(0);
+            v_inc = vr - u_last;
 
             ct_rp = v_inc * v_inc;
 
             if (t > 0) {
-                gradu_rp(stu-2) = -2.0 * v_inc;
+                gradu_rp_last = -2.0 * v_inc;
             }
-            gradu_rp(stu) = 2.0 * v_inc;
+            gradu_rp = 2.0 * v_inc;
 
-            u_last(0) = robot_traj.u(stu);
+            u_last = robot_traj.u(stu);
 
             //! compute cost for human priority
             double d = x_rel.squaredNorm();
@@ -275,13 +304,12 @@ void BeliefModelExponential::implicit_cost(const Trajectory& robot_traj, const T
             ct_hp = 0.0;
             ct_rp = 0.0;
             gradu_hp.setZero();
-            gradu_rp.setZero();
             gradx_hp.setZero();
         }
 
         // update total cost and cost history
-        update_cost_hist(ct_hp, cost_hist_hp, cost_hp);
-        update_cost_hist(ct_rp, cost_hist_rp, cost_rp);
+        update_cost_hist(ct_hp, n_hist + t, cost_seq_hp, cost_hp);
+        update_cost_hist(ct_rp, n_hist + t, cost_seq_rp, cost_rp);
 
         // assign to output cost
         costs_hp(t) = cost_hp;
@@ -295,11 +323,82 @@ void BeliefModelExponential::implicit_cost(const Trajectory& robot_traj, const T
 
         // human priority
         jacobian_hp.block(t, stu, 1, 2) = gradu_hp.transpose();
-        jacobian_hp.row(t) = jacobian_hp.row(t) + gradx_hp.transpose() * robot_traj.Ju.block(str, 0, 2, robot_traj.Ju.cols());
+        robot_traj.Ju_blocks.transpose_mult_step(t, gradx_hp, grad_step);
+        jacobian_hp.row(t) += grad_step.transpose();
 
         // robot priority
-        jacobian_rp.row(t) = jacobian_rp.row(t) + gradu_rp.transpose();
+        if (t > 0)
+            jacobian_rp(t, stu-2) += gradu_rp_last;
+        jacobian_rp(t, stu) += gradu_rp;
+    }
+}
+
+//----------------------------------------------------------------------------------
+BeliefModelMulti::BeliefModelMulti(const std::shared_ptr<BeliefModelBase>& model, const std::vector<double>& levels):
+        model_(model)
+{
+    if (levels.size() < 2)
+        throw "Multi-intent belief model requires at least two intents!";
+
+    levels_ = Eigen::Map<const Eigen::VectorXd>(levels.data(), levels.size());
+}
+
+//----------------------------------------------------------------------------------
+void BeliefModelMulti::update_belief(const Trajectory &robot_traj, const Trajectory &human_traj,
+                                     ConstVecRef p_ex_hp, ConstVecRef p_ex_rp,
+                                     MatRef belief, MatRef scale, MatRef jacobian)
+{
+    int T = robot_traj.horizon();
+    int N = num_intents();
+    Scratch<Eigen::VectorXd> costs_hp(T);
+    Scratch<Eigen::VectorXd> costs_rp(T);
+    Scratch<Eigen::MatrixXd> jacobian_hp(T, robot_traj.traj_control_size());
+    Scratch<Eigen::MatrixXd> jacobian_rp(T, robot_traj.traj_control_size());
+
+    model_->implicit_cost(robot_traj, human_traj, costs_hp, jacobian_hp, costs_rp, jacobian_rp);
+
+    // log-likelihoods of the two priorities, overwriting the costs
+    const std::vector<double>& fcorrection = model_->fcorrection_;
+    costs_hp = p_ex_hp.array().log() - fcorrection[HumanPriority] * costs_hp.array();
+    costs_rp = p_ex_rp.array().log() - fcorrection[RobotPriority] * costs_rp.array();
+
+    // softmax over the interpolated log-likelihoods
+    // the levels are in [0, 1], so no z_k is greater than max(z_hp, z_rp), which is used as the shift
+    for (int t = 0; t < T; ++t) {
+        double z_max = std::max(costs_hp(t), costs_rp(t));
+        double sum = 0.0;
+        for (int k = 0; k < N; ++k) {
+            belief(t, k) = std::exp(levels_(k) * costs_hp(t) + (1.0 - levels_(k)) * costs_rp(t) - z_max);
+            sum += belief(t, k);
+        }
+        belief.row(t) /= sum;
+    }
+
+    // d z_k / d ur = l_k * d z_hp + (1 - l_k) * d z_rp, so the softmax jacobian becomes
+    // d p_k / d ur = p_k * (l_k - sum_j p_j * l_j) * (d z_hp - d z_rp)
+    Scratch<Eigen::VectorXd> level_mean(T);
+    level_mean.noalias() = belief * levels_;
+    for (int k = 0; k < N; ++k)
+        scale.col(k) = belief.col(k).array() * (levels_(k) - level_mean.array());
+
+    jacobian = fcorrection[RobotPriority] * jacobian_rp - fcorrection[HumanPriority] * jacobian_hp;
+}
+
+//----------------------------------------------------------------------------------
+void BeliefModelMulti::constant_belief(double prob_hp, const Eigen::VectorXd &levels, VecRef belief)
+{
+    // a certain belief would give 0 * log(0) for the other priority
+    const double prob_min = 1e-300;
+    double z_hp = std::log(std::max(prob_hp, prob_min));
+    double z_rp = std::log(std::max(1.0 - prob_hp, prob_min));
+    double z_max = std::max(z_hp, z_rp);
+
+    double sum = 0.0;
+    for (int k = 0; k < levels.size(); ++k) {
+        belief(k) = std::exp(levels(k) * z_hp + (1.0 - levels(k)) * z_rp - z_max);
+        sum += belief(k);
     }
+    belief /= sum;
 }
 
 }
\ No newline at end of file
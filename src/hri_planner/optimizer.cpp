@@ -3,13 +3,17 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/9/2018
-// Last revision: 4/26/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
 //----------------------------------------------------------------------------------
 
 #include <utility>
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <algorithm>
 
 #include "hri_planner/optimizer.h"
 
@@ -19,18 +23,32 @@ namespace hri_planner {
 TrajectoryOptimizer::TrajectoryOptimizer(unsigned int dim, const nlopt::algorithm& alg)
 {
     optimizer_ = nlopt::opt(alg, dim);
+    neval_last_ = 0;
+    grad_mode_ = GRADIENT_JACOBIAN;
+
+    grad_tol_ = 0.0;
+    flag_stopped_ = false;
+    flag_cancelled_ = false;
+    flag_warm_start_ = false;
+
+    solver_ = SOLVER_NLOPT;
+    neval_newton_ = 0;
+    max_iter_ = 0;
+    t_max_ = 0.0;
 }
 
 //----------------------------------------------------------------------------------
 void TrajectoryOptimizer::set_cost_function(SingleTrajectoryCost *cost)
 {
     cost_ = std::shared_ptr<SingleTrajectoryCost>(cost);
+    cost_human_ = std::dynamic_pointer_cast<SingleTrajectoryCostHuman>(cost_);
 }
 
 //----------------------------------------------------------------------------------
 void TrajectoryOptimizer::set_cost_function(std::shared_ptr<SingleTrajectoryCost> cost)
 {
     cost_ = std::move(cost);
+    cost_human_ = std::dynamic_pointer_cast<SingleTrajectoryCostHuman>(cost_);
 }
 
 //----------------------------------------------------------------------------------
@@ -38,51 +56,84 @@ void TrajectoryOptimizer::set_bounds(const Eigen::VectorXd &lb, const Eigen::Vec
 {
     lb_ = lb;
     ub_ = ub;
+
+    // the bounds are passed to nlopt once, not on every optimization
+    std::vector<double> lb_vec;
+    std::vector<double> ub_vec;
+
+    utils::EigenToVector(lb_, lb_vec);
+    utils::EigenToVector(ub_, ub_vec);
+
+    optimizer_.set_lower_bounds(lb_vec);
+    optimizer_.set_upper_bounds(ub_vec);
 }
 
 //----------------------------------------------------------------------------------
 void TrajectoryOptimizer::set_time_limit(const double t_max)
 {
     optimizer_.set_maxtime(t_max);
+    t_max_ = t_max;
 }
 
 //----------------------------------------------------------------------------------
 bool TrajectoryOptimizer::optimize(const Trajectory& traj_init, const Trajectory& traj_const, Trajectory& traj_opt)
 {
-    // recreate the trajectory object with trajectory data
-    traj_.reset(new Trajectory(traj_init.dyn_type, traj_init.horizon(), traj_init.dt()));
+    // only recreate the trajectory object and the workspace if the dimensions change
+    if (!traj_ || traj_->dyn_type != traj_init.dyn_type || traj_->horizon() != traj_init.horizon() ||
+            traj_->dt() != traj_init.dt()) {
+        traj_.reset(new Trajectory(traj_init.dyn_type, traj_init.horizon(), traj_init.dt()));
+        workspace_.reserve(Workspace::default_capacity(traj_init.horizon()));
+    }
     traj_->x0 = traj_init.x0;
 
     // set the const trajectory data
     cost_->set_trajectory_data(traj_const);
 
-    // set lower and upper bounds
-    std::vector<double> lb;
-    std::vector<double> ub;
-
-    utils::EigenToVector(lb_, lb);
-    utils::EigenToVector(ub_, ub);
+    // initial condition, the previous solution if warm starting
+    const Eigen::VectorXd& u_init = flag_warm_start_ && u_warm_.size() == traj_init.u.size() ? u_warm_ : traj_init.u;
 
-    optimizer_.set_lower_bounds(lb);
-    optimizer_.set_upper_bounds(ub);
-
-    // set cost function
-    optimizer_.set_min_objective(cost_wrapper, this);
+    if (solver_ == SOLVER_PROJECTED_NEWTON) {
+        if (!cost_human_)
+            throw "Projected newton solver requires a human cost with hessians!";
 
-    // set tolerance
-    optimizer_.set_xtol_abs(1e-2);
+        // works on eigen buffers directly
+        traj_opt.u = u_init;
+        optimize_projected_newton(traj_const, traj_opt.u);
+    }
+    else {
+        // set cost function
+        optimizer_.set_min_objective(cost_wrapper, this);
+
+        // set tolerance
+        optimizer_.set_xtol_abs(1e-2);
+
+        u_opt_.assign(u_init.data(), u_init.data() + u_init.size());
+        VecMap u_opt(u_opt_.data(), u_opt_.size());
+
+        // optimizer!
+        double min_cost;
+        flag_stopped_ = false;
+        flag_cancelled_ = false;
+        try {
+            optimizer_.optimize(u_opt_, min_cost);
+        }
+        catch (nlopt::forced_stop& e) {
+            // stopped by the gradient check, which saved the converged point
+            // or cancelled, then nlopt leaves the best point so far in u_opt_
+            if (flag_stopped_)
+                u_opt = u_stop_;
+            else if (!flag_cancelled_)
+                throw;
+        }
+
+        traj_opt.u = u_opt;
+    }
 
-    // initial condition
-    std::vector<double> u_opt;
-    utils::EigenToVector(traj_init.u, u_opt);
-
-    // optimizer!
-    double min_cost;
-    optimizer_.optimize(u_opt, min_cost);
+    if (flag_warm_start_)
+        u_warm_ = traj_opt.u;
 
     // send result back
     traj_opt.x0 = traj_init.x0;
-    utils::VectorToEigen(u_opt, traj_opt.u);
     traj_opt.compute();
     traj_opt.compute_jacobian();
 
@@ -90,29 +141,208 @@ bool TrajectoryOptimizer::optimize(const Trajectory& traj_init, const Trajectory
 }
 
 //----------------------------------------------------------------------------------
-double TrajectoryOptimizer::cost_func(const std::vector<double> &u, std::vector<double> &grad)
+double TrajectoryOptimizer::cost_func(const ConstVecMap& u, VecMap& grad)
 {
+    // temporaries of the cost functions are taken from the workspace
+    WorkspaceScope scope(workspace_);
+
     // re-compute the trjectory
-    Eigen::Map<const Eigen::VectorXd> u_new(u.data(), u.size());
+    traj_->update(u);
+
+    // compute the gradient in place, the view is empty if not needed
+    if (grad.size() > 0) {
+        if (grad_mode_ == GRADIENT_ADJOINT) {
+            cost_->grad_adjoint(*traj_, grad);
+        }
+        else {
+            // the gradients only need products with Ju, so skip the dense jacobian
+            traj_->compute_jacobian_blocks();
+            cost_->grad(*traj_, grad);
+        }
+
+        // close enough to a stationary point, no need to spend the remaining iterations
+        if (grad_tol_ > 0 && projected_grad_norm(u, grad) < grad_tol_) {
+            u_stop_ = u;
+            flag_stopped_ = true;
+            optimizer_.force_stop();
+        }
+    }
 
-    traj_->update(u_new);
-    traj_->compute_jacobian();
+    // return the cost
+    return cost_->compute(*traj_);
+}
 
-    // compute the cost and gradient
-    Eigen::VectorXd grad_vec(u_new.size());
-    cost_->grad(*traj_, grad_vec);
+//----------------------------------------------------------------------------------
+double TrajectoryOptimizer::cost_wrapper(unsigned n, const double* u, double* grad, void *data)
+{
+    auto optimizer = reinterpret_cast<TrajectoryOptimizer *>(data);
 
-    // covert eigen vec to std vector
-    utils::EigenToVector(grad_vec, grad);
+    // skip the evaluation, nlopt ignores the value once stopped
+    if (optimizer->cancel_token_ && optimizer->cancel_token_->cancelled()) {
+        optimizer->flag_cancelled_ = true;
+        optimizer->optimizer_.force_stop();
+        return std::numeric_limits<double>::infinity();
+    }
 
-    // return the cost
-    return cost_->compute(*traj_);
+    ConstVecMap u_map(u, n);
+    VecMap grad_map(grad, grad == nullptr ? 0 : n);
+
+    return optimizer->cost_func(u_map, grad_map);
 }
 
 //----------------------------------------------------------------------------------
-double TrajectoryOptimizer::cost_wrapper(const std::vector<double> &u, std::vector<double> &grad, void *data)
+double TrajectoryOptimizer::projected_grad_norm(const ConstVecMap& u, const VecMap& grad) const
 {
-    return reinterpret_cast<TrajectoryOptimizer *>(data)->cost_func(u, grad);
+    bool has_bounds = lb_.size() == u.size() && ub_.size() == u.size();
+
+    double norm_sq = 0.0;
+    for (int i = 0; i < u.size(); ++i) {
+        // descent direction points out of the feasible set
+        if (has_bounds && ((u(i) <= lb_(i) && grad(i) > 0) || (u(i) >= ub_(i) && grad(i) < 0)))
+            continue;
+        norm_sq += grad(i) * grad(i);
+    }
+
+    return std::sqrt(norm_sq);
+}
+
+//----------------------------------------------------------------------------------
+double TrajectoryOptimizer::optimize_projected_newton(const Trajectory& traj_const, Eigen::VectorXd& u)
+{
+    using namespace std::chrono;
+    steady_clock::time_point t_start = steady_clock::now();
+
+    const int len = static_cast<int>(u.size());
+    const int max_iter = max_iter_ > 0 ? max_iter_ : 50;
+    const double grad_tol = grad_tol_ > 0 ? grad_tol_ : 1e-6;
+
+    // armijo condition and the largest threshold for a bound to be active
+    const double sigma = 1e-4;
+    const double eps_active_max = 1e-2;
+    const int max_line_search = 20;
+    const int max_shift = 20;
+
+    const bool has_bounds = lb_.size() == len && ub_.size() == len;
+
+    WorkspaceScope scope(workspace_);
+
+    Scratch<Eigen::VectorXd> grad(len);
+    Scratch<Eigen::VectorXd> dir(len);
+    Scratch<Eigen::VectorXd> u_trial(len);
+    Scratch<Eigen::MatrixXd> hess(len, len);
+
+    project_to_bounds(u);
+    traj_->update(u);
+    double cost = cost_->compute(*traj_);
+    ++neval_newton_;
+
+    for (int k = 0; k < max_iter; ++k) {
+        if (t_max_ > 0 && duration_cast<duration<double> >(steady_clock::now() - t_start).count() > t_max_)
+            break;
+
+        if (cancel_token_ && cancel_token_->cancelled())
+            break;
+
+        traj_->compute_jacobian();
+        cost_->grad(*traj_, grad);
+        cost_human_->hessian_uh(traj_const, *traj_, hess);
+
+        // no descent direction to take
+        if (!grad.allFinite())
+            break;
+
+        // variables near a bound with the gradient pointing outwards are held fixed
+        // they only take a (projected) gradient step, the rest take the newton step
+        // the threshold shrinks with the projected gradient step, as in Bertsekas' method
+        u_trial = u - grad;
+        project_to_bounds(u_trial);
+        const double eps_active = std::min(eps_active_max, (u - u_trial).norm());
+
+        double grad_norm_sq = 0.0;
+        for (int i = 0; i < len; ++i) {
+            if (has_bounds && ((u(i) <= lb_(i) + eps_active && grad(i) > 0) ||
+                               (u(i) >= ub_(i) - eps_active && grad(i) < 0))) {
+                hess.row(i).setZero();
+                hess.col(i).setZero();
+                hess(i, i) = 1.0;
+            }
+            else {
+                grad_norm_sq += grad(i) * grad(i);
+            }
+        }
+
+        if (std::sqrt(grad_norm_sq) < grad_tol)
+            break;
+
+        // shift the hessian until it is positive definite, a limited number of times
+        // if that fails (or the hessian isn't finite), take a projected gradient step instead
+        bool flag_newton = hess.allFinite();
+        double shift = 0.0;
+        for (int i = 0; flag_newton; ++i) {
+            ldlt_.compute(hess);
+            if (ldlt_.info() == Eigen::Success && ldlt_.vectorD().minCoeff() > 0)
+                break;
+
+            if (i == max_shift) {
+                flag_newton = false;
+                break;
+            }
+
+            double shift_new = shift > 0 ? 10.0 * shift : 1e-6 * std::max(1.0, hess.diagonal().cwiseAbs().maxCoeff());
+            hess.diagonal().array() += shift_new - shift;
+            shift = shift_new;
+        }
+
+        if (flag_newton)
+            dir = ldlt_.solve(grad);
+        else
+            dir = grad;
+        dir *= -1.0;
+
+        // backtracking along the projection arc
+        double alpha = 1.0;
+        double cost_trial = cost;
+        bool flag_accepted = false;
+
+        for (int i = 0; i < max_line_search; ++i) {
+            u_trial = u + alpha * dir;
+            project_to_bounds(u_trial);
+
+            traj_->update(u_trial);
+            cost_trial = cost_->compute(*traj_);
+            ++neval_newton_;
+
+            if (cost_trial <= cost + sigma * grad.dot(u_trial - u)) {
+                flag_accepted = true;
+                break;
+            }
+
+            alpha *= 0.5;
+        }
+
+        if (!flag_accepted) {
+            traj_->update(u);
+            break;
+        }
+
+        double step = (u_trial - u).lpNorm<Eigen::Infinity>();
+        u = u_trial;
+        cost = cost_trial;
+
+        if (step < 1e-10)
+            break;
+    }
+
+    return cost;
+}
+
+//----------------------------------------------------------------------------------
+void TrajectoryOptimizer::project_to_bounds(Eigen::Ref<Eigen::VectorXd> u) const
+{
+    if (lb_.size() != u.size() || ub_.size() != u.size())
+        return;
+
+    u = u.cwiseMax(lb_).cwiseMin(ub_);
 }
 
 //----------------------------------------------------------------------------------
@@ -120,6 +350,12 @@ NestedOptimizerBase::NestedOptimizerBase(unsigned int dim, const nlopt::algorith
 {
     optimizer_ = nlopt::opt(alg, dim);
     neval_last_ = 0;
+    grad_mode_ = GRADIENT_JACOBIAN;
+    flag_stopped_ = false;
+
+    u_best_.setZero(dim);
+    cost_best_ = std::numeric_limits<double>::infinity();
+    flag_has_best_ = false;
 }
 
 //----------------------------------------------------------------------------------
@@ -135,10 +371,145 @@ void NestedOptimizerBase::set_robot_cost(std::shared_ptr<ProbabilisticCostBase>
 }
 
 //----------------------------------------------------------------------------------
-double NestedOptimizerBase::cost_wrapper(const std::vector<double> &u, std::vector<double> &grad,
-                                         void *cost_func_data)
+double NestedOptimizerBase::cost_wrapper(unsigned n, const double* u, double* grad, void *cost_func_data)
+{
+    auto optimizer = reinterpret_cast<NestedOptimizerBase *>(cost_func_data);
+
+    // skip the evaluation, nlopt ignores the value once stopped
+    if (optimizer->check_cancelled())
+        return std::numeric_limits<double>::infinity();
+
+    ConstVecMap u_map(u, n);
+    VecMap grad_map(grad, grad == nullptr ? 0 : n);
+
+    double cost = optimizer->cost_func(u_map, grad_map);
+
+    // nan costs never replace the best iterate
+    if (cost < optimizer->cost_best_) {
+        std::lock_guard<std::mutex> lock(optimizer->best_mutex_);
+        optimizer->u_best_ = u_map;
+        optimizer->cost_best_ = cost;
+        optimizer->flag_has_best_ = true;
+        optimizer->save_best_iterate();
+    }
+
+    if (optimizer->progress_callback_ && !optimizer->progress_callback_(cost)) {
+        optimizer->flag_stopped_ = true;
+        optimizer->optimizer_.force_stop();
+    }
+
+    return cost;
+}
+
+//----------------------------------------------------------------------------------
+nlopt::result NestedOptimizerBase::run_optimizer(std::vector<double> &u, double &min_cost)
+{
+    clear_best_iterate();
+
+    flag_stopped_ = false;
+    try {
+        return optimizer_.optimize(u, min_cost);
+    }
+    catch (nlopt::forced_stop& e) {
+        // nlopt leaves the best point so far in u and its cost in min_cost
+        if (!flag_stopped_)
+            throw;
+        return nlopt::FORCED_STOP;
+    }
+}
+
+//----------------------------------------------------------------------------------
+bool NestedOptimizerBase::check_cancelled()
+{
+    if (!cancel_token_ || !cancel_token_->cancelled())
+        return false;
+
+    flag_stopped_ = true;
+    optimizer_.force_stop();
+    return true;
+}
+
+//----------------------------------------------------------------------------------
+bool NestedOptimizerBase::get_best_iterate(Eigen::VectorXd &u, double &cost)
+{
+    std::lock_guard<std::mutex> lock(best_mutex_);
+    if (!flag_has_best_)
+        return false;
+
+    u = u_best_;
+    cost = cost_best_;
+    return true;
+}
+
+//----------------------------------------------------------------------------------
+void NestedOptimizerBase::clear_best_iterate()
+{
+    std::lock_guard<std::mutex> lock(best_mutex_);
+    cost_best_ = std::numeric_limits<double>::infinity();
+    flag_has_best_ = false;
+}
+
+//----------------------------------------------------------------------------------
+void NestedOptimizerBase::run_parallel(const std::vector<ThreadPool::Task>& tasks)
+{
+    if (thread_pool_) {
+        thread_pool_->run_parallel(tasks);
+        return;
+    }
+
+    for (auto& task: tasks)
+        task();
+}
+
+//----------------------------------------------------------------------------------
+void NestedOptimizerBase::cost_func_subroutine(SingleTrajectoryCostHuman *cost, const Trajectory& human_traj,
+                                               const Eigen::Ref<const Eigen::VectorXd> &grad_uh,
+                                               ImplicitGradData &data)
+{
+    // may run on a pool worker, so uses a separate workspace
+    WorkspaceScope scope(data.workspace);
+
+    // the hessians only depend on the two trajectories, so a repeated point reuses the factorization
+    if (!data.flag_factorized || data.ur_factorized != robot_traj_->u || data.uh_factorized != human_traj.u) {
+        cost->hessian_uh(*robot_traj_, human_traj, data.hess_uh);
+        cost->hessian_uh_ur(*robot_traj_, human_traj, data.hess_uh_ur);
+
+        data.ldlt.compute(data.hess_uh);
+        data.flag_use_qr = data.ldlt.info() != Eigen::Success || data.ldlt.vectorD().minCoeff() <= 0;
+        if (data.flag_use_qr)
+            data.qr.compute(data.hess_uh);
+
+        data.flag_factorized = true;
+        data.ur_factorized = robot_traj_->u;
+        data.uh_factorized = human_traj.u;
+    }
+
+    // solve with the gradient instead of hess_uh_ur, which only needs one right-hand side
+    if (data.flag_use_qr)
+        data.sol = data.qr.solve(grad_uh);
+    else
+        data.sol = data.ldlt.solve(grad_uh);
+
+    data.sub_grad.noalias() = data.hess_uh_ur.transpose() * data.sol;
+}
+
+//----------------------------------------------------------------------------------
+void NestedOptimizerBase::ImplicitGradData::resize(int T, int len_uh, int len_ur)
 {
-    return reinterpret_cast<NestedOptimizerBase *>(cost_func_data)->cost_func(u, grad);
+    workspace.reserve(Workspace::default_capacity(T));
+
+    hess_uh.resize(len_uh, len_uh);
+    hess_uh_ur.resize(len_uh, len_ur);
+    sol.resize(len_uh);
+    sub_grad.resize(len_ur);
+
+    ldlt = Eigen::LDLT<Eigen::MatrixXd>(len_uh);
+    qr = Eigen::ColPivHouseholderQR<Eigen::MatrixXd>(len_uh, len_uh);
+    flag_use_qr = false;
+
+    flag_factorized = false;
+    ur_factorized.resize(len_ur);
+    uh_factorized.resize(len_uh);
 }
 
 //----------------------------------------------------------------------------------
@@ -194,6 +565,11 @@ double NestedTrajectoryOptimizer::optimize(const Trajectory &robot_traj_init, co
 
     robot_cost_->update_human_pred(human_traj_pred);
 
+    // gradient buffers for the evaluations that don't need the gradient
+    grad_ur_.setZero(robot_traj_->traj_control_size());
+    grad_uh_hp_.setZero(human_traj_hp_->traj_control_size());
+    grad_uh_rp_.setZero(human_traj_rp_->traj_control_size());
+
     // set lower and upper bounds
     std::vector<double> lb;
     std::vector<double> ub;
@@ -219,14 +595,15 @@ double NestedTrajectoryOptimizer::optimize(const Trajectory &robot_traj_init, co
 
     // optimizer!
     double min_cost;
-    nlopt::result result = optimizer_.optimize(u_opt, min_cost);
+    nlopt::result result = run_optimizer(u_opt, min_cost);
     std::cout << "result is: " << result << std::endl;
 
     // print cost and constraint error
     std::cout << "min cost is: " << min_cost << std::endl;
 
-    std::vector<double> grad_opt;
-    std::cout << "constraint error is: " << constraint(u_opt, grad_opt) << std::endl;
+    ConstVecMap u_opt_map(u_opt.data(), u_opt.size());
+    VecMap grad_none(nullptr, 0);
+    std::cout << "constraint error is: " << constraint(u_opt_map, grad_none) << std::endl;
 
     // send result back
     int len_ur = robot_traj_opt.traj_control_size();
@@ -251,11 +628,15 @@ double NestedTrajectoryOptimizer::optimize(const Trajectory &robot_traj_init, co
 double NestedTrajectoryOptimizer::check_constraint(const Trajectory &robot_traj, const Trajectory &human_traj_hp,
                                                    const Trajectory &human_traj_rp)
 {
-    // convert to std vector
-    std::vector<double> u;
-    utils::EigenToVector3(robot_traj.u, human_traj_hp.u, human_traj_rp.u, u);
+    // stack the controls
+    int len_ur = robot_traj.traj_control_size();
+    int len_uh = human_traj_hp.traj_control_size();
 
-    std::vector<double> grad;
+    Eigen::VectorXd u(len_ur + 2 * len_uh);
+    u << robot_traj.u, human_traj_hp.u, human_traj_rp.u;
+
+    ConstVecMap u_map(u.data(), u.size());
+    VecMap grad_none(nullptr, 0);
 
     // construct the trajectories
     int T = robot_traj.horizon();
@@ -269,64 +650,58 @@ double NestedTrajectoryOptimizer::check_constraint(const Trajectory &robot_traj,
     human_traj_rp_.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
     human_traj_rp_->x0 = human_traj_rp.x0;
 
-    return constraint(u, grad);
+    return constraint(u_map, grad_none);
 }
 
 //----------------------------------------------------------------------------------
-double NestedTrajectoryOptimizer::cost_func(const std::vector<double> &u, std::vector<double> &grad)
+double NestedTrajectoryOptimizer::cost_func(const ConstVecMap& u, VecMap& grad)
 {
+    WorkspaceScope scope(workspace_);
+
     // update robot and human trajectories
-    int len = robot_traj_->traj_control_size();
-    Eigen::Map<const Eigen::VectorXd> ur(u.data(), len);
-    robot_traj_->update(ur);
+    int len_ur = robot_traj_->traj_control_size();
+    int len_uh = human_traj_hp_->traj_control_size();
+
+    robot_traj_->update(u.head(len_ur));
     robot_traj_->compute_jacobian();
 
-    Eigen::Map<const Eigen::VectorXd> uh_hp(u.data()+len, human_traj_hp_->traj_control_size());
-    human_traj_hp_->update(uh_hp);
+    human_traj_hp_->update(u.segment(len_ur, len_uh));
     human_traj_hp_->compute_jacobian();
 
-    len += human_traj_hp_->traj_control_size();
-    Eigen::Map<const Eigen::VectorXd> uh_rp(u.data()+len, human_traj_rp_->traj_control_size());
-    human_traj_rp_->update(uh_rp);
+    human_traj_rp_->update(u.tail(len_uh));
     human_traj_rp_->compute_jacobian();
 
-    // compute cost and gradients
-    Eigen::VectorXd grad_ur;
-    Eigen::VectorXd grad_uh_hp;
-    Eigen::VectorXd grad_uh_rp;
-
-    double cost = robot_cost_->compute(*robot_traj_, *human_traj_hp_, *human_traj_rp_, acomm_, tcomm_,
-                                       grad_ur, grad_uh_hp, grad_uh_rp);
-
-    // convert to single gradient vector
-    utils::EigenToVector3(grad_ur, grad_uh_hp, grad_uh_rp, grad);
+    // compute cost and gradients, directly into nlopt's gradient if it is needed
+    if (grad.size() > 0) {
+        return robot_cost_->compute(*robot_traj_, *human_traj_hp_, *human_traj_rp_, acomm_, tcomm_,
+                                    grad.head(len_ur), grad.segment(len_ur, len_uh), grad.tail(len_uh));
+    }
 
-    return cost;
+    return robot_cost_->compute(*robot_traj_, *human_traj_hp_, *human_traj_rp_, acomm_, tcomm_,
+                                grad_ur_, grad_uh_hp_, grad_uh_rp_);
 }
 
 //----------------------------------------------------------------------------------
-double NestedTrajectoryOptimizer::constraint(const std::vector<double> &u, std::vector<double> &grad)
+double NestedTrajectoryOptimizer::constraint(const ConstVecMap& u, VecMap& grad)
 {
+    WorkspaceScope scope(workspace_);
+
     // update robot and human trajectories
-    int len = robot_traj_->traj_control_size();
-    Eigen::Map<const Eigen::VectorXd> ur(u.data(), len);
-    robot_traj_->update(ur);
+    int len_ur = robot_traj_->traj_control_size();
+    int len_uh = human_traj_hp_->traj_control_size();
+
+    robot_traj_->update(u.head(len_ur));
     robot_traj_->compute_jacobian();
 
-    Eigen::Map<const Eigen::VectorXd> uh_hp(u.data()+len, human_traj_hp_->traj_control_size());
-    human_traj_hp_->update(uh_hp);
+    human_traj_hp_->update(u.segment(len_ur, len_uh));
     human_traj_hp_->compute_jacobian();
 
-    len += human_traj_hp_->traj_control_size();
-    Eigen::Map<const Eigen::VectorXd> uh_rp(u.data()+len, human_traj_rp_->traj_control_size());
-    human_traj_rp_->update(uh_rp);
+    human_traj_rp_->update(u.tail(len_uh));
     human_traj_rp_->compute_jacobian();
 
     // find gradients of the human cost functions
-    int len_uh = human_traj_rp_->traj_control_size();
-    int len_ur = robot_traj_->traj_control_size();
-    Eigen::VectorXd grad_uh_hp(len_uh);
-    Eigen::VectorXd grad_uh_rp(len_uh);
+    Scratch<Eigen::VectorXd> grad_uh_hp(len_uh);
+    Scratch<Eigen::VectorXd> grad_uh_rp(len_uh);
 
     human_cost_hp_->grad_uh(*robot_traj_, *human_traj_hp_, grad_uh_hp);
     human_cost_rp_->grad_uh(*robot_traj_, *human_traj_rp_, grad_uh_rp);
@@ -335,8 +710,8 @@ double NestedTrajectoryOptimizer::constraint(const std::vector<double> &u, std::
     double constraint_val = grad_uh_hp.squaredNorm() + grad_uh_rp.squaredNorm();
 
     //! compute the constraint gradient
-    Eigen::MatrixXd Ju_hp(len_uh, u.size());
-    Eigen::MatrixXd Ju_rp(len_uh, u.size());
+    Scratch<Eigen::MatrixXd> Ju_hp(len_uh, u.size());
+    Scratch<Eigen::MatrixXd> Ju_rp(len_uh, u.size());
 
     // cast the pointers first
     HumanCost* cost_hp_cast = dynamic_cast<HumanCost*>(human_cost_hp_.get());
@@ -347,23 +722,31 @@ double NestedTrajectoryOptimizer::constraint(const std::vector<double> &u, std::
     Ju_hp.block(0, len_ur+len_uh, len_uh, len_uh).setZero();
 
     cost_rp_cast->hessian_uh_ur(*robot_traj_, *human_traj_rp_, Ju_rp.block(0, 0, len_uh, len_ur));
-    Ju_hp.block(0, len_ur, len_uh, len_uh).setZero();
+    Ju_rp.block(0, len_ur, len_uh, len_uh).setZero();
     cost_rp_cast->hessian_uh(*robot_traj_, *human_traj_rp_, Ju_rp.block(0, len_ur+len_uh, len_uh, len_uh));
 
-    grad_uh_hp = Ju_hp.transpose() * grad_uh_hp * 2.0;
-    grad_uh_rp = Ju_rp.transpose() * grad_uh_rp * 2.0;
-
-    // convert to std vector
-    utils::EigenToVector(grad_uh_hp + grad_uh_rp, grad);
+    // the gradient view is empty if not needed
+    if (grad.size() > 0) {
+        grad.noalias() = 2.0 * Ju_hp.transpose() * grad_uh_hp;
+        grad.noalias() += 2.0 * Ju_rp.transpose() * grad_uh_rp;
+    }
 
     return constraint_val;
 }
 
 //----------------------------------------------------------------------------------
-double NestedTrajectoryOptimizer::constraint_wrapper(const std::vector<double> &u, std::vector<double> &grad,
+double NestedTrajectoryOptimizer::constraint_wrapper(unsigned n, const double* u, double* grad,
                                                     void *constraint_data)
 {
-    return reinterpret_cast<NestedTrajectoryOptimizer *>(constraint_data)->constraint(u, grad);
+    auto optimizer = reinterpret_cast<NestedTrajectoryOptimizer *>(constraint_data);
+
+    if (optimizer->check_cancelled())
+        return 0.0;
+
+    ConstVecMap u_map(u, n);
+    VecMap grad_map(grad, grad == nullptr ? 0 : n);
+
+    return optimizer->constraint(u_map, grad_map);
 }
 
 //----------------------------------------------------------------------------------
@@ -372,6 +755,28 @@ NaiveNestedOptimizer::NaiveNestedOptimizer(unsigned int dim_r, unsigned int dim_
 {
     optimizer_hp_.reset(new TrajectoryOptimizer(dim_h, sub_alg));
     optimizer_rp_.reset(new TrajectoryOptimizer(dim_h, sub_alg));
+
+    // the robot control changes little between evaluations, so do the follower solutions
+    optimizer_hp_->set_warm_start(true);
+    optimizer_rp_->set_warm_start(true);
+
+    flag_implicit_grad_ = true;
+
+    follower_tasks_.emplace_back([this] {
+        optimizer_hp_->optimize(*human_traj_hp_, *robot_traj_, *human_traj_hp_opt_);
+    });
+    follower_tasks_.emplace_back([this] {
+        optimizer_rp_->optimize(*human_traj_rp_, *robot_traj_, *human_traj_rp_opt_);
+    });
+
+    implicit_grad_tasks_.emplace_back([this] {
+        cost_func_subroutine(dynamic_cast<SingleTrajectoryCostHuman*>(human_cost_hp_.get()),
+                             *human_traj_hp_opt_, grad_uh_hp_, implicit_hp_);
+    });
+    implicit_grad_tasks_.emplace_back([this] {
+        cost_func_subroutine(dynamic_cast<SingleTrajectoryCostHuman*>(human_cost_rp_.get()),
+                             *human_traj_rp_opt_, grad_uh_rp_, implicit_rp_);
+    });
 }
 
 //----------------------------------------------------------------------------------
@@ -430,6 +835,25 @@ double NaiveNestedOptimizer::optimize(const Trajectory &robot_traj_init, const T
     human_traj_rp_->x0 = human_traj_rp_init.x0;
     human_traj_rp_->u = human_traj_rp_init.u;
 
+    human_traj_hp_opt_.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
+    human_traj_rp_opt_.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
+
+    // allocate everything the cost evaluations need up front
+    int len_ur = robot_traj_->traj_control_size();
+    int len_uh = human_traj_hp_->traj_control_size();
+
+    workspace_.reserve(Workspace::default_capacity(T));
+    grad_ur_.setZero(len_ur);
+    grad_uh_hp_.setZero(len_uh);
+    grad_uh_rp_.setZero(len_uh);
+
+    implicit_hp_.resize(T, len_uh, len_ur);
+    implicit_rp_.resize(T, len_uh, len_ur);
+
+    // follower optimizations start from the given initial guesses
+    optimizer_hp_->reset_warm_start();
+    optimizer_rp_->reset_warm_start();
+
     // set lower and upper bounds
     std::vector<double> lb;
     std::vector<double> ub;
@@ -459,7 +883,7 @@ double NaiveNestedOptimizer::optimize(const Trajectory &robot_traj_init, const T
 
     // optimizer!
     double min_cost;
-    nlopt::result result = optimizer_.optimize(u_opt, min_cost);
+    nlopt::result result = run_optimizer(u_opt, min_cost);
     std::cout << "result is: " << result << ", min cost is: " << min_cost << std::endl;
 
     // send result back
@@ -470,102 +894,46 @@ double NaiveNestedOptimizer::optimize(const Trajectory &robot_traj_init, const T
 
     // compute "optimal" human trajectory if not null
     if (human_traj_hp_opt != nullptr) {
-        *human_traj_hp_opt = *human_traj_hp_;
-        *human_traj_rp_opt = *human_traj_rp_;
+        *human_traj_hp_opt = *human_traj_hp_opt_;
+        *human_traj_rp_opt = *human_traj_rp_opt_;
     }
 
     return min_cost;
 }
 
 //----------------------------------------------------------------------------------
-double NaiveNestedOptimizer::cost_func(const std::vector<double> &u, std::vector<double> &grad)
+double NaiveNestedOptimizer::cost_func(const ConstVecMap& u, VecMap& grad)
 {
     double cost = 0.0;
 
+    WorkspaceScope scope(workspace_);
+
     // first need to compute the optimal human paths
-    Eigen::Map<const Eigen::VectorXd> ur(u.data(), u.size());
-    robot_traj_->update(ur);
+    robot_traj_->update(u);
     robot_traj_->compute_jacobian();
 
-    int T = human_traj_hp_->horizon();
-    double dt = human_traj_hp_->dt();
-    Trajectory human_traj_hp_opt(CONST_ACC_MODEL, T, dt);
-    Trajectory human_traj_rp_opt(CONST_ACC_MODEL, T, dt);
-
-    // use two parallel threads to run optimization
-    std::thread th1(&TrajectoryOptimizer::optimize, optimizer_hp_.get(), std::ref(*human_traj_hp_),
-                    std::ref(*robot_traj_), std::ref(human_traj_hp_opt));
-    std::thread th2(&TrajectoryOptimizer::optimize, optimizer_rp_.get(), std::ref(*human_traj_rp_),
-                    std::ref(*robot_traj_), std::ref(human_traj_rp_opt));
+    // run the two follower optimizations in parallel
+    run_parallel(follower_tasks_);
 //    optimizer_hp_->optimize(*human_traj_hp_, *robot_traj_, human_traj_hp_opt);
 //    optimizer_rp_->optimize(*human_traj_rp_, *robot_traj_, human_traj_rp_opt);
-    th1.join();
-    th2.join();
 
     neval_nested_hp_ += optimizer_hp_->get_niter();
     neval_nested_rp_ += optimizer_rp_->get_niter();
 
-    *human_traj_hp_ = human_traj_hp_opt;
-    *human_traj_rp_ = human_traj_rp_opt;
-
-    // compute the robot cost and gradients
-    Eigen::VectorXd grad_ur;
-    Eigen::VectorXd grad_uh_hp;
-    Eigen::VectorXd grad_uh_rp;
-
-    cost = robot_cost_->compute(*robot_traj_, human_traj_hp_opt, human_traj_rp_opt, acomm_, tcomm_,
-                                grad_ur, grad_uh_hp, grad_uh_rp);
+    // compute the robot cost and gradients, the robot gradient goes into nlopt's buffer if it is needed
+    VecMap grad_ur(grad.size() > 0 ? grad.data() : grad_ur_.data(), grad_ur_.size());
+    cost = robot_cost_->compute(*robot_traj_, *human_traj_hp_opt_, *human_traj_rp_opt_, acomm_, tcomm_,
+                                grad_ur, grad_uh_hp_, grad_uh_rp_);
 
     robot_cost_->get_partial_cost(cost_hp_, cost_rp_, costs_non_int_);
 
-    // compute the hessians for human cost functions
-//    int len_uh = human_traj_hp_->traj_control_size();
-//    int len_ur = robot_traj_->traj_control_size();
-//    Eigen::MatrixXd hess_uh_hp(len_uh, len_uh);
-//    Eigen::MatrixXd hess_uh_ur_hp(len_uh, len_ur);
-//    Eigen::MatrixXd hess_uh_rp(len_uh, len_uh);
-//    Eigen::MatrixXd hess_uh_ur_rp(len_uh, len_ur);
-//
-    auto cost_hp_cast = dynamic_cast<SingleTrajectoryCostHuman*>(human_cost_hp_.get());
-    auto cost_rp_cast = dynamic_cast<SingleTrajectoryCostHuman*>(human_cost_rp_.get());
-//
-//    cost_hp_cast->hessian_uh(*robot_traj_, human_traj_hp_opt, hess_uh_hp);
-//    cost_hp_cast->hessian_uh_ur(*robot_traj_, human_traj_hp_opt, hess_uh_ur_hp);
-//    cost_rp_cast->hessian_uh(*robot_traj_, human_traj_rp_opt, hess_uh_rp);
-//    cost_rp_cast->hessian_uh_ur(*robot_traj_, human_traj_rp_opt, hess_uh_ur_rp);
-//
-//    // compute the full gradient of ur
-//    Eigen::VectorXd sol_hp = hess_uh_hp.colPivHouseholderQr().solve(grad_uh_hp);
-//    Eigen::VectorXd sol_rp = hess_uh_rp.colPivHouseholderQr().solve(grad_uh_rp);
-//
-//    Eigen::VectorXd grad_inc = hess_uh_ur_hp.transpose() * sol_hp + hess_uh_ur_rp.transpose() * sol_rp;
-//
-//    grad_ur -= grad_inc;
-
-    Eigen::VectorXd sub_grad_hp;
-    Eigen::VectorXd sub_grad_rp;
-
-    std::thread th_hp(&NaiveNestedOptimizer::cost_func_subroutine, this, std::ref(cost_hp_cast),
-                      std::ref(human_traj_hp_opt), std::ref(grad_uh_hp), std::ref(sub_grad_hp));
-    std::thread th_rp(&NaiveNestedOptimizer::cost_func_subroutine, this, std::ref(cost_rp_cast),
-                      std::ref(human_traj_rp_opt), std::ref(grad_uh_rp), std::ref(sub_grad_rp));
-    th_hp.join();
-    th_rp.join();
-
-    grad_ur -= sub_grad_hp + sub_grad_rp;
-
-
-//    std::cout << "-------------" << std::endl;
-//    std::cout << grad_inc.transpose() << std::endl;
-//    std::cout << "-------------" << std::endl;
-//    std::cout << hess_uh_ur_hp << std::endl;
-//    std::cout << "-------------" << std::endl;
-//    std::cout << hess_uh_ur_rp << std::endl;
-//    std::cout << "-------------" << std::endl;
-//    grad_ur -= hess_uh_ur_hp.transpose() * hess_uh_hp.colPivHouseholderQr().solve(grad_uh_hp)
-//               + hess_uh_ur_rp.transpose() * hess_uh_rp.colPivHouseholderQr().solve(grad_uh_rp);
-
-    utils::EigenToVector(grad_ur, grad);
+    // account for the follower responses with the implicit function theorem
+    // grad_ur -= hess_uh_ur^T * hess_uh^-1 * grad_uh, for both followers
+    // only needed when nlopt asks for the gradient
+    if (grad.size() > 0 && flag_implicit_grad_) {
+        run_parallel(implicit_grad_tasks_);
+        grad -= implicit_hp_.sub_grad + implicit_rp_.sub_grad;
+    }
 
 //    static int counter = 0;
 //    ++counter;
@@ -578,19 +946,577 @@ double NaiveNestedOptimizer::cost_func(const std::vector<double> &u, std::vector
 }
 
 //----------------------------------------------------------------------------------
-void NaiveNestedOptimizer::cost_func_subroutine(SingleTrajectoryCostHuman *&cost, const Trajectory& human_traj,
-                                                const Eigen::VectorXd &grad_uh, Eigen::VectorXd &sub_grad)
+MultiHumanNestedOptimizer::MultiHumanNestedOptimizer(unsigned int dim_r, unsigned int dim_h, int max_humans,
+                                                     const nlopt::algorithm &alg, const nlopt::algorithm &sub_alg):
+        NestedOptimizerBase(dim_r, alg), flag_implicit_grad_(true), dim_h_(dim_h), sub_alg_(sub_alg),
+        n_humans_(0), n_humans_best_(0)
 {
-    int len_uh = human_traj_hp_->traj_control_size();
+    if (max_humans < 1)
+        throw "Multi-human optimizer needs at least one human!";
+
+    humans_.resize(static_cast<std::size_t>(max_humans));
+    for (auto& human: humans_) {
+        human.optimizer_hp.reset(new TrajectoryOptimizer(dim_h, sub_alg));
+        human.optimizer_rp.reset(new TrajectoryOptimizer(dim_h, sub_alg));
+
+        human.optimizer_hp->set_warm_start(true);
+        human.optimizer_rp->set_warm_start(true);
+
+        human.uh_hp_best.setZero(dim_h);
+        human.uh_rp_best.setZero(dim_h);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_robot_cost(const std::shared_ptr<ProbabilisticCostMultiHuman> &cost)
+{
+    robot_cost_ = cost;
+    robot_cost_multi_ = cost;
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_human_cost(int k, const std::shared_ptr<SingleTrajectoryCostHuman> &cost_hp,
+                                               const std::shared_ptr<SingleTrajectoryCostHuman> &cost_rp)
+{
+    HumanSlot& human = humans_[k];
+    human.cost_hp = cost_hp;
+    human.cost_rp = cost_rp;
+    human.optimizer_hp->set_cost_function(cost_hp);
+    human.optimizer_rp->set_cost_function(cost_rp);
+
+    if (!levels_.empty())
+        human.create_hypotheses(levels_, dim_h_, sub_alg_);
+
+    if (k == 0) {
+        human_cost_hp_ = cost_hp;
+        human_cost_rp_ = cost_rp;
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_intent_levels(const std::vector<double> &levels)
+{
+    levels_ = levels;
+
+    // humans without costs get their hypotheses with the costs
+    for (auto& human: humans_) {
+        if (human.cost_hp)
+            human.create_hypotheses(levels_, dim_h_, sub_alg_);
+        else
+            human.hypotheses.clear();
+    }
+
+    // the tasks refer to the old hypotheses
+    n_humans_ = 0;
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::HumanSlot::create_hypotheses(const std::vector<double> &levels, unsigned int dim_h,
+                                                            const nlopt::algorithm &alg)
+{
+    hypotheses.clear();
+    hypotheses.resize(levels.size());
+
+    for (int m = 0; m < levels.size(); ++m) {
+        Hypothesis& hypothesis = hypotheses[m];
+        hypothesis.cost = std::make_shared<InterpolatedHumanCost>(cost_hp, cost_rp, levels[m]);
+        hypothesis.optimizer.reset(new TrajectoryOptimizer(dim_h, alg));
+        hypothesis.optimizer->set_cost_function(hypothesis.cost);
+        hypothesis.optimizer->set_warm_start(true);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_human_cost(LinearCost *cost_hp, LinearCost *cost_rp)
+{
+    set_human_cost(std::shared_ptr<LinearCost>(cost_hp), std::shared_ptr<LinearCost>(cost_rp));
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_human_cost(const std::shared_ptr<LinearCost> &cost_hp,
+                                               const std::shared_ptr<LinearCost> &cost_rp)
+{
+    auto single_cost_hp = std::dynamic_pointer_cast<SingleTrajectoryCostHuman>(cost_hp);
+    auto single_cost_rp = std::dynamic_pointer_cast<SingleTrajectoryCostHuman>(cost_rp);
+
+    if (!single_cost_hp || !single_cost_rp)
+        throw "Multi-human optimizer needs human costs of type SingleTrajectoryCostHuman!";
+
+    set_human_cost(0, single_cost_hp, single_cost_rp);
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_bounds(const Eigen::VectorXd &lb_ur, const Eigen::VectorXd &ub_ur,
+                                           const Eigen::VectorXd &lb_uh, const Eigen::VectorXd &ub_uh)
+{
+    lb_ur_ = lb_ur;
+    ub_ur_ = ub_ur;
+
+    for (auto& human: humans_) {
+        human.optimizer_hp->set_bounds(lb_uh, ub_uh);
+        human.optimizer_rp->set_bounds(lb_uh, ub_uh);
+        for (auto& hypothesis: human.hypotheses)
+            hypothesis.optimizer->set_bounds(lb_uh, ub_uh);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_time_limit(const double t_max)
+{
+    optimizer_.set_maxtime(t_max);
+
+    // same heuristic as the naive nested optimizer, the followers of different humans run in parallel
+    for (auto& human: humans_) {
+        human.optimizer_hp->set_time_limit(t_max * 0.08);
+        human.optimizer_rp->set_time_limit(t_max * 0.08);
+        for (auto& hypothesis: human.hypotheses)
+            hypothesis.optimizer->set_time_limit(t_max * 0.08);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_gradient_mode(GradientMode mode)
+{
+    grad_mode_ = mode;
+
+    for (auto& human: humans_) {
+        human.optimizer_hp->set_gradient_mode(mode);
+        human.optimizer_rp->set_gradient_mode(mode);
+        for (auto& hypothesis: human.hypotheses)
+            hypothesis.optimizer->set_gradient_mode(mode);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_follower_grad_tol(const double grad_tol)
+{
+    for (auto& human: humans_) {
+        human.optimizer_hp->set_grad_tol(grad_tol);
+        human.optimizer_rp->set_grad_tol(grad_tol);
+        for (auto& hypothesis: human.hypotheses)
+            hypothesis.optimizer->set_grad_tol(grad_tol);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_follower_max_iter(const int max_iter)
+{
+    for (auto& human: humans_) {
+        human.optimizer_hp->set_max_iter(max_iter);
+        human.optimizer_rp->set_max_iter(max_iter);
+        for (auto& hypothesis: human.hypotheses)
+            hypothesis.optimizer->set_max_iter(max_iter);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_follower_warm_start(const bool flag_warm_start)
+{
+    for (auto& human: humans_) {
+        human.optimizer_hp->set_warm_start(flag_warm_start);
+        human.optimizer_rp->set_warm_start(flag_warm_start);
+        for (auto& hypothesis: human.hypotheses)
+            hypothesis.optimizer->set_warm_start(flag_warm_start);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_follower_solver(TrajectorySolver solver)
+{
+    for (auto& human: humans_) {
+        human.optimizer_hp->set_solver(solver);
+        human.optimizer_rp->set_solver(solver);
+        for (auto& hypothesis: human.hypotheses)
+            hypothesis.optimizer->set_solver(solver);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::set_cancellation_token(std::shared_ptr<const CancellationToken> cancel_token)
+{
+    for (auto& human: humans_) {
+        human.optimizer_hp->set_cancellation_token(cancel_token);
+        human.optimizer_rp->set_cancellation_token(cancel_token);
+        for (auto& hypothesis: human.hypotheses)
+            hypothesis.optimizer->set_cancellation_token(cancel_token);
+    }
+
+    cancel_token_ = std::move(cancel_token);
+}
+
+//----------------------------------------------------------------------------------
+double MultiHumanNestedOptimizer::optimize(const Trajectory &robot_traj_init,
+                                           const std::vector<Trajectory> &human_trajs_hp_init,
+                                           const std::vector<Trajectory> &human_trajs_rp_init, int acomm,
+                                           double tcomm, Trajectory &robot_traj_opt,
+                                           std::vector<Trajectory> *human_trajs_hp_opt,
+                                           std::vector<Trajectory> *human_trajs_rp_opt)
+{
+    int K = static_cast<int>(human_trajs_hp_init.size());
+    if (K < 1 || K > max_humans() || (int) human_trajs_rp_init.size() != K)
+        throw "Invalid number of humans!";
+
+    // set communication action
+    acomm_ = acomm;
+    tcomm_ = tcomm;
+
+    // recreate the trajectory objects with trajectory data
+    int T = robot_traj_init.horizon();
+    double dt = robot_traj_init.dt();
+    robot_traj_.reset(new Trajectory(DIFFERENTIAL_MODEL, T, dt));
+    robot_traj_->x0 = robot_traj_init.x0;
+
     int len_ur = robot_traj_->traj_control_size();
-    Eigen::MatrixXd hess_uh(len_uh, len_uh);
-    Eigen::MatrixXd hess_uh_ur(len_uh, len_ur);
+    int len_uh = human_trajs_hp_init[0].traj_control_size();
+
+    for (int k = 0; k < K; ++k) {
+        HumanSlot& human = humans_[k];
+
+        human.traj_hp.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
+        human.traj_hp->x0 = human_trajs_hp_init[k].x0;
+        human.traj_hp->u = human_trajs_hp_init[k].u;
+
+        human.traj_rp.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
+        human.traj_rp->x0 = human_trajs_rp_init[k].x0;
+        human.traj_rp->u = human_trajs_rp_init[k].u;
+
+        human.traj_hp_opt.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
+        human.traj_rp_opt.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
+
+        human.implicit_hp.resize(T, len_uh, len_ur);
+        human.implicit_rp.resize(T, len_uh, len_ur);
+
+        // follower optimizations start from the given initial guesses
+        human.optimizer_hp->reset_warm_start();
+        human.optimizer_rp->reset_warm_start();
+
+        for (auto& hypothesis: human.hypotheses) {
+            double level = hypothesis.cost->level();
+
+            hypothesis.traj.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
+            hypothesis.traj->x0 = human_trajs_hp_init[k].x0;
+            hypothesis.traj->u = level * human_trajs_hp_init[k].u + (1.0 - level) * human_trajs_rp_init[k].u;
+
+            hypothesis.traj_opt.reset(new Trajectory(CONST_ACC_MODEL, T, dt));
+            hypothesis.implicit.resize(T, len_uh, len_ur);
+            hypothesis.optimizer->reset_warm_start();
+        }
+    }
+
+    if (K != n_humans_)
+        create_tasks(K);
+
+    int M = static_cast<int>(levels_.size());
+    human_trajs_hp_opt_.resize(K);
+    human_trajs_rp_opt_.resize(K);
+    human_trajs_mid_opt_.resize(M * K);
+    for (int k = 0; k < K; ++k) {
+        human_trajs_hp_opt_[k] = humans_[k].traj_hp_opt.get();
+        human_trajs_rp_opt_[k] = humans_[k].traj_rp_opt.get();
+        for (int m = 0; m < M; ++m)
+            human_trajs_mid_opt_[m * K + k] = humans_[k].hypotheses[m].traj_opt.get();
+    }
+
+    // allocate everything the cost evaluations need up front
+    // the interactive jacobians of the robot cost grow with the number of humans and intents
+    workspace_.reserve(Workspace::default_capacity(T) + (2 + M) * K * T * (len_ur + len_uh + 4));
+    grad_ur_.setZero(len_ur);
+    grad_uh_hp_multi_.setZero(len_uh, K);
+    grad_uh_rp_multi_.setZero(len_uh, K);
+    grad_uh_mid_multi_.setZero(len_uh, M * K);
+
+    // set lower and upper bounds
+    std::vector<double> lb;
+    std::vector<double> ub;
+
+    utils::EigenToVector(lb_ur_, lb);
+    utils::EigenToVector(ub_ur_, ub);
+
+    optimizer_.set_lower_bounds(lb);
+    optimizer_.set_upper_bounds(ub);
+
+    // set cost function
+    optimizer_.set_min_objective(cost_wrapper, this);
+
+    // set tolerance
+    optimizer_.set_xtol_abs(1e-2);
+
+    // initial condition
+    std::vector<double> u_opt;
+    utils::EigenToVector(robot_traj_init.u, u_opt);
 
-    cost->hessian_uh(*robot_traj_, human_traj, hess_uh);
-    cost->hessian_uh_ur(*robot_traj_, human_traj, hess_uh_ur);
+    neval_nested_hp_ = 0;
+    neval_nested_rp_ = 0;
+
+    // optimizer!
+    double min_cost;
+    run_optimizer(u_opt, min_cost);
+
+    // send result back
+    robot_traj_opt.x0 = robot_traj_init.x0;
+    robot_traj_opt.u = Eigen::Map<Eigen::VectorXd>(u_opt.data(), u_opt.size());
+
+    robot_traj_opt.compute();
+
+    // "optimal" human trajectories if requested
+    if (human_trajs_hp_opt != nullptr) {
+        human_trajs_hp_opt->clear();
+        human_trajs_rp_opt->clear();
+        for (int k = 0; k < K; ++k) {
+            human_trajs_hp_opt->push_back(*humans_[k].traj_hp_opt);
+            human_trajs_rp_opt->push_back(*humans_[k].traj_rp_opt);
+        }
+    }
+
+    return min_cost;
+}
+
+//----------------------------------------------------------------------------------
+bool MultiHumanNestedOptimizer::get_best_iterate(Trajectory &robot_traj, std::vector<Trajectory> &human_trajs_hp,
+                                                 std::vector<Trajectory> &human_trajs_rp, double &cost)
+{
+    {
+        std::lock_guard<std::mutex> lock(best_mutex_);
+        if (!flag_has_best_)
+            return false;
+
+        cost = cost_best_;
+        robot_traj.x0 = xr0_best_;
+        robot_traj.u = u_best_;
+
+        human_trajs_hp.resize(n_humans_best_);
+        human_trajs_rp.resize(n_humans_best_);
+        for (int k = 0; k < n_humans_best_; ++k) {
+            human_trajs_hp[k].x0 = humans_[k].xh0_best;
+            human_trajs_hp[k].u = humans_[k].uh_hp_best;
+            human_trajs_rp[k].x0 = humans_[k].xh0_best;
+            human_trajs_rp[k].u = humans_[k].uh_rp_best;
+        }
+    }
+
+    // roll out without holding the lock
+    robot_traj.compute();
+    for (int k = 0; k < (int) human_trajs_hp.size(); ++k) {
+        human_trajs_hp[k].compute();
+        human_trajs_rp[k].compute();
+    }
 
-    Eigen::VectorXd sol = hess_uh.colPivHouseholderQr().solve(grad_uh);
-    sub_grad = hess_uh_ur.transpose() * sol;
+    return true;
+}
+
+//----------------------------------------------------------------------------------
+double MultiHumanNestedOptimizer::optimize(const Trajectory &robot_traj_init, const Trajectory &human_traj_hp_init,
+                                           const Trajectory &human_traj_rp_init, int acomm, double tcomm,
+                                           Trajectory &robot_traj_opt, Trajectory *human_traj_hp_opt,
+                                           Trajectory *human_traj_rp_opt)
+{
+    std::vector<Trajectory> human_trajs_hp_init(1, human_traj_hp_init);
+    std::vector<Trajectory> human_trajs_rp_init(1, human_traj_rp_init);
+
+    if (human_traj_hp_opt == nullptr)
+        return optimize(robot_traj_init, human_trajs_hp_init, human_trajs_rp_init, acomm, tcomm, robot_traj_opt);
+
+    std::vector<Trajectory> human_trajs_hp_opt;
+    std::vector<Trajectory> human_trajs_rp_opt;
+    double min_cost = optimize(robot_traj_init, human_trajs_hp_init, human_trajs_rp_init, acomm, tcomm,
+                               robot_traj_opt, &human_trajs_hp_opt, &human_trajs_rp_opt);
+
+    *human_traj_hp_opt = human_trajs_hp_opt[0];
+    *human_traj_rp_opt = human_trajs_rp_opt[0];
+
+    return min_cost;
+}
+
+//----------------------------------------------------------------------------------
+double MultiHumanNestedOptimizer::evaluate_cost(const Trajectory &robot_traj,
+                                                const std::vector<Trajectory> &human_trajs_hp,
+                                                const std::vector<Trajectory> &human_trajs_rp, int acomm,
+                                                double tcomm)
+{
+    int K = static_cast<int>(human_trajs_hp.size());
+    if (K < 1 || K > max_humans() || (int) human_trajs_rp.size() != K)
+        throw "Invalid number of humans!";
+
+    int T = robot_traj.horizon();
+    int len_ur = robot_traj.traj_control_size();
+    int len_uh = human_trajs_hp[0].traj_control_size();
+
+    int M = static_cast<int>(levels_.size());
+    workspace_.reserve(Workspace::default_capacity(T) + (2 + M) * K * T * (len_ur + len_uh + 4));
+    WorkspaceScope scope(workspace_);
+
+    std::vector<const Trajectory*> trajs_hp;
+    std::vector<const Trajectory*> trajs_rp;
+    for (int k = 0; k < K; ++k) {
+        trajs_hp.push_back(&human_trajs_hp[k]);
+        trajs_rp.push_back(&human_trajs_rp[k]);
+    }
+
+    // the intermediate intents respond with the hp and rp responses interpolated by level
+    std::vector<Trajectory> human_trajs_mid;
+    std::vector<const Trajectory*> trajs_mid;
+    human_trajs_mid.reserve(M * K);
+    for (int m = 0; m < M; ++m) {
+        for (int k = 0; k < K; ++k) {
+            human_trajs_mid.emplace_back(CONST_ACC_MODEL, T, robot_traj.dt());
+            human_trajs_mid.back().update(human_trajs_hp[k].x0,
+                                          levels_[m] * human_trajs_hp[k].u + (1.0 - levels_[m]) * human_trajs_rp[k].u);
+            human_trajs_mid.back().compute_jacobian();
+            trajs_mid.push_back(&human_trajs_mid.back());
+        }
+    }
+
+    // the cost also computes the gradients
+    Scratch<Eigen::VectorXd> grad_ur(len_ur);
+    Scratch<Eigen::MatrixXd> grad_hp(len_uh, K);
+    Scratch<Eigen::MatrixXd> grad_rp(len_uh, K);
+    Scratch<Eigen::MatrixXd> grad_mid(len_uh, M * K);
+
+    return robot_cost_multi_->compute(robot_traj, trajs_hp, trajs_rp, trajs_mid, acomm, tcomm,
+                                      grad_ur, grad_hp, grad_rp, grad_mid);
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::create_tasks(int n_humans)
+{
+    follower_tasks_.clear();
+    implicit_grad_tasks_.clear();
+
+    // the followers of the same human next to each other, so a small pool still groups them
+    for (int k = 0; k < n_humans; ++k) {
+        HumanSlot* human = &humans_[k];
+
+        follower_tasks_.emplace_back([this, human] {
+            human->optimizer_hp->optimize(*human->traj_hp, *robot_traj_, *human->traj_hp_opt);
+        });
+        follower_tasks_.emplace_back([this, human] {
+            human->optimizer_rp->optimize(*human->traj_rp, *robot_traj_, *human->traj_rp_opt);
+        });
+        for (auto& hypothesis: human->hypotheses) {
+            HumanSlot::Hypothesis* h = &hypothesis;
+            follower_tasks_.emplace_back([this, h] {
+                h->optimizer->optimize(*h->traj, *robot_traj_, *h->traj_opt);
+            });
+        }
+
+        implicit_grad_tasks_.emplace_back([this, human, k] {
+            cost_func_subroutine(human->cost_hp.get(), *human->traj_hp_opt, grad_uh_hp_multi_.col(k),
+                                 human->implicit_hp);
+        });
+        implicit_grad_tasks_.emplace_back([this, human, k] {
+            cost_func_subroutine(human->cost_rp.get(), *human->traj_rp_opt, grad_uh_rp_multi_.col(k),
+                                 human->implicit_rp);
+        });
+        for (int m = 0; m < human->hypotheses.size(); ++m) {
+            HumanSlot::Hypothesis* h = &human->hypotheses[m];
+            int col = m * n_humans + k;
+            implicit_grad_tasks_.emplace_back([this, h, col] {
+                cost_func_subroutine(h->cost.get(), *h->traj_opt, grad_uh_mid_multi_.col(col), h->implicit);
+            });
+        }
+    }
+
+    n_humans_ = n_humans;
+}
+
+//----------------------------------------------------------------------------------
+double MultiHumanNestedOptimizer::cost_func(const ConstVecMap &u, VecMap &grad)
+{
+    WorkspaceScope scope(workspace_);
+
+    // first need to compute the optimal human paths
+    robot_traj_->update(u);
+    robot_traj_->compute_jacobian();
+
+    // all follower optimizations at once
+    run_parallel(follower_tasks_);
+
+    for (int k = 0; k < n_humans_; ++k) {
+        neval_nested_hp_ += humans_[k].optimizer_hp->get_niter();
+        neval_nested_rp_ += humans_[k].optimizer_rp->get_niter();
+    }
+
+    // the robot cost evaluates the interactive features of all humans in one batch
+    VecMap grad_ur(grad.size() > 0 ? grad.data() : grad_ur_.data(), grad_ur_.size());
+    double cost = robot_cost_multi_->compute(*robot_traj_, human_trajs_hp_opt_, human_trajs_rp_opt_,
+                                             human_trajs_mid_opt_, acomm_, tcomm_, grad_ur,
+                                             grad_uh_hp_multi_, grad_uh_rp_multi_, grad_uh_mid_multi_);
+
+    robot_cost_multi_->get_partial_cost(cost_hp_, cost_rp_, costs_non_int_);
+
+    // implicit gradients of all followers, only needed when nlopt asks for the gradient
+    if (grad.size() > 0 && flag_implicit_grad_) {
+        run_parallel(implicit_grad_tasks_);
+
+        for (int k = 0; k < n_humans_; ++k) {
+            grad -= humans_[k].implicit_hp.sub_grad + humans_[k].implicit_rp.sub_grad;
+            for (auto& hypothesis: humans_[k].hypotheses)
+                grad -= hypothesis.implicit.sub_grad;
+        }
+    }
+
+    return cost;
+}
+
+//----------------------------------------------------------------------------------
+void MultiHumanNestedOptimizer::save_best_iterate()
+{
+    n_humans_best_ = n_humans_;
+    xr0_best_ = robot_traj_->x0;
+    for (int k = 0; k < n_humans_; ++k) {
+        humans_[k].xh0_best = humans_[k].traj_hp->x0;
+        humans_[k].uh_hp_best = humans_[k].traj_hp_opt->u;
+        humans_[k].uh_rp_best = humans_[k].traj_rp_opt->u;
+    }
+}
+
+//----------------------------------------------------------------------------------
+MultiStartMonitor::MultiStartMonitor(int n_seeds, double ratio, int min_evals):
+        ratio_(ratio), min_evals_(min_evals)
+{
+    if (n_seeds < 1)
+        throw "Multi-start needs at least one seed!";
+
+    costs_best_.resize(static_cast<unsigned long>(n_seeds));
+    n_evals_.resize(static_cast<unsigned long>(n_seeds));
+    reset();
+}
+
+//----------------------------------------------------------------------------------
+void MultiStartMonitor::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::fill(costs_best_.begin(), costs_best_.end(), std::numeric_limits<double>::infinity());
+    std::fill(n_evals_.begin(), n_evals_.end(), 0);
+}
+
+//----------------------------------------------------------------------------------
+bool MultiStartMonitor::update(int s, double cost)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // nan costs don't count as progress
+    if (cost < costs_best_[s])
+        costs_best_[s] = cost;
+    ++n_evals_[s];
+
+    if (n_evals_[s] < min_evals_)
+        return true;
+
+    double cost_min = *std::min_element(costs_best_.begin(), costs_best_.end());
+    if (std::isinf(cost_min))
+        return true;
+
+    return costs_best_[s] - cost_min <= ratio_ * std::abs(cost_min);
+}
+
+//----------------------------------------------------------------------------------
+NestedOptimizerBase::ProgressCallback MultiStartMonitor::callback(int s)
+{
+    return [this, s](double cost) {
+        return update(s, cost);
+    };
 }
 
-} // namespace
\ No newline at end of file
+} // namespace
@@ -3,15 +3,17 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/24/2018
-// Last revision: 4/23/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
 //----------------------------------------------------------------------------------
 
 #include <string>
+#include <algorithm>
 #include <ctime>
 #include <chrono>
+#include <limits>
 
 #include "hri_planner/planner.h"
 
@@ -46,6 +48,10 @@ PlannerBase::PlannerBase(ros::NodeHandle &nh, ros::NodeHandle &pnh): nh_(nh) {
     xr_meas_.setZero(nXr_);
     ur_meas_.setZero(nUr_);
     xh_meas_.setZero(nXh_);
+    xh_meas_all_.assign(1, xh_meas_);
+    human_ids_meas_.assign(1, 0);
+
+    cancel_token_ = std::make_shared<CancellationToken>();
 };
 
 //----------------------------------------------------------------------------------
@@ -128,6 +134,30 @@ void PlannerBase::generate_steer_posq(const Eigen::VectorXd &x0, const Eigen::Ve
     }
 }
 
+//----------------------------------------------------------------------------------
+void PlannerBase::generate_steer_posq(const Eigen::VectorXd &x0, const Eigen::VectorXd &x_via,
+                                      const Eigen::VectorXd &x_goal, double r_via, Eigen::VectorXd &ur)
+{
+    Eigen::VectorXd xr(T_ * nXr_);
+    ur.resize(T_ * nUr_);
+
+    DifferentialDynamics dyn(dt_);
+
+    Eigen::VectorXd x_last = x0;
+    Eigen::VectorXd u(nUr_);
+    bool via_reached = false;
+    for (int t = 0; t < T_; ++t) {
+        if (!via_reached && (x_via - x_last.head(2)).norm() < r_via)
+            via_reached = true;
+
+        compute_steer_posq(x_last, via_reached ? x_goal : x_via, u);
+        ur.segment(t*nUr_, nUr_) = u;
+
+        dyn.forward_dyn(x_last, u, xr.segment(t*nXr_, nXr_));
+        x_last = xr.segment(t*nXr_, nXr_);
+    }
+}
+
 //----------------------------------------------------------------------------------
 void PlannerBase::generate_steer_acc(const Eigen::VectorXd &x0, const Eigen::VectorXd &x_goal, Eigen::VectorXd &uh)
 {
@@ -166,6 +196,32 @@ Planner::Planner(ros::NodeHandle &nh, ros::NodeHandle &pnh): PlannerBase(nh, pnh
     // communication cost
     ros::param::param<double>("~planner/comm_cost", comm_cost_, 5.0);
 
+    // worker threads shared by the two optimizers and their follower optimizations
+    int n_workers;
+    int queue_capacity;
+    bool pin_workers;
+    ros::param::param<int>("~planner/thread_pool/n_workers", n_workers, 3);
+    ros::param::param<int>("~planner/thread_pool/queue_capacity", queue_capacity, 16);
+    ros::param::param<bool>("~planner/thread_pool/pin_workers", pin_workers, false);
+
+    thread_pool_ = std::make_shared<ThreadPool>(n_workers, queue_capacity, pin_workers);
+
+    // number of humans the optimizers are created for, each gets a belief model and follower optimizations
+    ros::param::param<int>("~planner/max_humans", max_humans_, 1);
+    max_humans_ = std::max(max_humans_, 1);
+    n_humans_ = 1;
+    human_ids_.assign(1, 0);
+
+    // intermediate intents, each adds one follower optimization per human
+    intent_levels_.clear();
+    ros::param::get("~planner/intent_levels", intent_levels_);
+
+    // seeds of the multi-start optimization, in order: the ranked initial guess, the steer law,
+    // detours on the left and right of the human, and stopping
+    ros::param::param<int>("~planner/multi_start/n_seeds", n_seeds_, 1);
+    ros::param::param<double>("~planner/multi_start/detour_offset", detour_offset_, 1.0);
+    n_seeds_ = utils::clamp(n_seeds_, 1, 5);
+
     // create two copies of optimizer for parallel computing
     create_optimizer();
 
@@ -175,12 +231,24 @@ Planner::Planner(ros::NodeHandle &nh, ros::NodeHandle &pnh): PlannerBase(nh, pnh
 
     // initialize the optimal trajectory
     robot_traj_opt_ = Trajectory(DIFFERENTIAL_MODEL, T_, dt_);
-    human_traj_hp_opt_ = Trajectory(CONST_ACC_MODEL, T_, dt_);
-    human_traj_rp_opt_ = Trajectory(CONST_ACC_MODEL, T_, dt_);
+    human_trajs_hp_opt_.assign(1, Trajectory(CONST_ACC_MODEL, T_, dt_));
+    human_trajs_rp_opt_.assign(1, Trajectory(CONST_ACC_MODEL, T_, dt_));
 
     robot_traj_init_ = Trajectory(DIFFERENTIAL_MODEL, T_, dt_);
-    human_traj_hp_init_ = Trajectory(CONST_ACC_MODEL, T_, dt_);
-    human_traj_rp_init_ = Trajectory(CONST_ACC_MODEL, T_, dt_);
+    human_trajs_hp_init_.assign(1, Trajectory(CONST_ACC_MODEL, T_, dt_));
+    human_trajs_rp_init_.assign(1, Trajectory(CONST_ACC_MODEL, T_, dt_));
+
+    // number of recent plans kept as initial guesses
+    int n_warm_start;
+    ros::param::param<int>("~planner/warm_start/n_plans", n_warm_start, 3);
+    warm_start_ = WarmStartCache(std::max(n_warm_start, 1));
+    robot_traj_cand_ = Trajectory(DIFFERENTIAL_MODEL, T_, dt_);
+
+    init_guess_age_ = -1;
+    niter_no_comm_ = 0;
+    niter_comm_ = 0;
+    seed_no_comm_ = 0;
+    seed_comm_ = 0;
 
     // flags
     ros::param::param<bool>("~planner/publish_full_plan", flag_publish_full_plan_, false);
@@ -218,7 +286,8 @@ void Planner::create_belief_model(std::shared_ptr<BeliefModelBase> &belief_model
 
 //----------------------------------------------------------------------------------
 void Planner::create_human_costs(std::vector<std::shared_ptr<SingleTrajectoryCostHuman> > &single_cost_hp,
-                                 std::vector<std::shared_ptr<SingleTrajectoryCostHuman> > &single_cost_rp, int n)
+                                 std::vector<std::shared_ptr<SingleTrajectoryCostHuman> > &single_cost_rp, int n,
+                                 const std::string& suffix)
 {
     std::vector<std::shared_ptr<FeatureBase> > features_hp;
     std::vector<std::shared_ptr<FeatureBase> > features_rp;
@@ -253,7 +322,7 @@ void Planner::create_human_costs(std::vector<std::shared_ptr<SingleTrajectoryCos
 
             // add to feature and weight list
             std::shared_ptr<FeatureBase> feature = FeatureHumanCost::create(feature_name, args);
-            features_human_.insert({feature_name + "_" + type_str, feature});
+            features_human_.insert({feature_name + "_" + type_str + suffix, feature});
 
             if (type == HumanPriority) {
                 features_hp.push_back(feature);
@@ -271,14 +340,35 @@ void Planner::create_human_costs(std::vector<std::shared_ptr<SingleTrajectoryCos
 //    human_cost_rp = std::make_shared<HumanCost>(weights_rp, features_rp);
 //    single_cost_hp = std::make_shared<SingleTrajectoryCostHuman>(weights_hp, features_hp);
 //    single_cost_rp = std::make_shared<SingleTrajectoryCostHuman>(weights_rp, features_rp);
+
+    // use the compile-time version if the feature list matches one
+    bool use_static_features;
+    ros::param::param<bool>("~human_cost/use_static_features", use_static_features, true);
+
     for (int i = 0; i < n; ++i) {
-        single_cost_hp.push_back(std::make_shared<SingleTrajectoryCostHuman>(weights_hp, features_hp));
-        single_cost_rp.push_back(std::make_shared<SingleTrajectoryCostHuman>(weights_rp, features_rp));
+        std::shared_ptr<SingleTrajectoryCostHuman> cost_hp;
+        std::shared_ptr<SingleTrajectoryCostHuman> cost_rp;
+
+        if (use_static_features) {
+            cost_hp = create_static_human_cost(weights_hp, features_hp);
+            cost_rp = create_static_human_cost(weights_rp, features_rp);
+        }
+
+        if (i == 0)
+            ROS_INFO("static human costs: hp %d, rp %d", (bool) cost_hp, (bool) cost_rp);
+
+        if (!cost_hp)
+            cost_hp = std::make_shared<SingleTrajectoryCostHuman>(weights_hp, features_hp);
+        if (!cost_rp)
+            cost_rp = std::make_shared<SingleTrajectoryCostHuman>(weights_rp, features_rp);
+
+        single_cost_hp.push_back(cost_hp);
+        single_cost_rp.push_back(cost_rp);
     }
 }
 
 //----------------------------------------------------------------------------------
-void Planner::create_robot_costs(std::vector<std::shared_ptr<ProbabilisticCostBase> >& robot_cost,
+void Planner::create_robot_costs(std::vector<std::shared_ptr<ProbabilisticCostMultiHuman> >& robot_cost,
                                  int n, const std::string& ns)
 {
     std::vector<std::shared_ptr<FeatureBase> > f_non_int;
@@ -286,6 +376,10 @@ void Planner::create_robot_costs(std::vector<std::shared_ptr<ProbabilisticCostBa
     std::vector<double> w_non_int;
     std::vector<double> w_int;
 
+    // interactive features with per-human data, one copy for each human
+    std::vector<std::vector<std::shared_ptr<FeatureVectorizedBase> > > f_int_human(max_humans_);
+    std::vector<double> w_int_human;
+
     // clear the features map first
     features_robot_.clear();
     features_robot_int_.clear();
@@ -344,19 +438,37 @@ void Planner::create_robot_costs(std::vector<std::shared_ptr<ProbabilisticCostBa
         std::shared_ptr<FeatureVectorizedBase> feature = FeatureVectorizedBase::create(feature_name, args);
         features_robot_int_.insert({feature_name, feature});
 
-        f_int.push_back(feature);
-        w_int.push_back(w);
+        // the human goal differs between humans, the other features are evaluated for all humans in one batch
+        if (feature_name == "HumanGoal") {
+            f_int_human[0].push_back(feature);
+            for (int k = 1; k < max_humans_; ++k) {
+                std::shared_ptr<FeatureVectorizedBase> feature_k = FeatureVectorizedBase::create(feature_name, args);
+                features_robot_int_.insert({feature_name + "_" + std::to_string(k), feature_k});
+                f_int_human[k].push_back(feature_k);
+            }
+            w_int_human.push_back(w);
+        }
+        else {
+            f_int.push_back(feature);
+            w_int.push_back(w);
+        }
     }
 
-    // create a belief model
-    create_belief_model(belief_model_);
-    ROS_INFO("Belief model created...");
+    // create a belief model for each human
+    belief_models_.resize(max_humans_);
+    for (auto& belief_model: belief_models_)
+        create_belief_model(belief_model);
+    ROS_INFO("Belief models created...");
 
     // create the robot cost function and set cost features
     for (int i = 0; i < n; ++i) {
-        robot_cost.push_back(std::make_shared<ProbabilisticCostSimplified>(belief_model_));
+        robot_cost.push_back(std::make_shared<ProbabilisticCostMultiHuman>(belief_models_));
         robot_cost[i]->set_features_non_int(w_non_int, f_non_int);
         robot_cost[i]->set_features_int(w_int, f_int);
+        robot_cost[i]->set_intent_levels(intent_levels_);
+
+        for (int k = 0; k < max_humans_; ++k)
+            robot_cost[i]->set_features_int_human(k, w_int_human, f_int_human[k]);
     }
 //    robot_cost = std::make_shared<ProbabilisticCostSimplified>(belief_model_);
 //
@@ -375,15 +487,19 @@ void Planner::create_optimizer()
 //
 //    create_human_costs(human_cost_hp, human_cost_rp, single_cost_hp, single_cost_rp);
 
-    std::vector<std::shared_ptr<SingleTrajectoryCostHuman> > single_cost_hp;
-    std::vector<std::shared_ptr<SingleTrajectoryCostHuman> > single_cost_rp;
-    create_human_costs(single_cost_hp, single_cost_rp, 2);
+    // each human has its own features, the goals are different
+    std::vector<std::vector<std::shared_ptr<SingleTrajectoryCostHuman> > > single_cost_hp(max_humans_);
+    std::vector<std::vector<std::shared_ptr<SingleTrajectoryCostHuman> > > single_cost_rp(max_humans_);
+    for (int k = 0; k < max_humans_; ++k)
+        create_human_costs(single_cost_hp[k], single_cost_rp[k], 2 * n_seeds_,
+                           k == 0 ? "" : "_" + std::to_string(k));
 
     ROS_INFO("Human cost func created...");
 
     // create the robot cost functions
-    std::vector<std::shared_ptr<ProbabilisticCostBase> > robot_cost;
-    create_robot_costs(robot_cost, 2);
+    std::vector<std::shared_ptr<ProbabilisticCostMultiHuman> > robot_cost;
+    create_robot_costs(robot_cost, 2 * n_seeds_);
+    robot_costs_ = robot_cost;
 
     ROS_INFO("Robot cost func created...");
 
@@ -394,21 +510,35 @@ void Planner::create_optimizer()
     int dim_r = T_ * nUr_;
     int dim_h = T_ * nUh_;
 
-    // FIXME: only use the naive nested optimizer with SLSQP for now
-    optimizer_comm_ = std::make_shared<NaiveNestedOptimizer>(static_cast<unsigned int>(dim_r),
-                                                             static_cast<unsigned int>(dim_r),
-                                                             nlopt::LD_SLSQP, nlopt::LD_SLSQP);
-    optimizer_no_comm_ = std::make_shared<NaiveNestedOptimizer>(static_cast<unsigned int>(dim_r),
-                                                                static_cast<unsigned int>(dim_r),
-                                                                nlopt::LD_SLSQP, nlopt::LD_SLSQP);
+    // FIXME: only use the naive nested formulation with SLSQP for now
+    // with a single human this is the same as NaiveNestedOptimizer
+    optimizers_comm_.clear();
+    optimizers_no_comm_.clear();
+    for (int s = 0; s < n_seeds_; ++s) {
+        optimizers_comm_.push_back(std::make_shared<MultiHumanNestedOptimizer>(
+                static_cast<unsigned int>(dim_r), static_cast<unsigned int>(dim_h), max_humans_,
+                nlopt::LD_SLSQP, nlopt::LD_SLSQP));
+        optimizers_no_comm_.push_back(std::make_shared<MultiHumanNestedOptimizer>(
+                static_cast<unsigned int>(dim_r), static_cast<unsigned int>(dim_h), max_humans_,
+                nlopt::LD_SLSQP, nlopt::LD_SLSQP));
+    }
 
     ROS_INFO("Optimizer created...");
 
+    // comm and no comm optimizers of all seeds in one list, for the common settings
+    std::vector<std::shared_ptr<MultiHumanNestedOptimizer> > optimizers;
+    for (int s = 0; s < n_seeds_; ++s) {
+        optimizers.push_back(optimizers_comm_[s]);
+        optimizers.push_back(optimizers_no_comm_[s]);
+    }
+
     // set costs
-    optimizer_comm_->set_robot_cost(robot_cost[0]);
-    optimizer_no_comm_->set_robot_cost(robot_cost[1]);
-    optimizer_comm_->set_human_cost(single_cost_hp[0], single_cost_rp[0]);
-    optimizer_no_comm_->set_human_cost(single_cost_hp[1], single_cost_rp[1]);
+    for (int i = 0; i < 2 * n_seeds_; ++i) {
+        optimizers[i]->set_robot_cost(robot_cost[i]);
+        optimizers[i]->set_intent_levels(intent_levels_);
+        for (int k = 0; k < max_humans_; ++k)
+            optimizers[i]->set_human_cost(k, single_cost_hp[k][i], single_cost_rp[k][i]);
+    }
 
     // load and set bounds
     Eigen::VectorXd lb_ur(dim_r);
@@ -431,8 +561,67 @@ void Planner::create_optimizer()
         }
     }
 
-    optimizer_comm_->set_bounds(lb_ur, ub_ur, lb_uh, ub_uh);
-    optimizer_no_comm_->set_bounds(lb_ur, ub_ur, lb_uh, ub_uh);
+    for (auto& optimizer: optimizers)
+        optimizer->set_bounds(lb_ur, ub_ur, lb_uh, ub_uh);
+
+    // "jacobian" or "adjoint" gradient evaluation for the human trajectory optimizers
+    std::string gradient_mode;
+    ros::param::param<std::string>("~optimizer/gradient_mode", gradient_mode, "jacobian");
+
+    GradientMode grad_mode = gradient_mode == "adjoint" ? GRADIENT_ADJOINT : GRADIENT_JACOBIAN;
+    for (auto& optimizer: optimizers)
+        optimizer->set_gradient_mode(grad_mode);
+
+    // stop the follower optimizations early once the gradient is small enough
+    double follower_grad_tol;
+    ros::param::param<double>("~optimizer/follower_grad_tol", follower_grad_tol, 1e-3);
+    for (auto& optimizer: optimizers)
+        optimizer->set_follower_grad_tol(follower_grad_tol);
+
+    // start the follower optimizations from their previous solutions across outer iterations
+    bool flag_follower_warm_start;
+    ros::param::param<bool>("~optimizer/follower_warm_start", flag_follower_warm_start, true);
+    for (auto& optimizer: optimizers)
+        optimizer->set_follower_warm_start(flag_follower_warm_start);
+
+    // iteration limit of the follower optimizations, 0 leaves them to the time limit only
+    int follower_max_iter;
+    ros::param::param<int>("~optimizer/follower_max_iter", follower_max_iter, 0);
+    for (auto& optimizer: optimizers)
+        optimizer->set_follower_max_iter(follower_max_iter);
+
+    // "nlopt" or "newton" for the human trajectory optimizations
+    std::string follower_solver;
+    ros::param::param<std::string>("~optimizer/follower_solver", follower_solver, "nlopt");
+
+    TrajectorySolver solver = follower_solver == "newton" ? SOLVER_PROJECTED_NEWTON : SOLVER_NLOPT;
+    for (auto& optimizer: optimizers)
+        optimizer->set_follower_solver(solver);
+
+    // include the follower responses in the robot gradient
+    bool flag_implicit_grad;
+    ros::param::param<bool>("~optimizer/implicit_gradient", flag_implicit_grad, true);
+    for (auto& optimizer: optimizers)
+        optimizer->set_implicit_gradient(flag_implicit_grad);
+
+    for (auto& optimizer: optimizers) {
+        optimizer->set_thread_pool(thread_pool_);
+        optimizer->set_cancellation_token(cancel_token_);
+    }
+
+    // seeds that fall clearly behind the best one of the same branch are stopped early
+    double dominance_ratio;
+    int dominance_min_evals;
+    ros::param::param<double>("~planner/multi_start/dominance_ratio", dominance_ratio, 0.2);
+    ros::param::param<int>("~planner/multi_start/dominance_min_evals", dominance_min_evals, 5);
+
+    monitor_comm_ = std::make_shared<MultiStartMonitor>(n_seeds_, dominance_ratio, dominance_min_evals);
+    monitor_no_comm_ = std::make_shared<MultiStartMonitor>(n_seeds_, dominance_ratio, dominance_min_evals);
+
+    for (int s = 0; s < n_seeds_; ++s) {
+        optimizers_comm_[s]->set_progress_callback(monitor_comm_->callback(s));
+        optimizers_no_comm_[s]->set_progress_callback(monitor_no_comm_->callback(s));
+    }
 }
 
 //----------------------------------------------------------------------------------
@@ -442,7 +631,6 @@ void Planner::compute_plan(double t_max)
     // copy the current state measurements
     xr_ = xr_meas_;
     ur_ = ur_meas_;
-    xh_ = xh_meas_;
 
     // first update current belief
     // compute some parameters needed to update belief
@@ -456,55 +644,97 @@ void Planner::compute_plan(double t_max)
     ur_d(0) = utils::clamp(k_rho_ * std::tanh(k_v_ * rho), lb_ur_vec_[0], ub_ur_vec_[0]);
     ur_d(1) = utils::clamp(k_alp_ * alpha + k_phi_ * phi, lb_ur_vec_[1], ub_ur_vec_[1]);
 
-    belief_model_->set_ur_nav(ur_d);
-
     // FIXME: decrease tcomm each time, t_curr is always 0
     tcomm_ -= dt_;
-    belief_model_->update_belief(xr_, ur_, xh_, acomm_, tcomm_, 0.0);
+    update_humans(ur_d);
 
     // update initial guesses
     update_init_guesses();
 
-    // set optimizer time limit if specified
-    if (t_max > 0) {
-        optimizer_comm_->set_time_limit(t_max);
-        optimizer_no_comm_->set_time_limit(t_max);
-    }
+    int n_seeds = static_cast<int>(robot_trajs_seed_.size());
 
-    // optimize for no communication
-    std::vector<double> cost_ni_no_comm;
-    Trajectory robot_traj_opt_n(DIFFERENTIAL_MODEL, T_, dt_);
-    Trajectory human_traj_hp_opt_n(CONST_ACC_MODEL, T_, dt_);
-    Trajectory human_traj_rp_opt_n(CONST_ACC_MODEL, T_, dt_);
+    // optimize for no communication, one result per seed
+    std::vector<double> costs_no_comm(n_seeds);
+    std::vector<Trajectory> robot_trajs_opt_n(n_seeds, Trajectory(DIFFERENTIAL_MODEL, T_, dt_));
+    std::vector<std::vector<Trajectory> > human_trajs_hp_opt_n_seed(n_seeds);
+    std::vector<std::vector<Trajectory> > human_trajs_rp_opt_n_seed(n_seeds);
 
     // optimize for communication
-    std::vector<double> cost_ni_comm;
-    Trajectory robot_traj_opt(DIFFERENTIAL_MODEL, T_, dt_);
-    Trajectory human_traj_hp_opt(CONST_ACC_MODEL, T_, dt_);
-    Trajectory human_traj_rp_opt(CONST_ACC_MODEL, T_, dt_);
+    std::vector<double> costs_comm(n_seeds);
+    std::vector<Trajectory> robot_trajs_opt(n_seeds, Trajectory(DIFFERENTIAL_MODEL, T_, dt_));
+    std::vector<std::vector<Trajectory> > human_trajs_hp_opt_seed(n_seeds);
+    std::vector<std::vector<Trajectory> > human_trajs_rp_opt_seed(n_seeds);
 
 //    using namespace std::chrono;
 //    steady_clock::time_point t1 = steady_clock::now();
 
-    // create two threads to perform optimization separately
-    std::thread th_no_comm(&NestedOptimizerBase::optimize_nr, optimizer_no_comm_.get(), std::ref(robot_traj_init_),
-                           std::ref(human_traj_hp_init_), std::ref(human_traj_rp_init_), acomm_, tcomm_,
-                           std::ref(cost_no_comm_), std::ref(robot_traj_opt_n), &human_traj_hp_opt_n,
-                           &human_traj_rp_opt_n);
+    // perform all optimizations in parallel on the thread pool
+    // seed 0 always runs so that there is a plan, the others are skipped once the budget is used up
+    monitor_no_comm_->reset();
+    monitor_comm_->reset();
+
+    std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+
+    std::vector<ThreadPool::Task> tasks;
+    for (int s = 0; s < n_seeds; ++s) {
+        tasks.emplace_back([&, s] {
+            if (!start_seed(*optimizers_no_comm_[s], t_start, t_max) && s > 0) {
+                costs_no_comm[s] = std::numeric_limits<double>::quiet_NaN();
+                return;
+            }
+            costs_no_comm[s] = optimizers_no_comm_[s]->optimize(robot_trajs_seed_[s], human_trajs_hp_init_,
+                                                                human_trajs_rp_init_, acomm_, tcomm_,
+                                                                robot_trajs_opt_n[s], &human_trajs_hp_opt_n_seed[s],
+                                                                &human_trajs_rp_opt_n_seed[s]);
+        });
+        tasks.emplace_back([&, s] {
+            if (!start_seed(*optimizers_comm_[s], t_start, t_max) && s > 0) {
+                costs_comm[s] = std::numeric_limits<double>::quiet_NaN();
+                return;
+            }
+            costs_comm[s] = optimizers_comm_[s]->optimize(robot_trajs_seed_[s], human_trajs_hp_init_,
+                                                          human_trajs_rp_init_, intent_, 0.0, robot_trajs_opt[s],
+                                                          &human_trajs_hp_opt_seed[s], &human_trajs_rp_opt_seed[s]);
+        });
+    }
 
-    std::thread th_comm(&NestedOptimizerBase::optimize_nr, optimizer_comm_.get(), std::ref(robot_traj_init_),
-                        std::ref(human_traj_hp_init_), std::ref(human_traj_rp_init_), intent_, 0.0,
-                        std::ref(cost_comm_), std::ref(robot_traj_opt), &human_traj_hp_opt, &human_traj_rp_opt);
+    thread_pool_->run_parallel(tasks);
 
-    th_no_comm.join();
-    th_comm.join();
+    // keep the best seed of each branch
+    seed_no_comm_ = select_seed(costs_no_comm);
+    seed_comm_ = select_seed(costs_comm);
+
+    cost_no_comm_ = costs_no_comm[seed_no_comm_];
+    Trajectory& robot_traj_opt_n = robot_trajs_opt_n[seed_no_comm_];
+    std::vector<Trajectory>& human_trajs_hp_opt_n = human_trajs_hp_opt_n_seed[seed_no_comm_];
+    std::vector<Trajectory>& human_trajs_rp_opt_n = human_trajs_rp_opt_n_seed[seed_no_comm_];
+
+    cost_comm_ = costs_comm[seed_comm_];
+    Trajectory& robot_traj_opt = robot_trajs_opt[seed_comm_];
+    std::vector<Trajectory>& human_trajs_hp_opt = human_trajs_hp_opt_seed[seed_comm_];
+    std::vector<Trajectory>& human_trajs_rp_opt = human_trajs_rp_opt_seed[seed_comm_];
+
+    // evaluations of all seeds
+    niter_no_comm_ = 0;
+    niter_comm_ = 0;
+    for (int s = 0; s < n_seeds; ++s) {
+        niter_no_comm_ += optimizers_no_comm_[s]->get_niter();
+        niter_comm_ += optimizers_comm_[s]->get_niter();
+    }
+
+    ROS_INFO("outer iterations: %d (no communication), %d (communication), initial guess age: %d",
+             niter_no_comm_, niter_comm_, init_guess_age_);
+    ROS_INFO("best seeds: %d (no communication), %d (communication) of %d", seed_no_comm_, seed_comm_, n_seeds);
+
+    std::vector<double> cost_ni_no_comm;
+    std::vector<double> cost_ni_comm;
 
 //    steady_clock::time_point t2 = steady_clock::now();
 //    duration<double> time_span = duration_cast<duration<double>>(t2 - t1);
 //    std::cout << "[Planner] time spent for planning is: " << time_span.count() << "s" << std::endl;
 
     // get some info
-    optimizer_no_comm_->get_partial_cost(cost_hp_no_comm_, cost_rp_no_comm_, cost_ni_no_comm);
+    optimizers_no_comm_[seed_no_comm_]->get_partial_cost(cost_hp_no_comm_, cost_rp_no_comm_, cost_ni_no_comm);
     ROS_INFO("min cost no communication is: %f", cost_no_comm_);
     std::cout << ">>>>>>>> partial costs: " << cost_hp_no_comm_ << ", " << cost_rp_no_comm_ << " | ";
     for (auto c: cost_ni_no_comm)
@@ -516,7 +746,7 @@ void Planner::compute_plan(double t_max)
 //    std::cout << "number of iterations: " << optimizer_no_comm_->get_niter()
 //              << ", nested iterations: (" << neval_hp << ", " << neval_rp << ")" << std::endl;
 
-    optimizer_comm_->get_partial_cost(cost_hp_comm_, cost_rp_comm_, cost_ni_comm);
+    optimizers_comm_[seed_comm_]->get_partial_cost(cost_hp_comm_, cost_rp_comm_, cost_ni_comm);
     ROS_INFO("min cost with communication is: %f", cost_comm_);
     std::cout << ">>>>>>>> partial costs: " << cost_hp_comm_ << ", " << cost_rp_comm_ << " | ";
     for (auto c: cost_ni_comm)
@@ -530,9 +760,9 @@ void Planner::compute_plan(double t_max)
     cost_comm_ += comm_cost_;
 
     // check for abnormal solution (nan)
+    // a failed plan isn't stored, the next cycle starts from the older plans or the steer law
     if (std::isnan(cost_comm_) || std::isnan(cost_no_comm_)) {
         flag_plan_succeeded_ = false;
-        flag_gen_init_guesses_ = true;
     }
     else {
         flag_plan_succeeded_ = true;
@@ -541,22 +771,27 @@ void Planner::compute_plan(double t_max)
     // compare the cost and choose optimal actions
     if (cost_comm_ < cost_no_comm_) {
         robot_traj_opt_ = robot_traj_opt;
-        human_traj_hp_opt_ = human_traj_hp_opt;
-        human_traj_rp_opt_ = human_traj_rp_opt;
+        human_trajs_hp_opt_ = human_trajs_hp_opt;
+        human_trajs_rp_opt_ = human_trajs_rp_opt;
 
         acomm_ = intent_;
         tcomm_ = 0.0;
     }
     else {
         robot_traj_opt_ = robot_traj_opt_n;
-        human_traj_hp_opt_ = human_traj_hp_opt_n;
-        human_traj_rp_opt_ = human_traj_rp_opt_n;
+        human_trajs_hp_opt_ = human_trajs_hp_opt_n;
+        human_trajs_rp_opt_ = human_trajs_rp_opt_n;
     }
 
+    if (flag_plan_succeeded_)
+        warm_start_.push(robot_traj_opt_, human_trajs_hp_opt_, human_trajs_rp_opt_, human_ids_);
+
+    clear_best_iterates();
+
 //    ROS_INFO("Got plan!");
 
     if (flag_publish_debug_info_) {
-        // publish trajectories for both with/without communication
+        // publish trajectories for both with/without communication, of the first human
         PlannedTrajectories planned_traj;
         planned_traj.T = T_;
         planned_traj.nXr = nXr_;
@@ -568,14 +803,14 @@ void Planner::compute_plan(double t_max)
         utils::EigenToVector(robot_traj_opt.x, traj);
         planned_traj.robot_traj_opt.insert(planned_traj.robot_traj_opt.end(), traj.begin(), traj.end());
 
-        utils::EigenToVector(human_traj_hp_opt.x, traj);
+        utils::EigenToVector(human_trajs_hp_opt[0].x, traj);
         planned_traj.human_traj_hp_opt.assign(traj.begin(), traj.end());
-        utils::EigenToVector(human_traj_hp_opt_n.x, traj);
+        utils::EigenToVector(human_trajs_hp_opt_n[0].x, traj);
         planned_traj.human_traj_hp_opt.insert(planned_traj.human_traj_hp_opt.end(), traj.begin(), traj.end());
 
-        utils::EigenToVector(human_traj_rp_opt.x, traj);
+        utils::EigenToVector(human_trajs_rp_opt[0].x, traj);
         planned_traj.human_traj_rp_opt.assign(traj.begin(), traj.end());
-        utils::EigenToVector(human_traj_rp_opt_n.x, traj);
+        utils::EigenToVector(human_trajs_rp_opt_n[0].x, traj);
         planned_traj.human_traj_rp_opt.insert(planned_traj.human_traj_rp_opt.end(), traj.begin(), traj.end());
 
         plan_pub_debug_.publish(planned_traj);
@@ -589,7 +824,6 @@ void Planner::compute_plan_no_comm(double t_max)
     // copy the current state measurements
     xr_ = xr_meas_;
     ur_ = ur_meas_;
-    xh_ = xh_meas_;
 
     // first update current belief
     // compute some parameters needed to update belief
@@ -603,36 +837,73 @@ void Planner::compute_plan_no_comm(double t_max)
     ur_d(0) = utils::clamp(k_rho_ * std::tanh(k_v_ * rho), lb_ur_vec_[0], ub_ur_vec_[0]);
     ur_d(1) = utils::clamp(k_alp_ * alpha + k_phi_ * phi, lb_ur_vec_[1], ub_ur_vec_[1]);
 
-    belief_model_->set_ur_nav(ur_d);
-
     // FIXME: decrease tcomm each time, t_curr is always 0
     tcomm_ -= dt_;
-    belief_model_->update_belief(xr_, ur_, xh_, acomm_, tcomm_, 0.0);
+    update_humans(ur_d);
 
     // update initial guesses
     update_init_guesses();
 
-    // set optimizer time limit if specified
-    if (t_max > 0) {
-        optimizer_no_comm_->set_time_limit(t_max);
+    int n_seeds = static_cast<int>(robot_trajs_seed_.size());
+
+    // optimize for no communication, one result per seed
+    std::vector<double> costs_no_comm(n_seeds);
+    std::vector<Trajectory> robot_trajs_opt_n(n_seeds, Trajectory(DIFFERENTIAL_MODEL, T_, dt_));
+    std::vector<std::vector<Trajectory> > human_trajs_hp_opt_n(n_seeds);
+    std::vector<std::vector<Trajectory> > human_trajs_rp_opt_n(n_seeds);
+
+    // seed 0 always runs, the others are skipped once the budget is used up
+    monitor_no_comm_->reset();
+
+    std::chrono::steady_clock::time_point t_start = std::chrono::steady_clock::now();
+
+    std::vector<ThreadPool::Task> tasks;
+    for (int s = 0; s < n_seeds; ++s) {
+        tasks.emplace_back([&, s] {
+            if (!start_seed(*optimizers_no_comm_[s], t_start, t_max) && s > 0) {
+                costs_no_comm[s] = std::numeric_limits<double>::quiet_NaN();
+                return;
+            }
+            costs_no_comm[s] = optimizers_no_comm_[s]->optimize(robot_trajs_seed_[s], human_trajs_hp_init_,
+                                                                human_trajs_rp_init_, acomm_, tcomm_,
+                                                                robot_trajs_opt_n[s], &human_trajs_hp_opt_n[s],
+                                                                &human_trajs_rp_opt_n[s]);
+        });
     }
 
-    // optimize for no communication
+    thread_pool_->run_parallel(tasks);
+
+    // keep the best seed
+    seed_no_comm_ = select_seed(costs_no_comm);
+
+    cost_no_comm_ = costs_no_comm[seed_no_comm_];
+    robot_traj_opt_ = robot_trajs_opt_n[seed_no_comm_];
+    human_trajs_hp_opt_ = human_trajs_hp_opt_n[seed_no_comm_];
+    human_trajs_rp_opt_ = human_trajs_rp_opt_n[seed_no_comm_];
+
+    niter_no_comm_ = 0;
+    for (int s = 0; s < n_seeds; ++s)
+        niter_no_comm_ += optimizers_no_comm_[s]->get_niter();
+
+    ROS_INFO("outer iterations: %d, initial guess age: %d, best seed: %d of %d",
+             niter_no_comm_, init_guess_age_, seed_no_comm_, n_seeds);
+
     std::vector<double> cost_ni_no_comm;
 
-    cost_no_comm_ = optimizer_no_comm_->optimize(robot_traj_init_, human_traj_hp_init_, human_traj_rp_init_,
-                                                 acomm_, tcomm_, robot_traj_opt_, &human_traj_hp_opt_,
-                                                 &human_traj_rp_opt_);
+    if (!std::isnan(cost_no_comm_))
+        warm_start_.push(robot_traj_opt_, human_trajs_hp_opt_, human_trajs_rp_opt_, human_ids_);
+
+    clear_best_iterates();
 
     // get some info
-    optimizer_no_comm_->get_partial_cost(cost_hp_no_comm_, cost_rp_no_comm_, cost_ni_no_comm);
+    optimizers_no_comm_[seed_no_comm_]->get_partial_cost(cost_hp_no_comm_, cost_rp_no_comm_, cost_ni_no_comm);
     ROS_INFO("min cost no communication is: %f", cost_no_comm_);
 
     ROS_INFO("Got plan!");
 }
 
 //----------------------------------------------------------------------------------
-void Planner::publish_plan(bool human_tracking_lost)
+void Planner::get_plan_messages(bool human_tracking_lost, std::vector<PlanMessage>& msgs)
 {
     // publish communicative action if any
     if (tcomm_ == 0.0) {
@@ -643,14 +914,14 @@ void Planner::publish_plan(bool human_tracking_lost)
         else
             comm_msg.data = "Repel";
 
-        comm_pub_.publish(comm_msg);
+        msgs.push_back(plan_message(comm_pub_, comm_msg));
     }
 
     // publish robot control
     geometry_msgs::Twist cmd_vel;
     cmd_vel.linear.x = robot_traj_opt_.u(0);
     cmd_vel.angular.z = robot_traj_opt_.u(1);
-    robot_ctrl_pub_.publish(cmd_vel);
+    msgs.push_back(plan_message(robot_ctrl_pub_, cmd_vel));
 
     // publish full plan if specified
     if (flag_publish_full_plan_) {
@@ -660,18 +931,18 @@ void Planner::publish_plan(bool human_tracking_lost)
         trajectories.nXr = nXr_;
         trajectories.nXh = nXh_;
         utils::EigenToVector(robot_traj_opt_.x0, trajectories.xr_init);
-        utils::EigenToVector(human_traj_hp_opt_.x0, trajectories.xh_init);
+        utils::EigenToVector(human_trajs_hp_opt_[0].x0, trajectories.xh_init);
         utils::EigenToVector(robot_traj_opt_.x, trajectories.robot_traj_opt);
-        utils::EigenToVector(human_traj_hp_opt_.x, trajectories.human_traj_hp_opt);
-        utils::EigenToVector(human_traj_rp_opt_.x, trajectories.human_traj_rp_opt);
+        utils::EigenToVector(human_trajs_hp_opt_[0].x, trajectories.human_traj_hp_opt);
+        utils::EigenToVector(human_trajs_rp_opt_[0].x, trajectories.human_traj_rp_opt);
 
-        plan_pub_.publish(trajectories);
+        msgs.push_back(plan_message(plan_pub_, trajectories));
     }
 
     // get partial cost and publish belief + cost
     if (flag_publish_belief_cost_) {
         std_msgs::Float64MultiArray data;
-        data.data.push_back(belief_model_->get_belief());
+        data.data.push_back(belief_models_[0]->get_belief());
         data.data.push_back(cost_no_comm_);
         data.data.push_back(cost_comm_);
         data.data.push_back(cost_hp_no_comm_);
@@ -679,20 +950,79 @@ void Planner::publish_plan(bool human_tracking_lost)
         data.data.push_back(cost_hp_comm_);
         data.data.push_back(cost_rp_comm_);
 
-        belief_cost_pub_.publish(data);
+        msgs.push_back(plan_message(belief_cost_pub_, data));
     }
 }
 
+//----------------------------------------------------------------------------------
+bool Planner::get_intermediate_plan_messages(bool human_tracking_lost, std::vector<PlanMessage>& msgs)
+{
+    // only the no communication branch, whether to communicate is decided with the final plan
+    Trajectory robot_traj(DIFFERENTIAL_MODEL, T_, dt_);
+    std::vector<Trajectory> human_trajs_hp;
+    std::vector<Trajectory> human_trajs_rp;
+    double cost_best = std::numeric_limits<double>::infinity();
+
+    Trajectory robot_traj_seed(DIFFERENTIAL_MODEL, T_, dt_);
+    std::vector<Trajectory> human_trajs_hp_seed;
+    std::vector<Trajectory> human_trajs_rp_seed;
+    double cost;
+
+    for (auto& optimizer: optimizers_no_comm_) {
+        human_trajs_hp_seed.assign(max_humans_, Trajectory(CONST_ACC_MODEL, T_, dt_));
+        human_trajs_rp_seed.assign(max_humans_, Trajectory(CONST_ACC_MODEL, T_, dt_));
+
+        if (optimizer->get_best_iterate(robot_traj_seed, human_trajs_hp_seed, human_trajs_rp_seed, cost) &&
+                cost < cost_best) {
+            cost_best = cost;
+            std::swap(robot_traj, robot_traj_seed);
+            std::swap(human_trajs_hp, human_trajs_hp_seed);
+            std::swap(human_trajs_rp, human_trajs_rp_seed);
+        }
+    }
+
+    if (std::isinf(cost_best))
+        return false;
+
+    // the snapshots have their own initial states, the planner may already be in the next cycle
+    geometry_msgs::Twist cmd_vel;
+    cmd_vel.linear.x = robot_traj.u(0);
+    cmd_vel.angular.z = robot_traj.u(1);
+    msgs.push_back(plan_message(robot_ctrl_pub_, cmd_vel));
+
+    if (flag_publish_full_plan_) {
+        PlannedTrajectories trajectories;
+        trajectories.tracking_lost = (unsigned char) human_tracking_lost;
+        trajectories.T = T_;
+        trajectories.nXr = nXr_;
+        trajectories.nXh = nXh_;
+        utils::EigenToVector(robot_traj.x0, trajectories.xr_init);
+        utils::EigenToVector(human_trajs_hp[0].x0, trajectories.xh_init);
+        utils::EigenToVector(robot_traj.x, trajectories.robot_traj_opt);
+        utils::EigenToVector(human_trajs_hp[0].x, trajectories.human_traj_hp_opt);
+        utils::EigenToVector(human_trajs_rp[0].x, trajectories.human_traj_rp_opt);
+
+        msgs.push_back(plan_message(plan_pub_, trajectories));
+    }
+
+    ROS_INFO("Got intermediate plan with cost %f", cost_best);
+
+    return true;
+}
+
 //----------------------------------------------------------------------------------
 void Planner::reset_planner(const Eigen::VectorXd &xr_goal, const Eigen::VectorXd &xh_goal,
                             const int intent, const std::string& ns)
 {
     // recreate the robot cost functions and reset optimizer
-    std::vector<std::shared_ptr<ProbabilisticCostBase> > robot_cost;
-    create_robot_costs(robot_cost, 2, ns);
+    std::vector<std::shared_ptr<ProbabilisticCostMultiHuman> > robot_cost;
+    create_robot_costs(robot_cost, 2 * n_seeds_, ns);
+    robot_costs_ = robot_cost;
 
-    optimizer_comm_->set_robot_cost(robot_cost[0]);
-    optimizer_no_comm_->set_robot_cost(robot_cost[1]);
+    for (int s = 0; s < n_seeds_; ++s) {
+        optimizers_comm_[s]->set_robot_cost(robot_cost[2*s]);
+        optimizers_no_comm_[s]->set_robot_cost(robot_cost[2*s+1]);
+    }
 
     ROS_INFO("Robot cost function reset!");
 
@@ -716,8 +1046,9 @@ void Planner::reset_planner(const Eigen::VectorXd &xr_goal, const Eigen::VectorX
     // flags
     flag_gen_init_guesses_ = true;
 
-    // reset belief model
-    belief_model_->reset_hist(Eigen::Vector2d::Zero());
+    // reset belief models
+    for (auto& belief_model: belief_models_)
+        belief_model->reset_hist(Eigen::Vector2d::Zero());
 }
 
 //----------------------------------------------------------------------------------
@@ -727,21 +1058,118 @@ void Planner::reset_planner()
     // flags
     flag_gen_init_guesses_ = true;
 
-    // reset belief model
-    belief_model_->reset_hist(Eigen::Vector2d::Zero());
+    // reset belief models
+    for (auto& belief_model: belief_models_)
+        belief_model->reset_hist(Eigen::Vector2d::Zero());
 }
 
 //----------------------------------------------------------------------------------
 void Planner::get_human_pred(const int t, const int intent, Eigen::VectorXd &human_state)
 {
     if (intent == HumanPriority)
-        human_state = human_traj_hp_opt_.x.segment(nXh_ * t, nXh_);
+        human_state = human_trajs_hp_opt_[0].x.segment(nXh_ * t, nXh_);
     else
-        human_state = human_traj_rp_opt_.x.segment(nXh_ * t, nXh_);
+        human_state = human_trajs_rp_opt_[0].x.segment(nXh_ * t, nXh_);
 }
 
 //----------------------------------------------------------------------------------
-void Planner::generate_init_guesses(Trajectory &robot_traj, Trajectory &human_traj_hp, Trajectory &human_traj_rp)
+void Planner::update_humans(const Eigen::VectorXd &ur_d)
+{
+    // humans beyond what the optimizers are created for are dropped, the node sends the closest ones first
+    assign_humans(std::min(static_cast<int>(xh_meas_all_.size()), max_humans_));
+
+    // update the current belief of each human
+    for (int k = 0; k < n_humans_; ++k) {
+        belief_models_[k]->set_ur_nav(ur_d);
+        belief_models_[k]->update_belief(xr_, ur_, xh_all_[k], acomm_, tcomm_, 0.0);
+    }
+
+    // only the goal of the first human is known, the others are assumed to keep their velocity
+    xh_goals_.resize(n_humans_);
+    xh_goals_[0] = xh_goal_;
+
+    for (int k = 1; k < n_humans_; ++k) {
+        xh_goals_[k] = xh_all_[k].head(2) + xh_all_[k].tail(2) * (T_ * dt_);
+
+        std::string suffix = "_" + std::to_string(k);
+        features_human_["Goal_hp" + suffix]->set_data(&xh_goals_[k]);
+        features_human_["Goal_rp" + suffix]->set_data(&xh_goals_[k]);
+
+        auto feature = features_robot_int_.find("HumanGoal" + suffix);
+        if (feature != features_robot_int_.end())
+            feature->second->set_data(&xh_goals_[k]);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void Planner::assign_humans(int n_humans)
+{
+    // the human with the goal stays first, the others keep their order from the last cycle
+    // and the people new to the plan are appended
+    std::vector<int> order(1, 0);
+    for (int k = 1; k < n_humans_; ++k) {
+        for (int i = 1; i < n_humans; ++i) {
+            if (human_ids_meas_[i] == human_ids_[k]) {
+                order.push_back(i);
+                break;
+            }
+        }
+    }
+
+    for (int i = 1; i < n_humans; ++i) {
+        if (std::find(order.begin(), order.end(), i) == order.end())
+            order.push_back(i);
+    }
+
+    // each belief model moves with its person, a new person gets a free model with the history cleared
+    std::vector<std::shared_ptr<BeliefModelBase> > belief_models(max_humans_);
+    std::vector<bool> flag_taken(max_humans_, false);
+    std::vector<int> human_ids(n_humans);
+
+    for (int k = 0; k < n_humans; ++k) {
+        human_ids[k] = human_ids_meas_[order[k]];
+
+        auto it = std::find(human_ids_.begin(), human_ids_.end(), human_ids[k]);
+        if (it != human_ids_.end()) {
+            int k_last = static_cast<int>(it - human_ids_.begin());
+            belief_models[k] = belief_models_[k_last];
+            flag_taken[k_last] = true;
+        }
+    }
+
+    int k_free = 0;
+    for (int k = 0; k < max_humans_; ++k) {
+        if (belief_models[k])
+            continue;
+
+        while (flag_taken[k_free])
+            ++k_free;
+
+        belief_models[k] = belief_models_[k_free];
+        flag_taken[k_free] = true;
+
+        if (k < n_humans)
+            belief_models[k]->reset_hist(ur_);
+    }
+
+    if (belief_models != belief_models_) {
+        belief_models_ = belief_models;
+        for (auto& robot_cost: robot_costs_)
+            robot_cost->set_belief_models(belief_models_);
+    }
+
+    n_humans_ = n_humans;
+    human_ids_ = human_ids;
+
+    xh_all_.resize(n_humans_);
+    for (int k = 0; k < n_humans_; ++k)
+        xh_all_[k] = xh_meas_all_[order[k]];
+    xh_ = xh_all_[0];
+}
+
+//----------------------------------------------------------------------------------
+void Planner::generate_init_guesses(Trajectory &robot_traj, std::vector<Trajectory> &human_trajs_hp,
+                                    std::vector<Trajectory> &human_trajs_rp)
 {
     // create initial guesses for robot control and human trajectory
     //! use a closed-loop control law to generate initial control for the robot
@@ -751,39 +1179,148 @@ void Planner::generate_init_guesses(Trajectory &robot_traj, Trajectory &human_tr
     robot_traj.update(xr_, ur);
 
     //! for human initial guess also use a control-based alg to generate
+    human_trajs_hp.assign(n_humans_, Trajectory(CONST_ACC_MODEL, T_, dt_));
+    human_trajs_rp.assign(n_humans_, Trajectory(CONST_ACC_MODEL, T_, dt_));
+
     Eigen::VectorXd uh;
-    generate_steer_acc(xh_, xh_goal_, uh);
+    for (int k = 0; k < n_humans_; ++k) {
+        generate_steer_acc(xh_all_[k], xh_goals_[k], uh);
 
-    human_traj_hp.update(xh_, uh);
-    human_traj_rp.update(xh_, uh);
+        human_trajs_hp[k].update(xh_all_[k], uh);
+        human_trajs_rp[k].update(xh_all_[k], uh);
+    }
 }
 
 //----------------------------------------------------------------------------------
 void Planner::update_init_guesses()
 {
+    // plans for other goals or another number of humans can't be reused
     if (flag_gen_init_guesses_) {
-        generate_init_guesses(robot_traj_init_, human_traj_hp_init_, human_traj_rp_init_);
+        warm_start_.clear();
         flag_gen_init_guesses_ = false;
     }
-    else {
-        // use the optimal plan from previous time step as initial guess
-        shift_control(robot_traj_opt_.u, robot_traj_init_.u, nUr_, false);
-        shift_control(human_traj_hp_opt_.u, human_traj_hp_init_.u, nUh_, true);
-        shift_control(human_traj_rp_opt_.u, human_traj_rp_init_.u, nUh_, true);
 
-        robot_traj_init_.x0 = xr_;
-        human_traj_hp_init_.x0 = xh_;
-        human_traj_rp_init_.x0 = xh_;
+    warm_start_.advance();
 
-        robot_traj_init_.compute();
-        robot_traj_init_.compute_jacobian();
-        human_traj_hp_init_.compute();
-        human_traj_hp_init_.compute_jacobian();
-        human_traj_rp_init_.compute();
-        human_traj_rp_init_.compute_jacobian();
+    // the steer law rollout is always a candidate, and the only one after a reset
+    generate_init_guesses(robot_traj_init_, human_trajs_hp_init_, human_trajs_rp_init_);
+
+    robot_traj_init_.compute_jacobian();
+    for (int k = 0; k < n_humans_; ++k) {
+        human_trajs_hp_init_[k].compute_jacobian();
+        human_trajs_rp_init_[k].compute_jacobian();
+    }
+
+    init_guess_age_ = -1;
+    double cost_init = optimizers_no_comm_[0]->evaluate_cost(robot_traj_init_, human_trajs_hp_init_,
+                                                         human_trajs_rp_init_, acomm_, tcomm_);
+    if (std::isnan(cost_init))
+        cost_init = std::numeric_limits<double>::infinity();
+
+    // the stored plans shifted to the current cycle, ranked with the human responses they were planned with
+    human_trajs_hp_cand_.assign(n_humans_, Trajectory(CONST_ACC_MODEL, T_, dt_));
+    human_trajs_rp_cand_.assign(n_humans_, Trajectory(CONST_ACC_MODEL, T_, dt_));
+
+    for (int i = 0; i < warm_start_.size(); ++i) {
+        if (!warm_start_.get_candidate(i, xr_, xh_all_, human_ids_, robot_traj_cand_, human_trajs_hp_cand_,
+                                       human_trajs_rp_cand_))
+            continue;
+
+        double cost = optimizers_no_comm_[0]->evaluate_cost(robot_traj_cand_, human_trajs_hp_cand_,
+                                                            human_trajs_rp_cand_, acomm_, tcomm_);
+        if (cost < cost_init) {
+            cost_init = cost;
+            init_guess_age_ = warm_start_.age(i);
+
+            std::swap(robot_traj_init_, robot_traj_cand_);
+            std::swap(human_trajs_hp_init_, human_trajs_hp_cand_);
+            std::swap(human_trajs_rp_init_, human_trajs_rp_cand_);
+        }
+    }
+
+    generate_seeds();
+}
+
+//----------------------------------------------------------------------------------
+void Planner::generate_seeds()
+{
+    // the ranked initial guess is always the first seed
+    std::vector<Eigen::VectorXd> ur_seeds;
+    ur_seeds.push_back(robot_traj_init_.u);
+
+    // the steer law rollout, unless the initial guess already is
+    Eigen::VectorXd ur;
+    if (init_guess_age_ >= 0) {
+        generate_steer_posq(xr_, xr_goal_, ur);
+        ur_seeds.push_back(ur);
+    }
+
+    // detours through points beside the first human, on the left and the right of the way to the goal
+    Eigen::Vector2d dir = xr_goal_.head(2) - xr_.head(2);
+    if (dir.norm() < 1e-3)
+        dir << std::cos(xr_(2)), std::sin(xr_(2));
+    dir.normalize();
+
+    Eigen::Vector2d normal(-dir(1), dir(0));
+    for (int side = 1; side >= -1; side -= 2) {
+        Eigen::VectorXd x_via = xh_.head(2) + side * detour_offset_ * normal;
+        generate_steer_posq(xr_, x_via, xr_goal_, 0.5 * detour_offset_, ur);
+        ur_seeds.push_back(ur);
+    }
+
+    // stopping in place
+    ur.resize(T_ * nUr_);
+    for (int t = 0; t < T_; ++t) {
+        for (int i = 0; i < nUr_; ++i)
+            ur(t*nUr_+i) = utils::clamp(0.0, lb_ur_vec_[i], ub_ur_vec_[i]);
+    }
+    ur_seeds.push_back(ur);
+
+    // only the first n_seeds_ are optimized
+    int n_seeds = std::min(n_seeds_, static_cast<int>(ur_seeds.size()));
+    robot_trajs_seed_.resize(n_seeds, Trajectory(DIFFERENTIAL_MODEL, T_, dt_));
+
+    robot_trajs_seed_[0] = robot_traj_init_;
+    for (int s = 1; s < n_seeds; ++s)
+        robot_trajs_seed_[s].update(xr_, ur_seeds[s]);
+}
+
+//----------------------------------------------------------------------------------
+bool Planner::start_seed(MultiHumanNestedOptimizer &optimizer, const std::chrono::steady_clock::time_point &t_start,
+                         double t_max)
+{
+    if (t_max <= 0)
+        return true;
+
+    // seeds queued behind others only get what is left of the budget
+    std::chrono::duration<double> t_elapsed = std::chrono::steady_clock::now() - t_start;
+    double t_left = t_max - t_elapsed.count();
+
+    optimizer.set_time_limit(std::max(t_left, 1e-3));
+    return t_left > 0;
+}
+
+//----------------------------------------------------------------------------------
+void Planner::clear_best_iterates()
+{
+    for (int s = 0; s < n_seeds_; ++s) {
+        optimizers_comm_[s]->clear_best_iterate();
+        optimizers_no_comm_[s]->clear_best_iterate();
     }
 }
 
+//----------------------------------------------------------------------------------
+int Planner::select_seed(const std::vector<double> &costs)
+{
+    int s_best = 0;
+    for (int s = 1; s < (int) costs.size(); ++s) {
+        if (std::isnan(costs[s_best]) || costs[s] < costs[s_best])
+            s_best = s;
+    }
+
+    return s_best;
+}
+
 //----------------------------------------------------------------------------------
 PlannerSimple::PlannerSimple(ros::NodeHandle &nh, ros::NodeHandle &pnh): PlannerBase(nh, pnh)
 {
@@ -829,13 +1366,13 @@ void PlannerSimple::compute_plan(double t_max)
 }
 
 //----------------------------------------------------------------------------------
-void PlannerSimple::publish_plan(bool human_tracking_lost)
+void PlannerSimple::get_plan_messages(bool human_tracking_lost, std::vector<PlanMessage>& msgs)
 {
     // publish robot control
     geometry_msgs::Twist cmd_vel;
     cmd_vel.linear.x = robot_traj_opt_.u(0);
     cmd_vel.angular.z = robot_traj_opt_.u(1);
-    robot_ctrl_pub_.publish(cmd_vel);
+    msgs.push_back(plan_message(robot_ctrl_pub_, cmd_vel));
 
     // publish full plan if specified
     if (flag_publish_full_plan_) {
@@ -846,7 +1383,7 @@ void PlannerSimple::publish_plan(bool human_tracking_lost)
         utils::EigenToVector(robot_traj_opt_.x0, trajectories.xr_init);
         utils::EigenToVector(robot_traj_opt_.x, trajectories.robot_traj_opt);
 
-        plan_pub_.publish(trajectories);
+        msgs.push_back(plan_message(plan_pub_, trajectories));
     }
 }
 
@@ -948,6 +1485,12 @@ void PlannerSimple::create_optimizer()
         }
     }
     optimizer_->set_bounds(lb_ur, ub_ur);
+
+    std::string gradient_mode;
+    ros::param::param<std::string>("~optimizer/gradient_mode", gradient_mode, "jacobian");
+    optimizer_->set_gradient_mode(gradient_mode == "adjoint" ? GRADIENT_ADJOINT : GRADIENT_JACOBIAN);
+
+    optimizer_->set_cancellation_token(cancel_token_);
 }
 
 //----------------------------------------------------------------------------------
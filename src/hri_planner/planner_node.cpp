@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/24/2018
-// Last revision: 05/05/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -11,6 +11,9 @@
 
 #include <ctime>
 #include <chrono>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 #include "hri_planner/planner_node.h"
 
@@ -24,13 +27,22 @@ PlannerNode::PlannerNode(ros::NodeHandle &nh, ros::NodeHandle &pnh): nh_(nh)
     ros::param::param<double>("~planner/state_machine_rate", state_machine_rate_, 1000);
     ros::param::param<std::string>("~planner/planner_mode", mode_, "simulation");
     ros::param::param<bool>("~planner/allow_explicit_comm", flag_allow_explicit_comm_, true);
+    ros::param::param<bool>("~planner/publish_intermediate_plan", flag_publish_intermediate_plan_, true);
     ros::param::param<double>("~planner/goal_reaching_th_planner", goal_reaching_th_planner_, 0.5);
     ros::param::param<double>("~planner/goal_reaching_th_controller", goal_reaching_th_controller_, 0.1);
 
     ros::param::param<double>("~planner/human_filter_dist_th", human_filter_dist_th_, 1.0);
 
+    ros::param::param<int>("~planner/max_humans", max_humans_, 1);
+    ros::param::param<double>("~planner/crowd_dist_th", crowd_dist_th_, 3.0);
+    next_human_id_ = 1;
+
     ros::param::param<int >("~planner/human_tracking_lost_th", tracking_lost_th_, 2);
 
+    // the simulator steps as soon as it receives a plan, so only the final plans are published there
+    if (mode_ == "simulation")
+        flag_publish_intermediate_plan_ = false;
+
     int nXh, nUh, nXr, nUr;
     ros::param::param<int>("~dimension/nXh", nXh, 4);
     ros::param::param<int>("~dimension/nUh", nUh, 2);
@@ -53,6 +65,17 @@ PlannerNode::PlannerNode(ros::NodeHandle &nh, ros::NodeHandle &pnh): nh_(nh)
     xh_goal_.resize(goal_dim_);
     xh_init_.resize(goal_dim_);
 
+    // planning threads
+    flag_threads_running_ = false;
+    planning_epoch_ = 0;
+    flag_reset_interactive_ = false;
+    flag_reset_simple_ = false;
+    planner_running_ = nullptr;
+    epoch_running_ = 0;
+    flag_human_detected_running_ = false;
+    n_cycles_ = 0;
+    cycle_intermediate_ = 0;
+
     // create subscribers
     goal_sub_ = nh.subscribe<std_msgs::Float64MultiArray>("/planner/set_goal", 1,
                                                           &PlannerNode::goal_callback, this);
@@ -86,11 +109,17 @@ void PlannerNode::run()
     PlannerStates planner_state = Idle;
     reset_state_machine();
 
+    // start the planning and publishing threads
+    flag_threads_running_ = true;
+    planning_thread_ = std::thread(&PlannerNode::planning_loop, this);
+    publisher_thread_ = std::thread(&PlannerNode::publishing_loop, this);
+
     // two rates
     ros::Rate rate_fast(state_machine_rate_);
-    ros::Rate rate_slow(planning_rate_);
     ros::Rate rate_controller(controller_rate_);
 
+    ros::Time t_plan_next;
+
     while (!ros::isShuttingDown()) {
         switch (planner_state) {
             case Idle:
@@ -136,7 +165,8 @@ void PlannerNode::run()
             case Planning:
                 ROS_INFO("In state Planning");
 
-                rate_slow.reset();
+                flag_pause_requested_ = false;
+                t_plan_next = ros::Time::now();
                 while (!ros::isShuttingDown()) {
                     ros::spinOnce();
 
@@ -147,7 +177,7 @@ void PlannerNode::run()
                         if (flag_human_tracking_lost_) {
                             flag_human_tracking_lost_ = false;
                             human_tracking_lost_frames_ = 0;
-                            planner_interactive_->reset_planner();
+                            flag_reset_interactive_ = true;
                         }
 
                         flag_human_detected_ = false;
@@ -163,14 +193,15 @@ void PlannerNode::run()
                             ++human_tracking_lost_frames_;
                             if (human_tracking_lost_frames_ > tracking_lost_th_) {
                                 flag_human_tracking_lost_ = true;
-                                planner_simple_->reset_planner();
+                                flag_reset_simple_ = true;
                             }
                         }
 
                         // if tracking not lost, use a prediction
                         if (!flag_human_tracking_lost_) {
-                            dynamic_cast<hri_planner::Planner*>(planner_interactive_.get())->
-                                    get_human_pred(0, intent_, xh_meas_);
+                            std::lock_guard<std::mutex> lock(pred_mutex_);
+                            if (xh_pred_.size() > 0)
+                                xh_meas_ = xh_pred_;
 
                             ROS_INFO("Using interactive planner...");
                             plan(planner_interactive_);
@@ -182,14 +213,35 @@ void PlannerNode::run()
                         }
                     }
 
-                    rate_slow.sleep();
+                    // keep handling the callbacks until the next cycle, the plan is published by the other threads
+                    t_plan_next += ros::Duration(1.0 / planning_rate_);
+                    if (t_plan_next < ros::Time::now())
+                        t_plan_next = ros::Time::now();
+
+                    rate_fast.reset();
+                    while (ros::Time::now() < t_plan_next && !flag_stop_planning_ && !flag_pause_requested_ &&
+                            !ros::isShuttingDown()) {
+                        ros::spinOnce();
+
+                        if (flag_publish_intermediate_plan_)
+                            push_intermediate_plan();
+
+                        rate_fast.sleep();
+                    }
 
                     if (mode_ == "simulation") {
                         planner_state = Pausing;
                         break;
                     }
                     else {
-                        // check for stop flag and goal reached
+                        // check for stop and pause flags and goal reached
+                        if (flag_pause_requested_) {
+                            flag_pause_requested_ = false;
+                            planner_state = Pausing;
+
+                            break;
+                        }
+
                         if (flag_stop_planning_) {
                             flag_stop_planning_ = false;
                             planner_state = Idle;
@@ -208,6 +260,7 @@ void PlannerNode::run()
                             goal_reached_pub_.publish(goal_reach_data);
 
                             // planner back to idle
+                            cancel_planning();
                             planner_state = Idle;
                             reset_state_machine();
 
@@ -254,6 +307,12 @@ void PlannerNode::run()
                 break;
         }
     }
+
+    cancel_planning();
+
+    flag_threads_running_ = false;
+    planning_thread_.join();
+    publisher_thread_.join();
 }
 
 //----------------------------------------------------------------------------------
@@ -277,6 +336,11 @@ void PlannerNode::plan(const std::shared_ptr<hri_planner::PlannerBase> &planner)
     double cosy = 1.0 - 2.0 * (q.y() * q.y() + q.z() * q.z());
     xr_meas_(2) = std::atan2(siny, cosy);
 
+    PlanningRequest request;
+
+    std::vector<int> human_ids(1, 0);
+    human_ids.insert(human_ids.end(), ids_others_.begin(), ids_others_.end());
+
     // use simple prediction to take into account the planning time
     if (mode_ != "simulation") {
         Eigen::VectorXd xr_pred = xr_meas_;
@@ -295,45 +359,177 @@ void PlannerNode::plan(const std::shared_ptr<hri_planner::PlannerBase> &planner)
         dt_pred = 0.75 - 0.3 * v;
         planner->propagate_steer_acc(xh_meas_, xh_goal_, xh_pred, dt_pred);
 
+        // the goals of the other humans are unknown, so they are predicted with constant velocity
+        std::vector<Eigen::VectorXd> xh_preds(1, xh_pred);
+        for (auto& xh_other: xh_meas_others_) {
+            xh_preds.push_back(xh_other);
+            xh_preds.back().head(2) += xh_other.tail(2) * dt_pred;
+        }
+
         // set planning initial condition with the predicted states
-        planner->set_robot_state(xr_pred, ur_meas_);
-        planner->set_human_state(xh_pred);
-//        planner->set_robot_state(xr_meas_, ur_meas_);
-//        planner->set_human_state(xh_meas_);
+        request.xr = xr_pred;
+        request.ur = ur_meas_;
+        request.xh = xh_preds;
+        request.human_ids = human_ids;
     }
     else {
-        // update planner measurements
-        planner->set_robot_state(xr_meas_, ur_meas_);
-        planner->set_human_state(xh_meas_);
+        std::vector<Eigen::VectorXd> xh_meas_all(1, xh_meas_);
+        xh_meas_all.insert(xh_meas_all.end(), xh_meas_others_.begin(), xh_meas_others_.end());
+
+        request.xr = xr_meas_;
+        request.ur = ur_meas_;
+        request.xh = xh_meas_all;
+        request.human_ids = human_ids;
     }
 
-    // set the time limit for the optimizer to be 85% of the desired planner rate
-    double t_max_planning = 0.85 * (1.0 / planning_rate_);
+    request.epoch = planning_epoch_;
+    request.planner = planner;
+    request.flag_allow_comm = flag_allow_explicit_comm_ || flag_human_tracking_lost_;
+    request.flag_human_detected = flag_human_detected_frame_;
+    request.intent = intent_;
+
+    // the real measurement
+    utils::EigenToVector(xr_meas_, request.state_data.data);
+    request.state_data.data.insert(request.state_data.data.end(), xh_meas_.data(), xh_meas_.data() + xh_meas_.size());
+
+    // a request the planning thread hasn't picked up yet is replaced
+    requests_.push(request);
+}
 
-    // compute plan
-    using namespace std::chrono;
-    steady_clock::time_point t1 = steady_clock::now();
+//----------------------------------------------------------------------------------
+void PlannerNode::planning_loop()
+{
+    ros::WallRate rate(state_machine_rate_);
+    PlanningRequest request;
 
-    if (flag_allow_explicit_comm_ || flag_human_tracking_lost_) {
-        planner->compute_plan(t_max_planning);
+    while (flag_threads_running_) {
+        if (!requests_.pop(request)) {
+            rate.sleep();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(planner_mutex_);
+
+        // a cancel before the reset has bumped the epoch already, one after it stops the optimization
+        request.planner->reset_cancel();
+        if (request.epoch != planning_epoch_)
+            continue;
+
+        if (flag_reset_interactive_.exchange(false))
+            planner_interactive_->reset_planner();
+        if (flag_reset_simple_.exchange(false))
+            planner_simple_->reset_planner();
+
+        auto& planner = request.planner;
+        planner->set_robot_state(request.xr, request.ur);
+        planner->set_human_states(request.xh, request.human_ids);
+
+        // set the time limit for the optimizer to be 85% of the desired planner rate
+        double t_max_planning = 0.85 * (1.0 / planning_rate_);
+
+        // the cycle count first, so that the running planner is never seen with the count of the last cycle
+        flag_human_detected_running_ = request.flag_human_detected;
+        epoch_running_ = request.epoch;
+        ++n_cycles_;
+        planner_running_ = planner.get();
+
+        using namespace std::chrono;
+        steady_clock::time_point t1 = steady_clock::now();
+
+        if (request.flag_allow_comm) {
+            planner->compute_plan(t_max_planning);
+        }
+        else {
+            dynamic_cast<hri_planner::Planner*>(planner.get())->compute_plan_no_comm(t_max_planning);
+        }
+
+        planner_running_ = nullptr;
+
+        steady_clock::time_point t2 = steady_clock::now();
+        duration<double> time_span = duration_cast<duration<double>>(t2 - t1);
+        std::cout << "time spent for planning is: " << time_span.count() << "s" << std::endl;
+
+        // the plan of a cancelled cycle is dropped
+        if (request.epoch != planning_epoch_)
+            continue;
+
+        if (planner == planner_interactive_) {
+            Eigen::VectorXd xh_pred;
+            dynamic_cast<hri_planner::Planner*>(planner.get())->get_human_pred(0, request.intent, xh_pred);
+
+            std::lock_guard<std::mutex> lock_pred(pred_mutex_);
+            xh_pred_ = xh_pred;
+        }
+
+        PlanningResult result;
+        result.epoch = request.epoch;
+        result.cycle = n_cycles_;
+        planner->get_plan_messages(request.flag_human_detected, result.msgs);
+        result.state_data = request.state_data;
+
+        results_.push(result);
     }
-    else {
-        dynamic_cast<hri_planner::Planner*>(planner.get())->compute_plan_no_comm(t_max_planning);
+}
+
+//----------------------------------------------------------------------------------
+void PlannerNode::publishing_loop()
+{
+    ros::WallRate rate(state_machine_rate_);
+    PlanningResult result;
+    int cycle_final = 0;
+
+    while (flag_threads_running_) {
+        if (results_.pop(result)) {
+            // a plan cancelled after it was computed is dropped as well
+            if (result.epoch == planning_epoch_) {
+                for (auto& msg: result.msgs)
+                    msg();
+
+                robot_human_state_pub_.publish(result.state_data);
+            }
+
+            cycle_final = result.cycle;
+        }
+
+        // the best plan so far is replaced by the final plan, nothing of a cancelled cycle goes out
+        if (intermediate_results_.pop(result) && result.epoch == planning_epoch_ && result.cycle > cycle_final) {
+            for (auto& msg: result.msgs)
+                msg();
+        }
+
+        rate.sleep();
     }
+}
+
+//----------------------------------------------------------------------------------
+void PlannerNode::push_intermediate_plan()
+{
+    // the optimizers may still be winding down after a cancel, so nothing of a cancelled cycle is taken
+    hri_planner::PlannerBase* planner = planner_running_;
+    int cycle = n_cycles_;
+    int epoch = epoch_running_;
 
-    steady_clock::time_point t2 = steady_clock::now();
-    duration<double> time_span = duration_cast<duration<double>>(t2 - t1);
-    std::cout << "time spent for planning is: " << time_span.count() << "s" << std::endl;
+    if (planner == nullptr || cycle == cycle_intermediate_ || epoch != planning_epoch_)
+        return;
 
-    // publish plan
-    planner->publish_plan(flag_human_detected_frame_);
+    PlanningResult result;
+    if (!planner->get_intermediate_plan_messages(flag_human_detected_running_, result.msgs))
+        return;
 
-    // publish the real measurement
-    std_msgs::Float64MultiArray state_data;
-    utils::EigenToVector(xr_meas_, state_data.data);
-    state_data.data.insert(state_data.data.end(), xh_meas_.data(), xh_meas_.data() + xh_meas_.size());
+    result.epoch = epoch;
+    result.cycle = cycle;
+    intermediate_results_.push(result);
 
-    robot_human_state_pub_.publish(state_data);
+    cycle_intermediate_ = cycle;
+}
+
+//----------------------------------------------------------------------------------
+void PlannerNode::cancel_planning()
+{
+    ++planning_epoch_;
+
+    planner_interactive_->cancel_plan();
+    planner_simple_->cancel_plan();
 }
 
 //----------------------------------------------------------------------------------
@@ -356,6 +552,7 @@ void PlannerNode::reset_state_machine()
     flag_start_planning_ = false;
     flag_pause_planning_ = true;
     flag_stop_planning_ = false;
+    flag_pause_requested_ = false;
     flag_human_detected_ = false;
 
     flag_human_tracking_lost_ = true;
@@ -380,6 +577,15 @@ void PlannerNode::goal_callback(const std_msgs::Float64MultiArrayConstPtr& goal_
 
     ROS_INFO("Received new goal, reset planner...");
 
+    // wait for the planning thread to let go of the planners
+    cancel_planning();
+    std::lock_guard<std::mutex> lock(planner_mutex_);
+
+    {
+        std::lock_guard<std::mutex> lock_pred(pred_mutex_);
+        xh_pred_.resize(0);
+    }
+
     // reset the planners
     std::string ns;
     if (intent_ == hri_planner::HumanPriority)
@@ -398,12 +604,15 @@ void PlannerNode::planner_ctrl_callback(const std_msgs::StringConstPtr& msg)
 
     if (ctrl == "pause") {
         flag_pause_planning_ = true;
+        flag_pause_requested_ = true;
+        cancel_planning();
     }
     else if (ctrl == "resume") {
         flag_pause_planning_ = false;
     }
     else if (ctrl == "stop") {
         flag_stop_planning_ = true;
+        cancel_planning();
     }
     else if (ctrl == "start") {
         flag_start_planning_ = true;
@@ -461,6 +670,20 @@ void PlannerNode::human_tracking_callback(const people_msgs::PeopleConstPtr &peo
         xh_meas_(2) = people_msg->people[person_id].velocity.x;
         xh_meas_(3) = people_msg->people[person_id].velocity.y;
     }
+
+    // everyone else is a candidate for the other humans
+    std::vector<Eigen::VectorXd> xh_candidates;
+    for (int i = 0; i < people_msg->people.size(); ++i) {
+        if (i == person_id)
+            continue;
+
+        Eigen::VectorXd xh(xh_meas_.size());
+        xh << people_msg->people[i].position.x, people_msg->people[i].position.y,
+                people_msg->people[i].velocity.x, people_msg->people[i].velocity.y;
+        xh_candidates.push_back(xh);
+    }
+
+    select_other_humans(xh_candidates);
 }
 
 //----------------------------------------------------------------------------------
@@ -481,6 +704,33 @@ void PlannerNode::human_detection_callback(const people_msgs::PositionMeasuremen
         }
     }
 
+    // everyone else is a candidate for the other humans
+    // the velocities are from the closest of the previous other humans, if there is one close enough
+    std::vector<Eigen::VectorXd> xh_candidates;
+    double dt_meas = t_meas_last_ < 0 ? -1.0 : pos_arr_msg->header.stamp.toSec() - t_meas_last_;
+
+    for (int i = 0; i < pos_arr_msg->people.size(); ++i) {
+        if (i == person_id)
+            continue;
+
+        Eigen::VectorXd xh = Eigen::VectorXd::Zero(xh_meas_.size());
+        xh(0) = pos_arr_msg->people[i].pos.x;
+        xh(1) = pos_arr_msg->people[i].pos.y;
+
+        double min_dist_prev = human_filter_dist_th_;
+        for (auto& xh_prev: xh_meas_others_) {
+            double dist = (xh.head(2) - xh_prev.head(2)).norm();
+            if (dt_meas > 0 && dist < min_dist_prev) {
+                min_dist_prev = dist;
+                xh.tail(2) = (xh.head(2) - xh_prev.head(2)) / dt_meas;
+            }
+        }
+
+        xh_candidates.push_back(xh);
+    }
+
+    select_other_humans(xh_candidates);
+
     if (person_id == -1) {
         flag_human_detected_ = false;
     }
@@ -523,6 +773,54 @@ double PlannerNode::point_line_dist(const Eigen::VectorXd &p, const Eigen::Vecto
     }
 }
 
+//----------------------------------------------------------------------------------
+void PlannerNode::select_other_humans(std::vector<Eigen::VectorXd> &xh_candidates)
+{
+    std::vector<Eigen::VectorXd> xh_prev;
+    std::vector<int> ids_prev;
+    xh_prev.swap(xh_meas_others_);
+    ids_prev.swap(ids_others_);
+
+    // sort by the distance to the robot and keep the ones close enough
+    std::vector<std::pair<double, int> > dists;
+    for (int i = 0; i < xh_candidates.size(); ++i) {
+        double dist = (xh_candidates[i].head(2) - xr_meas_.head(2)).norm();
+        if (dist < crowd_dist_th_)
+            dists.push_back({dist, i});
+    }
+
+    std::sort(dists.begin(), dists.end());
+
+    // each human keeps the id of the closest unmatched human of the last callback within the filter distance,
+    // the planner uses the ids to keep the belief of each person with them
+    std::vector<bool> matched(xh_prev.size(), false);
+
+    int n_others = std::min(static_cast<int>(dists.size()), max_humans_ - 1);
+    for (int i = 0; i < n_others; ++i) {
+        const Eigen::VectorXd& xh = xh_candidates[dists[i].second];
+
+        int j_match = -1;
+        double min_dist = human_filter_dist_th_;
+        for (int j = 0; j < xh_prev.size(); ++j) {
+            double dist = (xh.head(2) - xh_prev[j].head(2)).norm();
+            if (!matched[j] && dist < min_dist) {
+                min_dist = dist;
+                j_match = j;
+            }
+        }
+
+        if (j_match >= 0) {
+            matched[j_match] = true;
+            ids_others_.push_back(ids_prev[j_match]);
+        }
+        else {
+            ids_others_.push_back(next_human_id_++);
+        }
+
+        xh_meas_others_.push_back(xh);
+    }
+}
+
 int main(int argc, char** argv)
 {
     ros::init(argc, argv, "hri_planner");
@@ -534,4 +832,4 @@ int main(int argc, char** argv)
     planner_node.run();
 
     return 0;
-}
\ No newline at end of file
+}
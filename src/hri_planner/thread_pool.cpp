@@ -0,0 +1,161 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "hri_planner/thread_pool.h"
+
+namespace hri_planner {
+
+//----------------------------------------------------------------------------------
+ThreadPool::ThreadPool(int n_workers, int queue_capacity, bool pin_workers): head_(0), size_(0), stop_(false)
+{
+    if (queue_capacity < 1)
+        throw "Thread pool queue capacity must be positive!";
+
+    queue_.resize(static_cast<std::size_t>(queue_capacity));
+
+    for (int i = 0; i < n_workers; ++i)
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i, pin_workers);
+}
+
+//----------------------------------------------------------------------------------
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+
+    for (auto& worker: workers_)
+        worker.join();
+}
+
+//----------------------------------------------------------------------------------
+void ThreadPool::run_parallel(const std::vector<Task>& tasks)
+{
+    if (tasks.empty())
+        return;
+
+    TaskGroup group;
+    group.n_pending = 0;
+
+    // queue everything but the first task, the rest run here if the queue is full
+    std::size_t n_queued = 1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (; n_queued < tasks.size() && size_ < queue_.size(); ++n_queued) {
+            queue_[(head_ + size_) % queue_.size()] = {&tasks[n_queued], &group};
+            ++size_;
+            ++group.n_pending;
+        }
+    }
+    if (n_queued > 1)
+        cond_.notify_all();
+
+    std::exception_ptr error;
+    execute({&tasks[0], &group}, error);
+    for (std::size_t i = n_queued; i < tasks.size(); ++i)
+        execute({&tasks[i], &group}, error);
+
+    // help with the queued tasks of this call instead of blocking, so nested calls can't deadlock
+    // other tasks are left to the workers, they may be whole optimizations that would hold this call up
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (group.n_pending > 0) {
+        if (!run_one(lock, &group))
+            cond_.wait(lock);
+    }
+
+    if (!error)
+        error = group.error;
+    lock.unlock();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+//----------------------------------------------------------------------------------
+void ThreadPool::worker_loop(int id, bool pin)
+{
+#ifdef __linux__
+    int n_cpus = static_cast<int>(std::thread::hardware_concurrency());
+    if (pin && n_cpus > 1) {
+        // leave the first core to the thread that owns the pool
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET((id + 1) % n_cpus, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cond_.wait(lock, [this] { return stop_ || size_ > 0; });
+
+        if (size_ == 0)
+            return;
+
+        run_one(lock);
+    }
+}
+
+//----------------------------------------------------------------------------------
+bool ThreadPool::run_one(std::unique_lock<std::mutex>& lock, const TaskGroup* group)
+{
+    // position of the first task of the group in the queue
+    std::size_t pos = 0;
+    if (group != nullptr) {
+        while (pos < size_ && queue_[(head_ + pos) % queue_.size()].group != group)
+            ++pos;
+    }
+
+    if (pos == size_)
+        return false;
+
+    // close the gap by moving the tasks before it back
+    QueuedTask queued = queue_[(head_ + pos) % queue_.size()];
+    for (; pos > 0; --pos)
+        queue_[(head_ + pos) % queue_.size()] = queue_[(head_ + pos - 1) % queue_.size()];
+
+    head_ = (head_ + 1) % queue_.size();
+    --size_;
+
+    lock.unlock();
+    std::exception_ptr error;
+    execute(queued, error);
+    lock.lock();
+
+    if (error && !queued.group->error)
+        queued.group->error = error;
+
+    if (--queued.group->n_pending == 0)
+        cond_.notify_all();
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------
+void ThreadPool::execute(const QueuedTask& queued, std::exception_ptr& error)
+{
+    try {
+        (*queued.task)();
+    }
+    catch (...) {
+        if (!error)
+            error = std::current_exception();
+    }
+}
+
+} // namespace
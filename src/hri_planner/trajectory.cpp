@@ -3,7 +3,7 @@
 // Human Robot Interaction Planning Framework
 //
 // Created on   : 3/7/2018
-// Last revision: 3/8/2018
+// Last revision: 10/16/2026
 // Author       : Che, Yuhang <yuhangc@stanford.edu>
 // Contact      : Che, Yuhang <yuhangc@stanford.edu>
 //
@@ -13,6 +13,151 @@
 
 namespace hri_planner {
 
+//----------------------------------------------------------------------------------
+StructuredJacobian::StructuredJacobian(int nX, int nU, int T)
+{
+    resize(nX, nU, T);
+}
+
+//----------------------------------------------------------------------------------
+void StructuredJacobian::resize(int nX, int nU, int T)
+{
+    nX_ = nX;
+    nU_ = nU;
+    T_ = T;
+
+    A_.setZero(nX_, T_ * nX_);
+    B_.setZero(nX_, T_ * nU_);
+}
+
+//----------------------------------------------------------------------------------
+void StructuredJacobian::mult(ConstVecRef v, VecRef out) const
+{
+    // dx_t = A_t * dx_{t-1} + B_t * v_t
+    StateBuffer dx(nX_);
+    dx.setZero();
+
+    for (int t = 0; t < T_; ++t) {
+        out.segment(t*nX_, nX_).noalias() = A(t).lazyProduct(dx);
+        out.segment(t*nX_, nX_).noalias() += B(t).lazyProduct(v.segment(t*nU_, nU_));
+        dx = out.segment(t*nX_, nX_);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void StructuredJacobian::transpose_mult(ConstVecRef w, VecRef out) const
+{
+    // lambda_t = w_t + A_{t+1}^T * lambda_{t+1}, out_t = B_t^T * lambda_t
+    StateBuffer lambda(nX_);
+    StateBuffer lambda_next(nX_);
+    lambda_next.setZero();
+
+    for (int t = T_-1; t >= 0; --t) {
+        lambda = w.segment(t*nX_, nX_) + lambda_next;
+        out.segment(t*nU_, nU_).noalias() = B(t).transpose().lazyProduct(lambda);
+        lambda_next.noalias() = A(t).transpose().lazyProduct(lambda);
+    }
+}
+
+//----------------------------------------------------------------------------------
+void StructuredJacobian::transpose_mult_step(int t, ConstVecRef w_t, StridedVecRef out) const
+{
+    StateBuffer lambda(nX_);
+    StateBuffer lambda_next(nX_);
+    lambda.setZero();
+    lambda.head(w_t.size()) = w_t;
+
+    // controls after step t have no effect on x_t
+    out.tail((T_-t-1) * nU_).setZero();
+
+    for (int s = t; s >= 0; --s) {
+        out.segment(s*nU_, nU_).noalias() = B(s).transpose().lazyProduct(lambda);
+        lambda_next.noalias() = A(s).transpose().lazyProduct(lambda);
+        lambda = lambda_next;
+    }
+}
+
+//----------------------------------------------------------------------------------
+void StructuredJacobian::transpose_mult_step_add(int t, ConstVecRef w_t, StridedVecRef out) const
+{
+    StateBuffer lambda(nX_);
+    StateBuffer lambda_next(nX_);
+    lambda.setZero();
+    lambda.head(w_t.size()) = w_t;
+
+    for (int s = t; s >= 0; --s) {
+        out.segment(s*nU_, nU_).noalias() += B(s).transpose().lazyProduct(lambda);
+        lambda_next.noalias() = A(s).transpose().lazyProduct(lambda);
+        lambda = lambda_next;
+    }
+}
+
+//----------------------------------------------------------------------------------
+void StructuredJacobian::to_dense(MatRef Ju) const
+{
+    Ju.setZero();
+
+    for (int t2 = 0; t2 < T_; ++t2) {
+        Ju.block(t2*nX_, t2*nU_, nX_, nU_) = B(t2);
+        for (int t1 = t2+1; t1 < T_; ++t1) {
+            Ju.block(t1*nX_, t2*nU_, nX_, nU_).noalias() =
+                    A(t1).lazyProduct(Ju.block((t1-1)*nX_, t2*nU_, nX_, nU_));
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------
+std::mutex LinearJacobianCache::mutex_;
+std::map<LinearJacobianCache::Key, std::shared_ptr<const LinearJacobianCache::Entry> > LinearJacobianCache::cache_;
+
+//----------------------------------------------------------------------------------
+std::shared_ptr<const LinearJacobianCache::Entry> LinearJacobianCache::get(DynamicsModel dyn_type, int T, double dt)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Key key(dyn_type, T, dt);
+    auto it = cache_.find(key);
+    if (it != cache_.end())
+        return it->second;
+
+    std::shared_ptr<const Entry> entry = create(dyn_type, T, dt);
+    cache_[key] = entry;
+
+    return entry;
+}
+
+//----------------------------------------------------------------------------------
+std::shared_ptr<LinearJacobianCache::Entry> LinearJacobianCache::create(DynamicsModel dyn_type, int T, double dt)
+{
+    if (dyn_type != CONST_ACC_MODEL)
+        throw "Jacobian is only constant for linear dynamics!";
+
+    typedef DynamicsTraits<CONST_ACC_MODEL> Dyn;
+    const int nX = Dyn::nX;
+    const int nU = Dyn::nU;
+
+    auto entry = std::make_shared<Entry>();
+
+    // dx_t/du_s only depends on t - s
+    entry->Ju.setZero(T * nX, T * nU);
+    for (int t = 0; t < T; ++t) {
+        for (int s = 0; s <= t; ++s)
+            Dyn::trajectory_jacobian_block(t - s, dt, entry->Ju.block<nX, nU>(t*nX, s*nU));
+    }
+
+    // the per-step blocks are the same for all steps
+    Eigen::Matrix<double, nX, 1> x = Eigen::Matrix<double, nX, 1>::Zero();
+    Eigen::Matrix<double, nU, 1> u = Eigen::Matrix<double, nU, 1>::Zero();
+
+    entry->Ju_blocks.resize(nX, nU, T);
+    for (int t = 0; t < T; ++t) {
+        Dyn::grad_x(x, u, dt, entry->Ju_blocks.A(t));
+        Dyn::grad_u(x, u, dt, entry->Ju_blocks.B(t));
+    }
+
+    return entry;
+}
+
 //----------------------------------------------------------------------------------
 Trajectory::Trajectory(DynamicsModel dyn_type, int T, double dt): T_(T), dt_(dt), dyn_type(dyn_type)
 {
@@ -39,10 +184,15 @@ Trajectory::Trajectory(DynamicsModel dyn_type, int T, double dt): T_(T), dt_(dt)
     x.setZero(nXt_);
     u.setZero(nUt_);
     Ju.setZero(nXt_, nUt_);
+    Ju_blocks.resize(nX_, nU_, T_);
+
+    jacobian_const_ = dyn_->is_linear();
+    jacobian_loaded_ = false;
 }
 
 //----------------------------------------------------------------------------------
-void Trajectory::update(const Eigen::VectorXd& x0_new, const Eigen::VectorXd& u_new)
+void Trajectory::update(const Eigen::Ref<const Eigen::VectorXd>& x0_new,
+                        const Eigen::Ref<const Eigen::VectorXd>& u_new)
 {
     // update x0 and u
     x0 = x0_new;
@@ -52,7 +202,7 @@ void Trajectory::update(const Eigen::VectorXd& x0_new, const Eigen::VectorXd& u_
 }
 
 //----------------------------------------------------------------------------------
-void Trajectory::update(const Eigen::VectorXd &u_new)
+void Trajectory::update(const Eigen::Ref<const Eigen::VectorXd>& u_new)
 {
     // update u
     u = u_new;
@@ -63,38 +213,138 @@ void Trajectory::update(const Eigen::VectorXd &u_new)
 //----------------------------------------------------------------------------------
 void Trajectory::compute()
 {
-    // compute the new trajectory
-    Eigen::VectorXd x_last = x0;
-    for (int t = 0; t < T_; ++t) {
-        dyn_->forward_dyn(x_last, u.segment(t*nU_, nU_), x.segment(t*nX_, nX_));
-        x_last = x.segment(t*nX_, nX_);
+    // compute the new trajectory with the inlined kernels of the dynamics model
+    switch (dyn_type) {
+        case CONST_ACC_MODEL:
+            compute_model<CONST_ACC_MODEL>();
+            break;
+        case DIFFERENTIAL_MODEL:
+            compute_model<DIFFERENTIAL_MODEL>();
+            break;
+        default:
+            break;
     }
 }
 
 //----------------------------------------------------------------------------------
 void Trajectory::compute_jacobian()
 {
-    for (int t2 = 0; t2 < T_; ++t2) {
-        for (int t1 = t2; t1 < T_; ++t1) {
-            int xs = (t1-1) * nX_;
-            int ys = t2 * nU_;
-
-            if (t1 == t2) {
-                if (t1 == 0)
-                    dyn_->grad_u(x0, u.segment(ys, nU_), Ju.block(xs+nX_, ys, nX_, nU_));
-                else
-                    dyn_->grad_u(x.segment(xs, nX_), u.segment(ys, nU_), Ju.block(xs+nX_, ys, nX_, nU_));
-            }
-            else {
-                Eigen::MatrixXd A(nX_, nX_);
-                dyn_->grad_x(x.segment(xs, nX_), u.segment(ys, nU_), A);
-
-                Ju.block(xs+nX_, ys, nX_, nU_) = A * Ju.block(xs, ys, nX_, nU_);
-            }
-        }
+    if (jacobian_const_) {
+        load_const_jacobian();
+        return;
+    }
+
+    compute_jacobian_blocks();
+    Ju_blocks.to_dense(Ju);
+}
+
+//----------------------------------------------------------------------------------
+void Trajectory::compute_jacobian_blocks()
+{
+    if (jacobian_const_) {
+        load_const_jacobian();
+        return;
+    }
+
+    switch (dyn_type) {
+        case CONST_ACC_MODEL:
+            compute_jacobian_blocks_model<CONST_ACC_MODEL>();
+            break;
+        case DIFFERENTIAL_MODEL:
+            compute_jacobian_blocks_model<DIFFERENTIAL_MODEL>();
+            break;
+        default:
+            break;
+    }
+}
+
+//----------------------------------------------------------------------------------
+void Trajectory::backprop(const Eigen::Ref<const Eigen::VectorXd>& grad_x, Eigen::Ref<Eigen::VectorXd> grad_u) const
+{
+    switch (dyn_type) {
+        case CONST_ACC_MODEL:
+            backprop_model<CONST_ACC_MODEL>(grad_x, grad_u);
+            break;
+        case DIFFERENTIAL_MODEL:
+            backprop_model<DIFFERENTIAL_MODEL>(grad_x, grad_u);
+            break;
+        default:
+            break;
+    }
+}
+
+//----------------------------------------------------------------------------------
+template<DynamicsModel M>
+void Trajectory::compute_model()
+{
+    switch (T_) {
+        case HORIZON_SHORT:
+            FixedHorizonRollout<M, HORIZON_SHORT>::compute(x0.data(), u.data(), dt_, x.data());
+            break;
+        case HORIZON_LONG:
+            FixedHorizonRollout<M, HORIZON_LONG>::compute(x0.data(), u.data(), dt_, x.data());
+            break;
+        default:
+            rollout_dynamics<M>(x0, u, T_, dt_, x);
+            break;
+    }
+}
+
+//----------------------------------------------------------------------------------
+template<DynamicsModel M>
+void Trajectory::compute_jacobian_blocks_model()
+{
+    Eigen::MatrixXd& A = Ju_blocks.A_blocks();
+    Eigen::MatrixXd& B = Ju_blocks.B_blocks();
+
+    switch (T_) {
+        case HORIZON_SHORT:
+            FixedHorizonRollout<M, HORIZON_SHORT>::jacobian_blocks(x0.data(), x.data(), u.data(), dt_,
+                                                                   A.data(), B.data());
+            break;
+        case HORIZON_LONG:
+            FixedHorizonRollout<M, HORIZON_LONG>::jacobian_blocks(x0.data(), x.data(), u.data(), dt_,
+                                                                  A.data(), B.data());
+            break;
+        default:
+            rollout_jacobian_blocks<M>(x0, x, u, T_, dt_, A, B);
+            break;
     }
 }
 
+//----------------------------------------------------------------------------------
+template<DynamicsModel M>
+void Trajectory::backprop_model(const Eigen::Ref<const Eigen::VectorXd>& grad_x,
+                                Eigen::Ref<Eigen::VectorXd> grad_u) const
+{
+    switch (T_) {
+        case HORIZON_SHORT:
+            FixedHorizonRollout<M, HORIZON_SHORT>::backprop(x0.data(), x.data(), u.data(), dt_,
+                                                            grad_x.data(), grad_u.data());
+            break;
+        case HORIZON_LONG:
+            FixedHorizonRollout<M, HORIZON_LONG>::backprop(x0.data(), x.data(), u.data(), dt_,
+                                                           grad_x.data(), grad_u.data());
+            break;
+        default:
+            rollout_backprop<M>(x0, x, u, T_, dt_, grad_x, grad_u);
+            break;
+    }
+}
+
+//----------------------------------------------------------------------------------
+void Trajectory::load_const_jacobian()
+{
+    if (jacobian_loaded_)
+        return;
+
+    std::shared_ptr<const LinearJacobianCache::Entry> entry = LinearJacobianCache::get(dyn_type, T_, dt_);
+    Ju = entry->Ju;
+    Ju_blocks = entry->Ju_blocks;
+
+    jacobian_loaded_ = true;
+}
+
 //----------------------------------------------------------------------------------
 Trajectory& Trajectory::operator=(const Trajectory &traj)
 {
@@ -103,6 +353,7 @@ Trajectory& Trajectory::operator=(const Trajectory &traj)
     x = traj.x;
     u = traj.u;
     Ju = traj.Ju;
+    Ju_blocks = traj.Ju_blocks;
 
     T_ = traj.T_;
     nX_ = traj.nX_;
@@ -114,6 +365,9 @@ Trajectory& Trajectory::operator=(const Trajectory &traj)
     dyn_ = traj.dyn_;
     dyn_type = traj.dyn_type;
 
+    jacobian_const_ = traj.jacobian_const_;
+    jacobian_loaded_ = traj.jacobian_loaded_;
+
     return (*this);
 }
 
@@ -0,0 +1,111 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#include <algorithm>
+
+#include "hri_planner/warm_start.h"
+
+namespace hri_planner {
+
+//----------------------------------------------------------------------------------
+WarmStartCache::WarmStartCache(int capacity): capacity_(capacity)
+{
+    if (capacity < 1)
+        throw "Warm start cache needs room for at least one plan!";
+}
+
+//----------------------------------------------------------------------------------
+void WarmStartCache::push(const Trajectory &robot_traj, const std::vector<Trajectory> &human_trajs_hp,
+                          const std::vector<Trajectory> &human_trajs_rp, const std::vector<int> &human_ids)
+{
+    if (human_ids.size() != human_trajs_hp.size() || human_ids.size() != human_trajs_rp.size())
+        throw "Each human response needs an id!";
+
+    Entry entry;
+    entry.ur = robot_traj.u;
+    for (auto& traj: human_trajs_hp)
+        entry.uh_hp.push_back(traj.u);
+    for (auto& traj: human_trajs_rp)
+        entry.uh_rp.push_back(traj.u);
+    entry.human_ids = human_ids;
+    entry.horizon = robot_traj.horizon();
+    entry.age = 0;
+
+    entries_.push_front(entry);
+    if (size() > capacity_)
+        entries_.pop_back();
+}
+
+//----------------------------------------------------------------------------------
+void WarmStartCache::advance()
+{
+    for (auto& entry: entries_)
+        ++entry.age;
+
+    // nothing is left of a plan once it is shifted by the whole horizon
+    while (!entries_.empty() && entries_.back().age >= entries_.back().horizon)
+        entries_.pop_back();
+}
+
+//----------------------------------------------------------------------------------
+bool WarmStartCache::get_candidate(int i, const Eigen::VectorXd &xr, const std::vector<Eigen::VectorXd> &xh,
+                                   const std::vector<int> &human_ids, Trajectory &robot_traj,
+                                   std::vector<Trajectory> &human_trajs_hp,
+                                   std::vector<Trajectory> &human_trajs_rp) const
+{
+    const Entry& entry = entries_[i];
+
+    int n_humans = static_cast<int>(xh.size());
+    if ((int) human_ids.size() != n_humans || (int) human_trajs_hp.size() != n_humans ||
+            (int) human_trajs_rp.size() != n_humans)
+        return false;
+
+    // the humans may be in another order than when the plan was stored
+    std::vector<int> k_entry(n_humans);
+    for (int k = 0; k < n_humans; ++k) {
+        auto it = std::find(entry.human_ids.begin(), entry.human_ids.end(), human_ids[k]);
+        if (it == entry.human_ids.end())
+            return false;
+        k_entry[k] = static_cast<int>(it - entry.human_ids.begin());
+    }
+
+    rollout(xr, entry.ur, entry.age, false, robot_traj);
+
+    for (int k = 0; k < n_humans; ++k) {
+        rollout(xh[k], entry.uh_hp[k_entry[k]], entry.age, true, human_trajs_hp[k]);
+        rollout(xh[k], entry.uh_rp[k_entry[k]], entry.age, true, human_trajs_rp[k]);
+    }
+
+    return true;
+}
+
+//----------------------------------------------------------------------------------
+void WarmStartCache::rollout(const Eigen::VectorXd &x0, const Eigen::VectorXd &u, int n, bool pad_zero,
+                             Trajectory &traj)
+{
+    int dim = traj.control_size();
+    int len = static_cast<int>(u.size());
+    int len_shift = n * dim;
+
+    traj.u.head(len - len_shift) = u.tail(len - len_shift);
+    for (int st = len - len_shift; st < len; st += dim) {
+        if (pad_zero)
+            traj.u.segment(st, dim).setZero();
+        else
+            traj.u.segment(st, dim) = u.tail(dim);
+    }
+
+    traj.x0 = x0;
+    traj.compute();
+    traj.compute_jacobian();
+}
+
+}
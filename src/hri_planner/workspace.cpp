@@ -0,0 +1,97 @@
+//----------------------------------------------------------------------------------
+//
+// Human Robot Interaction Planning Framework
+//
+// Created on   : 10/16/2026
+// Last revision: 10/16/2026
+// Author       : Che, Yuhang <yuhangc@stanford.edu>
+// Contact      : Che, Yuhang <yuhangc@stanford.edu>
+//
+//----------------------------------------------------------------------------------
+
+#include <algorithm>
+
+#include "hri_planner/workspace.h"
+
+namespace hri_planner {
+
+thread_local Workspace* Workspace::current_ = nullptr;
+
+//----------------------------------------------------------------------------------
+Workspace::Workspace(std::size_t capacity): top_(0), peak_(0), overflow_count_(0)
+{
+    reserve(capacity);
+}
+
+//----------------------------------------------------------------------------------
+void Workspace::reserve(std::size_t capacity)
+{
+    if (capacity <= buffer_.size())
+        return;
+
+    if (top_ > 0)
+        throw "Cannot grow the workspace while it is in use!";
+
+    buffer_.resize(capacity);
+}
+
+//----------------------------------------------------------------------------------
+double* Workspace::allocate(std::size_t size)
+{
+    // keep every buffer 16-byte aligned
+    std::size_t size_aligned = (size + 1) & ~std::size_t(1);
+
+    if (top_ + size_aligned > buffer_.size()) {
+        ++overflow_count_;
+        return nullptr;
+    }
+
+    double* data = buffer_.data() + top_;
+    top_ += size_aligned;
+    peak_ = std::max(peak_, top_);
+
+    return data;
+}
+
+//----------------------------------------------------------------------------------
+void Workspace::release(double* data)
+{
+    // scratch objects are scoped, so this is always the last buffer taken
+    top_ = data - buffer_.data();
+}
+
+//----------------------------------------------------------------------------------
+std::size_t Workspace::default_capacity(int T)
+{
+    // the largest temporaries are the state hessians and the interactive jacobians
+    std::size_t n = 4 * (std::size_t) T;
+    return 4 * n * n + 32 * n;
+}
+
+namespace internal {
+
+//----------------------------------------------------------------------------------
+ScratchStorage::ScratchStorage(std::size_t size): data_(nullptr), size_(size)
+{
+    workspace_ = Workspace::current();
+    if (workspace_ != nullptr)
+        data_ = workspace_->allocate(size_);
+
+    if (data_ == nullptr) {
+        workspace_ = nullptr;
+        data_ = new double[size_];
+    }
+}
+
+//----------------------------------------------------------------------------------
+ScratchStorage::~ScratchStorage()
+{
+    if (workspace_ != nullptr)
+        workspace_->release(data_);
+    else
+        delete[] data_;
+}
+
+} // namespace internal
+
+} // namespace